@@ -14,36 +14,51 @@ LOCAL_SRC_FILES = \
 			cmdline.c \
 		  	lispd_afi.c \
 			lispd_config.c \
+			lispd_data_plane.c \
+			lispd_epoch.c \
 			lispd_external.c \
+			lispd_flow_cache.c \
+			lispd_hash.c \
 			lispd_iface_list.c \
 			lispd_iface_mgmt.c \
 			lispd_info_nat.c \
 			lispd_info_reply.c \
 			lispd_info_request.c \
 			lispd_input.c \
+			lispd_instance.c \
 			lispd_lib.c \
 			lispd_local_db.c \
 			lispd_locator.c	\
 			lispd_log.c	\
+			lispd_lpm.c \
+			lispd_maglev.c \
 			lispd_map_cache_db.c \
+			lispd_map_cache_snapshot.c \
 			lispd_map_cache.c \
 			lispd_map_notify.c \
 			lispd_map_referral.c \
 		  	lispd_map_register.c \
 		  	lispd_map_reply.c \
 		  	lispd_map_request.c	\
+		  	lispd_map_request_scheduler.c \
 		  	lispd_mapping.c \
+		  	lispd_miss_queue.c \
 		  	lispd_nonce.c \
 		  	lispd_output.c \
 		  	lispd_pkt_lib.c \
+		  	lispd_reactor.c \
 		  	lispd_referral_cache.c \
 		  	lispd_referral_cache_db.c \
+		  	lispd_rloc_index.c \
 		  	lispd_rloc_probing.c \
+		  	lispd_rx_ring.c \
 		  	lispd_routing_tables_lib.c \
 		  	lispd_smr.c \
 		  	lispd_sockets.c \
 		  	lispd_timers.c \
 		  	lispd_tun.c \
+		  	lispd_uring.c \
+		  	lispd_xdp.c \
 		  	lispd.c \
 		  	api/ipc.c \
 		  	hmac/hmac.c \
@@ -43,15 +43,16 @@
 #include <sys/ioctl.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
-#ifdef ANDROID
- #include <fcntl.h>
-#endif
+#include <fcntl.h>
 #include <linux/capability.h>
 #include <sys/prctl.h>
 #include <netinet/in.h>
 #include <net/if.h>
 #include "lispd.h"
 #include "lispd_config.h"
+#include "lispd_data_plane.h"
+#include "lispd_epoch.h"
+#include "lispd_hash.h"
 #include "lispd_iface_list.h"
 #include "lispd_iface_mgmt.h"
 #include "lispd_info_request.h"
@@ -63,29 +64,43 @@
 #include "lispd_local_db.h"
 #include "lispd_log.h"
 #include "lispd_map_cache_db.h"
+#include "lispd_map_cache_snapshot.h"
 #include "lispd_map_register.h"
 #include "lispd_map_request.h"
+#include "lispd_map_request_scheduler.h"
+#include "lispd_miss_queue.h"
 #include "lispd_output.h"
+#include "lispd_reactor.h"
 #include "lispd_referral_cache_db.h"
 #include "lispd_rloc_probing.h"
+#include "lispd_rx_ring.h"
 #include "lispd_routing_tables_lib.h"
 #include "lispd_smr.h"
 #include "lispd_sockets.h"
 #include "lispd_timers.h"
 #include "lispd_tun.h"
+#include "lispd_uring.h"
+#include "lispd_xdp.h"
 #include "api/ipc.h"
 
 
 
 void event_loop();
 void signal_handler(int);
+int init_signal_pipe();
+void close_signal_pipe();
 int check_capabilities();
 /* system calls - look to libc for function to system call mapping */
 extern int capset(cap_user_header_t header, cap_user_data_t data);
 extern int capget(cap_user_header_t header, const cap_user_data_t data);
 #ifdef ANDROID
+#define CAP_TO_INDEX(x)     ((x) >> 5)
 #define CAP_TO_MASK(x)      (1 << ((x) & 31))
 #endif
+/* Defined by Linux >= 5.8 */
+#ifndef CAP_BPF
+#define CAP_BPF             39
+#endif
 
 
 /*
@@ -105,10 +120,33 @@ int                          ctrl_supported_afi;
 int                          default_rloc_afi;
 int                          daemonize;
 int                          map_request_retries;
+int                          map_request_rate;
+int                          map_request_batch;
+int                          smr_rate;
+int                          map_cache_size;
+int                          map_cache_memory;
+int                          map_cache_refresh;
+char                         *map_cache_snapshot_file;
+int                          map_cache_snapshot_interval;
 /* RLOC probing parameters */
 int                          rloc_probe_interval;
 int                          rloc_probe_retries;
 int                          rloc_probe_retries_interval;
+int                          rloc_probe_rate;
+int                          rloc_probe_rtt_weighting;
+/* Data plane parameters */
+int                          tun_batch_size;
+int                          data_plane_threads;
+int                          tx_batch_size;
+int                          tx_batch_timeout;
+int                          flow_cache_size;
+int                          outer_src_port_entropy;
+int                          outer_src_port_min;
+int                          outer_src_port_max;
+int                          rx_ring_size;
+int                          io_engine;
+int                          miss_queue_size;
+int                          miss_queue_memory;
 
 int                          control_port;
 
@@ -154,6 +192,11 @@ timer                         *smr_retry_timer;
  */
 int                         timers_fd;
 
+/*
+ *      signals (written by the signal handler, read by the event loop)
+ */
+static int                  signal_pipe[2]  = {-1, -1};
+
 uint8_t                     lispd_running;
 
 #ifndef VPNAPI
@@ -201,10 +244,14 @@ int main(int argc, char **argv)
     /*
      * Set up signal handlers
      */
+    if (init_signal_pipe() != GOOD){
+        exit_cleanup();
+    }
     signal(SIGHUP,  signal_handler);
     signal(SIGTERM, signal_handler);
     signal(SIGINT,  signal_handler);
     signal(SIGQUIT, signal_handler);
+    signal(SIGUSR1, signal_handler);
 
 
     /*
@@ -246,12 +293,15 @@ int main(int argc, char **argv)
 
     if (build_timers_event_socket(&timers_fd) != GOOD)
     {
-        lispd_log_msg(LISP_LOG_CRIT, " Error programing the timer signal. Exiting...");
+        lispd_log_msg(LISP_LOG_CRIT, " Error programing the timers. Exiting...");
         exit_cleanup();
     }
     init_timers();
 
-
+    if (init_nonces() != GOOD){
+        lispd_log_msg(LISP_LOG_CRIT, " Error initializing the nonces. Exiting...");
+        exit_cleanup();
+    }
 
     /*
      * Create net_link socket to receive notifications of changes of RLOC status.
@@ -282,6 +332,8 @@ int main(int argc, char **argv)
         exit_cleanup();
     }
 
+    init_tuple_hash();
+
     if (ddt_client == FALSE){
         drop_referral_cache();
     }
@@ -306,6 +358,10 @@ int main(int argc, char **argv)
         exit_cleanup();
     }
 
+    if (init_tun_batch(&main_tun_batch, tun_batch_size) != GOOD){
+        exit_cleanup();
+    }
+
     /*
      * Assign address to the tun interface and add routing to this interface
      */
@@ -327,7 +383,14 @@ int main(int argc, char **argv)
         ipv6_data_input_fd = open_data_input_socket(AF_INET6);
     }
 
-
+    /*
+     * LISP data packets of the AF_XDP interfaces are redirected before reaching the data sockets
+     */
+#ifdef LISPD_XDP
+    if (init_xdp() != GOOD){
+        exit_cleanup();
+    }
+#endif
 
     /*
      * Request to dump the routing tables to obtain the gatways when processing the netlink messages
@@ -358,6 +421,11 @@ int main(int argc, char **argv)
 
 
 
+    /*
+     * Restore the map cache saved by the previous execution
+     */
+    init_map_cache_snapshot();
+
     /*
      *  Register to the Map-Server(s)
      */
@@ -379,6 +447,14 @@ int main(int argc, char **argv)
      */
     programming_petr_rloc_probing();
 
+    /*
+     * Start the data plane threads. From now on, they read the databases without locks: the
+     * control plane replaces the objects they use and releases the old ones after a grace
+     * period (lispd_epoch.h)
+     */
+    if (init_data_plane_workers(data_plane_threads) != GOOD){
+        exit_cleanup();
+    }
 
     event_loop();
 
@@ -427,10 +503,14 @@ JNIEXPORT jintArray JNICALL Java_org_lispmob_noroot_LISPmob_1JNI_startLispd
     /*
      * Set up signal handlers
      */
+    if (init_signal_pipe() != GOOD){
+        exit_cleanup();
+    }
     signal(SIGHUP,  signal_handler);
     signal(SIGTERM, signal_handler);
     signal(SIGINT,  signal_handler);
     signal(SIGQUIT, signal_handler);
+    signal(SIGUSR1, signal_handler);
 
     /*
      *  set up databases
@@ -447,12 +527,18 @@ JNIEXPORT jintArray JNICALL Java_org_lispmob_noroot_LISPmob_1JNI_startLispd
 
     if (build_timers_event_socket(&timers_fd) == 0)
     {
-        lispd_log_msg(LISP_LOG_CRIT, " Error programing the timer signal. Exiting...");
+        lispd_log_msg(LISP_LOG_CRIT, " Error programing the timers. Exiting...");
         exit_cleanup();
         return (NULL);
     }
     init_timers();
 
+    if (init_nonces() != GOOD){
+        lispd_log_msg(LISP_LOG_CRIT, " Error initializing the nonces. Exiting...");
+        exit_cleanup();
+        return (NULL);
+    }
+
     /*
      * Create net_link socket to receive notifications of changes of RLOC status.
      */
@@ -479,6 +565,8 @@ JNIEXPORT jintArray JNICALL Java_org_lispmob_noroot_LISPmob_1JNI_startLispd
         return (NULL);
     }
 
+    init_tuple_hash();
+
     if (nat_aware == TRUE){
         nat_set_xTR_ID();
     }
@@ -516,6 +604,11 @@ JNIEXPORT jintArray JNICALL Java_org_lispmob_noroot_LISPmob_1JNI_startLispd
 
     tun_fd = vpn_tun_fd;
 
+    if (tun_set_nonblocking(tun_fd) != GOOD || init_tun_batch(&main_tun_batch, tun_batch_size) != GOOD){
+        exit_cleanup();
+        return (NULL);
+    }
+
 
 
 
@@ -559,82 +652,199 @@ JNIEXPORT jintArray JNICALL Java_org_lispmob_noroot_LISPmob_1JNI_startLispd
  */
 
 
+/*
+ *      callbacks of the fds of the event loop
+ */
+
+static int  afi_ipv4    = AF_INET;
+static int  afi_ipv6    = AF_INET6;
+
+void data_input_callback(int fd, void *ctx)
+{
+    process_input_packet(fd, *(int *)ctx);
+}
+
+void control_input_callback(int fd, void *ctx)
+{
+    lispd_log_msg(LISP_LOG_DEBUG_3,"Received %s packet in the control input buffer (4342)",
+            (*(int *)ctx == AF_INET) ? "IPv4" : "IPv6");
+    process_ctr_msg(fd, *(int *)ctx);
+}
+
+void tun_callback(int fd, void *ctx)
+{
+    lispd_log_msg(LISP_LOG_DEBUG_3,"Received packet in the tun buffer");
+    process_output_packet(fd);
+}
+
+void timers_callback(int fd, void *ctx)
+{
+    process_timer_event(fd);
+}
+
+void netlink_callback(int fd, void *ctx)
+{
+    lispd_log_msg(LISP_LOG_DEBUG_3,"Received notification from net link");
+    process_netlink_msg(fd);
+}
+
+void signal_callback(int fd, void *ctx);
+
 #ifndef VPNAPI
+void data_plane_misses_callback(int fd, void *ctx)
+{
+    process_data_plane_misses(fd);
+}
+#else
+void ipc_callback(int fd, void *ctx)
+{
+    process_ipc_packet(fd);
+}
+#endif
 
-void event_loop()
+
+/*
+ * Register the fds processed by the main thread, except the tun and the data sockets. With
+ * data plane threads they are read by the workers.
+ */
+
+int register_event_loop_fds(int workers)
 {
-    int    max_fd;
-    fd_set readfds;
-    int    retval;
-    /*
-     *  calculate the max_fd for select.
-     */
+    if (init_reactor() != GOOD){
+        return (BAD);
+    }
+    if (default_rloc_afi != AF_INET6 &&
+            reactor_add_fd(ipv4_control_input_fd, REACTOR_READ, control_input_callback, &afi_ipv4, "IPv4 control") != GOOD){
+        return (BAD);
+    }
+    if (default_rloc_afi != AF_INET &&
+            reactor_add_fd(ipv6_control_input_fd, REACTOR_READ, control_input_callback, &afi_ipv6, "IPv6 control") != GOOD){
+        return (BAD);
+    }
+    if (reactor_add_fd(timers_fd, REACTOR_READ, timers_callback, NULL, "timers") != GOOD ||
+            reactor_add_fd(netlink_fd, REACTOR_READ, netlink_callback, NULL, "netlink") != GOOD ||
+            reactor_add_fd(signal_pipe[0], REACTOR_READ, signal_callback, NULL, "signals") != GOOD){
+        return (BAD);
+    }
+#ifndef VPNAPI
+    if (workers == TRUE &&
+            reactor_add_fd(get_data_plane_miss_fd(), REACTOR_READ, data_plane_misses_callback, NULL, "data plane misses") != GOOD){
+        return (BAD);
+    }
+#ifdef LISPD_XDP
+    if (workers == FALSE && reactor_add_xdp_sockets() != GOOD){
+        return (BAD);
+    }
+#endif
+#else
+    if (ipc_control_fd != -1 &&
+            reactor_add_fd(ipc_control_fd, REACTOR_READ, ipc_callback, NULL, "IPC control") != GOOD){
+        return (BAD);
+    }
+#endif
+    return (GOOD);
+}
+
 
-    max_fd = tun_fd;
-    if (default_rloc_afi != AF_INET6){
-        max_fd = (max_fd > ipv4_data_input_fd)      ? max_fd : ipv4_data_input_fd;
-        max_fd = (max_fd > ipv4_control_input_fd)   ? max_fd : ipv4_control_input_fd;
+/*
+ * Register the tun and the data sockets when they are read by the reactor of the main thread
+ */
+
+int register_packet_fds(
+        int     tun,
+        int     ipv4_data,
+        int     ipv6_data)
+{
+    if (tun == TRUE && reactor_add_fd(tun_fd, REACTOR_READ, tun_callback, NULL, "tun") != GOOD){
+        return (BAD);
+    }
+    if (ipv4_data == TRUE && default_rloc_afi != AF_INET6 &&
+            reactor_add_fd(ipv4_data_input_fd, REACTOR_READ, data_input_callback, &afi_ipv4, "IPv4 data") != GOOD){
+        return (BAD);
+    }
+    if (ipv6_data == TRUE && default_rloc_afi != AF_INET &&
+            reactor_add_fd(ipv6_data_input_fd, REACTOR_READ, data_input_callback, &afi_ipv6, "IPv6 data") != GOOD){
+        return (BAD);
     }
-    if (default_rloc_afi != AF_INET){
-        max_fd = (max_fd > ipv6_data_input_fd)      ? max_fd : ipv6_data_input_fd;
-        max_fd = (max_fd > ipv6_control_input_fd)   ? max_fd : ipv6_control_input_fd;
+    return (GOOD);
+}
+
+
+#ifndef VPNAPI
+
+#ifdef LISPD_IO_URING
+
+/*
+ * The tun and the data sockets are read through io_uring. The packet socket of the rx ring
+ * is left to the reactor. Returns BAD if the engine is not available.
+ */
+
+int uring_event_loop()
+{
+    int     ipv4_ring   = (rx_ring_size > 0);
+
+    if (init_uring(tun_fd,
+            (ipv4_ring == FALSE && default_rloc_afi != AF_INET6) ? ipv4_data_input_fd : -1,
+            (default_rloc_afi != AF_INET) ? ipv6_data_input_fd : -1) != GOOD){
+        return (BAD);
+    }
+    if (register_packet_fds(FALSE, ipv4_ring, FALSE) != GOOD){
+        lispd_log_msg(LISP_LOG_CRIT, "event_loop: Couldn't register the sockets of the event loop");
+        /* The event loop falls back to epoll */
+        close_uring();
+        return (BAD);
     }
-    max_fd = (max_fd > timers_fd)               ? max_fd : timers_fd;
-    max_fd = (max_fd > netlink_fd)              ? max_fd : netlink_fd;
 
     lispd_running = TRUE;
 
     while (lispd_running) {
-        FD_ZERO(&readfds);
-        FD_SET(tun_fd, &readfds);
-        if (default_rloc_afi != AF_INET6){
-            FD_SET(ipv4_data_input_fd, &readfds);
-            FD_SET(ipv4_control_input_fd, &readfds);
+        if (uring_wait() == 0) {
+            continue;        /* interrupted */
         }
-        if (default_rloc_afi != AF_INET){
-            FD_SET(ipv6_data_input_fd, &readfds);
-            FD_SET(ipv6_control_input_fd, &readfds);
+
+        uring_dispatch();
+        /* Release the objects replaced while processing the events */
+        epoch_reclaim();
+    }
+    return (GOOD);
+}
+#endif
+
+
+void event_loop()
+{
+    int     workers     = data_plane_workers_enabled();
+
+    if (register_event_loop_fds(workers) != GOOD){
+        lispd_log_msg(LISP_LOG_CRIT, "event_loop: Couldn't register the sockets of the event loop");
+        return;
+    }
+
+#ifdef LISPD_IO_URING
+    if (io_engine == IO_ENGINE_IO_URING){
+        if (uring_event_loop() == GOOD){
+            return;
         }
-        FD_SET(timers_fd, &readfds);
-        FD_SET(netlink_fd, &readfds);
+        lispd_log_msg(LISP_LOG_WARNING, "event_loop: io_uring engine not available. Using epoll");
+    }
+#endif
+
+    if (workers == FALSE && register_packet_fds(TRUE, TRUE, TRUE) != GOOD){
+        lispd_log_msg(LISP_LOG_CRIT, "event_loop: Couldn't register the sockets of the event loop");
+        return;
+    }
 
-        retval = have_input(max_fd, &readfds);
+    lispd_running = TRUE;
 
-        if (retval != GOOD) {
+    while (lispd_running) {
+        /* The timers wake up the loop through the timers fd: no timeout is needed */
+        if (reactor_wait(-1) == 0) {
             continue;        /* interrupted */
         }
-        if (default_rloc_afi != AF_INET6){
-            if (FD_ISSET(ipv4_data_input_fd, &readfds)) {
-                //lispd_log_msg(LISP_LOG_DEBUG_3,"Received input IPv4 packet");
-                process_input_packet(ipv4_data_input_fd, AF_INET);
-            }
-            if (FD_ISSET(ipv4_control_input_fd, &readfds)) {
-                lispd_log_msg(LISP_LOG_DEBUG_3,"Received IPv4 packet in the control input buffer (4342)");
-                process_ctr_msg(ipv4_control_input_fd, AF_INET);
-            }
-        }
-        if (default_rloc_afi != AF_INET){
-            if (FD_ISSET(ipv6_data_input_fd, &readfds)) {
-                //lispd_log_msg(LISP_LOG_DEBUG_3,"Received input IPv6 packet");
-                process_input_packet(ipv6_data_input_fd, AF_INET6);
-            }
-            if (FD_ISSET(ipv6_control_input_fd, &readfds)) {
-                lispd_log_msg(LISP_LOG_DEBUG_3,"Received IPv6 packet in the control input buffer (4342)");
-                process_ctr_msg(ipv6_control_input_fd, AF_INET6);
-            }
-        }
-        if (FD_ISSET(tun_fd, &readfds)) {
-            lispd_log_msg(LISP_LOG_DEBUG_3,"Received packet in the tun buffer");
-            process_output_packet(tun_fd);
-        }
-        if (FD_ISSET(timers_fd,&readfds)){
-            //lispd_log_msg(LISP_LOG_DEBUG_3,"Received something in the timer fd");
-            process_timer_signal(timers_fd);
-        }
-        if (FD_ISSET(netlink_fd,&readfds)){
-            lispd_log_msg(LISP_LOG_DEBUG_3,"Received notification from net link");
-            process_netlink_msg(netlink_fd);
-        }
+
+        reactor_dispatch();
+        /* Release the objects replaced while processing the events */
+        epoch_reclaim();
     }
 }
 
@@ -644,10 +854,7 @@ void event_loop (){}
 
 JNIEXPORT void JNICALL Java_org_lispmob_noroot_LISPmob_1JNI_lispd_1loop(JNIEnv * env, jclass cl)
 {
-    int    max_fd;
-    fd_set readfds;
-    int    retval;
-
+    init_map_cache_snapshot();
     if (nat_aware == TRUE){
         initial_info_request_process();
     }else{
@@ -664,82 +871,20 @@ JNIEXPORT void JNICALL Java_org_lispmob_noroot_LISPmob_1JNI_lispd_1loop(JNIEnv *
      */
     programming_petr_rloc_probing();
 
-    /*
-     *  calculate the max_fd for select.
-     */
+    if (register_event_loop_fds(FALSE) != GOOD || register_packet_fds(TRUE, TRUE, TRUE) != GOOD){
+        lispd_log_msg(LISP_LOG_CRIT, "event_loop: Couldn't register the sockets of the event loop");
+        return;
+    }
 
-        max_fd = tun_fd;
-        if (default_rloc_afi != AF_INET6){
-            max_fd = (max_fd > ipv4_data_input_fd)      ? max_fd : ipv4_data_input_fd;
-            max_fd = (max_fd > ipv4_control_input_fd)   ? max_fd : ipv4_control_input_fd;
-        }
-        if (default_rloc_afi != AF_INET){
-            max_fd = (max_fd > ipv6_data_input_fd)      ? max_fd : ipv6_data_input_fd;
-            max_fd = (max_fd > ipv6_control_input_fd)   ? max_fd : ipv6_control_input_fd;
+    lispd_running = TRUE;
+
+    while (lispd_running) {
+        if (reactor_wait(-1) == 0) {
+            continue;        /* interrupted */
         }
-        max_fd = (max_fd > timers_fd)               ? max_fd : timers_fd;
-        max_fd = (max_fd > netlink_fd)              ? max_fd : netlink_fd;
-
-        lispd_running = TRUE;
-
-        while (lispd_running) {
-            FD_ZERO(&readfds);
-            FD_SET(tun_fd, &readfds);
-            if (default_rloc_afi != AF_INET6){
-                FD_SET(ipv4_data_input_fd, &readfds);
-                FD_SET(ipv4_control_input_fd, &readfds);
-            }
-            if (default_rloc_afi != AF_INET){
-                FD_SET(ipv6_data_input_fd, &readfds);
-                FD_SET(ipv6_control_input_fd, &readfds);
-            }
-            FD_SET(timers_fd, &readfds);
-            FD_SET(netlink_fd, &readfds);
-
-            retval = have_input(max_fd, &readfds);
-
-            if (retval != GOOD) {
-                continue;        /* interrupted */
-            }
-            if (default_rloc_afi != AF_INET6){
-                if (FD_ISSET(ipv4_data_input_fd, &readfds)) {
-                    lispd_log_msg(LISP_LOG_DEBUG_3,"Received input IPv4 packet");
-                    process_input_packet(ipv4_data_input_fd, AF_INET);
-                }
-                if (FD_ISSET(ipv4_control_input_fd, &readfds)) {
-                    lispd_log_msg(LISP_LOG_DEBUG_3,"Received IPv4 packet in the control input buffer (4342)");
-                    process_ctr_msg(ipv4_control_input_fd, AF_INET);
-                }
-            }
-            if (default_rloc_afi != AF_INET){
-
-                if (FD_ISSET(ipv6_data_input_fd, &readfds)) {
-                    //lispd_log_msg(LISP_LOG_DEBUG_3,"Received input IPv6 packet");
-                    process_input_packet(ipv6_data_input_fd, AF_INET6);
-                }
-
-                if (FD_ISSET(ipv6_control_input_fd, &readfds)) {
-                    lispd_log_msg(LISP_LOG_DEBUG_3,"Received IPv6 packet in the control input buffer (4342)");
-                    process_ctr_msg(ipv6_control_input_fd, AF_INET6);
-                }
-            }
-
-            if (FD_ISSET(tun_fd, &readfds)) {
-                lispd_log_msg(LISP_LOG_DEBUG_3,"Received packet in the tun buffer");
-                process_output_packet(tun_fd);
-            }
-
-            if (FD_ISSET(timers_fd,&readfds)){
-                //lispd_log_msg(LISP_LOG_DEBUG_3,"Received something in the timer fd");
-                process_timer_signal(timers_fd);
-            }
-
-            if (FD_ISSET(netlink_fd,&readfds)){
-                lispd_log_msg(LISP_LOG_DEBUG_3,"Received notification from net link");
-                process_netlink_msg(netlink_fd);
-            }
-     }
-     lispd_log_msg(LISP_LOG_DEBUG_2,"event_loop: Exiting from event loop");
+        reactor_dispatch();
+    }
+    lispd_log_msg(LISP_LOG_DEBUG_2,"event_loop: Exiting from event loop");
 }
 
 JNIEXPORT void JNICALL Java_org_lispmob_noroot_LISPmob_1JNI_lispd_1exit
@@ -750,12 +895,89 @@ JNIEXPORT void JNICALL Java_org_lispmob_noroot_LISPmob_1JNI_lispd_1exit
 
 #endif
 
+/*
+ *      signals --
+ *
+ *  The statistics walk tables the event loop may be updating when the signal arrives. The
+ *  handler only writes the signal number to a pipe and the dump is done by the event loop.
+ */
+
+int init_signal_pipe()
+{
+    if (pipe(signal_pipe) == -1){
+        lispd_log_msg(LISP_LOG_CRIT, "init_signal_pipe: Couldn't create the signal pipe: %s", strerror(errno));
+        return (BAD);
+    }
+    if (fcntl(signal_pipe[0], F_SETFL, O_NONBLOCK) == -1 || fcntl(signal_pipe[1], F_SETFL, O_NONBLOCK) == -1 ||
+            fcntl(signal_pipe[0], F_SETFD, FD_CLOEXEC) == -1 || fcntl(signal_pipe[1], F_SETFD, FD_CLOEXEC) == -1){
+        lispd_log_msg(LISP_LOG_CRIT, "init_signal_pipe: Couldn't set up the signal pipe: %s", strerror(errno));
+        close_signal_pipe();
+        return (BAD);
+    }
+    return (GOOD);
+}
+
+void close_signal_pipe()
+{
+    if (signal_pipe[0] != -1){
+        close(signal_pipe[0]);
+        close(signal_pipe[1]);
+        signal_pipe[0] = -1;
+        signal_pipe[1] = -1;
+    }
+}
+
+void dump_statistics()
+{
+    dump_reactor_stats(LISP_LOG_INFO);
+    dump_timers_stats(LISP_LOG_INFO);
+    dump_nonces_stats(LISP_LOG_INFO);
+    dump_miss_queue_stats(LISP_LOG_INFO);
+    dump_map_request_stats(LISP_LOG_INFO);
+    dump_rloc_probe_stats(LISP_LOG_INFO);
+    dump_rloc_probe_rtts(LISP_LOG_DEBUG_1);
+    dump_smr_stats(LISP_LOG_INFO);
+    dump_rloc_index_stats(LISP_LOG_INFO);
+    dump_map_cache_stats(LISP_LOG_INFO);
+    dump_tun_batch_stats(&main_tun_batch, "main thread", LISP_LOG_INFO);
+    dump_data_plane_workers_stats(LISP_LOG_INFO);
+#ifdef LISPD_RX_RING
+    dump_rx_ring_stats(LISP_LOG_INFO);
+#endif
+#ifdef LISPD_XDP
+    dump_xdp_stats(LISP_LOG_INFO);
+#endif
+#ifdef LISPD_IO_URING
+    dump_uring_stats(LISP_LOG_INFO);
+#endif
+}
+
+void signal_callback(int fd, void *ctx)
+{
+    uint8_t     sig     = 0;
+
+    while (read(fd, &sig, sizeof(sig)) == sizeof(sig)){
+        switch (sig) {
+        case SIGUSR1:
+            /* SIGUSR1 dumps the data plane statistics */
+            lispd_log_msg(LISP_LOG_DEBUG_1, "Received SIGUSR1 signal. Dumping statistics...");
+            dump_statistics();
+            break;
+        default:
+            break;
+        }
+    }
+}
+
 /*
  *      signal_handler --
  *
  */
 
 void signal_handler(int sig) {
+    int         saved_errno = errno;
+    uint8_t     signo       = sig;
+
     switch (sig) {
     case SIGHUP:
         /* TODO: SIGHUP should trigger reloading the configuration file */
@@ -766,6 +988,12 @@ void signal_handler(int sig) {
         lispd_log_msg(LISP_LOG_DEBUG_1, "Received SIGTERM signal. Cleaning up...");
         exit_cleanup();
         break;
+    case SIGUSR1:
+        /* Deferred to signal_callback. If the pipe is full a dump is already pending */
+        if (write(signal_pipe[1], &signo, sizeof(signo)) == -1){
+            errno = saved_errno;
+        }
+        break;
     case SIGINT:
         /* SIGINT is sent by pressing Ctrl-C. Exit cleanly */
         lispd_log_msg(LISP_LOG_DEBUG_1, "Terminal interrupt. Cleaning up...");
@@ -784,31 +1012,41 @@ void signal_handler(int sig) {
 int check_capabilities()
 {
     struct __user_cap_header_struct cap_header;
-    struct __user_cap_data_struct cap_data;
+    /* Version 3 uses two words: the capabilities above 31 (CAP_BPF) are in the second one */
+    struct __user_cap_data_struct cap_data[2];
+    int         keep_bpf    = FALSE;
 
     cap_header.pid = getpid();
-    cap_header.version = _LINUX_CAPABILITY_VERSION;
-    if (capget(&cap_header, &cap_data) < 0)
+    cap_header.version = _LINUX_CAPABILITY_VERSION_3;
+    if (capget(&cap_header, cap_data) < 0)
     {
         lispd_log_msg(LISP_LOG_ERR, "Could not retrieve capabilities");
         return BAD;
     }
 
-    lispd_log_msg(LISP_LOG_DEBUG_1, "Rights: Effective [%u] Permitted  [%u]", cap_data.effective, cap_data.permitted);
+    lispd_log_msg(LISP_LOG_DEBUG_1, "Rights: Effective [%u] Permitted  [%u]", cap_data[0].effective, cap_data[0].permitted);
 
     /* check for capabilities */
-    if(  (cap_data.effective & CAP_TO_MASK(CAP_NET_ADMIN)) && (cap_data.effective & CAP_TO_MASK(CAP_NET_RAW))  )  {
+    if(  (cap_data[0].effective & CAP_TO_MASK(CAP_NET_ADMIN)) && (cap_data[0].effective & CAP_TO_MASK(CAP_NET_RAW))  )  {
     }
     else {
         lispd_log_msg(LISP_LOG_CRIT, "Insufficient rights, you need CAP_NET_ADMIN and CAP_NET_RAW. See README");
         return BAD;
     }
+#ifdef LISPD_XDP
+    /* The XDP program and its maps are created with CAP_BPF. Without it, AF_XDP can't be used */
+    keep_bpf = (cap_data[CAP_TO_INDEX(CAP_BPF)].effective & CAP_TO_MASK(CAP_BPF)) != 0;
+#endif
 
     /* Clear all but the capability to bind to low ports */
-    cap_data.effective = CAP_TO_MASK(CAP_NET_ADMIN) | CAP_TO_MASK(CAP_NET_RAW);
-    cap_data.permitted = cap_data.effective ;
-    cap_data.inheritable = 0;
-    if (capset(&cap_header, &cap_data) < 0) {
+    memset(cap_data, 0, sizeof(cap_data));
+    cap_data[0].effective = CAP_TO_MASK(CAP_NET_ADMIN) | CAP_TO_MASK(CAP_NET_RAW);
+    if (keep_bpf == TRUE){
+        cap_data[CAP_TO_INDEX(CAP_BPF)].effective |= CAP_TO_MASK(CAP_BPF);
+    }
+    cap_data[0].permitted = cap_data[0].effective;
+    cap_data[1].permitted = cap_data[1].effective;
+    if (capset(&cap_header, cap_data) < 0) {
         lispd_log_msg(LISP_LOG_WARNING, "Could not drop privileges");
         return BAD;
     }
@@ -825,13 +1063,13 @@ int check_capabilities()
     }
 
     /* that's why we need to set effective rights equal to permitted rights */
-    if (capset(&cap_header, &cap_data) < 0)
+    if (capset(&cap_header, cap_data) < 0)
     {
         lispd_log_msg(LISP_LOG_CRIT, "Could not set effective rights to permitted ones");
         return (BAD);
     }
 
-    lispd_log_msg(LISP_LOG_DEBUG_1, "Rights: Effective [%u] Permitted  [%u]", cap_data.effective, cap_data.permitted);
+    lispd_log_msg(LISP_LOG_DEBUG_1, "Rights: Effective [%u] Permitted  [%u]", cap_data[0].effective, cap_data[0].permitted);
 
     return GOOD;
 }
@@ -846,12 +1084,32 @@ int check_capabilities()
 #ifndef VPNAPI
 void exit_cleanup(void) {
     lispd_running = FALSE;
+    /* Wait for the data plane threads before releasing the databases */
+    stop_data_plane_workers();
+    /* The next execution restores the map cache */
+    save_map_cache_snapshot();
+#ifdef LISPD_XDP
+    /* Detach the XDP programs */
+    close_xdp();
+#endif
     /* Remove source routing tables */
     remove_created_rules();
     /* Close timer file descriptors */
-    if (timers_fd != 0){
-        remove_sig_timer();
+    if (timers_fd != -1){
+        close_timers_event_socket();
     }
+#ifdef LISPD_IO_URING
+    close_uring();
+#endif
+    close_reactor();
+    close_signal_pipe();
+#ifdef LISPD_RX_RING
+    /* The ring is the IPv4 data socket */
+    if (rx_ring_size > 0){
+        close_rx_ring();
+        ipv4_data_input_fd = -1;
+    }
+#endif
     /* Close receive sockets */
     close_socket(tun_fd);
     close_socket(ipv4_data_input_fd);
@@ -870,7 +1128,9 @@ void exit_cleanup(void) {
     drop_map_cache();
     drop_local_mappings();
     drop_referral_cache();
+    free_tun_batch(&main_tun_batch);
     free(config_file);
+    free(map_cache_snapshot_file);
 
 #ifdef ANDROID
     close_log_file();
@@ -880,10 +1140,13 @@ void exit_cleanup(void) {
 #else
 void exit_cleanup(void) {
     lispd_running = FALSE;
+    save_map_cache_snapshot();
     /* Close timer file descriptors */
-    if (timers_fd != 0){
-        remove_sig_timer();
+    if (timers_fd != -1){
+        close_timers_event_socket();
     }
+    close_reactor();
+    close_signal_pipe();
     /* Close receive sockets */
     close_socket(tun_fd);
     close_socket(ipv4_data_input_fd);
@@ -900,7 +1163,9 @@ void exit_cleanup(void) {
     free_map_cache_entry(proxy_etrs);
     free_lisp_addr_list(proxy_itrs, TRUE);
     free_map_server_list(map_servers);
+    free_tun_batch(&main_tun_batch);
     free(config_file);
+    free(map_cache_snapshot_file);
 
 
     close_log_file();
@@ -74,9 +74,11 @@
  *  Protocols constants related with timeouts
  *
  */
-#define LISPD_INITIAL_MRQ_TIMEOUT       2  // Initial expiration timer for the first MRq
-#define LISPD_INITIAL_DDT_MRQ_TIMEOUT   2  // Initial expiration timer for the first DDT MRq
-#define LISPD_INITIAL_SMR_TIMEOUT       3  // Initial expiration timer for the first MRq SMR
+#define LISPD_INITIAL_MRQ_TIMEOUT       250  // ms. Initial expiration timer for the first MRq
+#define LISPD_INITIAL_DDT_MRQ_TIMEOUT   250  // ms. Initial expiration timer for the first DDT MRq
+#define LISPD_INITIAL_SMR_TIMEOUT       500  // ms. Initial expiration timer for the first MRq SMR
+#define LISPD_INITIAL_RETRANSMIT_TIMEOUT 500 // ms. Initial time between retransmits of other control messages
+#define LISPD_MAX_RETRANSMIT_TIMEOUT    4000 // ms. Limit of the exponential backoff of the retransmits
 #define LISPD_INITIAL_PROBE_TIMEOUT     3  // Initial expiration timer for the first MRq RLOC probe
 #define LISPD_INITIAL_MR_TIMEOUT        3  // Initial expiration timer for the first Map Register
 #define LISPD_SMR_TIMEOUT               6  // Time since interface status change until balancing arrays and SMR is done
@@ -216,6 +218,12 @@ int err;
 
 
 #define DEFAULT_MAP_REQUEST_RETRIES             3
+#define DEFAULT_MAP_REQUEST_RATE                50  /* Map-Requests per second to each Map Resolver */
+#define MAX_MAP_REQUEST_RATE                    10000
+#define DEFAULT_MAP_REQUEST_BATCH               1   /* Records per Map-Request. RFC 6830 senders use one */
+#define MAX_MAP_REQUEST_BATCH                   32
+#define DEFAULT_SMR_RATE                        100 /* Solicit-Map-Requests per second */
+#define MAX_SMR_RATE                            10000
 #define DEFAULT_RLOC_PROBING_RETRIES            2
 #define DEFAULT_MAP_REGISTER_TIMEOUT            5  /* PN: expected to be in minutes; however,
                                                      * lisp_mod treats this as seconds instead of
@@ -228,8 +236,35 @@ int err;
 #define RLOC_PROBING_INTERVAL                   30  /* LJ: sets the interval at which periodic
                                                      * RLOC probes are sent (seconds) */
 #define DEFAULT_RLOC_PROBING_RETRIES_INTERVAL   5   /* Interval in seconds between RLOC probing retries  */
+#define DEFAULT_RLOC_PROBE_RATE                 100 /* RLOC probes per second */
+#define MAX_RLOC_PROBE_RATE                     10000
 #define DEFAULT_DATA_CACHE_TTL                  60  /* seconds */
-#define DEFAULT_SELECT_TIMEOUT                  1000/* ms */
+#define DEFAULT_TUN_BATCH_SIZE                  32  /* Max packets read from the tun per wakeup */
+#define MAX_TUN_BATCH_SIZE                      256
+#define MAX_DATA_PLANE_THREADS                  64
+#define DEFAULT_TX_BATCH_SIZE                   32  /* Max encapsulated packets per sendmmsg */
+#define DEFAULT_TX_BATCH_TIMEOUT                1000/* us */
+#define DEFAULT_FLOW_CACHE_SIZE                 4096/* Flows cached per data plane thread */
+#define MAX_FLOW_CACHE_SIZE                     1048576
+#define DEFAULT_OUTER_SRC_PORT_MIN              49152/* Ephemeral range of RFC 6335 */
+#define DEFAULT_OUTER_SRC_PORT_MAX              65535
+#define MAX_RX_RING_SIZE                        262144/* KB */
+#define DEFAULT_THREADS_RX_RING_SIZE            1024/* KB. Rx ring per data plane thread if not configured */
+#define DEFAULT_MISS_QUEUE_SIZE                 8   /* Packets held per map cache entry being resolved */
+#define MAX_MISS_QUEUE_SIZE                     256
+#define DEFAULT_MISS_QUEUE_MEMORY               256 /* KB held by all the map cache entries */
+#define MAX_MISS_QUEUE_MEMORY                   65536
+#define DEFAULT_MAP_CACHE_SIZE                  65536 /* Dynamic map cache entries */
+#define MAX_MAP_CACHE_SIZE                      4194304
+#define MAX_MAP_CACHE_MEMORY                    4194304 /* KB */
+#define DEFAULT_MAP_CACHE_REFRESH               90  /* % of the TTL at which the entries in use are refreshed */
+#define MAX_MAP_CACHE_REFRESH                   99
+#define DEFAULT_MAP_CACHE_SNAPSHOT_INTERVAL     300 /* Seconds between snapshots of the map cache */
+#define MAX_MAP_CACHE_SNAPSHOT_INTERVAL         86400
+
+/* Engines of the packet I/O of the main thread */
+#define IO_ENGINE_EPOLL                         0
+#define IO_ENGINE_IO_URING                      1
 
 
 /*
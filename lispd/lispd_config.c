@@ -51,7 +51,11 @@
 #include "lispd_map_cache_db.h"
 #include "lispd_mapping.h"
 #include "lispd_referral_cache_db.h"
+#include "lispd_rloc_index.h"
 #include "lispd_rloc_probing.h"
+#include "lispd_rx_ring.h"
+#include "lispd_uring.h"
+#include "lispd_xdp.h"
 
 
 
@@ -103,7 +107,45 @@ int add_ddt_root_entry(
 void validate_rloc_probing_parameters (
         int probe_int,
         int probe_retries,
-        int probe_retries_interval);
+        int probe_retries_interval,
+        int probe_rate,
+        int rtt_weighting);
+
+void validate_data_plane_parameters (
+        int batch_size,
+        int threads,
+        int tx_size,
+        int tx_timeout,
+        int flow_size,
+        int rx_size);
+
+void add_xdp_data_plane_interface(char *iface_name);
+
+void validate_io_engine(char *engine);
+
+void validate_miss_queue_parameters (
+        int queue_size,
+        int queue_memory);
+
+void validate_map_request_parameters (
+        int rate,
+        int batch);
+
+void validate_smr_parameters (int rate);
+
+void validate_map_cache_parameters (
+        int size,
+        int memory,
+        int refresh);
+
+void validate_map_cache_snapshot_parameters (
+        const char  *file,
+        int         interval);
+
+void validate_outer_src_port_parameters (
+        int entropy,
+        int port_min,
+        int port_max);
 
 /*
  * Validates the information obtained from the configuration file
@@ -170,6 +212,24 @@ int handle_lispd_command_line(
 #ifdef OPENWRT
 /* Compiling for OpenWRT */
 
+/*
+ * Returns the integer value of an UCI option or default_value if the option is not defined
+ */
+
+int uci_lookup_option_int(
+        struct uci_context  *ctx,
+        struct uci_section  *s,
+        const char          *name,
+        int                 default_value)
+{
+    const char  *value  = uci_lookup_option_string(ctx, s, name);
+
+    if (value == NULL){
+        return (default_value);
+    }
+    return (strtol(value,NULL,10));
+}
+
 /* UCI parsing function (for OpenWRT) */
 
 int handle_uci_lispd_config_file(char *uci_conf_file_path) {
@@ -185,6 +245,8 @@ int handle_uci_lispd_config_file(char *uci_conf_file_path) {
     int                 uci_rloc_probe_int              = 0;
     int                 uci_rloc_probe_retries          = 0;
     int                 uci_rloc_probe_retries_interval = 0;
+    int                 uci_rloc_probe_rate             = DEFAULT_RLOC_PROBE_RATE;
+    const char*         uci_rloc_probe_rtt_weighting    = NULL;
     const char*         uci_address                     = NULL;
     int                 uci_key_type                    = 0;
     const char*         uci_key                         = NULL;
@@ -200,6 +262,29 @@ int handle_uci_lispd_config_file(char *uci_conf_file_path) {
     const char*         uci_rloc                        = NULL;
     const char*         uci_eid_prefix                  = NULL;
     int                 uci_ddt_enabled                 = 0;
+    int                 uci_tun_batch_size              = 0;
+    int                 uci_data_plane_threads          = 0;
+    int                 uci_tx_batch_size               = DEFAULT_TX_BATCH_SIZE;
+    int                 uci_tx_batch_timeout            = DEFAULT_TX_BATCH_TIMEOUT;
+    int                 uci_flow_cache_size             = DEFAULT_FLOW_CACHE_SIZE;
+    int                 uci_rx_ring_size                = 0;
+    const char*         uci_src_port_entropy            = NULL;
+    const char*         uci_xdp_interfaces              = NULL;
+    const char*         uci_io_engine                   = NULL;
+    int                 uci_miss_queue_size             = DEFAULT_MISS_QUEUE_SIZE;
+    int                 uci_miss_queue_memory           = DEFAULT_MISS_QUEUE_MEMORY;
+    int                 uci_map_request_rate            = DEFAULT_MAP_REQUEST_RATE;
+    int                 uci_map_request_batch           = DEFAULT_MAP_REQUEST_BATCH;
+    int                 uci_smr_rate                    = DEFAULT_SMR_RATE;
+    int                 uci_map_cache_size              = DEFAULT_MAP_CACHE_SIZE;
+    int                 uci_map_cache_memory            = 0;
+    int                 uci_map_cache_refresh           = DEFAULT_MAP_CACHE_REFRESH;
+    const char*         uci_map_cache_snapshot_file     = NULL;
+    int                 uci_map_cache_snapshot_interval = DEFAULT_MAP_CACHE_SNAPSHOT_INTERVAL;
+    char                *xdp_iface_names                = NULL;
+    char                *xdp_iface_name                 = NULL;
+    int                 uci_src_port_min                = DEFAULT_OUTER_SRC_PORT_MIN;
+    int                 uci_src_port_max                = DEFAULT_OUTER_SRC_PORT_MAX;
 
     char                *uci_conf_dir                   = NULL;
     char                *uci_conf_file                  = NULL;
@@ -292,6 +377,16 @@ int handle_uci_lispd_config_file(char *uci_conf_file_path) {
                         LISPD_MAX_RETRANSMITS, LISPD_MAX_RETRANSMITS);
             }
 
+            uci_map_request_rate = uci_lookup_option_int(ctx, s, "map_request_rate", DEFAULT_MAP_REQUEST_RATE);
+            uci_map_request_batch = uci_lookup_option_int(ctx, s, "map_request_batch", DEFAULT_MAP_REQUEST_BATCH);
+            uci_smr_rate = uci_lookup_option_int(ctx, s, "smr_rate", DEFAULT_SMR_RATE);
+            uci_map_cache_size = uci_lookup_option_int(ctx, s, "map_cache_size", DEFAULT_MAP_CACHE_SIZE);
+            uci_map_cache_memory = uci_lookup_option_int(ctx, s, "map_cache_memory", 0);
+            uci_map_cache_refresh = uci_lookup_option_int(ctx, s, "map_cache_refresh", DEFAULT_MAP_CACHE_REFRESH);
+            uci_map_cache_snapshot_file = uci_lookup_option_string(ctx, s, "map_cache_snapshot_file");
+            uci_map_cache_snapshot_interval = uci_lookup_option_int(ctx, s, "map_cache_snapshot_interval",
+                    DEFAULT_MAP_CACHE_SNAPSHOT_INTERVAL);
+
 
 
             continue;
@@ -324,6 +419,34 @@ int handle_uci_lispd_config_file(char *uci_conf_file_path) {
             uci_rloc_probe_int = strtol(uci_lookup_option_string(ctx, s, "rloc_probe_interval"),NULL,10);
             uci_rloc_probe_retries = strtol(uci_lookup_option_string(ctx, s, "rloc_probe_retries"),NULL,10);
             uci_rloc_probe_retries_interval = strtol(uci_lookup_option_string(ctx, s, "rloc_probe_retries_interval"),NULL,10);
+            uci_rloc_probe_rate = uci_lookup_option_int(ctx, s, "rloc_probe_rate", DEFAULT_RLOC_PROBE_RATE);
+            uci_rloc_probe_rtt_weighting = uci_lookup_option_string(ctx, s, "rloc_probe_rtt_weighting");
+            continue;
+        }
+
+        if (strcmp(s->type, "data-plane") == 0){
+            uci_tun_batch_size = uci_lookup_option_int(ctx, s, "tun_batch_size", 0);
+            uci_data_plane_threads = uci_lookup_option_int(ctx, s, "data_plane_threads", 0);
+            uci_tx_batch_size = uci_lookup_option_int(ctx, s, "tx_batch_size", DEFAULT_TX_BATCH_SIZE);
+            uci_tx_batch_timeout = uci_lookup_option_int(ctx, s, "tx_batch_timeout", DEFAULT_TX_BATCH_TIMEOUT);
+            uci_flow_cache_size = uci_lookup_option_int(ctx, s, "flow_cache_size", DEFAULT_FLOW_CACHE_SIZE);
+            uci_rx_ring_size = uci_lookup_option_int(ctx, s, "rx_ring_size", 0);
+            uci_src_port_entropy = uci_lookup_option_string(ctx, s, "outer_src_port_entropy");
+            uci_src_port_min = uci_lookup_option_int(ctx, s, "outer_src_port_min", DEFAULT_OUTER_SRC_PORT_MIN);
+            uci_src_port_max = uci_lookup_option_int(ctx, s, "outer_src_port_max", DEFAULT_OUTER_SRC_PORT_MAX);
+            uci_io_engine = uci_lookup_option_string(ctx, s, "io_engine");
+            uci_miss_queue_size = uci_lookup_option_int(ctx, s, "miss_queue_size", DEFAULT_MISS_QUEUE_SIZE);
+            uci_miss_queue_memory = uci_lookup_option_int(ctx, s, "miss_queue_memory", DEFAULT_MISS_QUEUE_MEMORY);
+            uci_xdp_interfaces = uci_lookup_option_string(ctx, s, "xdp_interfaces");
+            if (uci_xdp_interfaces != NULL && (xdp_iface_names = strdup(uci_xdp_interfaces)) != NULL){
+                /* List of interfaces separated by spaces */
+                xdp_iface_name = strtok(xdp_iface_names, " ");
+                while (xdp_iface_name != NULL){
+                    add_xdp_data_plane_interface(xdp_iface_name);
+                    xdp_iface_name = strtok(NULL, " ");
+                }
+                free(xdp_iface_names);
+            }
             continue;
         }
 
@@ -453,7 +576,20 @@ int handle_uci_lispd_config_file(char *uci_conf_file_path) {
 
     }
 
-    validate_rloc_probing_parameters (uci_rloc_probe_int, uci_rloc_probe_retries, uci_rloc_probe_retries_interval);
+    validate_rloc_probing_parameters (uci_rloc_probe_int, uci_rloc_probe_retries, uci_rloc_probe_retries_interval,
+            uci_rloc_probe_rate,
+            (uci_rloc_probe_rtt_weighting != NULL && strcmp(uci_rloc_probe_rtt_weighting, "on") == 0) ? TRUE : FALSE);
+    validate_data_plane_parameters (uci_tun_batch_size, uci_data_plane_threads,
+            uci_tx_batch_size, uci_tx_batch_timeout, uci_flow_cache_size, uci_rx_ring_size);
+    validate_outer_src_port_parameters (
+            (uci_src_port_entropy != NULL && strcmp(uci_src_port_entropy, "on") == 0) ? TRUE : FALSE,
+            uci_src_port_min, uci_src_port_max);
+    validate_io_engine((char *)uci_io_engine);
+    validate_miss_queue_parameters(uci_miss_queue_size, uci_miss_queue_memory);
+    validate_map_request_parameters(uci_map_request_rate, uci_map_request_batch);
+    validate_smr_parameters(uci_smr_rate);
+    validate_map_cache_parameters(uci_map_cache_size, uci_map_cache_memory, uci_map_cache_refresh);
+    validate_map_cache_snapshot_parameters(uci_map_cache_snapshot_file, uci_map_cache_snapshot_interval);
 
     if (validate_configuration() != GOOD){
         return (BAD);
@@ -511,6 +647,7 @@ int handle_lispd_config_file(char * lispdconf_conf_file)
     int                     probe_int               = 0;
     int                     probe_retries           = 0;
     int                     probe_retries_interval  = 0;
+    int                     probe_rate              = 0;
     char                    *log_file               = NULL;
 
     static cfg_opt_t map_server_opts[] = {
@@ -564,6 +701,25 @@ int handle_lispd_config_file(char * lispdconf_conf_file)
             CFG_INT("rloc-probe-interval",           0, CFGF_NONE),
             CFG_INT("rloc-probe-retries",            0, CFGF_NONE),
             CFG_INT("rloc-probe-retries-interval",   0, CFGF_NONE),
+            CFG_INT("rloc-probe-rate",               DEFAULT_RLOC_PROBE_RATE, CFGF_NONE),
+            CFG_BOOL("rloc-probe-rtt-weighting",     cfg_false, CFGF_NONE),
+            CFG_END()
+    };
+
+    static cfg_opt_t data_plane_opts[] = {
+            CFG_INT("tun-batch-size",                0, CFGF_NONE),
+            CFG_INT("data-plane-threads",            0, CFGF_NONE),
+            CFG_INT("tx-batch-size",                 DEFAULT_TX_BATCH_SIZE, CFGF_NONE),
+            CFG_INT("tx-batch-timeout",              DEFAULT_TX_BATCH_TIMEOUT, CFGF_NONE),
+            CFG_INT("flow-cache-size",               DEFAULT_FLOW_CACHE_SIZE, CFGF_NONE),
+            CFG_INT("rx-ring-size",                  0, CFGF_NONE),
+            CFG_BOOL("outer-src-port-entropy",       cfg_false, CFGF_NONE),
+            CFG_INT("outer-src-port-min",            DEFAULT_OUTER_SRC_PORT_MIN, CFGF_NONE),
+            CFG_INT("outer-src-port-max",            DEFAULT_OUTER_SRC_PORT_MAX, CFGF_NONE),
+            CFG_STR_LIST("xdp-interfaces",           0, CFGF_NONE),
+            CFG_STR("io-engine",                     "epoll", CFGF_NONE),
+            CFG_INT("miss-queue-size",               DEFAULT_MISS_QUEUE_SIZE, CFGF_NONE),
+            CFG_INT("miss-queue-memory",             DEFAULT_MISS_QUEUE_MEMORY, CFGF_NONE),
             CFG_END()
     };
 
@@ -576,7 +732,16 @@ int handle_lispd_config_file(char * lispdconf_conf_file)
             CFG_SEC("ddt-root-node",        ddt_root_node_opts, CFGF_MULTI),
             CFG_SEC("nat-traversal",        nat_traversal_opts, CFGF_MULTI),
             CFG_SEC("rloc-probing",         rloc_probing_opts, CFGF_MULTI),
+            CFG_SEC("data-plane",           data_plane_opts, CFGF_MULTI),
             CFG_INT("map-request-retries",  0, CFGF_NONE),
+            CFG_INT("map-request-rate",     DEFAULT_MAP_REQUEST_RATE, CFGF_NONE),
+            CFG_INT("map-request-batch",    DEFAULT_MAP_REQUEST_BATCH, CFGF_NONE),
+            CFG_INT("smr-rate",             DEFAULT_SMR_RATE, CFGF_NONE),
+            CFG_INT("map-cache-size",       DEFAULT_MAP_CACHE_SIZE, CFGF_NONE),
+            CFG_INT("map-cache-memory",     0, CFGF_NONE),
+            CFG_INT("map-cache-refresh",    DEFAULT_MAP_CACHE_REFRESH, CFGF_NONE),
+            CFG_STR("map-cache-snapshot-file",      0, CFGF_NONE),
+            CFG_INT("map-cache-snapshot-interval",  DEFAULT_MAP_CACHE_SNAPSHOT_INTERVAL, CFGF_NONE),
             CFG_INT("control-port",         0, CFGF_NONE),
             CFG_INT("debug",                0, CFGF_NONE),
             CFG_STR("log-file",             0, CFGF_NONE),
@@ -626,6 +791,12 @@ int handle_lispd_config_file(char * lispdconf_conf_file)
         }
         map_request_retries = ret;
     }
+    validate_map_request_parameters(cfg_getint(cfg, "map-request-rate"), cfg_getint(cfg, "map-request-batch"));
+    validate_smr_parameters(cfg_getint(cfg, "smr-rate"));
+    validate_map_cache_parameters(cfg_getint(cfg, "map-cache-size"), cfg_getint(cfg, "map-cache-memory"),
+            cfg_getint(cfg, "map-cache-refresh"));
+    validate_map_cache_snapshot_parameters(cfg_getstr(cfg, "map-cache-snapshot-file"),
+            cfg_getint(cfg, "map-cache-snapshot-interval"));
 
 
     /*
@@ -661,14 +832,40 @@ int handle_lispd_config_file(char * lispdconf_conf_file)
         probe_int = cfg_getint(dm, "rloc-probe-interval");
         probe_retries = cfg_getint(dm, "rloc-probe-retries");
         probe_retries_interval = cfg_getint(dm, "rloc-probe-retries-interval");
+        probe_rate = cfg_getint(dm, "rloc-probe-rate");
 
-        validate_rloc_probing_parameters (probe_int, probe_retries, probe_retries_interval);
+        validate_rloc_probing_parameters (probe_int, probe_retries, probe_retries_interval, probe_rate,
+                cfg_getbool(dm, "rloc-probe-rtt-weighting") ? TRUE : FALSE);
     }else{
         lispd_log_msg(LISP_LOG_DEBUG_1, "Configuration file: RLOC probing not defined. "
                 "Setting default values: RLOC Probing Interval: %d sec.",RLOC_PROBING_INTERVAL);
     }
 
 
+    /*
+     *  Data plane options
+     */
+
+    cfg_t *dp = cfg_getnsec(cfg, "data-plane", 0);
+    if (dp != NULL){
+        validate_data_plane_parameters (cfg_getint(dp, "tun-batch-size"),
+                cfg_getint(dp, "data-plane-threads"),
+                cfg_getint(dp, "tx-batch-size"),
+                cfg_getint(dp, "tx-batch-timeout"),
+                cfg_getint(dp, "flow-cache-size"),
+                cfg_getint(dp, "rx-ring-size"));
+        validate_outer_src_port_parameters (cfg_getbool(dp, "outer-src-port-entropy") ? TRUE : FALSE,
+                cfg_getint(dp, "outer-src-port-min"),
+                cfg_getint(dp, "outer-src-port-max"));
+        validate_io_engine(cfg_getstr(dp, "io-engine"));
+        validate_miss_queue_parameters(cfg_getint(dp, "miss-queue-size"),
+                cfg_getint(dp, "miss-queue-memory"));
+        n = cfg_size(dp, "xdp-interfaces");
+        for (i = 0; i < n; i++){
+            add_xdp_data_plane_interface(cfg_getnstr(dp, "xdp-interfaces", i));
+        }
+    }
+
     /*
      * Nat Traversal options
      */
@@ -925,9 +1122,9 @@ int add_database_mapping(
     }
 
     /*
-     * Lookup if the mapping exists. If not, a new mapping is created.
+     * Lookup if the mapping exists in the Instance ID. If not, a new mapping is created.
      */
-    mapping = lookup_eid_exact_in_db(eid_prefix,eid_prefix_length);
+    mapping = lookup_eid_exact_in_iid_db(eid_prefix,eid_prefix_length,iid);
     if (mapping == NULL)
     {
         mapping = new_local_mapping(eid_prefix,eid_prefix_length,iid);
@@ -942,11 +1139,6 @@ int add_database_mapping(
         }
         is_new_mapping = TRUE;
     }else{
-        if (mapping->iid != iid){
-            lispd_log_msg(LISP_LOG_ERR,"Same EID prefix with different iid. This configuration is not supported..."
-                    "Ignoring EID prefix.");
-            return (BAD);
-        }
         is_new_mapping = FALSE;
     }
     /*
@@ -960,7 +1152,7 @@ int add_database_mapping(
     /* If we couldn't add the interface and the mapping is new, we remove it. */
     if (interface == NULL && is_new_mapping == TRUE){
         if (is_new_mapping){
-            del_mapping_entry_from_db (mapping->eid_prefix, mapping->eid_prefix_length);
+            del_mapping_entry_from_db (mapping->eid_prefix, mapping->eid_prefix_length, mapping->iid);
             lispd_log_msg(LISP_LOG_WARNING,"add_database_mapping: Couldn't add mapping -> Cudn't create interface");
         }else{
             lispd_log_msg(LISP_LOG_WARNING,"add_database_mapping: Couldn't add locator to the mapping -> Cudn't create interface");
@@ -1065,14 +1257,12 @@ int add_static_map_cache_entry(
         return (BAD);
     }
 
-    map_cache_entry = new_map_cache_entry(eid_prefix, eid_prefix_length, STATIC_MAP_CACHE_ENTRY,255);
+    map_cache_entry = new_map_cache_entry(eid_prefix, eid_prefix_length, iid, STATIC_MAP_CACHE_ENTRY,255);
     if (map_cache_entry == NULL){
         free(locator_addr);
         return (BAD);
     }
 
-    map_cache_entry->mapping->iid = iid;
-
     locator = new_static_rmt_locator(locator_addr,UP,priority,weight,255,0);
 
     if (locator != NULL){
@@ -1089,6 +1279,7 @@ int add_static_map_cache_entry(
     /*
      * Programming rloc probing timer
      */
+    index_map_cache_entry_rlocs(map_cache_entry);
     programming_rloc_probing(map_cache_entry);
 
     /*
@@ -1298,7 +1489,7 @@ int add_proxy_etr_entry(
         if ((get_lisp_addr_from_char ("0.0.0.0", &petr_addr))!=GOOD){
             return (BAD);
         }
-        proxy_etrs = new_map_cache_entry_no_db (petr_addr,0,STATIC_MAP_CACHE_ENTRY,0);
+        proxy_etrs = new_map_cache_entry_no_db (petr_addr,0,0,STATIC_MAP_CACHE_ENTRY,0);
         if (proxy_etrs == NULL){
             return (BAD);
         }
@@ -1329,7 +1520,9 @@ int add_proxy_etr_entry(
 void validate_rloc_probing_parameters (
         int probe_int,
         int probe_retries,
-        int probe_retries_interval){
+        int probe_retries_interval,
+        int probe_rate,
+        int rtt_weighting){
 
     if (probe_int  < 0){
         rloc_probe_interval = 0;
@@ -1369,7 +1562,306 @@ void validate_rloc_probing_parameters (
                 rloc_probe_retries_interval = probe_retries_interval;
             }
         }
+
+        if (probe_rate < 0 || probe_rate > MAX_RLOC_PROBE_RATE){
+            rloc_probe_rate = DEFAULT_RLOC_PROBE_RATE;
+            lispd_log_msg(LISP_LOG_WARNING, "RLOC Probing rate should be between 0 and %d. Using %d probes per second",
+                    MAX_RLOC_PROBE_RATE, DEFAULT_RLOC_PROBE_RATE);
+        }else{
+            rloc_probe_rate = probe_rate;
+        }
+
+        rloc_probe_rtt_weighting = rtt_weighting;
+        if (rloc_probe_rtt_weighting == TRUE){
+            lispd_log_msg(LISP_LOG_DEBUG_1, "RLOC Probing: weights of the locators biased by their RTT");
+        }
+    }else if (rtt_weighting == TRUE){
+        lispd_log_msg(LISP_LOG_WARNING, "RLOC Probing RTT weighting requires RLOC Probing. Ignored");
+    }
+}
+
+void validate_data_plane_parameters (
+        int batch_size,
+        int threads,
+        int tx_size,
+        int tx_timeout,
+        int flow_size,
+        int rx_size)
+{
+    if (batch_size == 0){
+        tun_batch_size = DEFAULT_TUN_BATCH_SIZE;
+    }else if (batch_size < 0 || batch_size > MAX_TUN_BATCH_SIZE){
+        tun_batch_size = DEFAULT_TUN_BATCH_SIZE;
+        lispd_log_msg(LISP_LOG_WARNING, "Tun batch size should be between 1 and %d. Using %d packets",
+                MAX_TUN_BATCH_SIZE, DEFAULT_TUN_BATCH_SIZE);
+    }else{
+        tun_batch_size = batch_size;
+    }
+    lispd_log_msg(LISP_LOG_DEBUG_1, "Tun batch size: %d packets per wakeup", tun_batch_size);
+
+#ifdef VPNAPI
+    /* The tun of the VPN API has a single queue */
+    threads = 0;
+#endif
+    if (threads < 0 || threads > MAX_DATA_PLANE_THREADS){
+        data_plane_threads = 0;
+        lispd_log_msg(LISP_LOG_WARNING, "Data plane threads should be between 0 and %d. Using the main thread",
+                MAX_DATA_PLANE_THREADS);
+    }else{
+        data_plane_threads = threads;
+    }
+    if (data_plane_threads > 0){
+        lispd_log_msg(LISP_LOG_DEBUG_1, "Data plane threads: %d", data_plane_threads);
+    }
+
+    if (tx_size < 0 || tx_size > MAX_TUN_BATCH_SIZE){
+        tx_batch_size = DEFAULT_TX_BATCH_SIZE;
+        lispd_log_msg(LISP_LOG_WARNING, "Tx batch size should be between 0 and %d. Using %d packets",
+                MAX_TUN_BATCH_SIZE, DEFAULT_TX_BATCH_SIZE);
+    }else{
+        tx_batch_size = tx_size;
+    }
+    if (tx_timeout < 0){
+        tx_batch_timeout = DEFAULT_TX_BATCH_TIMEOUT;
+    }else{
+        tx_batch_timeout = tx_timeout;
+    }
+    if (tx_batch_size > 1){
+        lispd_log_msg(LISP_LOG_DEBUG_1, "Tx batch: up to %d packets per sendmmsg, flushed after %d us",
+                tx_batch_size, tx_batch_timeout);
+    }else{
+        lispd_log_msg(LISP_LOG_DEBUG_1, "Tx batch disabled");
+    }
+
+    if (flow_size < 0 || flow_size > MAX_FLOW_CACHE_SIZE){
+        flow_cache_size = DEFAULT_FLOW_CACHE_SIZE;
+        lispd_log_msg(LISP_LOG_WARNING, "Flow cache size should be between 0 and %d. Using %d flows",
+                MAX_FLOW_CACHE_SIZE, DEFAULT_FLOW_CACHE_SIZE);
+    }else{
+        flow_cache_size = flow_size;
+    }
+    if (flow_cache_size > 0){
+        lispd_log_msg(LISP_LOG_DEBUG_1, "Flow cache: %d flows per data plane thread", flow_cache_size);
+    }else{
+        lispd_log_msg(LISP_LOG_DEBUG_1, "Flow cache disabled");
+    }
+
+#ifndef LISPD_RX_RING
+    rx_size = 0;
+#endif
+    if (rx_size < 0 || rx_size > MAX_RX_RING_SIZE){
+        rx_ring_size = 0;
+        lispd_log_msg(LISP_LOG_WARNING, "Rx ring size should be between 0 and %d KB. Using the raw socket",
+                MAX_RX_RING_SIZE);
+    }else{
+        rx_ring_size = rx_size;
+    }
+#ifdef LISPD_RX_RING
+    /* Each data plane thread decapsulates the IPv4 flows hashed to its own ring */
+    if (data_plane_threads > 1 && rx_ring_size == 0){
+        rx_ring_size = DEFAULT_THREADS_RX_RING_SIZE;
+    }
+#endif
+    if (rx_ring_size > 0){
+        lispd_log_msg(LISP_LOG_DEBUG_1, "Rx ring: %d KB", rx_ring_size);
+    }
+}
+
+/*
+ * Receive the LISP data packets of the interface through AF_XDP
+ */
+void add_xdp_data_plane_interface(char *iface_name)
+{
+#ifdef LISPD_XDP
+    if (add_xdp_interface(iface_name) == GOOD){
+        lispd_log_msg(LISP_LOG_DEBUG_1, "AF_XDP data plane in %s", iface_name);
+    }
+#else
+    lispd_log_msg(LISP_LOG_WARNING, "AF_XDP is not supported in this platform. Ignoring interface %s", iface_name);
+#endif
+}
+
+/*
+ * Engine used by the main thread to read and write the packets: "epoll" or "io_uring"
+ */
+void validate_io_engine(char *engine)
+{
+    io_engine = IO_ENGINE_EPOLL;
+    if (engine == NULL || strcmp(engine, "epoll") == 0){
+        return;
+    }
+    if (strcmp(engine, "io_uring") != 0){
+        lispd_log_msg(LISP_LOG_WARNING, "Unknown I/O engine %s. Using epoll", engine);
+        return;
+    }
+#ifdef LISPD_IO_URING
+    if (data_plane_threads > 0){
+        lispd_log_msg(LISP_LOG_WARNING, "The io_uring engine is only used by the main thread. Using epoll");
+        return;
+    }
+    io_engine = IO_ENGINE_IO_URING;
+    lispd_log_msg(LISP_LOG_DEBUG_1, "I/O engine: io_uring");
+#else
+    lispd_log_msg(LISP_LOG_WARNING, "io_uring is not supported in this platform. Using epoll");
+#endif
+}
+
+/*
+ * Packets held by each map cache entry being resolved and memory used by all of them
+ */
+void validate_miss_queue_parameters (
+        int queue_size,
+        int queue_memory)
+{
+    if (queue_size < 0 || queue_size > MAX_MISS_QUEUE_SIZE){
+        miss_queue_size = DEFAULT_MISS_QUEUE_SIZE;
+        lispd_log_msg(LISP_LOG_WARNING, "Miss queue size should be between 0 and %d. Using %d packets",
+                MAX_MISS_QUEUE_SIZE, DEFAULT_MISS_QUEUE_SIZE);
+    }else{
+        miss_queue_size = queue_size;
+    }
+    if (queue_memory < 0 || queue_memory > MAX_MISS_QUEUE_MEMORY){
+        miss_queue_memory = DEFAULT_MISS_QUEUE_MEMORY;
+        lispd_log_msg(LISP_LOG_WARNING, "Miss queue memory should be between 0 and %d KB. Using %d KB",
+                MAX_MISS_QUEUE_MEMORY, DEFAULT_MISS_QUEUE_MEMORY);
+    }else{
+        miss_queue_memory = queue_memory;
+    }
+    if (miss_queue_size > 0 && miss_queue_memory > 0){
+        lispd_log_msg(LISP_LOG_DEBUG_1, "Miss queue: %d packets per map cache entry, %d KB in total",
+                miss_queue_size, miss_queue_memory);
+    }else{
+        lispd_log_msg(LISP_LOG_DEBUG_1, "Miss queue disabled");
+    }
+}
+
+/*
+ * Map-Requests per second to each Map Resolver and records per Map-Request
+ */
+void validate_map_request_parameters (
+        int rate,
+        int batch)
+{
+    if (rate < 0 || rate > MAX_MAP_REQUEST_RATE){
+        map_request_rate = DEFAULT_MAP_REQUEST_RATE;
+        lispd_log_msg(LISP_LOG_WARNING, "Map-Request rate should be between 0 and %d. Using %d Map-Requests per second",
+                MAX_MAP_REQUEST_RATE, DEFAULT_MAP_REQUEST_RATE);
+    }else{
+        map_request_rate = rate;
+    }
+    if (batch < 1 || batch > MAX_MAP_REQUEST_BATCH){
+        map_request_batch = DEFAULT_MAP_REQUEST_BATCH;
+        lispd_log_msg(LISP_LOG_WARNING, "Map-Request batch should be between 1 and %d. Using %d records",
+                MAX_MAP_REQUEST_BATCH, DEFAULT_MAP_REQUEST_BATCH);
+    }else{
+        map_request_batch = batch;
+    }
+    if (map_request_rate == 0){
+        lispd_log_msg(LISP_LOG_DEBUG_1, "Map-Requests: no rate limit, %d records per Map-Request", map_request_batch);
+    }else{
+        lispd_log_msg(LISP_LOG_DEBUG_1, "Map-Requests: %d per second to each Map Resolver, %d records per Map-Request",
+                map_request_rate, map_request_batch);
+    }
+}
+
+/*
+ * Solicit-Map-Requests per second sent to the RLOCs of the map cache
+ */
+void validate_smr_parameters (int rate)
+{
+    if (rate < 0 || rate > MAX_SMR_RATE){
+        smr_rate = DEFAULT_SMR_RATE;
+        lispd_log_msg(LISP_LOG_WARNING, "SMR rate should be between 0 and %d. Using %d SMRs per second",
+                MAX_SMR_RATE, DEFAULT_SMR_RATE);
+    }else{
+        smr_rate = rate;
+    }
+}
+
+/*
+ * Maximum number of dynamic entries and memory of the map cache. 0 means no limit.
+ * Percentage of the TTL at which the entries in use are refreshed. 0 disables the refresh.
+ */
+void validate_map_cache_parameters (
+        int size,
+        int memory,
+        int refresh)
+{
+    if (size < 0 || size > MAX_MAP_CACHE_SIZE){
+        map_cache_size = DEFAULT_MAP_CACHE_SIZE;
+        lispd_log_msg(LISP_LOG_WARNING, "Map cache size should be between 0 and %d. Using %d entries",
+                MAX_MAP_CACHE_SIZE, DEFAULT_MAP_CACHE_SIZE);
+    }else{
+        map_cache_size = size;
+    }
+    if (memory < 0 || memory > MAX_MAP_CACHE_MEMORY){
+        map_cache_memory = 0;
+        lispd_log_msg(LISP_LOG_WARNING, "Map cache memory should be between 0 and %d KB. Memory not limited",
+                MAX_MAP_CACHE_MEMORY);
+    }else{
+        map_cache_memory = memory;
+    }
+    if (refresh < 0 || refresh > MAX_MAP_CACHE_REFRESH){
+        map_cache_refresh = DEFAULT_MAP_CACHE_REFRESH;
+        lispd_log_msg(LISP_LOG_WARNING, "Map cache refresh should be between 0 and %d %% of the TTL. Using %d %%",
+                MAX_MAP_CACHE_REFRESH, DEFAULT_MAP_CACHE_REFRESH);
+    }else{
+        map_cache_refresh = refresh;
+    }
+    lispd_log_msg(LISP_LOG_DEBUG_1, "Map cache: %d dynamic entries, %d KB (0 = no limit). Refresh at %d %% of the TTL",
+            map_cache_size, map_cache_memory, map_cache_refresh);
+}
+
+/*
+ * File where the map cache is saved across restarts and seconds between two snapshots.
+ * No file disables the snapshots. An interval of 0 only saves the map cache on exit.
+ */
+void validate_map_cache_snapshot_parameters (
+        const char  *file,
+        int         interval)
+{
+    if (interval < 0 || interval > MAX_MAP_CACHE_SNAPSHOT_INTERVAL){
+        map_cache_snapshot_interval = DEFAULT_MAP_CACHE_SNAPSHOT_INTERVAL;
+        lispd_log_msg(LISP_LOG_WARNING, "Map cache snapshot interval should be between 0 and %d seconds. Using %d seconds",
+                MAX_MAP_CACHE_SNAPSHOT_INTERVAL, DEFAULT_MAP_CACHE_SNAPSHOT_INTERVAL);
+    }else{
+        map_cache_snapshot_interval = interval;
+    }
+    free(map_cache_snapshot_file);
+    map_cache_snapshot_file = NULL;
+    if (file == NULL || file[0] == '\0'){
+        lispd_log_msg(LISP_LOG_DEBUG_1, "Map cache snapshot disabled");
+        return;
+    }
+    map_cache_snapshot_file = strdup(file);
+    lispd_log_msg(LISP_LOG_DEBUG_1, "Map cache snapshot: %s every %d seconds and on exit",
+            map_cache_snapshot_file, map_cache_snapshot_interval);
+}
+
+void validate_outer_src_port_parameters (
+        int entropy,
+        int port_min,
+        int port_max)
+{
+#ifdef VPNAPI
+    /* Packets are sent through the data socket, bound to the LISP data port */
+    entropy = FALSE;
+#endif
+    outer_src_port_entropy = entropy;
+    if (outer_src_port_entropy == FALSE){
+        return;
+    }
+    if (port_min < 1024 || port_max > 65535 || port_min > port_max){
+        outer_src_port_min = DEFAULT_OUTER_SRC_PORT_MIN;
+        outer_src_port_max = DEFAULT_OUTER_SRC_PORT_MAX;
+        lispd_log_msg(LISP_LOG_WARNING, "Outer source port range should be between 1024 and 65535. Using %d - %d",
+                DEFAULT_OUTER_SRC_PORT_MIN, DEFAULT_OUTER_SRC_PORT_MAX);
+    }else{
+        outer_src_port_min = port_min;
+        outer_src_port_max = port_max;
     }
+    lispd_log_msg(LISP_LOG_DEBUG_1, "Outer UDP source port selected per flow in the range %d - %d",
+            outer_src_port_min, outer_src_port_max);
 }
 
 /*
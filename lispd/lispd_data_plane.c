@@ -0,0 +1,405 @@
+/*
+ * lispd_data_plane.c
+ *
+ * This file is part of LISP Mobile Node Implementation.
+ * Data plane worker threads: each thread encapsulates the packets of one
+ * queue of a multi queue tun interface and decapsulates received packets.
+ *
+ * Copyright (C) 2012 Cisco Systems, Inc, 2012. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * Please send any bug reports or fixes you make to the email address(es):
+ *    LISP-MN developers <devel@lispmob.org>
+ *
+ */
+
+/* Define _GNU_SOURCE in order to use the CPU affinity macros */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/select.h>
+#include "lispd_data_plane.h"
+#include "lispd_epoch.h"
+#include "lispd_external.h"
+#include "lispd_input.h"
+#include "lispd_log.h"
+#include "lispd_map_cache_db.h"
+#include "lispd_output.h"
+#include "lispd_rx_ring.h"
+#include "lispd_tun.h"
+#include "lispd_xdp.h"
+
+/* Timeout of the select of the workers. Used to check if they should finish */
+#define DATA_PLANE_WORKER_TIMEOUT   100000 /* us */
+
+typedef struct {
+    lisp_addr_t     requested_eid;
+    lisp_addr_t     src_eid;
+    int             iid;
+} data_plane_miss;
+
+typedef struct {
+    pthread_t       thread;
+    int             id;
+    int             cpu;
+    int             tun_queue_fd;
+    int             ipv4_data_fd;   /* Own rx ring, or the shared data socket for the first thread */
+    int             ipv6_data_fd;   /* Shared data socket for the first thread. -1 for the others */
+    tun_batch_ctx   batch;
+    uint64_t        input_wakeups;
+} data_plane_worker;
+
+static struct {
+    data_plane_worker   *workers;
+    int                 num_workers;
+    int                 num_threads;    /* Workers whose thread was started */
+    volatile int        running;
+    pthread_t           main_thread;
+    int                 miss_pipe[2];
+    uint64_t            queued_misses;
+    uint64_t            dropped_misses;
+} data_plane = {
+        .workers        = NULL,
+        .num_workers    = 0,
+        .num_threads    = 0,
+        .running        = FALSE,
+        .miss_pipe      = {-1, -1}
+};
+
+
+void *data_plane_worker_loop(void *arg);
+
+
+/*
+ * Open the tun queue and the rx ring of a worker. The first worker uses the tun and the data
+ * sockets of the main thread.
+ */
+static int open_worker_queues(data_plane_worker *worker)
+{
+    worker->tun_queue_fd = -1;
+    worker->ipv4_data_fd = -1;
+    worker->ipv6_data_fd = -1;
+
+    if (worker->id == 0){
+        worker->tun_queue_fd = tun_fd;
+        worker->ipv4_data_fd = ipv4_data_input_fd;
+        worker->ipv6_data_fd = ipv6_data_input_fd;
+    }else{
+        if ((worker->tun_queue_fd = tun_open_queue(TUN_IFACE_NAME)) == -1){
+            return (BAD);
+        }
+#ifdef LISPD_RX_RING
+        /* The IPv4 flows are hashed to the rings of the workers */
+        if (rx_ring_size > 0 && (worker->ipv4_data_fd = open_rx_ring_queue()) == -1){
+            lispd_log_msg(LISP_LOG_CRIT, "init_data_plane_workers: Couldn't open the rx ring of worker %d", worker->id);
+            return (BAD);
+        }
+#endif
+    }
+    return (init_tun_batch(&(worker->batch), tun_batch_size));
+}
+
+
+int init_data_plane_workers(int num_workers)
+{
+    data_plane_worker   *worker     = NULL;
+    int                 num_cpus    = 0;
+    int                 i           = 0;
+
+    if (num_workers <= 0){
+        return (GOOD);
+    }
+
+    data_plane.main_thread = pthread_self();
+
+    /* Each worker is a reader of the map cache and of the local database */
+    if (init_epoch(num_workers) != GOOD){
+        return (BAD);
+    }
+
+    if (pipe(data_plane.miss_pipe) == -1 ||
+            fcntl(data_plane.miss_pipe[0], F_SETFL, O_NONBLOCK) == -1 ||
+            fcntl(data_plane.miss_pipe[1], F_SETFL, O_NONBLOCK) == -1){
+        lispd_log_msg(LISP_LOG_CRIT, "init_data_plane_workers: Couldn't create the map cache miss pipe: %s", strerror(errno));
+        stop_data_plane_workers();
+        return (BAD);
+    }
+
+    /* Don't block on a data socket if the packet that woke up the worker was discarded */
+    if (ipv4_data_input_fd != -1){
+        fcntl(ipv4_data_input_fd, F_SETFL, fcntl(ipv4_data_input_fd, F_GETFL, 0) | O_NONBLOCK);
+    }
+    if (ipv6_data_input_fd != -1){
+        fcntl(ipv6_data_input_fd, F_SETFL, fcntl(ipv6_data_input_fd, F_GETFL, 0) | O_NONBLOCK);
+    }
+
+    if ((data_plane.workers = (data_plane_worker *)calloc(num_workers, sizeof(data_plane_worker))) == NULL){
+        lispd_log_msg(LISP_LOG_CRIT, "init_data_plane_workers: Unable to allocate memory for workers: %s", strerror(errno));
+        stop_data_plane_workers();
+        return (ERR_MALLOC);
+    }
+
+    num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (num_cpus < 1){
+        num_cpus = 1;
+    }
+
+    /* The queues of all the workers are opened before starting them */
+    for (i = 0; i < num_workers; i++){
+        worker = &(data_plane.workers[i]);
+        worker->id = i;
+        worker->cpu = i % num_cpus;
+        data_plane.num_workers++;
+        if (open_worker_queues(worker) != GOOD){
+            stop_data_plane_workers();
+            return (BAD);
+        }
+    }
+
+    data_plane.running = TRUE;
+
+    for (i = 0; i < num_workers; i++){
+        worker = &(data_plane.workers[i]);
+        if (pthread_create(&(worker->thread), NULL, data_plane_worker_loop, (void *)worker) != 0){
+            lispd_log_msg(LISP_LOG_CRIT, "init_data_plane_workers: Couldn't create worker %d: %s", i, strerror(errno));
+            data_plane.num_threads = i;
+            stop_data_plane_workers();
+            return (BAD);
+        }
+    }
+    data_plane.num_threads = num_workers;
+
+    lispd_log_msg(LISP_LOG_INFO, "Started %d data plane threads", data_plane.num_workers);
+    if (num_workers > 1 && rx_ring_size == 0){
+        lispd_log_msg(LISP_LOG_INFO, "No rx rings: the data packets are decapsulated by the first thread");
+    }else if (num_workers > 1 && ipv6_data_input_fd != -1){
+        lispd_log_msg(LISP_LOG_DEBUG_1, "The IPv6 data packets are decapsulated by the first thread");
+    }
+    return (GOOD);
+}
+
+
+/*
+ * Stop the threads and release the resources of the workers. Also used to unwind a failed
+ * initialization.
+ */
+void stop_data_plane_workers()
+{
+    data_plane_worker   *worker     = NULL;
+    int                 i           = 0;
+
+    data_plane.running = FALSE;
+
+    for (i = 0; i < data_plane.num_threads; i++){
+        pthread_join(data_plane.workers[i].thread, NULL);
+    }
+    data_plane.num_threads = 0;
+
+    for (i = 0; i < data_plane.num_workers; i++){
+        worker = &(data_plane.workers[i]);
+        if (i != 0 && worker->tun_queue_fd != -1){
+            close(worker->tun_queue_fd);
+        }
+        free_tun_batch(&(worker->batch));
+    }
+#ifdef LISPD_RX_RING
+    close_rx_ring_queues();
+#endif
+    if (data_plane.workers != NULL){
+        free(data_plane.workers);
+        data_plane.workers = NULL;
+    }
+    data_plane.num_workers = 0;
+    if (data_plane.miss_pipe[0] != -1){
+        close(data_plane.miss_pipe[0]);
+        close(data_plane.miss_pipe[1]);
+        data_plane.miss_pipe[0] = -1;
+        data_plane.miss_pipe[1] = -1;
+    }
+    close_epoch();
+}
+
+
+int data_plane_workers_enabled()
+{
+    return (data_plane.num_workers > 0 ? TRUE : FALSE);
+}
+
+
+int is_data_plane_worker()
+{
+    if (data_plane.num_workers == 0){
+        return (FALSE);
+    }
+    return (pthread_equal(pthread_self(), data_plane.main_thread) ? FALSE : TRUE);
+}
+
+
+int get_data_plane_miss_fd()
+{
+    return (data_plane.miss_pipe[0]);
+}
+
+
+/*
+ * Called from the workers. The write is atomic (smaller than PIPE_BUF). If the pipe is full,
+ * the miss is dropped: next packets to the destination will generate it again.
+ */
+
+void queue_map_cache_miss(
+        lisp_addr_t *requested_eid,
+        lisp_addr_t *src_eid,
+        int         iid)
+{
+    data_plane_miss     miss;
+
+    memset(&miss, 0, sizeof(data_plane_miss));
+    miss.requested_eid = *requested_eid;
+    miss.src_eid = *src_eid;
+    miss.iid = iid;
+
+    if (write(data_plane.miss_pipe[1], &miss, sizeof(data_plane_miss)) != sizeof(data_plane_miss)){
+        __sync_fetch_and_add(&data_plane.dropped_misses, 1);
+        return;
+    }
+    __sync_fetch_and_add(&data_plane.queued_misses, 1);
+}
+
+
+/*
+ * Process the map cache misses notified by the workers. Called from the main thread.
+ */
+
+void process_data_plane_misses(int fd)
+{
+    data_plane_miss     miss;
+
+    while (read(fd, &miss, sizeof(data_plane_miss)) == sizeof(data_plane_miss)){
+        /* Several workers may have notified the same miss */
+        if (lookup_map_cache(miss.requested_eid, miss.iid) != NULL){
+            continue;
+        }
+        if (ddt_client == TRUE){
+            handle_map_cache_miss_with_ddt(&(miss.requested_eid), &(miss.src_eid), miss.iid);
+        }else{
+            handle_map_cache_miss(&(miss.requested_eid), &(miss.src_eid), miss.iid);
+        }
+    }
+}
+
+
+void dump_data_plane_workers_stats(int log_level)
+{
+    data_plane_worker   *worker     = NULL;
+    char                name[32];
+    int                 i           = 0;
+
+    if (data_plane.num_workers == 0 || is_loggable(log_level) == FALSE){
+        return;
+    }
+    lispd_log_msg(log_level, "Data plane threads: %d. Map cache misses queued: %llu, dropped: %llu",
+            data_plane.num_workers,
+            (unsigned long long)data_plane.queued_misses,
+            (unsigned long long)data_plane.dropped_misses);
+    dump_epoch_stats(log_level);
+
+    for (i = 0; i < data_plane.num_workers; i++){
+        worker = &(data_plane.workers[i]);
+        lispd_log_msg(log_level, "Thread %d (cpu %d): decapsulation wakeups: %llu", worker->id, worker->cpu,
+                (unsigned long long)worker->input_wakeups);
+        snprintf(name, sizeof(name), "thread %d", worker->id);
+        dump_tun_batch_stats(&(worker->batch), name, log_level);
+    }
+}
+
+
+void *data_plane_worker_loop(void *arg)
+{
+    data_plane_worker   *worker     = (data_plane_worker *)arg;
+    sigset_t            sigset;
+    cpu_set_t           cpu_set;
+    fd_set              readfds;
+    struct timeval      tv;
+    int                 max_fd      = 0;
+
+    /* Signals are processed by the main thread */
+    sigfillset(&sigset);
+    pthread_sigmask(SIG_BLOCK, &sigset, NULL);
+
+    CPU_ZERO(&cpu_set);
+    CPU_SET(worker->cpu, &cpu_set);
+    if (sched_setaffinity(0, sizeof(cpu_set_t), &cpu_set) == -1){
+        lispd_log_msg(LISP_LOG_WARNING, "data_plane_worker_loop: Couldn't pin thread %d to cpu %d: %s",
+                worker->id, worker->cpu, strerror(errno));
+    }
+
+    max_fd = worker->tun_queue_fd;
+    max_fd = (max_fd > worker->ipv4_data_fd) ? max_fd : worker->ipv4_data_fd;
+    max_fd = (max_fd > worker->ipv6_data_fd) ? max_fd : worker->ipv6_data_fd;
+#ifdef LISPD_XDP
+    max_fd = (max_fd > get_xdp_max_fd()) ? max_fd : get_xdp_max_fd();
+#endif
+
+    while (data_plane.running == TRUE){
+        FD_ZERO(&readfds);
+        FD_SET(worker->tun_queue_fd, &readfds);
+        if (worker->ipv4_data_fd != -1){
+            FD_SET(worker->ipv4_data_fd, &readfds);
+        }
+        if (worker->ipv6_data_fd != -1){
+            FD_SET(worker->ipv6_data_fd, &readfds);
+        }
+#ifdef LISPD_XDP
+        xdp_fd_set(&readfds, worker->id, data_plane.num_workers);
+#endif
+        tv.tv_sec = 0;
+        tv.tv_usec = DATA_PLANE_WORKER_TIMEOUT;
+
+        if (select(max_fd + 1, &readfds, NULL, NULL, &tv) <= 0){
+            continue;
+        }
+
+        /* The rx ring checks the destination of the packets against the interfaces list */
+        epoch_enter(worker->id);
+#ifdef LISPD_XDP
+        process_xdp_sockets(&readfds);
+#endif
+        if (worker->ipv4_data_fd != -1 && FD_ISSET(worker->ipv4_data_fd, &readfds)){
+            process_input_packet(worker->ipv4_data_fd, AF_INET);
+            worker->input_wakeups++;
+        }
+        if (worker->ipv6_data_fd != -1 && FD_ISSET(worker->ipv6_data_fd, &readfds)){
+            process_input_packet(worker->ipv6_data_fd, AF_INET6);
+            worker->input_wakeups++;
+        }
+        if (FD_ISSET(worker->tun_queue_fd, &readfds)){
+            drain_tun_queue(worker->tun_queue_fd, &(worker->batch));
+        }
+        epoch_exit(worker->id);
+    }
+    return (NULL);
+}
+
+/*
+ * Editor modelines
+ *
+ * vi: set shiftwidth=4 tabstop=4 expandtab:
+ * :indentSize=4:tabSize=4:noTabs=true:
+ */
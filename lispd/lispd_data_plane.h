@@ -0,0 +1,78 @@
+/*
+ * lispd_data_plane.h
+ *
+ * This file is part of LISP Mobile Node Implementation.
+ * Data plane worker threads: each thread encapsulates the packets of one
+ * queue of a multi queue tun interface and decapsulates received packets.
+ *
+ * Copyright (C) 2012 Cisco Systems, Inc, 2012. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * Please send any bug reports or fixes you make to the email address(es):
+ *    LISP-MN developers <devel@lispmob.org>
+ *
+ */
+
+#ifndef LISPD_DATA_PLANE_H_
+#define LISPD_DATA_PLANE_H_
+
+#include "lispd.h"
+
+/*
+ * Start data_plane_threads workers. The first worker reads tun_fd and the rest open a new queue
+ * of the tun interface. Each worker is pinned to a core.
+ * The main thread stops reading the tun and the data sockets.
+ */
+int init_data_plane_workers(int num_workers);
+
+/*
+ * Wait for the workers to finish. Called before releasing the databases
+ */
+void stop_data_plane_workers();
+
+/*
+ * Returns TRUE if the packets are processed by data plane workers
+ */
+int data_plane_workers_enabled();
+
+/*
+ * Returns TRUE if the caller is a data plane worker
+ */
+int is_data_plane_worker();
+
+/*
+ * Map cache misses detected by the workers are processed by the main thread.
+ * The worker writes the miss into a pipe which is read by the event loop.
+ */
+int get_data_plane_miss_fd();
+
+void queue_map_cache_miss(
+        lisp_addr_t *requested_eid,
+        lisp_addr_t *src_eid,
+        int         iid);
+
+void process_data_plane_misses(int fd);
+
+void dump_data_plane_workers_stats(int log_level);
+
+#endif /* LISPD_DATA_PLANE_H_ */
+
+/*
+ * Editor modelines
+ *
+ * vi: set shiftwidth=4 tabstop=4 expandtab:
+ * :indentSize=4:tabSize=4:noTabs=true:
+ */
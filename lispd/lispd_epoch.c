@@ -0,0 +1,237 @@
+/*
+ * lispd_epoch.c
+ *
+ * This file is part of LISP Mobile Node Implementation.
+ * Epoch based reclamation of the memory shared with the data plane threads.
+ *
+ * Copyright (C) 2012 Cisco Systems, Inc, 2012. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * Please send any bug reports or fixes you make to the email address(es):
+ *    LISP-MN developers <devel@lispmob.org>
+ *
+ */
+
+#include <time.h>
+#include "lispd_epoch.h"
+#include "lispd_log.h"
+
+/* Objects of the current epoch and of the two previous ones */
+#define EPOCH_LISTS                 3
+#define EPOCH_LINE_SIZE             64
+/* Sleep of epoch_synchronize while a reader delays the grace period */
+#define EPOCH_SYNCHRONIZE_SLEEP     1000000 /* ns */
+
+typedef struct epoch_deferred_ {
+    void                    *data;
+    epoch_callback          callback;
+    struct epoch_deferred_  *next;
+} epoch_deferred;
+
+/*
+ * Epoch observed by a reader, shifted one bit. The low bit is set while the reader is inside
+ * a read side section. Each record fills a cache line: it is written by its reader on each batch.
+ */
+typedef struct {
+    uint64_t        state;
+} __attribute__ ((aligned (EPOCH_LINE_SIZE))) epoch_reader;
+
+static struct {
+    epoch_reader        *readers;
+    int                 num_readers;
+    uint64_t            epoch;
+    epoch_deferred      *deferred[EPOCH_LISTS];     /* Indexed by the epoch of the deferral */
+    int                 pending;
+    uint64_t            deferred_total;
+    uint64_t            released;
+    uint64_t            delayed;                    /* Advances delayed by a reader */
+    uint64_t            synchronizations;
+} epoch_info = {
+        .readers        = NULL,
+        .num_readers    = 0,
+        .epoch          = 1,
+        .pending        = 0
+};
+
+
+int init_epoch(int num_readers)
+{
+    if (posix_memalign((void **)&(epoch_info.readers), EPOCH_LINE_SIZE, num_readers * sizeof(epoch_reader)) != 0){
+        lispd_log_msg(LISP_LOG_CRIT, "init_epoch: Unable to allocate memory for the epoch readers");
+        epoch_info.readers = NULL;
+        return (ERR_MALLOC);
+    }
+    memset(epoch_info.readers, 0, num_readers * sizeof(epoch_reader));
+    epoch_info.num_readers = num_readers;
+    return (GOOD);
+}
+
+
+static void release_deferred_list(int list)
+{
+    epoch_deferred  *deferred   = epoch_info.deferred[list];
+    epoch_deferred  *next       = NULL;
+
+    epoch_info.deferred[list] = NULL;
+    while (deferred != NULL){
+        next = deferred->next;
+        deferred->callback(deferred->data);
+        free(deferred);
+        epoch_info.pending--;
+        epoch_info.released++;
+        deferred = next;
+    }
+}
+
+
+void close_epoch()
+{
+    int     i   = 0;
+
+    if (epoch_info.readers == NULL){
+        return;
+    }
+    /* Objects deferred by the callbacks are released immediately */
+    epoch_info.num_readers = 0;
+    /* Oldest objects first */
+    for (i = 1; i <= EPOCH_LISTS; i++){
+        release_deferred_list((epoch_info.epoch + i) % EPOCH_LISTS);
+    }
+    free(epoch_info.readers);
+    epoch_info.readers = NULL;
+}
+
+
+void epoch_enter(int reader)
+{
+    uint64_t    epoch   = __atomic_load_n(&(epoch_info.epoch), __ATOMIC_ACQUIRE);
+
+    __atomic_store_n(&(epoch_info.readers[reader].state), (epoch << 1) | 1, __ATOMIC_RELAXED);
+    /* The main thread must see the reader before it reads any shared object */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+
+void epoch_exit(int reader)
+{
+    __atomic_store_n(&(epoch_info.readers[reader].state), 0, __ATOMIC_RELEASE);
+}
+
+
+/*
+ * Advance the epoch if all the readers inside a read side section have observed the current one.
+ * The objects deferred two epochs ago can't be referenced anymore: they are released.
+ */
+static int epoch_try_advance()
+{
+    uint64_t    state   = 0;
+    int         i       = 0;
+
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    for (i = 0; i < epoch_info.num_readers; i++){
+        state = __atomic_load_n(&(epoch_info.readers[i].state), __ATOMIC_ACQUIRE);
+        if ((state & 1) != 0 && (state >> 1) != epoch_info.epoch){
+            epoch_info.delayed++;
+            return (FALSE);
+        }
+    }
+    __atomic_store_n(&(epoch_info.epoch), epoch_info.epoch + 1, __ATOMIC_RELEASE);
+    release_deferred_list((epoch_info.epoch + 1) % EPOCH_LISTS);
+    return (TRUE);
+}
+
+
+void epoch_synchronize()
+{
+    struct timespec     sleep_time;
+    int                 advances    = 0;
+
+    if (epoch_info.num_readers == 0){
+        return;
+    }
+    epoch_info.synchronizations++;
+    sleep_time.tv_sec = 0;
+    sleep_time.tv_nsec = EPOCH_SYNCHRONIZE_SLEEP;
+    while (advances < EPOCH_LISTS){
+        if (epoch_try_advance() == TRUE){
+            advances++;
+        }else{
+            nanosleep(&sleep_time, NULL);
+        }
+    }
+}
+
+
+void epoch_defer(
+        void            *data,
+        epoch_callback  callback)
+{
+    epoch_deferred  *deferred   = NULL;
+    int             list        = 0;
+
+    if (epoch_info.num_readers == 0){
+        callback(data);
+        return;
+    }
+    if ((deferred = (epoch_deferred *)malloc(sizeof(epoch_deferred))) == NULL){
+        lispd_log_msg(LISP_LOG_WARNING, "epoch_defer: Unable to allocate memory for epoch_deferred: %s. Waiting for the readers",
+                strerror(errno));
+        epoch_synchronize();
+        callback(data);
+        return;
+    }
+    list = epoch_info.epoch % EPOCH_LISTS;
+    deferred->data = data;
+    deferred->callback = callback;
+    deferred->next = epoch_info.deferred[list];
+    epoch_info.deferred[list] = deferred;
+    epoch_info.pending++;
+    epoch_info.deferred_total++;
+}
+
+
+void epoch_reclaim()
+{
+    int     advances    = 0;
+
+    /* The objects of the current epoch need two advances */
+    while (epoch_info.pending > 0 && advances < EPOCH_LISTS - 1 && epoch_try_advance() == TRUE){
+        advances++;
+    }
+}
+
+
+void dump_epoch_stats(int log_level)
+{
+    if (epoch_info.num_readers == 0 || is_loggable(log_level) == FALSE){
+        return;
+    }
+    lispd_log_msg(log_level, "Epoch reclamation: epoch %llu   deferred: %llu   released: %llu   pending: %d   "
+            "advances delayed by a reader: %llu   synchronizations: %llu",
+            (unsigned long long)epoch_info.epoch,
+            (unsigned long long)epoch_info.deferred_total,
+            (unsigned long long)epoch_info.released,
+            epoch_info.pending,
+            (unsigned long long)epoch_info.delayed,
+            (unsigned long long)epoch_info.synchronizations);
+}
+
+/*
+ * Editor modelines
+ *
+ * vi: set shiftwidth=4 tabstop=4 expandtab:
+ * :indentSize=4:tabSize=4:noTabs=true:
+ */
@@ -0,0 +1,92 @@
+/*
+ * lispd_epoch.h
+ *
+ * This file is part of LISP Mobile Node Implementation.
+ * Epoch based reclamation of the memory shared with the data plane threads.
+ *
+ * Copyright (C) 2012 Cisco Systems, Inc, 2012. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * Please send any bug reports or fixes you make to the email address(es):
+ *    LISP-MN developers <devel@lispmob.org>
+ *
+ */
+
+#ifndef LISPD_EPOCH_H_
+#define LISPD_EPOCH_H_
+
+#include "lispd.h"
+
+/*
+ * The data plane threads look up the map cache, the local database and the balancing vectors
+ * without locks. The main thread, the only writer, unlinks or replaces an object with atomic
+ * pointer stores and defers its release until every thread which may still use it has left
+ * its read side section (grace period).
+ *
+ * A global epoch is advanced by the main thread when all the readers inside a read side section
+ * have observed the current one. An object deferred in the epoch e is released once the epoch
+ * reaches e + 2. Without data plane threads the objects are released immediately.
+ */
+
+typedef void (*epoch_callback)(void *);
+
+/*
+ * Create the records of num_readers readers. Called before starting the data plane threads.
+ */
+int init_epoch(int num_readers);
+
+/*
+ * Release all the deferred objects. Called once the readers have finished.
+ * Later objects are released immediately.
+ */
+void close_epoch();
+
+/*
+ * Read side section of a reader. Nothing obtained inside it can be used after leaving it.
+ * Readers must not block inside the section: it delays the reclamation.
+ */
+void epoch_enter(int reader);
+void epoch_exit(int reader);
+
+/*
+ * Call callback(data) once the readers can't reference data anymore. Main thread only:
+ * data must have been unlinked from the structures of the data plane before.
+ */
+void epoch_defer(
+        void            *data,
+        epoch_callback  callback);
+
+/*
+ * Advance the epoch if the readers allow it and release the objects whose grace period has
+ * finished. Called by the main thread after processing the events.
+ */
+void epoch_reclaim();
+
+/*
+ * Wait for a grace period and release all the deferred objects
+ */
+void epoch_synchronize();
+
+void dump_epoch_stats(int log_level);
+
+#endif /* LISPD_EPOCH_H_ */
+
+/*
+ * Editor modelines
+ *
+ * vi: set shiftwidth=4 tabstop=4 expandtab:
+ * :indentSize=4:tabSize=4:noTabs=true:
+ */
@@ -41,6 +41,14 @@ void init_globales()
 	map_servers							= NULL;
 	config_file							= NULL;
 	map_request_retries 				= DEFAULT_MAP_REQUEST_RETRIES;
+	map_request_rate                    = DEFAULT_MAP_REQUEST_RATE;
+	map_request_batch                   = DEFAULT_MAP_REQUEST_BATCH;
+	smr_rate                            = DEFAULT_SMR_RATE;
+	map_cache_size                      = DEFAULT_MAP_CACHE_SIZE;
+	map_cache_memory                    = 0;
+	map_cache_refresh                   = DEFAULT_MAP_CACHE_REFRESH;
+	map_cache_snapshot_file             = NULL;
+	map_cache_snapshot_interval         = DEFAULT_MAP_CACHE_SNAPSHOT_INTERVAL;
 	control_port            			= LISP_CONTROL_PORT;
 	debug_level             			= -1;
 	daemonize               			= FALSE;
@@ -50,6 +58,21 @@ void init_globales()
 	rloc_probe_interval                	= RLOC_PROBING_INTERVAL;
 	rloc_probe_retries                 	= DEFAULT_RLOC_PROBING_RETRIES;
 	rloc_probe_retries_interval       	= DEFAULT_RLOC_PROBING_RETRIES_INTERVAL;
+	rloc_probe_rate                     = DEFAULT_RLOC_PROBE_RATE;
+	rloc_probe_rtt_weighting            = FALSE;
+	/* Data plane parameters */
+	tun_batch_size                      = DEFAULT_TUN_BATCH_SIZE;
+	data_plane_threads                  = 0;
+	tx_batch_size                       = DEFAULT_TX_BATCH_SIZE;
+	tx_batch_timeout                    = DEFAULT_TX_BATCH_TIMEOUT;
+	flow_cache_size                     = DEFAULT_FLOW_CACHE_SIZE;
+	outer_src_port_entropy              = FALSE;
+	outer_src_port_min                  = DEFAULT_OUTER_SRC_PORT_MIN;
+	outer_src_port_max                  = DEFAULT_OUTER_SRC_PORT_MAX;
+	rx_ring_size                        = 0;
+	io_engine                           = IO_ENGINE_EPOLL;
+	miss_queue_size                     = DEFAULT_MISS_QUEUE_SIZE;
+	miss_queue_memory                   = DEFAULT_MISS_QUEUE_MEMORY;
 	netlink_fd                          = -1;
 	ipv4_data_input_fd                  = -1;
 	ipv6_data_input_fd                  = -1;
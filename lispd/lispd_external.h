@@ -40,6 +40,7 @@
 
 
 extern  uint8_t                 router_mode;
+extern  uint8_t                 lispd_running;
 extern  lispd_addr_list_t       *map_resolvers;
 extern  int                     ddt_client;
 extern  lispd_addr_list_t       *rtrs_list;
@@ -49,6 +50,14 @@ extern  lispd_map_server_list_t *map_servers;
 extern  char                    *config_file;
 extern  char                    msg[];
 extern  int                     map_request_retries;
+extern  int                     map_request_rate;
+extern  int                     map_request_batch;
+extern  int                     smr_rate;
+extern  int                     map_cache_size;
+extern  int                     map_cache_memory;
+extern  int                     map_cache_refresh;
+extern  char                    *map_cache_snapshot_file;
+extern  int                     map_cache_snapshot_interval;
 extern  int                     control_port;
 extern  int                     debug_level;
 extern  int                     daemonize;
@@ -57,6 +66,20 @@ extern  int                     default_rloc_afi;
 extern  int                     rloc_probe_interval;
 extern  int                     rloc_probe_retries;
 extern  int                     rloc_probe_retries_interval;
+extern  int                     rloc_probe_rate;
+extern  int                     rloc_probe_rtt_weighting;
+extern  int                     tun_batch_size;
+extern  int                     data_plane_threads;
+extern  int                     tx_batch_size;
+extern  int                     tx_batch_timeout;
+extern  int                     flow_cache_size;
+extern  int                     outer_src_port_entropy;
+extern  int                     outer_src_port_min;
+extern  int                     outer_src_port_max;
+extern  int                     rx_ring_size;
+extern  int                     io_engine;
+extern  int                     miss_queue_size;
+extern  int                     miss_queue_memory;
 extern  int                     netlink_fd;
 extern  int                     ipv6_data_input_fd;
 extern  int                     ipv4_data_input_fd;
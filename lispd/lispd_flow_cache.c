@@ -0,0 +1,207 @@
+/*
+ * lispd_flow_cache.c
+ *
+ * This file is part of LISP Mobile Node Implementation.
+ * Exact match cache of the forwarding decision of the encapsulated flows.
+ *
+ * Copyright (C) 2012 Cisco Systems, Inc, 2012. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * Please send any bug reports or fixes you make to the email address(es):
+ *    LISP-MN developers <devel@lispmob.org>
+ *
+ */
+
+#include "lispd_flow_cache.h"
+#include "lispd_log.h"
+
+/*
+ * Shared by the caches of all the threads. Only the main thread increments it, when it replaces
+ * objects pointed to by the cached decisions, and before it defers their release to the end of
+ * the grace period (lispd_epoch.h). The objects of a decision taken after reading the generation
+ * are therefore valid until the worker leaves its read side section. 0 is reserved for the
+ * empty slots.
+ */
+static volatile uint32_t    flow_cache_generation = 1;
+
+
+flow_cache *new_flow_cache(int size)
+{
+    flow_cache  *cache  = NULL;
+    uint32_t    slots   = 1;
+
+    if (size <= 0){
+        return (NULL);
+    }
+    while (slots < (uint32_t)size){
+        slots <<= 1;
+    }
+
+    if ((cache = (flow_cache *)calloc(1, sizeof(flow_cache))) == NULL){
+        lispd_log_msg(LISP_LOG_WARNING, "new_flow_cache: Unable to allocate memory for the flow cache: %s", strerror(errno));
+        return (NULL);
+    }
+    if (posix_memalign((void **)&(cache->entries), FLOW_CACHE_LINE_SIZE, slots * sizeof(flow_cache_entry)) != 0){
+        lispd_log_msg(LISP_LOG_WARNING, "new_flow_cache: Unable to allocate memory for %u flow entries", slots);
+        free(cache);
+        return (NULL);
+    }
+    memset(cache->entries, 0, slots * sizeof(flow_cache_entry));
+    cache->mask = slots - 1;
+
+    lispd_log_msg(LISP_LOG_DEBUG_2, "Flow cache of %u entries created", slots);
+    return (cache);
+}
+
+
+void free_flow_cache(flow_cache *cache)
+{
+    if (cache == NULL){
+        return;
+    }
+    free(cache->entries);
+    free(cache);
+}
+
+
+void flow_key_from_tuple(
+        packet_tuple    *tuple,
+        flow_key        *key)
+{
+    memset(key, 0, sizeof(flow_key));
+
+    switch (tuple->src_addr.afi){
+    case AF_INET:
+        key->words[0] = tuple->src_addr.address.ip.s_addr;
+        key->words[4] = tuple->dst_addr.address.ip.s_addr;
+        break;
+    case AF_INET6:
+        memcpy(&(key->words[0]), &(tuple->src_addr.address.ipv6), sizeof(struct in6_addr));
+        memcpy(&(key->words[4]), &(tuple->dst_addr.address.ipv6), sizeof(struct in6_addr));
+        break;
+    }
+    key->words[8] = tuple->src_port + ((uint32_t)tuple->dst_port << 16);
+    key->words[9] = tuple->protocol + ((uint32_t)tuple->src_addr.afi << 8);
+}
+
+
+flow_cache_entry *flow_cache_lookup(
+        flow_cache      *cache,
+        flow_key        *key,
+        uint32_t        hash)
+{
+    flow_cache_entry    *entry      = NULL;
+    uint32_t            generation  = __atomic_load_n(&flow_cache_generation, __ATOMIC_ACQUIRE);
+    int                 i           = 0;
+
+    /*
+     * The pointers of a decision taken after this point are valid in this generation: if the main
+     * thread replaces them, it invalidates the generation before releasing them
+     */
+    cache->generation = generation;
+    for (i = 0; i < FLOW_CACHE_MAX_PROBE; i++){
+        entry = &(cache->entries[(hash + i) & cache->mask]);
+        if (entry->generation == 0){
+            break;
+        }
+        if (entry->hash != hash || memcmp(&(entry->key), key, sizeof(flow_key)) != 0){
+            continue;
+        }
+        if (entry->generation != generation){
+            cache->stale++;
+            break;
+        }
+        cache->hits++;
+        return (entry);
+    }
+    cache->misses++;
+    return (NULL);
+}
+
+
+flow_cache_entry *flow_cache_insert(
+        flow_cache      *cache,
+        flow_key        *key,
+        uint32_t        hash)
+{
+    flow_cache_entry    *entry      = NULL;
+    flow_cache_entry    *free_slot  = NULL;
+    uint32_t            generation  = cache->generation;
+    int                 i           = 0;
+
+    for (i = 0; i < FLOW_CACHE_MAX_PROBE; i++){
+        entry = &(cache->entries[(hash + i) & cache->mask]);
+        if (entry->generation == 0){
+            if (free_slot == NULL){
+                free_slot = entry;
+            }
+            break;
+        }
+        if (entry->hash == hash && memcmp(&(entry->key), key, sizeof(flow_key)) == 0){
+            /* Same flow from a previous generation */
+            free_slot = entry;
+            break;
+        }
+        if (free_slot == NULL && entry->generation != generation){
+            free_slot = entry;
+        }
+    }
+
+    if (free_slot == NULL){
+        free_slot = &(cache->entries[hash & cache->mask]);
+        cache->evictions++;
+    }
+    free_slot->key = *key;
+    free_slot->hash = hash;
+    free_slot->generation = generation;
+    cache->inserts++;
+
+    return (free_slot);
+}
+
+
+void flow_cache_invalidate_all()
+{
+    /* Skip the value reserved for the empty slots when wrapping around */
+    if (__sync_add_and_fetch(&flow_cache_generation, 1) == 0){
+        __sync_add_and_fetch(&flow_cache_generation, 1);
+    }
+}
+
+
+void dump_flow_cache_stats(
+        flow_cache      *cache,
+        int             log_level)
+{
+    if (cache == NULL || is_loggable(log_level) == FALSE){
+        return;
+    }
+    lispd_log_msg(log_level,"Flow cache (%u entries, generation %u): hits: %llu   misses: %llu   stale: %llu   "
+            "inserts: %llu   evictions: %llu",
+            cache->mask + 1, flow_cache_generation,
+            (unsigned long long)cache->hits,
+            (unsigned long long)cache->misses,
+            (unsigned long long)cache->stale,
+            (unsigned long long)cache->inserts,
+            (unsigned long long)cache->evictions);
+}
+
+/*
+ * Editor modelines
+ *
+ * vi: set shiftwidth=4 tabstop=4 expandtab:
+ * :indentSize=4:tabSize=4:noTabs=true:
+ */
@@ -0,0 +1,126 @@
+/*
+ * lispd_flow_cache.h
+ *
+ * This file is part of LISP Mobile Node Implementation.
+ * Exact match cache of the forwarding decision of the encapsulated flows.
+ *
+ * Copyright (C) 2012 Cisco Systems, Inc, 2012. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * Please send any bug reports or fixes you make to the email address(es):
+ *    LISP-MN developers <devel@lispmob.org>
+ *
+ */
+
+#ifndef LISPD_FLOW_CACHE_H_
+#define LISPD_FLOW_CACHE_H_
+
+#include "lispd.h"
+#include "lispd_map_cache.h"
+
+/* 4 words src addr + 4 words dst addr + 1 word ports + 1 word protocol and afi */
+#define FLOW_KEY_WORDS              10
+/* Maximum number of slots visited from the home slot of a flow */
+#define FLOW_CACHE_MAX_PROBE        8
+#define FLOW_CACHE_LINE_SIZE        64
+
+typedef struct {
+    uint32_t    words[FLOW_KEY_WORDS];
+} flow_key;
+
+/*
+ * Forwarding decision of a flow. The entry is only valid while its generation matches the
+ * global generation: any change of the map cache, the balancing vectors or the interfaces
+ * bumps the global generation and all the cached pointers are ignored.
+ * Entries are aligned to the cache line and fill two lines (IPv6 keys don't fit in one).
+ */
+typedef struct {
+    flow_key                key;
+    uint32_t                hash;
+    uint32_t                generation;     /* 0 if the slot has never been used */
+    lispd_mapping_elt       *src_mapping;
+    lispd_map_cache_entry   *map_cache_entry;
+    lispd_locator_elt       *src_locator;
+    lispd_locator_elt       *dst_locator;
+    lisp_addr_t             *dst_addr;      /* Outer destination (RTR if the src locator is behind NAT) */
+    int                     out_socket;
+    uint16_t                src_port;       /* Outer UDP source port */
+} __attribute__ ((aligned (FLOW_CACHE_LINE_SIZE))) flow_cache_entry;
+
+typedef struct {
+    flow_cache_entry        *entries;
+    uint32_t                mask;           /* Number of slots - 1 */
+    uint32_t                generation;     /* Global generation read by the last lookup */
+    uint64_t                hits;
+    uint64_t                misses;
+    uint64_t                stale;          /* Lookups that found the flow from a previous generation */
+    uint64_t                inserts;
+    uint64_t                evictions;
+} flow_cache;
+
+
+/*
+ * Create a flow cache of at least size slots (rounded up to a power of two).
+ * Returns NULL if size is 0 (flow cache disabled) or if there is not enough memory.
+ */
+flow_cache *new_flow_cache(int size);
+
+void free_flow_cache(flow_cache *cache);
+
+/*
+ * Fill the key of a flow from the 5 tuple of a packet. Unused words are set to 0
+ */
+void flow_key_from_tuple(
+        packet_tuple    *tuple,
+        flow_key        *key);
+
+/*
+ * Returns the valid entry of the flow or NULL. The global generation is read before the
+ * forwarding decision of a missed flow is taken: the decision is inserted with it.
+ */
+flow_cache_entry *flow_cache_lookup(
+        flow_cache      *cache,
+        flow_key        *key,
+        uint32_t        hash);
+
+/*
+ * Returns the slot where the flow should be stored. The caller fills the forwarding fields.
+ * The slot is taken from the probe sequence of the flow: the same flow, an empty or stale slot,
+ * or the home slot is evicted. The flow gets the generation read by the previous lookup.
+ */
+flow_cache_entry *flow_cache_insert(
+        flow_cache      *cache,
+        flow_key        *key,
+        uint32_t        hash);
+
+/*
+ * Invalidate all the entries of all the flow caches. Called by the control plane each time
+ * a map cache entry, a balancing vector or an interface changes.
+ */
+void flow_cache_invalidate_all();
+
+void dump_flow_cache_stats(
+        flow_cache      *cache,
+        int             log_level);
+
+#endif /* LISPD_FLOW_CACHE_H_ */
+
+/*
+ * Editor modelines
+ *
+ * vi: set shiftwidth=4 tabstop=4 expandtab:
+ * :indentSize=4:tabSize=4:noTabs=true:
+ */
@@ -0,0 +1,144 @@
+/*
+ * lispd_hash.c
+ *
+ * This file is part of LISP Mobile Node Implementation.
+ * Hash of the 5 tuple of the packets used to select the RLOCs of a flow.
+ *
+ * Copyright (C) 2012 Cisco Systems, Inc, 2012. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * Please send any bug reports or fixes you make to the email address(es):
+ *    LISP-MN developers <devel@lispmob.org>
+ *
+ */
+
+#include "bob/lookup3.c"
+#include "lispd_external.h"
+#include "lispd_hash.h"
+#include "lispd_log.h"
+
+typedef uint32_t (*tuple_hash_fn)(const uint32_t *words, int len);
+
+/*
+ * Words of the tuple: IPv4 uses 4 words (src, dst, ports, protocol) and IPv6 uses 10
+ * (4 src, 4 dst, ports, protocol). It is the layout used by the previous implementation,
+ * so lookup3 selects the same locators as before.
+ */
+static inline int tuple_to_words(
+        packet_tuple    *tuple,
+        uint32_t        *words)
+{
+    uint32_t    ports   = tuple->src_port + ((uint32_t)tuple->dst_port << 16);
+
+    switch (tuple->src_addr.afi){
+    case AF_INET:
+        words[0] = tuple->src_addr.address.ip.s_addr;
+        words[1] = tuple->dst_addr.address.ip.s_addr;
+        words[2] = ports;
+        words[3] = tuple->protocol;
+        return (4);
+    case AF_INET6:
+        memcpy(&words[0], &(tuple->src_addr.address.ipv6), sizeof(struct in6_addr));
+        memcpy(&words[4], &(tuple->dst_addr.address.ipv6), sizeof(struct in6_addr));
+        words[8] = ports;
+        words[9] = tuple->protocol;
+        return (10);
+    default:
+        return (0);
+    }
+}
+
+
+static uint32_t lookup3_hash_words(
+        const uint32_t  *words,
+        int             len)
+{
+    return (hashword(words, len, TUPLE_HASH_SEED));
+}
+
+
+#ifdef LISPD_HASH_CRC32C
+/*
+ * One crc32 instruction per word followed by the murmur3 finalizer: the crc alone doesn't
+ * spread the changes of the last words to the low bits used to index the vectors.
+ */
+__attribute__ ((target ("sse4.2")))
+static uint32_t crc32c_hash_words(
+        const uint32_t  *words,
+        int             len)
+{
+    uint32_t    hash    = TUPLE_HASH_SEED;
+    int         i       = 0;
+
+    for (i = 0; i < len; i++){
+        hash = __builtin_ia32_crc32si(hash, words[i]);
+    }
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6b;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35;
+    hash ^= hash >> 16;
+    return (hash);
+}
+#endif
+
+
+static tuple_hash_fn    tuple_hash      = lookup3_hash_words;
+static char             *tuple_hash_name = "lookup3";
+
+
+uint32_t get_hash_from_tuple(packet_tuple *tuple)
+{
+    uint32_t    words[10];
+    int         len     = 0;
+
+    len = tuple_to_words(tuple, words);
+    return (tuple_hash(words, len));
+}
+
+
+/*
+ * The high bits of the hash are used: the low bits already select the locators and the slot
+ * of the flow cache.
+ */
+int get_outer_src_port(uint32_t hash)
+{
+    if (outer_src_port_entropy == FALSE){
+        return (LISP_DATA_PORT);
+    }
+    hash = (hash >> 16) | (hash << 16);
+    return (outer_src_port_min + hash % (outer_src_port_max - outer_src_port_min + 1));
+}
+
+
+void init_tuple_hash()
+{
+#ifdef LISPD_HASH_CRC32C
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.2")){
+        tuple_hash = crc32c_hash_words;
+        tuple_hash_name = "crc32c";
+    }
+#endif
+    lispd_log_msg(LISP_LOG_DEBUG_1, "Hash of the packet tuples: %s", tuple_hash_name);
+}
+
+/*
+ * Editor modelines
+ *
+ * vi: set shiftwidth=4 tabstop=4 expandtab:
+ * :indentSize=4:tabSize=4:noTabs=true:
+ */
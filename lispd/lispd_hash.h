@@ -0,0 +1,68 @@
+/*
+ * lispd_hash.h
+ *
+ * This file is part of LISP Mobile Node Implementation.
+ * Hash of the 5 tuple of the packets used to select the RLOCs of a flow.
+ *
+ * Copyright (C) 2012 Cisco Systems, Inc, 2012. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * Please send any bug reports or fixes you make to the email address(es):
+ *    LISP-MN developers <devel@lispmob.org>
+ *
+ */
+
+#ifndef LISPD_HASH_H_
+#define LISPD_HASH_H_
+
+#include "lispd.h"
+
+/* Initial value of the hash */
+#define TUPLE_HASH_SEED         2013
+
+/* The CRC32C instruction of SSE 4.2 is only available on x86 */
+#if defined(__x86_64__) || defined(__i386__)
+#define LISPD_HASH_CRC32C
+#endif
+
+/*
+ * Select the hash function used by all the threads: CRC32C if the CPU supports it,
+ * lookup3 otherwise. Must be called before the data plane threads are started.
+ * The cost of each function is measured by tests/hash_bench.
+ */
+void init_tuple_hash();
+
+/*
+ * Hash of the 5 tuple of a packet. It doesn't allocate memory and the same flow gets
+ * always the same hash. It is used to select the locators of the flow and to index
+ * the flow cache.
+ */
+uint32_t get_hash_from_tuple(packet_tuple *tuple);
+
+/*
+ * Outer UDP source port of the packets of a flow, from the hash of its tuple. LISP_DATA_PORT
+ * if outer-src-port-entropy is disabled.
+ */
+int get_outer_src_port(uint32_t hash);
+
+#endif /* LISPD_HASH_H_ */
+
+/*
+ * Editor modelines
+ *
+ * vi: set shiftwidth=4 tabstop=4 expandtab:
+ * :indentSize=4:tabSize=4:noTabs=true:
+ */
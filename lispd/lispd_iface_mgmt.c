@@ -28,6 +28,7 @@
  *
  */
 #include "lispd_external.h"
+#include "lispd_flow_cache.h"
 #include "lispd_iface_mgmt.h"
 #include "lispd_info_request.h"
 #include "lispd_lib.h"
@@ -38,6 +39,7 @@
 #include "lispd_sockets.h"
 #include "lispd_timers.h"
 #include "lispd_tun.h"
+#include "lispd_xdp.h"
 
 
 /************************* FUNCTION DECLARTAION ********************************/
@@ -253,6 +255,9 @@ void process_address_change (
                 (new_addr.afi == AF_INET) ? "IPv4" : "IPv6",iface->iface_name);
         return;
     }
+    /* The output sockets and locators of the cached flows may change */
+    flow_cache_invalidate_all();
+
     /*
      * Actions to be done due to a change of address: SMR
      */
@@ -321,6 +326,9 @@ void process_address_change (
     aux_afi = iface_addr->afi;
     // Update the new address
     copy_lisp_addr(iface_addr, &new_addr);
+#ifdef LISPD_XDP
+    xdp_update_local_addresses();
+#endif
 
 
     /* The interface was down during initial configuratiopn process and now it is up. Activate address */
@@ -386,10 +394,10 @@ void process_address_change (
 
     /* Reprograming SMR timer*/
     if (smr_timer == NULL){
-        smr_timer = create_timer (SMR_TIMER);
+        smr_timer = create_timer(NULL);
     }
 
-    start_timer(smr_timer, LISPD_SMR_TIMEOUT,(timer_callback)init_smr, NULL);
+    start_timer(smr_timer, SECONDS_TO_MS(LISPD_SMR_TIMEOUT),(timer_callback)init_smr, NULL);
 }
 
 
@@ -674,9 +682,9 @@ void process_new_gateway (
 
     /* Reprograming SMR timer*/
     if (smr_timer == NULL){
-        smr_timer = create_timer (SMR_TIMER);
+        smr_timer = create_timer(NULL);
     }
-    start_timer(smr_timer, LISPD_SMR_TIMEOUT,(timer_callback)init_smr, NULL);
+    start_timer(smr_timer, SECONDS_TO_MS(LISPD_SMR_TIMEOUT),(timer_callback)init_smr, NULL);
 
 }
 
@@ -837,7 +845,7 @@ void process_new_gateway (
 //    	smr_timer = create_timer (SMR_TIMER);
 //    }
 //
-//    start_timer(smr_timer, LISPD_SMR_TIMEOUT,(timer_callback)init_smr, NULL);
+//    start_timer(smr_timer, SECONDS_TO_MS(LISPD_SMR_TIMEOUT),(timer_callback)init_smr, NULL);
 //
 //}
 
@@ -866,6 +874,7 @@ void process_link_status_change(
 
     // Change status of the interface
     iface->status = new_status;
+    flow_cache_invalidate_all();
 
     /*
      * If the affected interface is the default control or output iface, recalculate it
@@ -907,9 +916,9 @@ void process_link_status_change(
 
     /* Reprograming SMR timer*/
     if (smr_timer == NULL){
-        smr_timer = create_timer (SMR_TIMER);
+        smr_timer = create_timer(NULL);
     }
-    start_timer(smr_timer, LISPD_SMR_TIMEOUT,(timer_callback)init_smr, NULL);
+    start_timer(smr_timer, SECONDS_TO_MS(LISPD_SMR_TIMEOUT),(timer_callback)init_smr, NULL);
 
 }
 
@@ -931,6 +940,7 @@ void activate_interface_address(
     lispd_locators_list             **locators_list             = NULL;
     lispd_locator_elt               *locator                    = NULL;
 
+    flow_cache_invalidate_all();
 #ifndef VPNAPI
     switch(new_address.afi){
     case AF_INET:
@@ -31,7 +31,9 @@
 
 
 #include "lispd_afi.h"
+#include "lispd_epoch.h"
 #include "lispd_external.h"
+#include "lispd_flow_cache.h"
 #include "lispd_info_reply.h"
 #include "lispd_info_request.h"
 #include "lispd_lib.h"
@@ -82,6 +84,7 @@ int process_info_reply_msg(
     lisp_addr_t                 ms_rloc                 = {.afi=AF_UNSPEC};
     lisp_addr_t                 private_etr_rloc        = {.afi=AF_UNSPEC};
     lispd_rtr_locators_list     *rtr_locators_list      = NULL;
+    lispd_rtr_locators_list     *old_rtr_locators_list  = NULL;
 
     lispd_mapping_elt           *mapping                = NULL;
     lispd_locator_elt           *src_locator            = NULL;
@@ -233,7 +236,7 @@ int process_info_reply_msg(
 
      if (check_nonce(nat_info->inf_req_nonce,nonce) == GOOD ){
          lispd_log_msg(LISP_LOG_DEBUG_2, "Info-Reply: Correct nonce field checking ");
-         free(nat_info->inf_req_nonce);
+         free_nonces_list(nat_info->inf_req_nonce);
          nat_info->inf_req_nonce = NULL;
      }else{
          lispd_log_msg(LISP_LOG_DEBUG_1, "Info-Reply: Error checking nonce field. No Info Request generated with nonce: %s "
@@ -282,10 +285,14 @@ int process_info_reply_msg(
                 " with local AFI", get_char_from_lisp_addr_t(local_rloc));
     }
 
-    if (nat_info->rtr_locators_list != NULL){
-        free_rtr_list(nat_info->rtr_locators_list);
+    /* The data plane threads may be using the old RTRs: they are released after a grace period */
+    old_rtr_locators_list = nat_info->rtr_locators_list;
+    __atomic_store_n(&(nat_info->rtr_locators_list), rtr_locators_list, __ATOMIC_RELEASE);
+    /* Cached flows may point to the old RTRs */
+    flow_cache_invalidate_all();
+    if (old_rtr_locators_list != NULL){
+        epoch_defer(old_rtr_locators_list, (epoch_callback)free_rtr_list);
     }
-    nat_info->rtr_locators_list = rtr_locators_list;
 
     /* Reinsert the locator in the correct position of the list */
     if (reinsert_locator_to_mapping(mapping, src_locator)!=GOOD){
@@ -296,9 +303,9 @@ int process_info_reply_msg(
     /* If we are behind NAT, the program timer to send Info Request after TTL minutes */
     // XXX We send always Inf Req, even if we are not behind NAT
     if (nat_info->inf_req_timer == NULL) {
-        nat_info->inf_req_timer = create_timer(INFO_REPLY_TTL_TIMER);
+        nat_info->inf_req_timer = create_timer(free);
     }
-    start_timer(nat_info->inf_req_timer, ttl*60, info_request, nat_info->inf_req_timer->cb_argument);
+    start_timer(nat_info->inf_req_timer, MINUTES_TO_MS(ttl), info_request, nat_info->inf_req_timer->cb_argument);
     lispd_log_msg(LISP_LOG_DEBUG_1, "Reprogrammed info request in %d minutes",ttl);
 
 
@@ -67,7 +67,7 @@ lispd_pkt_info_nat_t *build_info_request_pkt(
     uint32_t                        header_len   = 0;
     uint32_t                        lcaf_hdr_len = 0;
 
-    *nonce = build_nonce((unsigned int) time(NULL));
+    *nonce = build_nonce();
 
     irp = create_and_fill_info_nat_header(LISP_INFO_NAT,
                                           NAT_NO_REPLY,
@@ -265,7 +265,7 @@ void  restart_info_request_process(
 		nat_info = ((lcl_locator_extended_info *)src_locator->extended_info)->nat_info;
 
 		if (nat_info->inf_req_timer == NULL){
-		    nat_info->inf_req_timer = create_timer(INFO_REPLY_TTL_TIMER);
+		    nat_info->inf_req_timer = create_timer(free);
 			if (nat_info->inf_req_timer == NULL){
 				mapping_list = mapping_list->next;
 				continue;
@@ -273,17 +273,17 @@ void  restart_info_request_process(
 
 			timer_arg = (void *)new_timer_inf_req_arg(mapping, src_locator);
 			if (timer_arg == NULL){
-				free(nat_info->inf_req_timer);
+				free_timer(nat_info->inf_req_timer);
 				nat_info->inf_req_timer = NULL;
 				mapping_list = mapping_list->next;
 				continue;
 			}
 		}else{
-			free(nat_info->inf_req_nonce);
+			free_nonces_list(nat_info->inf_req_nonce);
 			nat_info->inf_req_nonce = NULL;
 			timer_arg = nat_info->inf_req_timer->cb_argument;
 		}
-		start_timer(nat_info->inf_req_timer, LISPD_INF_REQ_HANDOVER_TIMEOUT, info_request, timer_arg);
+		start_timer(nat_info->inf_req_timer, SECONDS_TO_MS(LISPD_INF_REQ_HANDOVER_TIMEOUT), info_request, timer_arg);
 		mapping_list = mapping_list->next;
 	}
 }
@@ -300,7 +300,7 @@ int info_request(
 	int                         next_timer_time     = 0;
 
 	if (nonces == NULL){
-		nonces = new_nonces_list();
+		nonces = new_nonces_list(NONCE_OWNER_INFO_REQUEST, src_locator);
 		if (nonces == NULL){
 			lispd_log_msg(LISP_LOG_WARNING,"info_request: Unable to allocate memory for nonces.");
 			return (BAD);
@@ -319,10 +319,11 @@ int info_request(
 				&(nonces->nonce[nonces->retransmits])))!=GOOD){
 			lispd_log_msg(LISP_LOG_DEBUG_1,"info_request: Couldn't send info request message.");
 		}
+		index_nonce(nonces, nonces->retransmits);
 		nonces->retransmits++;
 		next_timer_time = LISPD_INITIAL_MR_TIMEOUT;
 	} else{
-		free (nonces);
+		free_nonces_list(nonces);
 		nat_info->inf_req_nonce = NULL;
 		lispd_log_msg(LISP_LOG_ERR,"info_request: Communication error between LISPmob and Map Server. Retry after %d seconds",MAP_REGISTER_INTERVAL);
 //#ifdef VPNAPI
@@ -336,9 +337,9 @@ int info_request(
      * Configure timer to send the next map register.
      */
     if (nat_info->inf_req_timer == NULL) {
-        nat_info->inf_req_timer = create_timer(INFO_REPLY_TTL_TIMER);
+        nat_info->inf_req_timer = create_timer(free);
     }
-    start_timer(nat_info->inf_req_timer, next_timer_time, info_request, arg);
+    start_timer(nat_info->inf_req_timer, SECONDS_TO_MS(next_timer_time), info_request, arg);
     lispd_log_msg(LISP_LOG_DEBUG_1, "Reprogrammed info request in %d seconds",next_timer_time);
     return(GOOD);
 }
@@ -30,44 +30,105 @@
 #include "lispd_input.h"
 #include "lispd_map_notify.h"
 #include "lispd_pkt_lib.h"
+#include "lispd_rx_ring.h"
 #include "api/ipc.h"
 
 #ifndef VPNAPI
-void process_input_packet(int fd,
-                          int afi)
-{
-    uint8_t             *packet = NULL;
-    int                 length = 0;
-    uint8_t             ttl = 0;
-    uint8_t             tos = 0;
 
-    struct lisphdr      *lisp_hdr = NULL;
+/*
+ * Returns the packet encapsulated after lisp_hdr or NULL if it is discarded. The TTL and TOS of
+ * the outer header are copied to the inner one.
+ */
+
+static uint8_t *decapsulate_lisp_packet(
+        struct lisphdr  *lisp_hdr,
+        uint8_t         ttl,
+        uint8_t         tos)
+{
     struct iphdr        *iph = NULL;
     struct ip6_hdr      *ip6h = NULL;
-    struct udphdr       *udph = NULL;
+    int                 iid = 0;
 
+    iph = (struct iphdr *) CO(lisp_hdr,sizeof(struct lisphdr));
 
-    if ((packet = (uint8_t *) malloc(MAX_IP_PACKET))==NULL){
-        lispd_log_msg(LISP_LOG_ERR,"process_input_packet: Couldn't allocate space for packet: %s", strerror(errno));
-        return;
+    lispd_log_msg(LISP_LOG_DEBUG_3,"INPUT (4341): Inner src: %s | Inner dst: %s ",
+                  get_char_from_lisp_addr_t(extract_src_addr_from_packet((uint8_t *)iph)),
+                  get_char_from_lisp_addr_t(extract_dst_addr_from_packet((uint8_t *)iph)));
+
+    /*
+     * Demultiplex the Instance IDs: the packets of an instance are only delivered to its EIDs.
+     * The packets without instance are delivered as before.
+     */
+    if (lisp_hdr->instance_id == 1){
+        iid = get_lisp_header_iid(lisp_hdr);
+        if (iid != 0 && lookup_eid_in_iid_db(extract_dst_addr_from_packet((uint8_t *)iph), iid) == NULL){
+            lispd_log_msg(LISP_LOG_DEBUG_3,"INPUT (4341): The inner destination is not an EID of the IID %d. "
+                    "Discarding packet", iid);
+            return (NULL);
+        }
     }
 
-    memset(packet,0,MAX_IP_PACKET);
+    if (iph->version == 4) {
 
-    if (get_data_packet (fd,
-                         afi,
-                         packet,
-                         &length,
-                         &ttl,
-                         &tos) != GOOD){
-        lispd_log_msg(LISP_LOG_DEBUG_2,"process_input_packet: get_data_packet error: %s", strerror(errno));
-        free(packet);
+        if(ttl!=0){ /*XXX It seems that there is a bug in uClibc that causes ttl=0 in OpenWRT. This is a quick workaround */
+            iph->ttl = ttl;
+        }
+        iph->tos = tos;
+
+        /* We need to recompute the checksum since we have changed the TTL and TOS header fields */
+        iph->check = 0; /* New checksum must be computed with the checksum header field with 0s */
+        iph->check = ip_checksum((uint16_t*) iph, sizeof(struct iphdr));
+
+    }else{
+        ip6h = ( struct ip6_hdr *) iph;
+
+        if(ttl!=0){ /*XXX It seems that there is a bug in uClibc that causes ttl=0 in OpenWRT. This is a quick workaround */
+            ip6h->ip6_hops = ttl; /* ttl = Hops limit in IPv6 */
+        }
+
+        IPV6_SET_TC(ip6h,tos); /* tos = Traffic class field in IPv6 */
+    }
+
+    return ((uint8_t *)iph);
+}
+
+
+/*
+ * Write to the tun the packet encapsulated after lisp_hdr. length is the length of the inner
+ * packet.
+ */
+
+static void decapsulate_to_tun(
+        struct lisphdr  *lisp_hdr,
+        int             length,
+        uint8_t         ttl,
+        uint8_t         tos)
+{
+    uint8_t             *inner_packet = decapsulate_lisp_packet(lisp_hdr, ttl, tos);
+
+    if (inner_packet == NULL){
         return;
     }
+    if ((write(tun_fd, inner_packet, length)) < 0){
+        lispd_log_msg(LISP_LOG_DEBUG_2,"lisp_input: write error: %s\n ", strerror(errno));
+    }
+}
+
+
+uint8_t *decapsulate_data_packet(
+        uint8_t     *packet,
+        int         length,
+        int         afi,
+        uint8_t     ttl,
+        uint8_t     tos,
+        int         *inner_length)
+{
+    struct udphdr       *udph = NULL;
 
     if(afi == AF_INET){
         /* With input RAW UDP sockets in IPv4, we get the whole external IPv4 packet */
         udph = (struct udphdr *) CO(packet,sizeof(struct iphdr));
+        length = length - sizeof(struct iphdr);
     }else{
         /* With input RAW UDP sockets in IPv6, we get the whole external UDP packet */
         udph = (struct udphdr *) packet;
@@ -75,53 +136,87 @@ void process_input_packet(int fd,
 
     /* With input RAW UDP sockets, we receive all UDP packets, we only want lisp data ones */
     if(ntohs(udph->dest) != LISP_DATA_PORT){
-        free(packet);
         lispd_log_msg(LISP_LOG_DEBUG_3,"INPUT (No LISP data): UDP dest: %d ",ntohs(udph->dest));
-        return;
+        return (NULL);
     }
 
-    lisp_hdr = (struct lisphdr *) CO(udph,sizeof(struct udphdr));
-
-    length = length - sizeof(struct udphdr) - sizeof(struct lisphdr);
-
-    iph = (struct iphdr *) CO(lisp_hdr,sizeof(struct lisphdr));
+    *inner_length = length - sizeof(struct udphdr) - sizeof(struct lisphdr);
+    if (*inner_length <= 0){
+        lispd_log_msg(LISP_LOG_DEBUG_3,"decapsulate_data_packet: Packet too short");
+        return (NULL);
+    }
 
-    lispd_log_msg(LISP_LOG_DEBUG_3,"INPUT (4341): Inner src: %s | Inner dst: %s ",
-                  get_char_from_lisp_addr_t(extract_src_addr_from_packet((uint8_t *)iph)),
-                  get_char_from_lisp_addr_t(extract_dst_addr_from_packet((uint8_t *)iph)));
+    return (decapsulate_lisp_packet((struct lisphdr *) CO(udph,sizeof(struct udphdr)), ttl, tos));
+}
 
-    if (iph->version == 4) {
 
-        if(ttl!=0){ /*XXX It seems that there is a bug in uClibc that causes ttl=0 in OpenWRT. This is a quick workaround */
-            iph->ttl = ttl;
-        }
-        iph->tos = tos;
+void process_input_packet(int fd,
+                          int afi)
+{
+    /* The packet is written to the tun before returning: one buffer per thread is enough */
+    static __thread uint8_t packet[MAX_IP_PACKET];
+    int                 length = 0;
+    uint8_t             ttl = 0;
+    uint8_t             tos = 0;
+    uint8_t             *inner_packet = NULL;
 
-        /* We need to recompute the checksum since we have changed the TTL and TOS header fields */
-        iph->check = 0; /* New checksum must be computed with the checksum header field with 0s */
-        iph->check = ip_checksum((uint16_t*) iph, sizeof(struct iphdr));
+#ifdef LISPD_RX_RING
+    if (rx_ring_size > 0 && afi == AF_INET){
+        process_rx_ring(fd);
+        return;
+    }
+#endif
 
-    }else{
-        ip6h = ( struct ip6_hdr *) iph;
+    if (get_data_packet (fd,
+                         afi,
+                         packet,
+                         &length,
+                         &ttl,
+                         &tos) != GOOD){
+        lispd_log_msg(LISP_LOG_DEBUG_2,"process_input_packet: get_data_packet error: %s", strerror(errno));
+        return;
+    }
 
-        if(ttl!=0){ /*XXX It seems that there is a bug in uClibc that causes ttl=0 in OpenWRT. This is a quick workaround */
-            ip6h->ip6_hops = ttl; /* ttl = Hops limit in IPv6 */
-        }
+    if ((inner_packet = decapsulate_data_packet(packet, length, afi, ttl, tos, &length)) == NULL){
+        return;
+    }
 
-        IPV6_SET_TC(ip6h,tos); /* tos = Traffic class field in IPv6 */
+    if ((write(tun_fd, inner_packet, length)) < 0){
+        lispd_log_msg(LISP_LOG_DEBUG_2,"lisp_input: write error: %s\n ", strerror(errno));
     }
+}
 
 
-    if (lisp_hdr->instance_id == 1){ //Poor discriminator for data map notify...
-        lispd_log_msg(LISP_LOG_DEBUG_2,"Data-Map-Notify received\n ");
-        //Is there something to do here?
+void process_input_frame(
+        uint8_t     *packet,
+        int         length)
+{
+    struct iphdr        *iph = (struct iphdr *) packet;
+    struct ip6_hdr      *ip6h = NULL;
+    struct udphdr       *udph = NULL;
+    int                 ip_hdr_len = 0;
+    uint8_t             ttl = 0;
+    uint8_t             tos = 0;
+
+    if (iph->version == 4){
+        ip_hdr_len = iph->ihl * 4;
+        ttl = iph->ttl;
+        tos = iph->tos;
+    }else{
+        ip6h = (struct ip6_hdr *) packet;
+        ip_hdr_len = sizeof(struct ip6_hdr);
+        ttl = ip6h->ip6_hops;
+        tos = IPV6_GET_TC(*ip6h);
     }
 
-    if ((write(tun_fd, iph, length)) < 0){
-        lispd_log_msg(LISP_LOG_DEBUG_2,"lisp_input: write error: %s\n ", strerror(errno));
+    length = length - ip_hdr_len - sizeof(struct udphdr) - sizeof(struct lisphdr);
+    if (length <= 0){
+        lispd_log_msg(LISP_LOG_DEBUG_3,"process_input_frame: Packet too short");
+        return;
     }
+    udph = (struct udphdr *) CO(packet, ip_hdr_len);
 
-    free(packet);
+    decapsulate_to_tun((struct lisphdr *) CO(udph,sizeof(struct udphdr)), length, ttl, tos);
 }
 
 #else
@@ -48,6 +48,28 @@ void process_input_packet(
 		int 	fd,
 		int 	afi);
 
+/*
+ * Decapsulate a packet read from a data socket of the given afi. The TTL and TOS of the outer
+ * header are taken from the ancillary data of the socket.
+ * Returns the inner packet, to be written to the tun, or NULL if it is not a LISP data packet.
+ */
+uint8_t *decapsulate_data_packet(
+        uint8_t     *packet,
+        int         length,
+        int         afi,
+        uint8_t     ttl,
+        uint8_t     tos,
+        int         *inner_length);
+
+/*
+ * Decapsulate a LISP data packet read from the rx ring or from an AF_XDP socket. packet points
+ * to the outer IP header.
+ * The TTL and TOS are taken from the outer header.
+ */
+void process_input_frame(
+        uint8_t     *packet,
+        int         length);
+
 #else
 
 void process_input_packet(
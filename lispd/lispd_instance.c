@@ -0,0 +1,245 @@
+/*
+ * lispd_instance.c
+ *
+ * This file is part of LISP Mobile Node Implementation.
+ * Databases of the EID prefixes of each Instance ID.
+ *
+ * Copyright (C) 2012 Cisco Systems, Inc, 2012. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * Please send any bug reports or fixes you make to the email address(es):
+ *    LISP-MN developers <devel@lispmob.org>
+ *
+ */
+
+#include "lispd_epoch.h"
+#include "lispd_instance.h"
+#include "lispd_log.h"
+
+
+static lispd_instance *new_instance(
+        int     iid,
+        int     root_stride)
+{
+    lispd_instance  *instance   = NULL;
+
+    if ((instance = (lispd_instance *)calloc(1, sizeof(lispd_instance))) == NULL){
+        lispd_log_msg(LISP_LOG_WARNING, "new_instance: Unable to allocate memory for lispd_instance: %s", strerror(errno));
+        return (NULL);
+    }
+    instance->iid = iid;
+    instance->db[0] = New_Patricia(sizeof(struct in_addr) * 8);
+    instance->db[1] = New_Patricia(sizeof(struct in6_addr) * 8);
+    instance->lpm[0] = new_lpm_table(sizeof(struct in_addr) * 8, root_stride);
+    instance->lpm[1] = new_lpm_table(sizeof(struct in6_addr) * 8, root_stride);
+    if (!instance->db[0] || !instance->db[1] || !instance->lpm[0] || !instance->lpm[1]){
+        lispd_log_msg(LISP_LOG_WARNING, "new_instance: Unable to allocate memory for the databases of IID %d", iid);
+        if (instance->db[0] != NULL){
+            Destroy_Patricia(instance->db[0], NULL);
+        }
+        if (instance->db[1] != NULL){
+            Destroy_Patricia(instance->db[1], NULL);
+        }
+        free_lpm_table(instance->lpm[0]);
+        free_lpm_table(instance->lpm[1]);
+        free(instance);
+        return (NULL);
+    }
+    return (instance);
+}
+
+
+static void free_instance(
+        lispd_instance  *instance,
+        void_fn_t       free_data)
+{
+    Destroy_Patricia(instance->db[0], free_data);
+    Destroy_Patricia(instance->db[1], free_data);
+    free_lpm_table(instance->lpm[0]);
+    free_lpm_table(instance->lpm[1]);
+    free(instance);
+}
+
+
+static instance_slots *new_instance_slots(int bits)
+{
+    instance_slots  *hash   = NULL;
+
+    hash = (instance_slots *)calloc(1, sizeof(instance_slots) + (1 << bits) * sizeof(instance_slot));
+    if (hash == NULL){
+        lispd_log_msg(LISP_LOG_WARNING, "new_instance_slots: Unable to allocate memory for instance_slots: %s", strerror(errno));
+        return (NULL);
+    }
+    hash->bits = bits;
+    return (hash);
+}
+
+
+/* Multiplicative hash: consecutive IIDs are spread over the table */
+static inline uint32_t get_instance_slot(
+        int     iid,
+        int     bits)
+{
+    return (((uint32_t)iid * 2654435761U) >> (32 - bits));
+}
+
+
+static void insert_instance_in_slots(
+        instance_slots  *hash,
+        lispd_instance  *instance)
+{
+    uint32_t    mask    = (1 << hash->bits) - 1;
+    uint32_t    pos     = get_instance_slot(instance->iid, hash->bits);
+
+    while (hash->slots[pos].instance != NULL){
+        pos = (pos + 1) & mask;
+    }
+    hash->slots[pos].iid = instance->iid;
+    __atomic_store_n(&(hash->slots[pos].instance), instance, __ATOMIC_RELEASE);
+}
+
+
+instance_table *new_instance_table(
+        int     default_root_stride,
+        int     root_stride)
+{
+    instance_table  *table  = NULL;
+    int             bits    = 0;
+
+    if ((table = (instance_table *)calloc(1, sizeof(instance_table))) == NULL){
+        lispd_log_msg(LISP_LOG_WARNING, "new_instance_table: Unable to allocate memory for instance_table: %s", strerror(errno));
+        return (NULL);
+    }
+    while ((1 << bits) < INSTANCE_TABLE_MIN_SLOTS){
+        bits++;
+    }
+    table->default_root_stride = default_root_stride;
+    table->root_stride = root_stride;
+    table->default_instance = new_instance(0, default_root_stride);
+    table->hash = new_instance_slots(bits);
+    if (table->default_instance == NULL || table->hash == NULL){
+        if (table->default_instance != NULL){
+            free_instance(table->default_instance, NULL);
+        }
+        free(table->hash);
+        free(table);
+        return (NULL);
+    }
+    table->instances = table->default_instance;
+    return (table);
+}
+
+
+void free_instance_table(
+        instance_table  *table,
+        void_fn_t       free_data)
+{
+    lispd_instance  *instance   = NULL;
+    lispd_instance  *next       = NULL;
+
+    if (table == NULL){
+        return;
+    }
+    instance = table->instances;
+    while (instance != NULL){
+        next = instance->next;
+        free_instance(instance, free_data);
+        instance = next;
+    }
+    free(table->hash);
+    free(table);
+}
+
+
+lispd_instance *lookup_instance(
+        instance_table  *table,
+        int             iid)
+{
+    instance_slots  *hash       = NULL;
+    lispd_instance  *instance   = NULL;
+    uint32_t        mask        = 0;
+    uint32_t        pos         = 0;
+
+    if (iid == 0){
+        return (table->default_instance);
+    }
+    hash = __atomic_load_n(&(table->hash), __ATOMIC_ACQUIRE);
+    mask = (1 << hash->bits) - 1;
+    pos = get_instance_slot(iid, hash->bits);
+    while ((instance = __atomic_load_n(&(hash->slots[pos].instance), __ATOMIC_ACQUIRE)) != NULL){
+        if (hash->slots[pos].iid == iid){
+            return (instance);
+        }
+        pos = (pos + 1) & mask;
+    }
+    return (NULL);
+}
+
+
+/*
+ * Double the size of the hash table. The data plane threads may be probing the old one: it is
+ * released after a grace period.
+ */
+static int grow_instance_slots(instance_table *table)
+{
+    instance_slots  *old        = table->hash;
+    instance_slots  *hash       = NULL;
+    lispd_instance  *instance   = NULL;
+
+    if ((hash = new_instance_slots(old->bits + 1)) == NULL){
+        return (ERR_MALLOC);
+    }
+    for (instance = table->instances; instance != NULL; instance = instance->next){
+        if (instance->iid != 0){
+            insert_instance_in_slots(hash, instance);
+        }
+    }
+    __atomic_store_n(&(table->hash), hash, __ATOMIC_RELEASE);
+    epoch_defer(old, free);
+    return (GOOD);
+}
+
+
+lispd_instance *add_instance(
+        instance_table  *table,
+        int             iid)
+{
+    lispd_instance  *instance   = NULL;
+
+    if ((instance = lookup_instance(table, iid)) != NULL){
+        return (instance);
+    }
+    /* The load factor is kept under 1/2 */
+    if (2 * (table->num_instances + 1) > (1 << table->hash->bits) && grow_instance_slots(table) != GOOD){
+        return (NULL);
+    }
+    if ((instance = new_instance(iid, table->root_stride)) == NULL){
+        return (NULL);
+    }
+    instance->next = table->instances;
+    table->instances = instance;
+    table->num_instances++;
+    insert_instance_in_slots(table->hash, instance);
+    lispd_log_msg(LISP_LOG_DEBUG_2, "Created the databases of the Instance ID %d", iid);
+    return (instance);
+}
+
+/*
+ * Editor modelines
+ *
+ * vi: set shiftwidth=4 tabstop=4 expandtab:
+ * :indentSize=4:tabSize=4:noTabs=true:
+ */
@@ -0,0 +1,116 @@
+/*
+ * lispd_instance.h
+ *
+ * This file is part of LISP Mobile Node Implementation.
+ * Databases of the EID prefixes of each Instance ID.
+ *
+ * Copyright (C) 2012 Cisco Systems, Inc, 2012. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * Please send any bug reports or fixes you make to the email address(es):
+ *    LISP-MN developers <devel@lispmob.org>
+ *
+ */
+
+#ifndef LISPD_INSTANCE_H_
+#define LISPD_INSTANCE_H_
+
+#include "lispd.h"
+#include "lispd_lpm.h"
+#include "patricia/patricia.h"
+
+/* Initial number of slots of the hash table of the instances (power of 2) */
+#define INSTANCE_TABLE_MIN_SLOTS    16
+
+/*
+ * EID prefixes of an Instance ID. The patricia trees are used by the control plane and the
+ * multibit tries by the data plane lookups.
+ */
+typedef struct lispd_instance_ {
+    int                     iid;
+    patricia_tree_t         *db[2];     /* IPv4, IPv6 */
+    lpm_table               *lpm[2];
+    struct lispd_instance_  *next;      /* List of the instances of the table */
+} lispd_instance;
+
+/*
+ * Slot of the hash table. The IID is copied next to the instance: the probes of a lookup only
+ * read the slots, not the instances of the other IIDs.
+ */
+typedef struct {
+    int                     iid;
+    lispd_instance          *instance;  /* Published after iid */
+} instance_slot;
+
+/* Open addressing hash table indexed by IID. Replaced as a whole when it grows */
+typedef struct {
+    int                     bits;
+    instance_slot           slots[];
+} instance_slots;
+
+/*
+ * Instances of a database. The instance of IID 0 always exists and is not hashed. The instances
+ * are only added from the main thread and are never removed before free_instance_table: the data
+ * plane threads look them up without locks.
+ */
+typedef struct {
+    lispd_instance          *default_instance;
+    instance_slots          *hash;
+    int                     num_instances;  /* Hashed ones */
+    lispd_instance          *instances;     /* Including the default one */
+    int                     default_root_stride;
+    int                     root_stride;
+} instance_table;
+
+
+/*
+ * The multibit tries of the default instance use root strides of default_root_stride bits, the
+ * other ones of root_stride bits: the root is allocated for each instance with prefixes.
+ */
+instance_table *new_instance_table(
+        int     default_root_stride,
+        int     root_stride);
+
+/*
+ * Release the instances. free_data is called for the data of each prefix.
+ */
+void free_instance_table(
+        instance_table  *table,
+        void_fn_t       free_data);
+
+/*
+ * Returns the instance of the IID or NULL if it doesn't exist. Can be called from the data plane
+ * threads.
+ */
+lispd_instance *lookup_instance(
+        instance_table  *table,
+        int             iid);
+
+/*
+ * Returns the instance of the IID, creating it if it doesn't exist. Called from the main thread.
+ */
+lispd_instance *add_instance(
+        instance_table  *table,
+        int             iid);
+
+#endif /* LISPD_INSTANCE_H_ */
+
+/*
+ * Editor modelines
+ *
+ * vi: set shiftwidth=4 tabstop=4 expandtab:
+ * :indentSize=4:tabSize=4:noTabs=true:
+ */
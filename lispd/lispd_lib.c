@@ -1175,37 +1175,6 @@ static inline lisp_addr_t *get_server(
 
 
 
-/*
- *  select from among readfds, the largest of which
- *  is max_fd.
- */
-
-int have_input(
-    int         max_fd,
-    fd_set      *readfds)
-{
-    struct timeval tv;
-    tv.tv_sec  = 0;
-    tv.tv_usec = DEFAULT_SELECT_TIMEOUT;
-
-    while (1)
-    {
-        if (select(max_fd+1,readfds,NULL,NULL,&tv) == -1) {
-            if (errno == EINTR){
-                continue;
-            }
-            else {
-                lispd_log_msg(LISP_LOG_DEBUG_2, "have_input: select error: %s", strerror(errno));
-                return(BAD);
-            }
-        }else{
-            break;
-        }
-    }
-    return(GOOD);
-}
-
-
 /*
  *  Read a control message from a socket and process it
  */
@@ -1644,6 +1613,59 @@ char * get_char_from_xTR_ID (lispd_xTR_ID *xtrid)
     sprintf(xTR_ID_str, "%s", xTR_ID_str);
     return (xTR_ID_str);
 }
+
+
+uint64_t get_monotonic_ms()
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((uint64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000);
+}
+
+
+uint64_t get_monotonic_us()
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000);
+}
+
+
+void refill_token_bucket(
+        token_bucket    *bucket,
+        int             rate)
+{
+    uint64_t    now     = get_monotonic_ms();
+
+    if (rate == 0){
+        return;
+    }
+    bucket->tokens += (double)(now - bucket->last_refill) * rate / 1000.0;
+    if (bucket->tokens > rate){
+        bucket->tokens = rate;
+    }
+    bucket->last_refill = now;
+}
+
+
+uint64_t get_token_bucket_wait(
+        token_bucket    *bucket,
+        int             rate)
+{
+    if (rate == 0 || bucket->tokens >= 1){
+        return (0);
+    }
+    return ((uint64_t)((1 - bucket->tokens) * 1000 / rate) + 1);
+}
+
+
+void take_token(token_bucket *bucket)
+{
+    bucket->tokens -= 1;
+}
+
 /*
  * Editor modelines
  *
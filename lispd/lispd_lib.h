@@ -201,13 +201,6 @@ int get_lisp_addr_and_mask_from_char (char *address, lisp_addr_t *lisp_addr, int
 
 
 
-/*
- *  select from among readfds, the largest of which
- *  is max_fd.
- */
-int have_input(int max_fd,fd_set *readfds);
-
-
 /*
  *  Read a control message from a socket and process it
  */
@@ -297,5 +290,41 @@ void nat_set_xTR_ID();
 
 char * get_char_from_xTR_ID (lispd_xTR_ID *xtrid);
 
+/*
+ * Milliseconds and microseconds of the monotonic clock
+ */
+uint64_t get_monotonic_ms();
+
+uint64_t get_monotonic_us();
+
+/*
+ * Token bucket limiting the control messages sent to a rate per second. It holds up to one
+ * second of messages. A rate of 0 doesn't limit them. A zeroed bucket is full at its first
+ * refill.
+ */
+typedef struct {
+    double      tokens;
+    uint64_t    last_refill;    /* ms */
+} token_bucket;
+
+/*
+ * Add the tokens accumulated since the last refill
+ */
+void refill_token_bucket(
+        token_bucket    *bucket,
+        int             rate);
+
+/*
+ * Milliseconds to wait before a token is available. 0 if a message can be sent now.
+ */
+uint64_t get_token_bucket_wait(
+        token_bucket    *bucket,
+        int             rate);
+
+/*
+ * Take the token of a message sent
+ */
+void take_token(token_bucket *bucket);
+
 #endif /*LISPD_LIB_H_*/
 
@@ -32,28 +32,26 @@
 
 
 #include <netinet/in.h>
+#include "lispd_epoch.h"
 #include "lispd_external.h"
+#include "lispd_flow_cache.h"
+#include "lispd_instance.h"
 #include "lispd_lib.h"
 #include "lispd_map_cache_db.h"
 
 
 /*
- *  Patricia tree based databases
+ * Databases of each Instance ID. Few prefixes are configured: a root stride of 8 bits is enough.
  */
-patricia_tree_t *EIDv4_database           = NULL;
-patricia_tree_t *EIDv6_database           = NULL;
-
+static instance_table *local_db_instances = NULL;
 
 /*
- *  Add a EID entry to the database.
+ * Index of the EID prefixes of all the Instance IDs, used to find the mapping of the source of the
+ * packets of the tun. When a prefix is configured in several Instance IDs, the first one is used.
  */
-int add_mapping_to_db(lispd_mapping_elt *mapping);
-
-patricia_node_t *lookup_eid_node(lisp_addr_t eid);
-
-patricia_node_t *lookup_eid_exact_node(
-        lisp_addr_t eid,
-        int         eid_prefix_length);
+patricia_tree_t *EIDv4_database           = NULL;
+patricia_tree_t *EIDv6_database           = NULL;
+static lpm_table *local_db_lpm[2]         = {NULL, NULL};
 
 
 /*
@@ -64,8 +62,11 @@ int db_init(void)
 {
     EIDv4_database  = New_Patricia(sizeof(struct in_addr)  * 8);
     EIDv6_database  = New_Patricia(sizeof(struct in6_addr) * 8);
+    local_db_lpm[0] = new_lpm_table(sizeof(struct in_addr)  * 8, 8);
+    local_db_lpm[1] = new_lpm_table(sizeof(struct in6_addr) * 8, 8);
+    local_db_instances = new_instance_table(8, 8);
 
-    if (!EIDv4_database || !EIDv6_database) {
+    if (!EIDv4_database || !EIDv6_database || !local_db_lpm[0] || !local_db_lpm[1] || !local_db_instances) {
         lispd_log_msg(LISP_LOG_CRIT, "db_init: Unable to allocate memory for database");
         return (BAD);
     };
@@ -81,96 +82,74 @@ patricia_tree_t* get_local_db(int afi)
 }
 
 
+static inline int get_afi_index(int afi)
+{
+    return ((afi == AF_INET) ? 0 : 1);
+}
+
+
 /*
- *  Add a mapping entry to the database.
+ * Insert the mapping in a tree and in its multibit trie. Returns BAD if the prefix is already in the tree
  */
-int add_mapping_to_db(lispd_mapping_elt *mapping)
+static int insert_mapping_in_db(
+        patricia_tree_t     *database,
+        lpm_table           *lpm,
+        lispd_mapping_elt   *mapping)
 {
     prefix_t            *prefix             = NULL;
     patricia_node_t     *node               = NULL;
-    lisp_addr_t         eid_prefix;
-    int                 eid_prefix_length;
-
-    eid_prefix = mapping->eid_prefix;
-    eid_prefix_length = mapping->eid_prefix_length;
 
-    if ((node = malloc(sizeof(patricia_node_t))) == NULL) {
-        lispd_log_msg(LISP_LOG_WARNING, "add_mapping_to_db: Unable to allocate memory for patrica_node_t: %s", strerror(errno));
+    if ((prefix = New_Prefix(mapping->eid_prefix.afi, &(mapping->eid_prefix.address), mapping->eid_prefix_length)) == NULL) {
+        lispd_log_msg(LISP_LOG_WARNING, "add_mapping_to_db: Unable to allocate memory for prefix_t: %s", strerror(errno));
         return(ERR_MALLOC);
     }
-
-    switch(eid_prefix.afi) {
-    case AF_INET:
-        if ((prefix = New_Prefix(AF_INET, &(eid_prefix.address.ip), eid_prefix_length)) == NULL) {
-            lispd_log_msg(LISP_LOG_WARNING, "add_mapping_to_db: Unable to allocate memory for prefix_t (AF_INET): %s", strerror(errno));
-            free(node);
-            return(ERR_MALLOC);
-        }
-        node = patricia_lookup(EIDv4_database, prefix);
-        break;
-    case AF_INET6:
-        if ((prefix = New_Prefix(AF_INET6, &(eid_prefix.address.ipv6), eid_prefix_length)) == NULL) {
-            lispd_log_msg(LISP_LOG_WARNING, "add_mapping_to_db: Unable to allocate memory for prefix_t (AF_INET): %s", strerror(errno));
-            free(node);
-            return(ERR_MALLOC);
-        }
-        node = patricia_lookup(EIDv6_database, prefix);
-        break;
-    default:
-        free(node);
-        lispd_log_msg(LISP_LOG_DEBUG_2, "add_mapping_to_db: Unknown afi (%d) when allocating prefix_t", eid_prefix.afi);
-        return(ERR_AFI);
-    }
+    node = patricia_lookup(database, prefix);
     Deref_Prefix(prefix);
 
-    if (node->data == NULL){            /* its a new node */
-        node->data = (lispd_mapping_elt *) mapping;
-        lispd_log_msg(LISP_LOG_DEBUG_2, "EID prefix %s/%d inserted in the database",
-                get_char_from_lisp_addr_t(mapping->eid_prefix),
-                mapping->eid_prefix_length);
-        return (GOOD);
-    }else{
-        lispd_log_msg(LISP_LOG_DEBUG_2, "add_mapping_to_db: EID prefix entry (%s/%d) already installed in the data base",
-                get_char_from_lisp_addr_t(eid_prefix),eid_prefix_length);
+    if (node->data != NULL){
         return (BAD);
     }
+    if (lpm_insert(lpm, &(mapping->eid_prefix.address), mapping->eid_prefix_length, mapping) != GOOD){
+        patricia_remove(database, node);
+        return (ERR_MALLOC);
+    }
+    node->data = (lispd_mapping_elt *) mapping;
+    return (GOOD);
 }
 
 
-
-patricia_node_t *lookup_eid_node(lisp_addr_t eid)
+/*
+ * Remove a node from a tree and its prefix from the multibit trie. The slots of the prefix get the
+ * mapping covering it.
+ */
+static void remove_mapping_from_db(
+        patricia_tree_t     *database,
+        lpm_table           *lpm,
+        patricia_node_t     *node)
 {
-    patricia_node_t *node = NULL;
-    prefix_t prefix;
-
-    switch(eid.afi) {
-    case AF_INET:
-        prefix.family = AF_INET;
-        prefix.bitlen = 32;
-        prefix.ref_count = 0;
-        prefix.add.sin.s_addr = eid.address.ip.s_addr;
-        node = patricia_search_best(EIDv4_database, &prefix);
-        break;
-    case AF_INET6:
-        prefix.family = AF_INET6;
-        prefix.bitlen = 128;
-        prefix.ref_count = 0;
-        memcpy (&(prefix.add.sin6), &(eid.address.ipv6), sizeof(struct in6_addr));
-        node = patricia_search_best(EIDv6_database, &prefix);
-        break;
-    default:
-        break;
-    }
-
-    if ( node==NULL ){
-        lispd_log_msg(LISP_LOG_DEBUG_3, "The entry %s is not a local EID", get_char_from_lisp_addr_t(eid));
+    lispd_mapping_elt   *mapping    = (lispd_mapping_elt *)(node->data);
+    patricia_node_t     *cover      = NULL;
+    prefix_t            prefix;
+
+    patricia_remove(database, node);
+
+    prefix.family = mapping->eid_prefix.afi;
+    prefix.bitlen = mapping->eid_prefix_length;
+    prefix.ref_count = 0;
+    memcpy (&(prefix.add), &(mapping->eid_prefix.address), get_addr_len(mapping->eid_prefix.afi));
+    cover = patricia_search_best(database, &prefix);
+    if (cover != NULL && cover->data != NULL){
+        lpm_remove(lpm, &(mapping->eid_prefix.address), mapping->eid_prefix_length, cover->data, cover->prefix->bitlen);
+    }else{
+        lpm_remove(lpm, &(mapping->eid_prefix.address), mapping->eid_prefix_length, NULL, 0);
     }
-    return(node);
 }
 
-patricia_node_t *lookup_eid_exact_node(
-        lisp_addr_t eid,
-        int         eid_prefix_length)
+
+static patricia_node_t *lookup_eid_exact_node(
+        patricia_tree_t     *database,
+        lisp_addr_t         eid,
+        int                 eid_prefix_length)
 {
     patricia_node_t *node = NULL;
     prefix_t        prefix;
@@ -181,14 +160,14 @@ patricia_node_t *lookup_eid_exact_node(
         prefix.bitlen = eid_prefix_length;
         prefix.ref_count = 0;
         memcpy (&(prefix.add.sin), &(eid.address.ip), sizeof(struct in_addr));
-        node = patricia_search_exact(EIDv4_database, &prefix);
+        node = patricia_search_exact(database, &prefix);
         break;
     case AF_INET6:
         prefix.family = AF_INET6;
         prefix.bitlen = eid_prefix_length;
         prefix.ref_count = 0;
         memcpy (&(prefix.add.sin6), &(eid.address.ipv6), sizeof(struct in6_addr));
-        node = patricia_search_exact(EIDv6_database, &prefix);
+        node = patricia_search_exact(database, &prefix);
         break;
     default:
         break;
@@ -201,6 +180,57 @@ patricia_node_t *lookup_eid_exact_node(
 }
 
 
+/*
+ *  Add a mapping entry to the database of its Instance ID.
+ */
+int add_mapping_to_db(lispd_mapping_elt *mapping)
+{
+    lispd_instance      *instance           = NULL;
+    patricia_node_t     *node               = NULL;
+    lispd_mapping_elt   *first_mapping      = NULL;
+    int                 afi_idx             = 0;
+    int                 result              = 0;
+
+    if (mapping->eid_prefix.afi != AF_INET && mapping->eid_prefix.afi != AF_INET6){
+        lispd_log_msg(LISP_LOG_DEBUG_2, "add_mapping_to_db: Unknown afi (%d) when allocating prefix_t", mapping->eid_prefix.afi);
+        return(ERR_AFI);
+    }
+    afi_idx = get_afi_index(mapping->eid_prefix.afi);
+    if ((instance = add_instance(local_db_instances, mapping->iid)) == NULL){
+        return (ERR_MALLOC);
+    }
+
+    result = insert_mapping_in_db(instance->db[afi_idx], instance->lpm[afi_idx], mapping);
+    if (result == BAD){
+        lispd_log_msg(LISP_LOG_DEBUG_2, "add_mapping_to_db: EID prefix entry (%s/%d IID %d) already installed in the data base",
+                get_char_from_lisp_addr_t(mapping->eid_prefix),mapping->eid_prefix_length,mapping->iid);
+        return (BAD);
+    }
+    if (result != GOOD){
+        return (result);
+    }
+
+    /* Index of the sources of the packets of the tun */
+    result = insert_mapping_in_db(get_local_db(mapping->eid_prefix.afi), local_db_lpm[afi_idx], mapping);
+    if (result == BAD){
+        node = lookup_eid_exact_node(get_local_db(mapping->eid_prefix.afi), mapping->eid_prefix, mapping->eid_prefix_length);
+        first_mapping = (lispd_mapping_elt *)(node->data);
+        lispd_log_msg(LISP_LOG_WARNING, "EID prefix %s/%d is configured with IID %d and %d: the packets from it are "
+                "encapsulated with IID %d", get_char_from_lisp_addr_t(mapping->eid_prefix),mapping->eid_prefix_length,
+                first_mapping->iid, mapping->iid, first_mapping->iid);
+    }else if (result != GOOD){
+        node = lookup_eid_exact_node(instance->db[afi_idx], mapping->eid_prefix, mapping->eid_prefix_length);
+        remove_mapping_from_db(instance->db[afi_idx], instance->lpm[afi_idx], node);
+        return (result);
+    }
+
+    lispd_log_msg(LISP_LOG_DEBUG_2, "EID prefix %s/%d inserted in the database",
+            get_char_from_lisp_addr_t(mapping->eid_prefix),
+            mapping->eid_prefix_length);
+    return (GOOD);
+}
+
+
 /*
  * lookup_eid_in_db
  *
@@ -210,38 +240,87 @@ patricia_node_t *lookup_eid_exact_node(
 lispd_mapping_elt *lookup_eid_in_db(lisp_addr_t eid)
 {
     lispd_mapping_elt       *mapping = NULL;
-    patricia_node_t         *result     = NULL;
 
-    result = lookup_eid_node(eid);
-    if (result == NULL){
-        return(NULL);
+    switch(eid.afi) {
+    case AF_INET:
+        mapping = (lispd_mapping_elt *)lpm_lookup(local_db_lpm[0], &(eid.address.ip));
+        break;
+    case AF_INET6:
+        mapping = (lispd_mapping_elt *)lpm_lookup(local_db_lpm[1], &(eid.address.ipv6));
+        break;
+    default:
+        break;
     }
-    mapping = (lispd_mapping_elt *)(result->data);
 
+    if (mapping == NULL && is_loggable(LISP_LOG_DEBUG_3) == TRUE){
+        lispd_log_msg(LISP_LOG_DEBUG_3, "The entry %s is not a local EID", get_char_from_lisp_addr_t(eid));
+    }
     return(mapping);
 }
 
 /*
- * lookup_eid_in_db
+ * lookup_eid_exact_in_db
  *
  *  Look up a given eid in the database, returning the
  * lispd_mapping_elt containing the exact EID if it exists or NULL.
  */
 lispd_mapping_elt *lookup_eid_exact_in_db(lisp_addr_t eid_prefix, int eid_prefix_length)
 {
-    lispd_mapping_elt       *mapping = NULL;
     patricia_node_t         *result     = NULL;
 
-    result = lookup_eid_exact_node(eid_prefix,eid_prefix_length);
+    result = lookup_eid_exact_node(get_local_db(eid_prefix.afi), eid_prefix, eid_prefix_length);
     if (result == NULL){
         return(NULL);
     }
-    mapping = (lispd_mapping_elt *)(result->data);
+    return((lispd_mapping_elt *)(result->data));
+}
+
 
+lispd_mapping_elt *lookup_eid_in_iid_db(
+        lisp_addr_t eid,
+        int         iid)
+{
+    lispd_mapping_elt       *mapping    = NULL;
+    lispd_instance          *instance   = lookup_instance(local_db_instances, iid);
+
+    if (instance != NULL){
+        switch(eid.afi) {
+        case AF_INET:
+            mapping = (lispd_mapping_elt *)lpm_lookup(instance->lpm[0], &(eid.address.ip));
+            break;
+        case AF_INET6:
+            mapping = (lispd_mapping_elt *)lpm_lookup(instance->lpm[1], &(eid.address.ipv6));
+            break;
+        default:
+            break;
+        }
+    }
+
+    if (mapping == NULL && is_loggable(LISP_LOG_DEBUG_3) == TRUE){
+        lispd_log_msg(LISP_LOG_DEBUG_3, "The entry %s is not a local EID of IID %d", get_char_from_lisp_addr_t(eid), iid);
+    }
     return(mapping);
 }
 
 
+lispd_mapping_elt *lookup_eid_exact_in_iid_db(
+        lisp_addr_t eid_prefix,
+        int         eid_prefix_length,
+        int         iid)
+{
+    lispd_instance          *instance   = lookup_instance(local_db_instances, iid);
+    patricia_node_t         *result     = NULL;
+
+    if (instance == NULL){
+        return (NULL);
+    }
+    result = lookup_eid_exact_node(instance->db[get_afi_index(eid_prefix.afi)], eid_prefix, eid_prefix_length);
+    if (result == NULL){
+        return(NULL);
+    }
+    return((lispd_mapping_elt *)(result->data));
+}
+
 
 /*
  * del_mapping_entry_from_db()
@@ -250,12 +329,19 @@ lispd_mapping_elt *lookup_eid_exact_in_db(lisp_addr_t eid_prefix, int eid_prefix
  */
 void del_mapping_entry_from_db(
         lisp_addr_t eid,
-        int prefixlen)
+        int         prefixlen,
+        int         iid)
 {
     lispd_mapping_elt    *entry     = NULL;
+    lispd_mapping_elt    *other     = NULL;
+    lispd_instance       *instance  = NULL;
     patricia_node_t      *result    = NULL;
+    int                  afi_idx    = get_afi_index(eid.afi);
 
-    result = lookup_eid_exact_node(eid, prefixlen);
+    instance = lookup_instance(local_db_instances, iid);
+    if (instance != NULL){
+        result = lookup_eid_exact_node(instance->db[afi_idx], eid, prefixlen);
+    }
     if (result == NULL){
         lispd_log_msg(LISP_LOG_WARNING,"del_mapping_entry_from_db: Unable to locate eid entry %s/%d for deletion",
                 get_char_from_lisp_addr_t(eid),prefixlen);
@@ -265,15 +351,26 @@ void del_mapping_entry_from_db(
     }
 
     /*
-     * Remove the entry from the trie
+     * Remove the entry from the trie. The established flows refer to the mapping
      */
+    flow_cache_invalidate_all();
     entry = (lispd_mapping_elt *)(result->data);
-    if (eid.afi==AF_INET)
-        patricia_remove(EIDv4_database, result);
-    else
-        patricia_remove(EIDv6_database, result);
+    remove_mapping_from_db(instance->db[afi_idx], instance->lpm[afi_idx], result);
+
+    /* The sources of the prefix are assigned to another Instance ID configured with it */
+    result = lookup_eid_exact_node(get_local_db(eid.afi), eid, prefixlen);
+    if (result != NULL && result->data == entry){
+        remove_mapping_from_db(get_local_db(eid.afi), local_db_lpm[afi_idx], result);
+        for (instance = local_db_instances->instances; instance != NULL; instance = instance->next){
+            if ((other = lookup_eid_exact_in_iid_db(eid, prefixlen, instance->iid)) != NULL){
+                insert_mapping_in_db(get_local_db(eid.afi), local_db_lpm[afi_idx], other);
+                break;
+            }
+        }
+    }
 
-    free_mapping_elt(entry);
+    /* The data plane threads may be using the mapping */
+    epoch_defer(entry, (epoch_callback)free_mapping_elt);
 }
 
 /**
@@ -317,35 +414,38 @@ lispd_mapping_list *get_all_mappings(int afi)
 {
     lispd_mapping_list          *list           = NULL;
     lispd_mapping_elt           *mapping        = NULL;
+    lispd_instance              *instance       = NULL;
     patricia_node_t             *node           = NULL;
-    patricia_tree_t             *database[2]    = {NULL,NULL};
+    int                         afis[2]         = {FALSE,FALSE};
     int                         ctr             = 0;
 
     switch (afi){
     case AF_INET:
-        database[0] = EIDv4_database;
+        afis[0] = TRUE;
         break;
     case AF_INET6:
-        database[1] = EIDv6_database;
+        afis[1] = TRUE;
         break;
     case AF_UNSPEC:
-        database[0] = EIDv4_database;
-        database[1] = EIDv6_database;
+        afis[0] = TRUE;
+        afis[1] = TRUE;
         break;
     default:
         return (NULL);
     }
 
-    for (ctr = 0 ; ctr < 2 ; ctr++){
-        if (database[ctr] == NULL){
-            continue;
-        }
-        PATRICIA_WALK(database[ctr]->head, node) {
-            mapping = ((lispd_mapping_elt *)(node->data));
-            if (mapping != NULL){
-                add_mapping_to_list(mapping,&list);
+    for (instance = local_db_instances->instances; instance != NULL; instance = instance->next){
+        for (ctr = 0 ; ctr < 2 ; ctr++){
+            if (afis[ctr] == FALSE){
+                continue;
             }
-        }PATRICIA_WALK_END;
+            PATRICIA_WALK(instance->db[ctr]->head, node) {
+                mapping = ((lispd_mapping_elt *)(node->data));
+                if (mapping != NULL){
+                    add_mapping_to_list(mapping,&list);
+                }
+            }PATRICIA_WALK_END;
+        }
     }
     return (list);
 }
@@ -369,7 +469,7 @@ int num_entries_in_db(patricia_tree_t *database){
  */
 void dump_local_db(int log_level)
 {
-    patricia_tree_t     *dbs [2] = {EIDv4_database, EIDv6_database};
+    lispd_instance      *instance = NULL;
     int                 ctr      = 0;
     patricia_node_t     *node    = NULL;
     lispd_mapping_elt   *entry   = NULL;
@@ -380,11 +480,13 @@ void dump_local_db(int log_level)
 
     lispd_log_msg(log_level,"****************** LISP Local Mappings ****************\n");
 
-    for (ctr = 0 ; ctr < 2 ; ctr++){
-        PATRICIA_WALK(dbs[ctr]->head, node) {
-            entry = ((lispd_mapping_elt *)(node->data));
-            dump_mapping_entry(entry, log_level);
-        } PATRICIA_WALK_END;
+    for (instance = local_db_instances->instances; instance != NULL; instance = instance->next){
+        for (ctr = 0 ; ctr < 2 ; ctr++){
+            PATRICIA_WALK(instance->db[ctr]->head, node) {
+                entry = ((lispd_mapping_elt *)(node->data));
+                dump_mapping_entry(entry, log_level);
+            } PATRICIA_WALK_END;
+        }
     }
     lispd_log_msg(log_level,"*******************************************************\n");
 }
@@ -392,10 +494,17 @@ void dump_local_db(int log_level)
 void drop_local_mappings()
 {
 	lispd_log_msg(LISP_LOG_DEBUG_3,"free_local_db: Releasing memory of local mappings\n");
+	/* The mappings are released with the databases of their Instance IDs */
 	if (EIDv4_database != NULL)
-		Destroy_Patricia(EIDv4_database,free_mapping_elt);
+		Destroy_Patricia(EIDv4_database,NULL);
 	if (EIDv6_database != NULL)
-		Destroy_Patricia(EIDv6_database,free_mapping_elt);
+		Destroy_Patricia(EIDv6_database,NULL);
 	EIDv4_database = NULL;
 	EIDv6_database = NULL;
+	free_lpm_table(local_db_lpm[0]);
+	free_lpm_table(local_db_lpm[1]);
+	local_db_lpm[0] = NULL;
+	local_db_lpm[1] = NULL;
+	free_instance_table(local_db_instances, free_mapping_elt);
+	local_db_instances = NULL;
 }
@@ -45,37 +45,54 @@ int db_init(void);
 
 
 /*
- * Returns the local data base according ton afi
+ * Returns the local data base according ton afi. It indexes the EID prefixes of all the
+ * Instance IDs: a prefix configured in several ones appears once.
  */
 patricia_tree_t* get_local_db(int afi);
 
 /*
- *  Add a mapping entry to the database.
+ *  Add a mapping entry to the database of its Instance ID.
  */
 int add_mapping_to_db(lispd_mapping_elt *mapping);
 
 /*
- * Delete an EID mapping from the data base. We indicate if it is local or not
+ * Delete an EID mapping from the data base of the Instance ID
  */
 void del_mapping_entry_from_db(lisp_addr_t eid,
-        int prefixlen);
+        int prefixlen,
+        int iid);
 
 /*
  * lookup_eid_in_db
  *
  * Look up a given eid in the database, returning the
  * lispd_mapping_elt of this EID if it exists or NULL.
+ * Any Instance ID: used to find the mapping of the source of the packets of the tun, whose
+ * IID is used to encapsulate them.
  */
 lispd_mapping_elt *lookup_eid_in_db(lisp_addr_t eid);
 
 /*
- * lookup_eid_in_db
+ * lookup_eid_exact_in_db
  *
  *  Look up a given eid in the database, returning the
- * lispd_mapping_elt containing the exact EID if it exists or NULL.
+ * lispd_mapping_elt containing the exact EID if it exists or NULL. Any Instance ID.
  */
 lispd_mapping_elt *lookup_eid_exact_in_db(lisp_addr_t eid_prefix, int eid_prefix_length);
 
+/*
+ * Look up a given eid in the database of the Instance ID. The cost doesn't depend on the
+ * number of Instance IDs.
+ */
+lispd_mapping_elt *lookup_eid_in_iid_db(
+        lisp_addr_t eid,
+        int         iid);
+
+lispd_mapping_elt *lookup_eid_exact_in_iid_db(
+        lisp_addr_t eid_prefix,
+        int         eid_prefix_length,
+        int         iid);
+
 
 lisp_addr_t *get_main_eid(int afi);
 
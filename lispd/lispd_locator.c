@@ -33,6 +33,7 @@
 #include "lispd_lib.h"
 #include "lispd_locator.h"
 #include "lispd_log.h"
+#include "lispd_rloc_index.h"
 
 /*********************************** FUNCTIONS DECLARATION ************************/
 
@@ -363,8 +364,9 @@ static inline rmt_locator_extended_info *new_rmt_locator_extended_info()
         err = ERR_MALLOC;
         return(NULL);
     }
-    rmt_loc_ext_inf->rloc_probing_nonces = NULL;
-    rmt_loc_ext_inf->probe_timer = NULL;
+    rmt_loc_ext_inf->rloc_user = NULL;
+    rmt_loc_ext_inf->rtt = 0;
+    rmt_loc_ext_inf->rtt_jitter = 0;
 
     return rmt_loc_ext_inf;
 }
@@ -529,13 +531,13 @@ void free_nat_info_str(nat_info_str *nat_info)
         free(nat_info->public_addr);
     }
     if (nat_info->inf_req_nonce != NULL){
-        free(nat_info->inf_req_nonce);
+        free_nonces_list(nat_info->inf_req_nonce);
     }
     if (nat_info->inf_req_timer != NULL){
         stop_timer(nat_info->inf_req_timer);
     }
     if (nat_info->emap_reg_nonce != NULL){
-        free(nat_info->emap_reg_nonce);
+        free_nonces_list(nat_info->emap_reg_nonce);
     }
     if (nat_info->emap_reg_timer != NULL){
         stop_timer(nat_info->emap_reg_timer);
@@ -579,13 +581,7 @@ static inline void free_rmt_locator_extended_info(rmt_locator_extended_info *ext
     if (extended_info == NULL){
         return;
     }
-    if (extended_info->probe_timer != NULL){
-        stop_timer(extended_info->probe_timer);
-        extended_info->probe_timer = NULL;
-    }
-    if (extended_info->rloc_probing_nonces != NULL){
-        free (extended_info->rloc_probing_nonces);
-    }
+    remove_rloc_index_user(extended_info->rloc_user);
     free (extended_info);
 }
 
@@ -601,6 +597,12 @@ void dump_locator (
         sprintf(locator_str, "| %39s |", get_char_from_lisp_addr_t(*(locator->locator_addr)));
         sprintf(locator_str + strlen(locator_str), "  %5s ", *(locator->state) == UP ? "Up" : "Down");
         sprintf(locator_str + strlen(locator_str), "|     %3d/%-3d     |", locator->priority, locator->weight);
+        if (locator->locator_type != LOCAL_LOCATOR && locator->extended_info != NULL &&
+                ((rmt_locator_extended_info *)locator->extended_info)->rtt != 0){
+            sprintf(locator_str + strlen(locator_str), " RTT %.1f ms (+-%.1f)",
+                    ((rmt_locator_extended_info *)locator->extended_info)->rtt / 1000.0,
+                    ((rmt_locator_extended_info *)locator->extended_info)->rtt_jitter / 1000.0);
+        }
         lispd_log_msg(log_level,"%s",locator_str);
     }
 }
@@ -890,7 +892,6 @@ lispd_locator_elt *get_locator_with_nonce(
 {
     lispd_locator_elt           *locator        = NULL;
     nat_info_str                *nat_info       = NULL;
-    rmt_locator_extended_info   *rmt_ext_info   = NULL;
 
     switch (msg_type){
     case LISP_MAP_NOTIFY:
@@ -913,16 +914,6 @@ lispd_locator_elt *get_locator_with_nonce(
             locator_list = locator_list->next;
         }
         break;
-    case LISP_MAP_REPLY:
-        while (locator_list != NULL){
-            locator = locator_list->locator;
-            rmt_ext_info = (rmt_locator_extended_info *)(locator->extended_info);
-            if (check_nonce(rmt_ext_info->rloc_probing_nonces,nonce) == GOOD){
-                return (locator);
-            }
-            locator_list = locator_list->next;
-        }
-        break;
     }
 
 
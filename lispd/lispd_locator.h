@@ -98,8 +98,9 @@ typedef struct lcl_locator_extended_info_ {
  * Structure to expand lispd_locator_elt for remote locators
  */
 typedef struct rmt_locator_extended_info_ {
-    nonces_list                 *rloc_probing_nonces;
-    timer                       *probe_timer;
+    struct rloc_index_user_     *rloc_user;     /* Entry of the locator in the RLOC index (lispd_rloc_index.c) */
+    uint32_t                    rtt;            /* Smoothed RTT of the RLOC probes (us). 0 if not measured */
+    uint32_t                    rtt_jitter;     /* Mean deviation of the RTT (us) */
 }rmt_locator_extended_info;
 
 
@@ -0,0 +1,319 @@
+/*
+ * lispd_lpm.c
+ *
+ * This file is part of LISP Mobile Node Implementation.
+ * Multibit trie for the longest prefix match lookups of the data plane.
+ *
+ * Copyright (C) 2012 Cisco Systems, Inc, 2012. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * Please send any bug reports or fixes you make to the email address(es):
+ *    LISP-MN developers <devel@lispmob.org>
+ *
+ */
+
+
+#include "lispd_epoch.h"
+#include "lispd_lpm.h"
+
+
+static lpm_node *new_lpm_node(
+        lpm_table   *table,
+        int         stride)
+{
+    lpm_node    *node   = NULL;
+    int         slots   = 1 << stride;
+    size_t      size    = sizeof(lpm_node) + slots * (sizeof(lpm_slot) + sizeof(uint8_t));
+
+    if ((node = (lpm_node *)calloc(1, size)) == NULL){
+        return (NULL);
+    }
+    node->lengths = (uint8_t *)&(node->slots[slots]);
+    table->nodes++;
+    table->memory += size;
+    return (node);
+}
+
+
+static void free_lpm_node(
+        lpm_table   *table,
+        lpm_node    *node,
+        int         stride)
+{
+    int     slots   = 1 << stride;
+    int     ctr     = 0;
+
+    for (ctr = 0; ctr < slots; ctr++){
+        if (node->slots[ctr].child != NULL){
+            free_lpm_node(table, node->slots[ctr].child, LPM_STRIDE);
+        }
+    }
+    table->nodes--;
+    table->memory -= sizeof(lpm_node) + slots * (sizeof(lpm_slot) + sizeof(uint8_t));
+    free(node);
+}
+
+
+/*
+ * Release an empty node which has just been unlinked. The data plane threads may be visiting it.
+ */
+static void release_lpm_node(
+        lpm_table   *table,
+        lpm_node    *node,
+        int         stride)
+{
+    table->nodes--;
+    table->memory -= sizeof(lpm_node) + (1 << stride) * (sizeof(lpm_slot) + sizeof(uint8_t));
+    epoch_defer(node, free);
+}
+
+
+/*
+ * Slot of the node starting at bit offset of the address. The root stride is 8 or 16 bits
+ * and the other strides don't cross a byte boundary.
+ */
+static inline uint32_t get_lpm_index(
+        uint8_t     *bytes,
+        int         offset,
+        int         stride)
+{
+    if (stride == 16){
+        return ((bytes[offset / 8] << 8) | bytes[offset / 8 + 1]);
+    }
+    return ((bytes[offset / 8] >> (8 - stride - offset % 8)) & ((1 << stride) - 1));
+}
+
+
+lpm_table *new_lpm_table(
+        int     max_bits,
+        int     root_stride)
+{
+    lpm_table   *table  = NULL;
+
+    if ((table = (lpm_table *)calloc(1, sizeof(lpm_table))) == NULL){
+        lispd_log_msg(LISP_LOG_WARNING, "new_lpm_table: Unable to allocate memory for lpm_table: %s", strerror(errno));
+        return (NULL);
+    }
+    table->max_bits = max_bits;
+    table->root_stride = root_stride;
+    table->memory = sizeof(lpm_table);
+    return (table);
+}
+
+
+void free_lpm_table(lpm_table *table)
+{
+    if (table == NULL){
+        return;
+    }
+    if (table->root != NULL){
+        free_lpm_node(table, table->root, table->root_stride);
+    }
+    free(table);
+}
+
+
+int lpm_insert(
+        lpm_table   *table,
+        void        *address,
+        int         length,
+        void        *data)
+{
+    uint8_t     *bytes  = (uint8_t *)address;
+    lpm_node    *node   = NULL;
+    lpm_node    *child  = NULL;
+    lpm_slot    *slot   = NULL;
+    int         offset  = 0;
+    int         stride  = table->root_stride;
+    uint32_t    first   = 0;
+    uint32_t    count   = 0;
+    uint32_t    ctr     = 0;
+
+    if (length == 0){
+        __atomic_store_n(&(table->default_data), data, __ATOMIC_RELEASE);
+        table->prefixes++;
+        return (GOOD);
+    }
+    /*
+     * The trie is read concurrently by the data plane threads: new nodes and data are published
+     * with release stores once initialized
+     */
+    if (table->root == NULL){
+        if ((node = new_lpm_node(table, table->root_stride)) == NULL){
+            lispd_log_msg(LISP_LOG_WARNING, "lpm_insert: Unable to allocate memory for lpm_node: %s", strerror(errno));
+            return (ERR_MALLOC);
+        }
+        __atomic_store_n(&(table->root), node, __ATOMIC_RELEASE);
+    }
+
+    /* Descend to the node where the prefix ends */
+    node = table->root;
+    while (length > offset + stride){
+        slot = &(node->slots[get_lpm_index(bytes, offset, stride)]);
+        if (slot->child == NULL){
+            if ((child = new_lpm_node(table, LPM_STRIDE)) == NULL){
+                lispd_log_msg(LISP_LOG_WARNING, "lpm_insert: Unable to allocate memory for lpm_node: %s", strerror(errno));
+                return (ERR_MALLOC);
+            }
+            __atomic_store_n(&(slot->child), child, __ATOMIC_RELEASE);
+            if (slot->data == NULL){
+                node->used++;
+            }
+        }
+        node = slot->child;
+        offset += stride;
+        stride = LPM_STRIDE;
+    }
+
+    /* Expand it to the slots it covers, except those of more specific prefixes */
+    count = 1 << (offset + stride - length);
+    first = get_lpm_index(bytes, offset, stride) & ~(count - 1);
+    for (ctr = first; ctr < first + count; ctr++){
+        slot = &(node->slots[ctr]);
+        if (slot->data != NULL && node->lengths[ctr] > length){
+            continue;
+        }
+        if (slot->data == NULL && slot->child == NULL){
+            node->used++;
+        }
+        node->lengths[ctr] = length;
+        __atomic_store_n(&(slot->data), data, __ATOMIC_RELEASE);
+    }
+    table->prefixes++;
+    return (GOOD);
+}
+
+
+/*
+ * Remove the prefix from the node and its descendants. Returns TRUE if the node is left empty.
+ */
+static int lpm_node_remove(
+        lpm_table   *table,
+        lpm_node    *node,
+        uint8_t     *bytes,
+        int         offset,
+        int         stride,
+        int         length,
+        void        *cover_data,
+        int         cover_length)
+{
+    lpm_slot    *slot   = NULL;
+    lpm_node    *child  = NULL;
+    uint32_t    first   = 0;
+    uint32_t    count   = 0;
+    uint32_t    ctr     = 0;
+
+    if (length > offset + stride){
+        slot = &(node->slots[get_lpm_index(bytes, offset, stride)]);
+        if (slot->child == NULL){
+            return (FALSE);
+        }
+        if (lpm_node_remove(table, slot->child, bytes, offset + stride, LPM_STRIDE, length,
+                cover_data, cover_length) == TRUE){
+            child = slot->child;
+            __atomic_store_n(&(slot->child), NULL, __ATOMIC_RELEASE);
+            release_lpm_node(table, child, LPM_STRIDE);
+            if (slot->data == NULL){
+                node->used--;
+            }
+        }
+        return (node->used == 0);
+    }
+
+    count = 1 << (offset + stride - length);
+    first = get_lpm_index(bytes, offset, stride) & ~(count - 1);
+    for (ctr = first; ctr < first + count; ctr++){
+        slot = &(node->slots[ctr]);
+        if (slot->data == NULL || node->lengths[ctr] != length){
+            continue;
+        }
+        /* The covering prefix was expanded to these slots too if it ends in this node */
+        if (cover_data != NULL && cover_length > offset){
+            __atomic_store_n(&(slot->data), cover_data, __ATOMIC_RELEASE);
+            node->lengths[ctr] = cover_length;
+        }else{
+            __atomic_store_n(&(slot->data), NULL, __ATOMIC_RELEASE);
+            node->lengths[ctr] = 0;
+            if (slot->child == NULL){
+                node->used--;
+            }
+        }
+    }
+    return (node->used == 0);
+}
+
+
+void lpm_remove(
+        lpm_table   *table,
+        void        *address,
+        int         length,
+        void        *cover_data,
+        int         cover_length)
+{
+    lpm_node    *node   = NULL;
+
+    table->prefixes--;
+    if (length == 0){
+        __atomic_store_n(&(table->default_data), NULL, __ATOMIC_RELEASE);
+        return;
+    }
+    if (table->root == NULL){
+        return;
+    }
+    if (lpm_node_remove(table, table->root, (uint8_t *)address, 0, table->root_stride, length,
+            cover_data, cover_length) == TRUE){
+        node = table->root;
+        __atomic_store_n(&(table->root), NULL, __ATOMIC_RELEASE);
+        release_lpm_node(table, node, table->root_stride);
+    }
+}
+
+
+void *lpm_lookup(
+        lpm_table   *table,
+        void        *address)
+{
+    uint8_t     *bytes  = (uint8_t *)address;
+    lpm_node    *node   = __atomic_load_n(&(table->root), __ATOMIC_ACQUIRE);
+    lpm_slot    *slot   = NULL;
+    void        *best   = __atomic_load_n(&(table->default_data), __ATOMIC_ACQUIRE);
+    void        *data   = NULL;
+    uint32_t    index   = 0;
+    int         offset  = table->root_stride;
+
+    if (node == NULL){
+        return (best);
+    }
+    index = get_lpm_index(bytes, 0, table->root_stride);
+    for (;;){
+        slot = &(node->slots[index]);
+        if ((data = __atomic_load_n(&(slot->data), __ATOMIC_ACQUIRE)) != NULL){
+            best = data;
+        }
+        if ((node = __atomic_load_n(&(slot->child), __ATOMIC_ACQUIRE)) == NULL){
+            return (best);
+        }
+        index = get_lpm_index(bytes, offset, LPM_STRIDE);
+        offset += LPM_STRIDE;
+    }
+}
+
+/*
+ * Editor modelines
+ *
+ * vi: set shiftwidth=4 tabstop=4 expandtab:
+ * :indentSize=4:tabSize=4:noTabs=true:
+ */
@@ -0,0 +1,115 @@
+/*
+ * lispd_lpm.h
+ *
+ * This file is part of LISP Mobile Node Implementation.
+ * Multibit trie for the longest prefix match lookups of the data plane.
+ *
+ * Copyright (C) 2012 Cisco Systems, Inc, 2012. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * Please send any bug reports or fixes you make to the email address(es):
+ *    LISP-MN developers <devel@lispmob.org>
+ *
+ */
+
+
+#ifndef LISPD_LPM_H_
+#define LISPD_LPM_H_
+
+#include "lispd.h"
+
+/*
+ * Bits consumed by each level of the trie below the root. The stride of the root is chosen
+ * per table (8 or 16 bits): with a root of 16 bits an IPv4 EID of a /24 is resolved in 3 memory
+ * accesses. Wider strides below the root multiply the memory of the sparse tables of a map cache.
+ */
+#define LPM_STRIDE                  4
+
+/*
+ * Slot of a node. The prefixes ending in the stride of a node are expanded to all the slots
+ * they cover (controlled prefix expansion); the more specific ones continue in the child.
+ */
+typedef struct lpm_slot_ {
+    void                *data;      /* Value of the longest prefix ending in this node covering the slot */
+    struct lpm_node_    *child;
+} lpm_slot;
+
+typedef struct lpm_node_ {
+    int                 used;       /* Slots with data or child */
+    uint8_t             *lengths;   /* Length of the prefix of the data of each slot */
+    lpm_slot            slots[];
+} lpm_node;
+
+/*
+ * Read optimized copy of a patricia tree. The patricia tree remains the database of the
+ * control plane: each insertion or removal in it is mirrored in the trie.
+ */
+typedef struct lpm_table_ {
+    int                 max_bits;   /* 32 or 128 */
+    int                 root_stride;
+    lpm_node            *root;      /* Allocated with the first prefix */
+    void                *default_data;  /* Prefix of length 0 */
+    int                 prefixes;
+    int                 nodes;
+    size_t              memory;
+} lpm_table;
+
+
+lpm_table *new_lpm_table(
+        int     max_bits,
+        int     root_stride);
+
+void free_lpm_table(lpm_table *table);
+
+/*
+ * Insert address/length, not present in the table. The address is in network byte order.
+ * A prefix fully covered by more specific ones is not stored in the slots: it reappears
+ * as the cover of their removal.
+ */
+int lpm_insert(
+        lpm_table   *table,
+        void        *address,
+        int         length,
+        void        *data);
+
+/*
+ * Remove address/length, present in the table. cover_data and cover_length are the longest prefix of the patricia tree
+ * covering the removed one (NULL and 0 if none): they replace it in the slots it was expanded to.
+ */
+void lpm_remove(
+        lpm_table   *table,
+        void        *address,
+        int         length,
+        void        *cover_data,
+        int         cover_length);
+
+/*
+ * Data of the longest prefix matching the address or NULL. It doesn't allocate memory and
+ * can be used by the data plane threads while the main thread modifies the table: the nodes
+ * removed are released after a grace period (lispd_epoch.h).
+ */
+void *lpm_lookup(
+        lpm_table   *table,
+        void        *address);
+
+#endif /* LISPD_LPM_H_ */
+
+/*
+ * Editor modelines
+ *
+ * vi: set shiftwidth=4 tabstop=4 expandtab:
+ * :indentSize=4:tabSize=4:noTabs=true:
+ */
@@ -0,0 +1,169 @@
+/*
+ * lispd_maglev.c
+ *
+ * This file is part of LISP Mobile Node Implementation.
+ * Consistent hashing tables used to distribute the flows among the locators.
+ *
+ * Copyright (C) 2012 Cisco Systems, Inc, 2012. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * Please send any bug reports or fixes you make to the email address(es):
+ *    LISP-MN developers <devel@lispmob.org>
+ *
+ */
+
+
+#include "lispd_maglev.h"
+
+/* Primes with about twice the slots of the previous one */
+static int table_sizes[] = {67, 131, 257, 521, 1031, 2053, MAGLEV_MAX_TABLE_SIZE};
+
+
+int maglev_table_size(int num_items)
+{
+    int     ctr     = 0;
+
+    if (num_items <= 1){
+        return (1);
+    }
+    for (ctr = 0; ctr < sizeof(table_sizes) / sizeof(int); ctr++){
+        if (table_sizes[ctr] >= num_items * MAGLEV_SLOTS_PER_ITEM){
+            return (table_sizes[ctr]);
+        }
+    }
+    return (MAGLEV_MAX_TABLE_SIZE);
+}
+
+
+/* FNV-1a */
+uint32_t maglev_key_hash(
+        uint8_t     *key,
+        int         key_len)
+{
+    uint32_t    hash    = 2166136261U;
+    int         ctr     = 0;
+
+    for (ctr = 0; ctr < key_len; ctr++){
+        hash = (hash ^ key[ctr]) * 16777619U;
+    }
+    return (hash);
+}
+
+
+/* Finalizer of murmur3: the offset and the skip of an item must be independent */
+static inline uint32_t mix_hash(uint32_t hash)
+{
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6bU;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35U;
+    hash ^= hash >> 16;
+    return (hash);
+}
+
+
+int maglev_populate(
+        uint32_t    *keys,
+        int         *weights,
+        int         num_items,
+        int         *table,
+        int         table_size)
+{
+    uint32_t    *next           = NULL;
+    uint32_t    *skip           = NULL;
+    int         *credit         = NULL;
+    int         max_weight      = 0;
+    int         equal_weights   = FALSE;
+    int         weight          = 0;
+    int         filled          = 0;
+    int         ctr             = 0;
+
+    if (num_items <= 0){
+        return (BAD);
+    }
+    for (ctr = 0; ctr < num_items; ctr++){
+        if (weights[ctr] > max_weight){
+            max_weight = weights[ctr];
+        }
+    }
+    if (max_weight == 0){
+        equal_weights = TRUE;
+        max_weight = 1;
+    }
+    if (table_size == 1){
+        ctr = 0;
+        while (equal_weights == FALSE && weights[ctr] == 0){
+            ctr++;
+        }
+        table[0] = ctr;
+        return (GOOD);
+    }
+
+    next = (uint32_t *)malloc(num_items * sizeof(uint32_t));
+    skip = (uint32_t *)malloc(num_items * sizeof(uint32_t));
+    credit = (int *)calloc(num_items, sizeof(int));
+    if (next == NULL || skip == NULL || credit == NULL){
+        lispd_log_msg(LISP_LOG_WARNING, "maglev_populate: Unable to allocate memory: %s", strerror(errno));
+        free(next);
+        free(skip);
+        free(credit);
+        return (ERR_MALLOC);
+    }
+    /* The table size is prime: each item visits all the slots in table_size steps */
+    for (ctr = 0; ctr < num_items; ctr++){
+        next[ctr] = mix_hash(keys[ctr]) % table_size;
+        skip[ctr] = mix_hash(keys[ctr] ^ 0x9e3779b9U) % (table_size - 1) + 1;
+    }
+    for (ctr = 0; ctr < table_size; ctr++){
+        table[ctr] = -1;
+    }
+
+    /*
+     * In each round the items take their next free slot of their permutation. An item takes
+     * part in a round each time its credit reaches the highest weight.
+     */
+    while (filled < table_size){
+        for (ctr = 0; ctr < num_items && filled < table_size; ctr++){
+            weight = (equal_weights == TRUE) ? 1 : weights[ctr];
+            if (weight == 0){
+                continue;
+            }
+            credit[ctr] += weight;
+            if (credit[ctr] < max_weight){
+                continue;
+            }
+            credit[ctr] -= max_weight;
+            while (table[next[ctr]] != -1){
+                next[ctr] = (next[ctr] + skip[ctr]) % table_size;
+            }
+            table[next[ctr]] = ctr;
+            next[ctr] = (next[ctr] + skip[ctr]) % table_size;
+            filled++;
+        }
+    }
+
+    free(next);
+    free(skip);
+    free(credit);
+    return (GOOD);
+}
+
+/*
+ * Editor modelines
+ *
+ * vi: set shiftwidth=4 tabstop=4 expandtab:
+ * :indentSize=4:tabSize=4:noTabs=true:
+ */
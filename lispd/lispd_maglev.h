@@ -0,0 +1,76 @@
+/*
+ * lispd_maglev.h
+ *
+ * This file is part of LISP Mobile Node Implementation.
+ * Consistent hashing tables used to distribute the flows among the locators.
+ *
+ * Copyright (C) 2012 Cisco Systems, Inc, 2012. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * Please send any bug reports or fixes you make to the email address(es):
+ *    LISP-MN developers <devel@lispmob.org>
+ *
+ */
+
+
+#ifndef LISPD_MAGLEV_H_
+#define LISPD_MAGLEV_H_
+
+#include "lispd.h"
+
+/*
+ * The size of a table is the first prime of the list with at least MAGLEV_SLOTS_PER_ITEM
+ * slots per item. It depends only on the number of items: the table keeps its size when
+ * an item is removed and only the flows of the removed item move.
+ */
+#define MAGLEV_SLOTS_PER_ITEM       32
+#define MAGLEV_MAX_TABLE_SIZE       4099
+
+
+/*
+ * Number of slots of a table distributing the flows among num_items items
+ */
+int maglev_table_size(int num_items);
+
+/*
+ * Hash of the key of an item (the address of a locator). It selects the order in which
+ * the item takes the slots of the tables.
+ */
+uint32_t maglev_key_hash(
+        uint8_t     *key,
+        int         key_len);
+
+/*
+ * Fill the table_size slots of table with the index of the item owning each slot
+ * (Maglev consistent hashing). The number of slots of each item is proportional to its weight.
+ * Items with weight 0 get no slot unless all the weights are 0: then all the items get the
+ * same number of slots. Returns GOOD, BAD if there is no item or ERR_MALLOC.
+ */
+int maglev_populate(
+        uint32_t    *keys,
+        int         *weights,
+        int         num_items,
+        int         *table,
+        int         table_size);
+
+#endif /* LISPD_MAGLEV_H_ */
+
+/*
+ * Editor modelines
+ *
+ * vi: set shiftwidth=4 tabstop=4 expandtab:
+ * :indentSize=4:tabSize=4:noTabs=true:
+ */
@@ -29,10 +29,14 @@
  */
 
 #include "lispd.h"
+#include "lispd_epoch.h"
 #include "lispd_lib.h"
 #include "lispd_log.h"
 #include "lispd_map_cache.h"
 #include "lispd_map_cache_db.h"
+#include "lispd_map_request_scheduler.h"
+#include "lispd_miss_queue.h"
+#include "lispd_rloc_index.h"
 
 
 /*
@@ -41,6 +45,7 @@
 lispd_map_cache_entry *new_map_cache_entry_no_db (
         lisp_addr_t     eid_prefix,
         int             eid_prefix_length,
+        int             iid,
         int             how_learned,
         uint16_t        ttl)
 {
@@ -53,12 +58,13 @@ lispd_map_cache_entry *new_map_cache_entry_no_db (
     }
 
     /* Create themapping for this map-cache */
-    map_cache_entry->mapping = new_map_cache_mapping (eid_prefix, eid_prefix_length, 0);
+    map_cache_entry->mapping = new_map_cache_mapping (eid_prefix, eid_prefix_length, iid);
     if (map_cache_entry->mapping == NULL){
         return(NULL);
     }
 
     map_cache_entry->active_witin_period = FALSE;
+    map_cache_entry->refreshing = FALSE;
     map_cache_entry->how_learned = how_learned;
     map_cache_entry->ttl = ttl;
     if (how_learned == DYNAMIC_MAP_CACHE_ENTRY){
@@ -84,12 +90,13 @@ lispd_map_cache_entry *new_map_cache_entry_no_db (
 lispd_map_cache_entry *new_map_cache_entry (
         lisp_addr_t     eid_prefix,
         int             eid_prefix_length,
+        int             iid,
         int             how_learned,
         uint16_t        ttl)
 {
     lispd_map_cache_entry *map_cache_entry;
 
-    map_cache_entry = new_map_cache_entry_no_db (eid_prefix, eid_prefix_length, how_learned, ttl);
+    map_cache_entry = new_map_cache_entry_no_db (eid_prefix, eid_prefix_length, iid, how_learned, ttl);
 
     if (map_cache_entry == NULL){
         return (NULL);
@@ -138,7 +145,19 @@ lispd_map_cache_entry *copy_map_cache_entry (lispd_map_cache_entry *map_cache_en
 }
 
 /*
- * Free memory of a lispd_map_cache_entry structure
+ * Release the memory of an entry once the data plane threads can't reference it
+ */
+static void release_map_cache_entry(lispd_map_cache_entry *entry)
+{
+    /* A data plane thread may have held a packet while the entry was being removed */
+    drop_held_packets(entry);
+    free_mapping_elt(entry->mapping);
+    free(entry);
+}
+
+/*
+ * Free memory of a lispd_map_cache_entry structure. The entry must have been removed
+ * from the database: its memory is released after a grace period.
  */
 void free_map_cache_entry(lispd_map_cache_entry *entry)
 {
@@ -146,7 +165,14 @@ void free_map_cache_entry(lispd_map_cache_entry *entry)
         return;
     }
 
-    free_mapping_elt(entry->mapping);
+    unaccount_map_cache_entry(entry);
+    cancel_map_request(entry);
+    drop_held_packets(entry);
+    /* The entry is no longer probed or SMR'ed although its locators are released later */
+    if (entry->mapping != NULL){
+        unindex_locators_list(entry->mapping->head_v4_locators_list);
+        unindex_locators_list(entry->mapping->head_v6_locators_list);
+    }
     /*
      * Free the entry
      */
@@ -166,9 +192,10 @@ void free_map_cache_entry(lispd_map_cache_entry *entry)
     }
 
     if (entry->nonces != NULL){
-        free(entry->nonces);
+        free_nonces_list(entry->nonces);
+        entry->nonces = NULL;
     }
-    free(entry);
+    epoch_defer(entry, (epoch_callback)release_map_cache_entry);
 }
 
 /*
@@ -194,7 +221,6 @@ int activate_negative_map_cache (
     cache_entry->active = TRUE;
     cache_entry->ttl = ttl;
     cache_entry->actions = action;
-    cache_entry->active_witin_period = 1;
     cache_entry->timestamp = time(NULL);
     /* Stop Map Request Timer */
     if (cache_entry->request_retry_timer != NULL){
@@ -203,16 +229,15 @@ int activate_negative_map_cache (
     }
     /* Remove Nonces */
     if (cache_entry->nonces != NULL){
-        free (cache_entry->nonces);
+        free_nonces_list(cache_entry->nonces);
         cache_entry->nonces = NULL;
     }
+    map_request_resolved(cache_entry);
+    /* Held packets are dropped: the entry is negative */
+    release_held_packets(cache_entry);
 
     /* Expiration cache timer */
-    if (cache_entry->expiry_cache_timer == NULL){
-        cache_entry->expiry_cache_timer = create_timer (EXPIRE_MAP_CACHE_TIMER);
-    }
-    start_timer(cache_entry->expiry_cache_timer, cache_entry->ttl*60, (timer_callback)map_cache_entry_expiration,
-            (void *)cache_entry);
+    program_map_cache_entry_expiration(cache_entry);
     lispd_log_msg(LISP_LOG_DEBUG_1,"Activated negative map cache with prefix %s/%d. The entry will expire in %d minutes.",
             get_char_from_lisp_addr_t(cache_entry->mapping->eid_prefix),
             cache_entry->mapping->eid_prefix_length, cache_entry->ttl);
@@ -59,13 +59,29 @@ typedef struct lispd_map_cache_entry_ {
     uint8_t                     how_learned:2;
     uint8_t                     actions:2;
     uint8_t                     active:1;       /* TRUE if we have received a map reply for this entry */
-    uint8_t                     active_witin_period:1;
+    uint8_t                     refreshing:1;   /* Refresh Map-Request sent before the TTL expires (lispd_map_cache_db.h) */
     uint16_t                    ttl;
     time_t                      timestamp;
     timer                       *expiry_cache_timer;
     timer                       *request_retry_timer;
     timer                       *smr_inv_timer;
     nonces_list                 *nonces;
+    /* Packets waiting for the entry to be resolved (lispd_miss_queue.h) */
+    struct miss_queued_packet_  *held_packets;
+    int                         held_packets_count;
+    /* Scheduling of the Map-Requests of the entry while it is resolved (lispd_map_request_scheduler.h) */
+    struct map_request_state_   *request_state;
+    /*
+     * Set by the data plane each time the entry is used. Cleared by the CLOCK hand of the map cache.
+     * Not bitfields: the data plane threads would overwrite the bits written by the control plane.
+     */
+    uint8_t                     referenced;
+    /* Used by the data plane since the entry was (re)activated. Cleared when the entry is refreshed. */
+    uint8_t                     active_witin_period;
+    /* Ring of the dynamic entries swept by the CLOCK hand */
+    struct lispd_map_cache_entry_ *clock_next;
+    struct lispd_map_cache_entry_ *clock_prev;
+    uint32_t                    memory;         /* Bytes accounted in the map cache. 0 if not in the database */
 }lispd_map_cache_entry;
 
 /****************************************  FUNCTIONS **************************************/
@@ -73,7 +89,7 @@ typedef struct lispd_map_cache_entry_ {
 /*
  * Create a map cache entry and save it in the database
  */
-lispd_map_cache_entry *new_map_cache_entry (lisp_addr_t eid_prefix, int eid_prefix_length, int how_learned, uint16_t ttl);
+lispd_map_cache_entry *new_map_cache_entry (lisp_addr_t eid_prefix, int eid_prefix_length, int iid, int how_learned, uint16_t ttl);
 
 /*
  * Generates a copy of a map cache entry without initializing timers and nonces. The entry is not
@@ -85,7 +101,7 @@ lispd_map_cache_entry *copy_map_cache_entry (lispd_map_cache_entry *map_cache_en
  * Create a map cache entry but not saved in the database.
  * Used to create the proxy-etr list
  */
-lispd_map_cache_entry *new_map_cache_entry_no_db (lisp_addr_t eid_prefix, int eid_prefix_length, int how_learned, uint16_t ttl);
+lispd_map_cache_entry *new_map_cache_entry_no_db (lisp_addr_t eid_prefix, int eid_prefix_length, int iid, int how_learned, uint16_t ttl);
 
 /*
  * Free memory of a lispd_map_cache_entry structure
@@ -28,16 +28,42 @@
  *    Albert Lopez      <alopez@ac.upc.edu>
  */
 
+#include "lispd_external.h"
+#include "lispd_flow_cache.h"
+#include "lispd_instance.h"
 #include "lispd_lib.h"
 #include "lispd_map_cache_db.h"
+#include "lispd_map_request.h"
 #include <math.h>
 
 /*
- *  Patricia tree based databases
+ * Patricia tree based databases of each Instance ID, with their copies optimized for the lookups
+ * of the data plane
  */
+static instance_table *map_cache_instances  = NULL;
 
-patricia_tree_t *AF4_map_cache           = NULL;
-patricia_tree_t *AF6_map_cache           = NULL;
+/*
+ * Size of the map cache. Dynamic entries are kept in a ring swept by a CLOCK hand:
+ * an entry used since the last pass of the hand gets a second chance.
+ */
+static struct {
+    lispd_map_cache_entry   *hand;
+    int                     dynamic_entries;
+    int                     entries[2];     /* IPv4, IPv6 */
+    uint64_t                memory[2];
+    uint64_t                evictions;
+    uint64_t                refused;        /* Misses not cached: no entry could be evicted */
+} map_cache_size_info;
+
+/*
+ * Refresh of the entries in use before their TTL expires
+ */
+static struct {
+    uint64_t                sent;
+    uint64_t                idle;           /* Entries not used since they were activated: not refreshed */
+    uint64_t                hits;           /* Refreshed before the expiration */
+    uint64_t                misses;         /* Expired while the refresh was waiting for its Map-Reply */
+} map_cache_refresh_info;
 
 
 /*
@@ -47,11 +73,9 @@ int map_cache_init()
 {
   lispd_log_msg(LISP_LOG_DEBUG_2,  " Creating map cache...");
 
-  AF4_map_cache = New_Patricia(sizeof(struct in_addr) * 8);
-  AF6_map_cache = New_Patricia(sizeof(struct in6_addr) * 8);
-
+  map_cache_instances = new_instance_table(MAP_CACHE_ROOT_STRIDE, MAP_CACHE_IID_ROOT_STRIDE);
 
-  if (!AF4_map_cache || !AF6_map_cache){
+  if (!map_cache_instances){
       lispd_log_msg(LISP_LOG_CRIT, "map_cache_init: Unable to allocate memory for map cache database");
       return (BAD);
   }
@@ -59,16 +83,217 @@ int map_cache_init()
 }
 
 /*
- * Return map cache data base
+ * Return map cache data base of the Instance ID or NULL if it has no entries
  */
-patricia_tree_t* get_map_cache_db(int afi)
+patricia_tree_t* get_map_cache_db(
+        int     iid,
+        int     afi)
 {
+    lispd_instance  *instance   = lookup_instance(map_cache_instances, iid);
+
+    if (instance == NULL){
+        return (NULL);
+    }
     if (afi == AF_INET)
-        return (AF4_map_cache);
+        return (instance->db[0]);
     else
-        return (AF6_map_cache);
+        return (instance->db[1]);
+}
+
+/*
+ * Estimation of the memory used by an entry, its mapping, its locators and its node of the trie
+ */
+static uint32_t get_map_cache_entry_memory(lispd_map_cache_entry *entry)
+{
+    lispd_mapping_elt           *mapping        = entry->mapping;
+    rmt_mapping_extended_info   *extended_info  = NULL;
+    uint32_t                    memory          = 0;
+
+    memory = sizeof(lispd_map_cache_entry) + sizeof(lispd_mapping_elt) + sizeof(patricia_node_t) + sizeof(prefix_t);
+    if (entry->nonces != NULL){
+        memory += sizeof(nonces_list);
+    }
+    memory += mapping->locator_count * (sizeof(lispd_locators_list) + sizeof(lispd_locator_elt) + sizeof(lisp_addr_t) +
+            sizeof(uint8_t) + sizeof(rmt_locator_extended_info));
+    extended_info = (rmt_mapping_extended_info *)mapping->extended_info;
+    if (extended_info != NULL){
+        memory += sizeof(rmt_mapping_extended_info);
+    }
+    if (extended_info != NULL && extended_info->rmt_balancing_locators_vecs != NULL){
+        memory += sizeof(balancing_locators_vecs);
+        memory += sizeof(lispd_locator_elt *) * (extended_info->rmt_balancing_locators_vecs->v4_locators_vec_length +
+                extended_info->rmt_balancing_locators_vecs->v6_locators_vec_length +
+                extended_info->rmt_balancing_locators_vecs->locators_vec_length);
+    }
+    return (memory);
+}
+
+
+static inline int get_afi_index(int afi)
+{
+    return ((afi == AF_INET) ? 0 : 1);
+}
+
+
+void account_map_cache_entry(lispd_map_cache_entry *entry)
+{
+    int         afi_idx     = get_afi_index(entry->mapping->eid_prefix.afi);
+    uint32_t    memory      = get_map_cache_entry_memory(entry);
+
+    if (entry->memory == 0){
+        map_cache_size_info.entries[afi_idx]++;
+        if (entry->how_learned == DYNAMIC_MAP_CACHE_ENTRY){
+            /* New entries are inserted behind the hand: they are the last ones to be visited */
+            if (map_cache_size_info.hand == NULL){
+                entry->clock_next = entry;
+                entry->clock_prev = entry;
+                map_cache_size_info.hand = entry;
+            }else{
+                entry->clock_next = map_cache_size_info.hand;
+                entry->clock_prev = map_cache_size_info.hand->clock_prev;
+                entry->clock_prev->clock_next = entry;
+                map_cache_size_info.hand->clock_prev = entry;
+            }
+            entry->referenced = TRUE;
+            map_cache_size_info.dynamic_entries++;
+        }
+    }else{
+        map_cache_size_info.memory[afi_idx] -= entry->memory;
+    }
+    entry->memory = memory;
+    map_cache_size_info.memory[afi_idx] += memory;
+}
+
+
+void unaccount_map_cache_entry(lispd_map_cache_entry *entry)
+{
+    int         afi_idx     = get_afi_index(entry->mapping->eid_prefix.afi);
+
+    if (entry->memory == 0){
+        return;
+    }
+    map_cache_size_info.entries[afi_idx]--;
+    map_cache_size_info.memory[afi_idx] -= entry->memory;
+    entry->memory = 0;
+    if (entry->clock_next != NULL){
+        if (entry->clock_next == entry){
+            map_cache_size_info.hand = NULL;
+        }else{
+            if (map_cache_size_info.hand == entry){
+                map_cache_size_info.hand = entry->clock_next;
+            }
+            entry->clock_prev->clock_next = entry->clock_next;
+            entry->clock_next->clock_prev = entry->clock_prev;
+        }
+        entry->clock_next = NULL;
+        entry->clock_prev = NULL;
+        map_cache_size_info.dynamic_entries--;
+    }
+}
+
+
+static int is_map_cache_full()
+{
+    if (map_cache_size != 0 && map_cache_size_info.dynamic_entries >= map_cache_size){
+        return (TRUE);
+    }
+    if (map_cache_memory != 0 &&
+            map_cache_size_info.memory[0] + map_cache_size_info.memory[1] >= (uint64_t)map_cache_memory * 1024){
+        return (TRUE);
+    }
+    return (FALSE);
 }
 
+
+/*
+ * Advance the CLOCK hand until an entry not used since the previous pass is found. The entries
+ * being resolved are skipped: their Map-Request is in flight.
+ */
+static lispd_map_cache_entry *select_map_cache_victim()
+{
+    lispd_map_cache_entry   *entry      = NULL;
+    int                     visited     = 0;
+
+    while (map_cache_size_info.hand != NULL && visited < 2 * map_cache_size_info.dynamic_entries){
+        entry = map_cache_size_info.hand;
+        map_cache_size_info.hand = entry->clock_next;
+        visited++;
+        if (entry->active == NO_ACTIVE){
+            continue;
+        }
+        if (entry->referenced == TRUE){
+            entry->referenced = FALSE;
+            continue;
+        }
+        return (entry);
+    }
+    return (NULL);
+}
+
+
+int make_room_in_map_cache()
+{
+    lispd_map_cache_entry   *victim     = NULL;
+
+    while (is_map_cache_full() == TRUE){
+        if ((victim = select_map_cache_victim()) == NULL){
+            map_cache_size_info.refused++;
+            lispd_log_msg(LISP_LOG_DEBUG_1, "make_room_in_map_cache: The map cache is full and all its entries are "
+                    "in use or being resolved");
+            return (BAD);
+        }
+        lispd_log_msg(LISP_LOG_DEBUG_2, "Evicting map cache entry %s/%d: the map cache is full",
+                get_char_from_lisp_addr_t(victim->mapping->eid_prefix), victim->mapping->eid_prefix_length);
+        map_cache_size_info.evictions++;
+        del_map_cache_entry_from_db(victim->mapping->eid_prefix, victim->mapping->eid_prefix_length, victim->mapping->iid);
+    }
+    return (GOOD);
+}
+
+
+void dump_map_cache_stats(int log_level)
+{
+    lispd_instance  *instance   = NULL;
+    int             prefixes[2] = {0, 0};
+    int             nodes[2]    = {0, 0};
+    size_t          memory[2]   = {0, 0};
+    int             ctr         = 0;
+
+    if (is_loggable(log_level) == FALSE){
+        return;
+    }
+    lispd_log_msg(log_level, "Map cache: IPv4: %d entries, %llu KB   IPv6: %d entries, %llu KB   dynamic: %d (limit %d)   "
+            "evictions: %llu   refused: %llu",
+            map_cache_size_info.entries[0], (unsigned long long)(map_cache_size_info.memory[0] / 1024),
+            map_cache_size_info.entries[1], (unsigned long long)(map_cache_size_info.memory[1] / 1024),
+            map_cache_size_info.dynamic_entries, map_cache_size,
+            (unsigned long long)map_cache_size_info.evictions,
+            (unsigned long long)map_cache_size_info.refused);
+    if (map_cache_instances != NULL){
+        for (instance = map_cache_instances->instances; instance != NULL; instance = instance->next){
+            for (ctr = 0 ; ctr < 2 ; ctr++){
+                prefixes[ctr] += instance->lpm[ctr]->prefixes;
+                nodes[ctr] += instance->lpm[ctr]->nodes;
+                memory[ctr] += instance->lpm[ctr]->memory;
+            }
+        }
+        lispd_log_msg(log_level, "Map cache LPM: Instance IDs: %d   IPv4: %d prefixes, %d nodes, %lu KB   "
+                "IPv6: %d prefixes, %d nodes, %lu KB",
+                map_cache_instances->num_instances + 1,
+                prefixes[0], nodes[0], (unsigned long)(memory[0] / 1024),
+                prefixes[1], nodes[1], (unsigned long)(memory[1] / 1024));
+    }
+    lispd_log_msg(log_level, "Map cache refresh (%d%% of the TTL): sent %llu   idle %llu   hits %llu   misses %llu   hit rate: %.1f%%",
+            map_cache_refresh,
+            (unsigned long long)map_cache_refresh_info.sent,
+            (unsigned long long)map_cache_refresh_info.idle,
+            (unsigned long long)map_cache_refresh_info.hits,
+            (unsigned long long)map_cache_refresh_info.misses,
+            (map_cache_refresh_info.hits + map_cache_refresh_info.misses == 0) ? 0.0 :
+                    100.0 * map_cache_refresh_info.hits / (map_cache_refresh_info.hits + map_cache_refresh_info.misses));
+}
+
+
 /*
  *  Add a map cache entry to the database.
  */
@@ -77,12 +302,17 @@ int add_map_cache_entry_to_db(lispd_map_cache_entry *entry)
     prefix_t                *prefix             = NULL;
     patricia_node_t         *node               = NULL;
     lispd_map_cache_entry   *entry2             = NULL;
+    lispd_instance          *instance           = NULL;
     lisp_addr_t             eid_prefix;
     int                     eid_prefix_length   = 0;
 
     eid_prefix = entry->mapping->eid_prefix;
     eid_prefix_length = entry->mapping->eid_prefix_length;
 
+    if ((instance = add_instance(map_cache_instances, entry->mapping->iid)) == NULL){
+        return (ERR_MALLOC);
+    }
+
     if ((node = malloc(sizeof(patricia_node_t))) == NULL) {
         lispd_log_msg(LISP_LOG_WARNING, "add_map_cache_entry: Unable to allocate memory for patrica_node_t: %s", strerror(errno));
         return(ERR_MALLOC);
@@ -95,7 +325,7 @@ int add_map_cache_entry_to_db(lispd_map_cache_entry *entry)
             free(node);
             return(ERR_MALLOC);
         }
-        node = patricia_lookup(AF4_map_cache, prefix);
+        node = patricia_lookup(instance->db[0], prefix);
         break;
     case AF_INET6:
         if ((prefix = New_Prefix(AF_INET6, &(eid_prefix.address.ipv6), eid_prefix_length)) == NULL) {
@@ -103,7 +333,7 @@ int add_map_cache_entry_to_db(lispd_map_cache_entry *entry)
             free(node);
             return(ERR_MALLOC);
         }
-        node = patricia_lookup(AF6_map_cache, prefix);
+        node = patricia_lookup(instance->db[1], prefix);
         break;
     default:
         free(node);
@@ -113,79 +343,61 @@ int add_map_cache_entry_to_db(lispd_map_cache_entry *entry)
     Deref_Prefix(prefix);
     if (node->data != NULL){            /* The node already exists */
         entry2 = (lispd_map_cache_entry *)node->data;
-        lispd_log_msg(LISP_LOG_DEBUG_2, "add_map_cache_entry: Map cache entry (%s/%d) already installed in the data base",
-                get_char_from_lisp_addr_t(entry2->mapping->eid_prefix),entry2->mapping->eid_prefix_length);
+        lispd_log_msg(LISP_LOG_DEBUG_2, "add_map_cache_entry: Map cache entry (%s/%d IID %d) already installed in the data base",
+                get_char_from_lisp_addr_t(entry2->mapping->eid_prefix),entry2->mapping->eid_prefix_length,
+                entry2->mapping->iid);
         return (BAD);
     }
+    if (lpm_insert(instance->lpm[get_afi_index(eid_prefix.afi)], &(eid_prefix.address), eid_prefix_length, entry) != GOOD){
+        patricia_remove(instance->db[get_afi_index(eid_prefix.afi)], node);
+        return (ERR_MALLOC);
+    }
     node->data = (lispd_map_cache_entry *) entry;
-    lispd_log_msg(LISP_LOG_DEBUG_2, "Added map cache entry for EID: %s/%d",
-            get_char_from_lisp_addr_t(entry->mapping->eid_prefix),eid_prefix_length);
+    account_map_cache_entry(entry);
+    if (entry->mapping->iid == 0){
+        lispd_log_msg(LISP_LOG_DEBUG_2, "Added map cache entry for EID: %s/%d",
+                get_char_from_lisp_addr_t(entry->mapping->eid_prefix),eid_prefix_length);
+    }else{
+        lispd_log_msg(LISP_LOG_DEBUG_2, "Added map cache entry for EID: %s/%d IID %d",
+                get_char_from_lisp_addr_t(entry->mapping->eid_prefix),eid_prefix_length,entry->mapping->iid);
+    }
     return (GOOD);
 }
 
 
 
-/*
- * Given an eid , return the best patricai node in the map cache database (the most
- * specific prefix that contains the EID) or NULL if no one is found
- */
-
-patricia_node_t *lookup_map_cache_node(lisp_addr_t eid)
-{
-    patricia_node_t   *node = NULL;
-    prefix_t          prefix;
-
-    switch(eid.afi) {
-    case AF_INET:
-        prefix.family = AF_INET;
-        prefix.bitlen = 32;
-        prefix.ref_count = 0;
-        prefix.add.sin.s_addr = eid.address.ip.s_addr;
-        node = patricia_search_best(AF4_map_cache, &prefix);
-        break;
-    case AF_INET6:
-        prefix.family = AF_INET6;
-        prefix.bitlen = 128;
-        prefix.ref_count = 0;
-        memcpy (&(prefix.add.sin6), &(eid.address.ipv6), sizeof(struct in6_addr));
-        node = patricia_search_best(AF6_map_cache, &prefix);
-        break;
-    default:
-        break;
-    }
-
-    if (node==NULL){
-        lispd_log_msg(LISP_LOG_DEBUG_3, "lookup_map_cache_node: The entry %s is not found in the map cache", get_char_from_lisp_addr_t(eid));
-    }
-
-    return(node);
-}
-
 /*
  * Given an eid , return the node in the map cache database  of this EID
  * or NULL if it doesn't exist
  */
 patricia_node_t * lookup_map_cache_exact_node(
         lisp_addr_t     eid,
-        int             prefixlen)
+        int             prefixlen,
+        int             iid)
 {
-    patricia_node_t     *node = NULL;
+    patricia_node_t     *node       = NULL;
+    lispd_instance      *instance   = NULL;
     prefix_t            prefix;
 
+    if ((instance = lookup_instance(map_cache_instances, iid)) == NULL){
+        lispd_log_msg(LISP_LOG_DEBUG_3, "lookup_map_cache_exact_node: No map cache entry with IID %d", iid);
+        return (NULL);
+    }
+
     switch(eid.afi) {
     case AF_INET:
         prefix.family = AF_INET;
         prefix.bitlen = prefixlen;
         prefix.ref_count = 0;
         prefix.add.sin.s_addr = eid.address.ip.s_addr;
-        node = patricia_search_exact(AF4_map_cache, &prefix);
+        node = patricia_search_exact(instance->db[0], &prefix);
         break;
     case AF_INET6:
         prefix.family = AF_INET6;
         prefix.bitlen = prefixlen;
         prefix.ref_count = 0;
         memcpy (&(prefix.add.sin6), &(eid.address.ipv6), sizeof(struct in6_addr));
-        node = patricia_search_exact(AF6_map_cache, &prefix);
+        node = patricia_search_exact(instance->db[1], &prefix);
         break;
     default:
         break;
@@ -199,22 +411,61 @@ patricia_node_t * lookup_map_cache_exact_node(
 }
 
 /*
- * Look up a given eid in the database, returning the
+ * Look up a given eid in the database of the Instance ID, returning the
  * lispd_map_cache_entry of this EID if it exists or NULL.
+ * The data plane copy of the trie is used.
  */
 
-lispd_map_cache_entry *lookup_map_cache(lisp_addr_t eid)
+lispd_map_cache_entry *lookup_map_cache(
+        lisp_addr_t     eid,
+        int             iid)
 {
-  patricia_node_t           *node  = NULL;
-  lispd_map_cache_entry     *entry = NULL;
+    lispd_map_cache_entry     *entry    = NULL;
+    lispd_instance            *instance = lookup_instance(map_cache_instances, iid);
+
+    if (instance != NULL){
+        switch(eid.afi) {
+        case AF_INET:
+            entry = (lispd_map_cache_entry *)lpm_lookup(instance->lpm[0], &(eid.address.ip));
+            break;
+        case AF_INET6:
+            entry = (lispd_map_cache_entry *)lpm_lookup(instance->lpm[1], &(eid.address.ipv6));
+            break;
+        default:
+            break;
+        }
+    }
 
-  node = lookup_map_cache_node(eid);
-  if ( node == NULL ){
-      return(NULL);
-  }
-  entry = (lispd_map_cache_entry *)(node->data);
+    if (entry == NULL && is_loggable(LISP_LOG_DEBUG_3) == TRUE){
+        lispd_log_msg(LISP_LOG_DEBUG_3, "lookup_map_cache: The entry %s is not found in the map cache", get_char_from_lisp_addr_t(eid));
+    }
+    return(entry);
+}
 
-  return(entry);
+/*
+ * Mirror in the data plane copy of the trie the removal of a prefix from the map cache. The slots
+ * of the prefix get the entry of the trie covering it.
+ */
+static void remove_map_cache_prefix_from_lpm(
+        lispd_instance  *instance,
+        lisp_addr_t     eid_prefix,
+        int             eid_prefix_length)
+{
+    patricia_node_t     *cover      = NULL;
+    int                 afi_idx     = get_afi_index(eid_prefix.afi);
+    prefix_t            prefix;
+
+    prefix.family = eid_prefix.afi;
+    prefix.bitlen = eid_prefix_length;
+    prefix.ref_count = 0;
+    memcpy (&(prefix.add), &(eid_prefix.address), get_addr_len(eid_prefix.afi));
+    cover = patricia_search_best(instance->db[afi_idx], &prefix);
+    if (cover != NULL && cover->data != NULL){
+        lpm_remove(instance->lpm[afi_idx], &(eid_prefix.address), eid_prefix_length,
+                cover->data, cover->prefix->bitlen);
+    }else{
+        lpm_remove(instance->lpm[afi_idx], &(eid_prefix.address), eid_prefix_length, NULL, 0);
+    }
 }
 
 
@@ -224,12 +475,13 @@ lispd_map_cache_entry *lookup_map_cache(lisp_addr_t eid)
 
 lispd_map_cache_entry *lookup_map_cache_exact(
         lisp_addr_t             eid,
-        int                     prefixlen)
+        int                     prefixlen,
+        int                     iid)
 {
     lispd_map_cache_entry   *entry = NULL;
     patricia_node_t         *node  = NULL;
 
-    node = lookup_map_cache_exact_node(eid,prefixlen);
+    node = lookup_map_cache_exact_node(eid,prefixlen,iid);
     if ( node == NULL ){
           return(NULL);
     }
@@ -239,34 +491,42 @@ lispd_map_cache_entry *lookup_map_cache_exact(
 }
 
 /*
- * Lookup if there is a no active cache entry with the provided nonce and return it
+ * Lookup if there is a no active cache entry with the provided nonce and return it.
+ * The nonce is searched in the nonce index instead of walking the map cache.
  */
 
 lispd_map_cache_entry *lookup_nonce_in_no_active_map_caches(
-        int         eid_afi,
+        lisp_addr_t eid_prefix,
+        int         eid_prefix_length,
+        int         iid,
         uint64_t    nonce)
 {
-    patricia_tree_t         *tree;
-    patricia_node_t         *node;
-    lispd_map_cache_entry   *entry;
-
-    if (eid_afi == AF_INET)
-        tree = AF4_map_cache;
-    else
-        tree = AF6_map_cache;
-
-    PATRICIA_WALK(tree->head, node) {
-        entry = ((lispd_map_cache_entry *)(node->data));
-        if (entry->active == FALSE){
-            if (check_nonce(entry->nonces,nonce) == GOOD){
-                free(entry->nonces);
-                entry->nonces = NULL;
-                return (entry);
+    nonces_list             *nonces     = NULL;
+    lispd_map_cache_entry   *entry      = NULL;
+    lispd_map_cache_entry   *candidate  = NULL;
+
+    nonces = lookup_nonce(nonce, NONCE_OWNER_MAP_CACHE);
+    while (nonces != NULL){
+        entry = (lispd_map_cache_entry *)nonces->owner;
+        if (entry->active == FALSE && entry->mapping->eid_prefix.afi == eid_prefix.afi && entry->mapping->iid == iid){
+            if (is_prefix_b_part_of_a(eid_prefix, eid_prefix_length,
+                    entry->mapping->eid_prefix, entry->mapping->eid_prefix_length) == TRUE){
+                candidate = entry;
+                break;
+            }
+            /* A reply for a prefix not including the requested EID is accepted if it is the only one */
+            if (candidate == NULL){
+                candidate = entry;
             }
         }
-    } PATRICIA_WALK_END;
-
-    return (NULL);
+        nonces = lookup_next_nonce(nonce, NONCE_OWNER_MAP_CACHE, nonces);
+    }
+    if (candidate == NULL){
+        return (NULL);
+    }
+    free_nonces_list(candidate->nonces);
+    candidate->nonces = NULL;
+    return (candidate);
 }
 
 
@@ -277,12 +537,14 @@ lispd_map_cache_entry *lookup_nonce_in_no_active_map_caches(
  */
 void del_map_cache_entry_from_db(
         lisp_addr_t eid,
-        int prefixlen)
+        int         prefixlen,
+        int         iid)
 {
     lispd_map_cache_entry *entry    = NULL;
-    patricia_node_t       *node   = NULL;
+    patricia_node_t       *node     = NULL;
+    lispd_instance        *instance = NULL;
 
-    node = lookup_map_cache_exact_node(eid, prefixlen);
+    node = lookup_map_cache_exact_node(eid, prefixlen, iid);
     if (node == NULL){
         lispd_log_msg(LISP_LOG_DEBUG_2,"del_map_cache_entry: Unable to locate cache entry %s/%d for deletion",get_char_from_lisp_addr_t(eid),prefixlen);
         return;
@@ -293,11 +555,11 @@ void del_map_cache_entry_from_db(
     /*
      * Remove the entry from the trie
      */
+    flow_cache_invalidate_all();
     entry = (lispd_map_cache_entry *)(node->data);
-    if (eid.afi==AF_INET)
-        patricia_remove(AF4_map_cache, node);
-    else
-        patricia_remove(AF6_map_cache, node);
+    instance = lookup_instance(map_cache_instances, iid);
+    patricia_remove(instance->db[get_afi_index(eid.afi)], node);
+    remove_map_cache_prefix_from_lpm(instance, eid, prefixlen);
 
     free_map_cache_entry(entry);
 }
@@ -312,21 +574,22 @@ int change_map_cache_prefix_in_db(
         int                     new_eid_prefix_length,
         lispd_map_cache_entry   *cache_entry)
 {
-    patricia_node_t         *node = NULL;
+    patricia_node_t         *node       = NULL;
+    lispd_instance          *instance   = NULL;
     lisp_addr_t             old_eid_prefix;
     int                     old_eid_prefix_length;
 
     /* Get the node to be modified from the database */
-    node = lookup_map_cache_exact_node(cache_entry->mapping->eid_prefix, cache_entry->mapping->eid_prefix_length);
+    node = lookup_map_cache_exact_node(cache_entry->mapping->eid_prefix, cache_entry->mapping->eid_prefix_length,
+            cache_entry->mapping->iid);
     if (node == NULL){
         return (BAD);
     }
     /* Remove the node from the database*/
-    if (cache_entry->mapping->eid_prefix.afi==AF_INET){
-        patricia_remove(AF4_map_cache, node);
-    }else{
-        patricia_remove(AF6_map_cache, node);
-    }
+    flow_cache_invalidate_all();
+    instance = lookup_instance(map_cache_instances, cache_entry->mapping->iid);
+    patricia_remove(instance->db[get_afi_index(cache_entry->mapping->eid_prefix.afi)], node);
+    remove_map_cache_prefix_from_lpm(instance, cache_entry->mapping->eid_prefix, cache_entry->mapping->eid_prefix_length);
 
     old_eid_prefix = cache_entry->mapping->eid_prefix;
     old_eid_prefix_length = cache_entry->mapping->eid_prefix_length;
@@ -365,7 +628,107 @@ void map_cache_entry_expiration(
 
     lispd_log_msg(LISP_LOG_DEBUG_1,"Got expiration for EID %s/%d", get_char_from_lisp_addr_t(entry->mapping->eid_prefix),
             entry->mapping->eid_prefix_length);
-    del_map_cache_entry_from_db(entry->mapping->eid_prefix, entry->mapping->eid_prefix_length);
+    if (entry->refreshing == TRUE){
+        map_cache_refresh_info.misses++;
+    }
+    del_map_cache_entry_from_db(entry->mapping->eid_prefix, entry->mapping->eid_prefix_length, entry->mapping->iid);
+}
+
+/*
+ * Milliseconds until the TTL of the entry expires, counted from its activation
+ */
+static uint64_t get_map_cache_entry_remaining_ttl(lispd_map_cache_entry *entry)
+{
+    uint64_t    ttl_ms      = MINUTES_TO_MS(entry->ttl);
+    uint64_t    elapsed_ms  = 0;
+    time_t      now         = time(NULL);
+
+    if (now > entry->timestamp){
+        elapsed_ms = (uint64_t)(now - entry->timestamp) * 1000;
+    }
+    return ((elapsed_ms < ttl_ms) ? ttl_ms - elapsed_ms : 0);
+}
+
+/*
+ * Called at map_cache_refresh % of the TTL of the entry. If the entry has been used, a Map-Request
+ * is sent to refresh it while the packets continue using its current locators.
+ */
+static int map_cache_entry_refresh(
+        timer   *t,
+        void    *arg)
+{
+    lispd_map_cache_entry   *entry      = (lispd_map_cache_entry *)arg;
+
+    if (entry->active_witin_period == FALSE){
+        map_cache_refresh_info.idle++;
+    }else if (entry->nonces == NULL){ /* Otherwise a SMR triggered Map-Request is already in process */
+        lispd_log_msg(LISP_LOG_DEBUG_1,"Refreshing map cache entry %s/%d before its expiration",
+                get_char_from_lisp_addr_t(entry->mapping->eid_prefix), entry->mapping->eid_prefix_length);
+        map_cache_refresh_info.sent++;
+        entry->refreshing = TRUE;
+        send_map_request_refresh(NULL, (void *)entry);
+    }
+    start_timer(entry->expiry_cache_timer, get_map_cache_entry_remaining_ttl(entry),
+            (timer_callback)map_cache_entry_expiration, (void *)entry);
+    return (GOOD);
+}
+
+
+void program_map_cache_entry_expiration(lispd_map_cache_entry *entry)
+{
+    uint64_t    remaining_ms    = get_map_cache_entry_remaining_ttl(entry);
+    uint64_t    elapsed_ms      = MINUTES_TO_MS(entry->ttl) - remaining_ms;
+    uint64_t    refresh_ms      = MINUTES_TO_MS(entry->ttl) * map_cache_refresh / 100;
+
+    if (entry->expiry_cache_timer == NULL){
+        entry->expiry_cache_timer = create_timer(NULL);
+    }
+    entry->active_witin_period = FALSE;
+    /* The DDT client resolves the entries through the referral cache: they are not refreshed */
+    if (map_cache_refresh != 0 && ddt_client == FALSE && remaining_ms != 0){
+        /* An entry restored after its refresh point is refreshed in the same proportion of what remains */
+        if (refresh_ms > elapsed_ms){
+            refresh_ms -= elapsed_ms;
+        }else{
+            refresh_ms = remaining_ms * map_cache_refresh / 100;
+        }
+        start_timer(entry->expiry_cache_timer, refresh_ms, (timer_callback)map_cache_entry_refresh, (void *)entry);
+    }else{
+        start_timer(entry->expiry_cache_timer, remaining_ms, (timer_callback)map_cache_entry_expiration,
+                (void *)entry);
+    }
+}
+
+
+void map_cache_entry_refreshed(lispd_map_cache_entry *entry)
+{
+    map_cache_refresh_info.hits++;
+    entry->refreshing = FALSE;
+    if (entry->request_retry_timer != NULL){
+        stop_timer(entry->request_retry_timer);
+        entry->request_retry_timer = NULL;
+    }
+}
+
+
+void walk_map_cache_db(
+        void    (*callback)(lispd_map_cache_entry *entry, void *arg),
+        void    *arg)
+{
+    lispd_instance          *instance   = NULL;
+    patricia_node_t         *node       = NULL;
+    int                     ctr         = 0;
+
+    if (map_cache_instances == NULL){
+        return;
+    }
+    for (instance = map_cache_instances->instances; instance != NULL; instance = instance->next){
+        for (ctr = 0 ; ctr < 2 ; ctr++){
+            PATRICIA_WALK(instance->db[ctr]->head, node) {
+                callback((lispd_map_cache_entry *)(node->data), arg);
+            } PATRICIA_WALK_END;
+        }
+    }
 }
 
 
@@ -374,7 +737,7 @@ void map_cache_entry_expiration(
  */
 void dump_map_cache_db(int log_level)
 {
-    patricia_tree_t 	*dbs [2] = {AF4_map_cache, AF6_map_cache};
+    lispd_instance      *instance;
     int					ctr;
 
     patricia_node_t             *node;
@@ -383,11 +746,13 @@ void dump_map_cache_db(int log_level)
 
     lispd_log_msg(log_level,"**************** LISP Mapping Cache ******************\n");
 
-    for (ctr = 0 ; ctr < 2 ; ctr++){
-        PATRICIA_WALK(dbs[ctr]->head, node) {
-            entry = ((lispd_map_cache_entry *)(node->data));
-            dump_map_cache_entry (entry, log_level);
-        } PATRICIA_WALK_END;
+    for (instance = map_cache_instances->instances; instance != NULL; instance = instance->next){
+        for (ctr = 0 ; ctr < 2 ; ctr++){
+            PATRICIA_WALK(instance->db[ctr]->head, node) {
+                entry = ((lispd_map_cache_entry *)(node->data));
+                dump_map_cache_entry (entry, log_level);
+            } PATRICIA_WALK_END;
+        }
     }
     lispd_log_msg(log_level,"*******************************************************\n");
 }
@@ -396,10 +761,6 @@ void dump_map_cache_db(int log_level)
 void drop_map_cache()
 {
 	lispd_log_msg(LISP_LOG_DEBUG_3,"free_map_cache_db: Releasing memory of map cache\n");
-	if (AF4_map_cache != NULL)
-		Destroy_Patricia(AF4_map_cache,free_map_cache_entry);
-	if (AF6_map_cache != NULL)
-		Destroy_Patricia(AF6_map_cache,free_map_cache_entry);
-	AF4_map_cache = NULL;
-	AF6_map_cache = NULL;
+	free_instance_table(map_cache_instances, free_map_cache_entry);
+	map_cache_instances = NULL;
 }
@@ -37,6 +37,13 @@
 #include "lispd_timers.h"
 #include "patricia/patricia.h"
 
+/*
+ * Root strides of the multibit tries of the map cache (8 or 16 bits, lispd_lpm.c). The default
+ * instance gets the largest one; a root of 16 bits would take 1 MB for each Instance ID, one of
+ * 8 bits takes 4 KB.
+ */
+#define MAP_CACHE_ROOT_STRIDE       16
+#define MAP_CACHE_IID_ROOT_STRIDE   8
 
 /*
  * create database
@@ -44,9 +51,10 @@
 int map_cache_init();
 
 /*
- * Return map cache data base
+ * Return map cache data base of the Instance ID or NULL if it has never had entries.
+ * The map cache is keyed on (IID, EID prefix): each Instance ID has its own trees.
  */
-patricia_tree_t* get_map_cache_db(int afi);
+patricia_tree_t* get_map_cache_db(int iid, int afi);
 
 /*
  *  Add a map cache entry to the database.
@@ -58,7 +66,7 @@ int add_map_cache_entry_to_db(lispd_map_cache_entry *entry);
  *
  * Delete an EID mapping from the cache
  */
-void del_map_cache_entry_from_db(lisp_addr_t eid, int prefixlen);
+void del_map_cache_entry_from_db(lisp_addr_t eid, int prefixlen, int iid);
 
 
 /*
@@ -68,23 +76,51 @@ void del_map_cache_entry_from_db(lisp_addr_t eid, int prefixlen);
  */
 lispd_map_cache_entry *lookup_map_cache_exact(
         lisp_addr_t             eid,
-        int                     prefixlen);
+        int                     prefixlen,
+        int                     iid);
 
 
 /*
  * lookup_map_cache()
  *
- * Look up a given eid in the database, returning the
- * lispd_map_cache_entry of this EID if it exists or NULL.
+ * Look up a given eid in the database of the Instance ID, returning the
+ * lispd_map_cache_entry of this EID if it exists or NULL. The cost doesn't depend on
+ * the number of Instance IDs.
+ */
+lispd_map_cache_entry *lookup_map_cache(
+        lisp_addr_t             eid,
+        int                     iid);
+
+
+/*
+ * Account the memory of an entry of the database. Called again each time its locators change.
+ * Dynamic entries are added to the ring of the CLOCK hand.
+ */
+void account_map_cache_entry(lispd_map_cache_entry *entry);
+
+/*
+ * Remove an entry from the accounting and from the ring of the CLOCK hand
+ */
+void unaccount_map_cache_entry(lispd_map_cache_entry *entry);
+
+/*
+ * Evict dynamic entries not used since the last pass of the CLOCK hand until there is room for a new
+ * entry. Returns BAD if the map cache is full and no entry can be evicted.
  */
-lispd_map_cache_entry *lookup_map_cache(lisp_addr_t eid);
+int make_room_in_map_cache();
 
+void dump_map_cache_stats(int log_level);
 
 /*
- * Lookup if there is a no active cache entry with the provided nonce and return it
+ * Lookup if there is a no active cache entry with the provided nonce and return it. When several
+ * entries were requested with the nonce, the one whose EID is part of the replied prefix is returned.
  */
 
-lispd_map_cache_entry *lookup_nonce_in_no_active_map_caches(int eid_afi, uint64_t nonce);
+lispd_map_cache_entry *lookup_nonce_in_no_active_map_caches(
+        lisp_addr_t eid_prefix,
+        int         eid_prefix_length,
+        int         iid,
+        uint64_t    nonce);
 
 
 /*
@@ -98,6 +134,24 @@ int change_map_cache_prefix_in_db(lisp_addr_t         new_eid_prefix,
 
 void map_cache_entry_expiration(timer *t, void *arg);
 
+/*
+ * Program the expiration of an entry activated by a Map-Reply at timestamp + ttl. If map_cache_refresh
+ * is not 0, the entry is refreshed at map_cache_refresh % of its TTL when it has been used in the meantime.
+ */
+void program_map_cache_entry_expiration(lispd_map_cache_entry *entry);
+
+/*
+ * Called when the Map-Reply to the refresh of an entry is received
+ */
+void map_cache_entry_refreshed(lispd_map_cache_entry *entry);
+
+
+/*
+ * Call the callback for each entry of the map cache. The callback must not remove entries.
+ */
+void walk_map_cache_db(
+        void    (*callback)(lispd_map_cache_entry *entry, void *arg),
+        void    *arg);
 
 void dump_map_cache_db(int log_level);
 
@@ -0,0 +1,460 @@
+/*
+ * lispd_map_cache_snapshot.c
+ *
+ * This file is part of LISP Mobile Node Implementation.
+ * Snapshot of the map cache kept on disk across restarts.
+ *
+ * Copyright (C) 2012 Cisco Systems, Inc, 2012. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * Please send any bug reports or fixes you make to the email address(es):
+ *    LISP-MN developers <devel@lispmob.org>
+ *
+ */
+
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include "lispd_external.h"
+#include "lispd_lib.h"
+#include "lispd_log.h"
+#include "lispd_map_cache_db.h"
+#include "lispd_map_cache_snapshot.h"
+#include "lispd_mapping.h"
+#include "lispd_rloc_index.h"
+#include "lispd_rloc_probing.h"
+
+/*
+ * Snapshot being built in memory before being written to the file
+ */
+typedef struct map_cache_snapshot_buffer_ {
+    uint8_t     *data;
+    size_t      size;
+    size_t      length;
+    uint32_t    record_count;
+    int         error;
+} map_cache_snapshot_buffer;
+
+static struct {
+    /* FALSE until the previous snapshot has been restored: a failed start doesn't overwrite it */
+    uint8_t     enabled;
+    timer       *save_timer;
+} map_cache_snapshot = {
+        .enabled    = FALSE,
+        .save_timer = NULL
+};
+
+
+static int reserve_map_cache_snapshot_buffer(
+        map_cache_snapshot_buffer   *buffer,
+        size_t                      length)
+{
+    uint8_t     *data   = NULL;
+    size_t      size    = (buffer->size == 0) ? 4096 : buffer->size;
+
+    if (buffer->length + length <= buffer->size){
+        return (GOOD);
+    }
+    while (buffer->length + length > size){
+        size *= 2;
+    }
+    if ((data = (uint8_t *)realloc(buffer->data, size)) == NULL){
+        lispd_log_msg(LISP_LOG_WARNING, "reserve_map_cache_snapshot_buffer: Unable to allocate memory: %s", strerror(errno));
+        buffer->error = TRUE;
+        return (ERR_MALLOC);
+    }
+    buffer->data = data;
+    buffer->size = size;
+    return (GOOD);
+}
+
+
+static int get_locators_list_count(lispd_locators_list *list)
+{
+    int     count   = 0;
+
+    for (; list != NULL; list = list->next){
+        count++;
+    }
+    return (count);
+}
+
+
+static void append_snapshot_locators(
+        map_cache_snapshot_buffer   *buffer,
+        lispd_locators_list         *list,
+        int                         *remaining)
+{
+    map_cache_snapshot_locator  *snapshot_locator   = NULL;
+    lispd_locator_elt           *locator            = NULL;
+
+    for (; list != NULL && *remaining > 0; list = list->next){
+        locator = list->locator;
+        snapshot_locator = (map_cache_snapshot_locator *)(buffer->data + buffer->length);
+        memset(snapshot_locator, 0, sizeof(map_cache_snapshot_locator));
+        snapshot_locator->afi = (locator->locator_addr->afi == AF_INET) ? 4 : 6;
+        snapshot_locator->state = *(locator->state);
+        snapshot_locator->priority = locator->priority;
+        snapshot_locator->weight = locator->weight;
+        snapshot_locator->mpriority = locator->mpriority;
+        snapshot_locator->mweight = locator->mweight;
+        memcpy(snapshot_locator->address, &(locator->locator_addr->address), get_addr_len(locator->locator_addr->afi));
+        buffer->length += sizeof(map_cache_snapshot_locator);
+        (*remaining)--;
+    }
+}
+
+
+/*
+ * Append an entry of the map cache to the snapshot. Only the active entries learned from the
+ * mapping system are saved: the static ones are in the configuration.
+ */
+static void append_snapshot_record(
+        lispd_map_cache_entry   *entry,
+        void                    *arg)
+{
+    map_cache_snapshot_buffer   *buffer             = (map_cache_snapshot_buffer *)arg;
+    map_cache_snapshot_record   *record             = NULL;
+    lispd_mapping_elt           *mapping            = entry->mapping;
+    int                         locator_count       = 0;
+
+    if (buffer->error == TRUE || entry->how_learned != DYNAMIC_MAP_CACHE_ENTRY || entry->active == NO_ACTIVE){
+        return;
+    }
+    locator_count = get_locators_list_count(mapping->head_v4_locators_list) +
+            get_locators_list_count(mapping->head_v6_locators_list);
+    if (locator_count > 255){
+        locator_count = 255;
+    }
+    if (reserve_map_cache_snapshot_buffer(buffer,
+            sizeof(map_cache_snapshot_record) + locator_count * sizeof(map_cache_snapshot_locator)) != GOOD){
+        return;
+    }
+
+    record = (map_cache_snapshot_record *)(buffer->data + buffer->length);
+    memset(record, 0, sizeof(map_cache_snapshot_record));
+    record->eid_afi = (mapping->eid_prefix.afi == AF_INET) ? 4 : 6;
+    record->eid_prefix_length = mapping->eid_prefix_length;
+    record->action = entry->actions;
+    record->locator_count = locator_count;
+    record->iid = mapping->iid;
+    record->timestamp = entry->timestamp;
+    record->ttl = entry->ttl;
+    memcpy(record->eid_prefix, &(mapping->eid_prefix.address), get_addr_len(mapping->eid_prefix.afi));
+    buffer->length += sizeof(map_cache_snapshot_record);
+
+    append_snapshot_locators(buffer, mapping->head_v4_locators_list, &locator_count);
+    append_snapshot_locators(buffer, mapping->head_v6_locators_list, &locator_count);
+    buffer->record_count++;
+}
+
+
+static int write_map_cache_snapshot_file(
+        uint8_t     *data,
+        size_t      length)
+{
+    char        *tmp_file   = NULL;
+    ssize_t     written     = 0;
+    size_t      offset      = 0;
+    int         fd          = -1;
+
+    if ((tmp_file = (char *)malloc(strlen(map_cache_snapshot_file) + 5)) == NULL){
+        lispd_log_msg(LISP_LOG_WARNING, "write_map_cache_snapshot_file: Unable to allocate memory: %s", strerror(errno));
+        return (ERR_MALLOC);
+    }
+    sprintf(tmp_file, "%s.tmp", map_cache_snapshot_file);
+
+    if ((fd = open(tmp_file, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR)) == -1){
+        lispd_log_msg(LISP_LOG_WARNING, "write_map_cache_snapshot_file: Couldn't open %s: %s", tmp_file, strerror(errno));
+        free(tmp_file);
+        return (BAD);
+    }
+    while (offset < length){
+        written = write(fd, data + offset, length - offset);
+        if (written == -1){
+            if (errno == EINTR){
+                continue;
+            }
+            lispd_log_msg(LISP_LOG_WARNING, "write_map_cache_snapshot_file: Couldn't write %s: %s", tmp_file, strerror(errno));
+            close(fd);
+            unlink(tmp_file);
+            free(tmp_file);
+            return (BAD);
+        }
+        offset += written;
+    }
+    close(fd);
+
+    /* Readers never see a partial snapshot */
+    if (rename(tmp_file, map_cache_snapshot_file) == -1){
+        lispd_log_msg(LISP_LOG_WARNING, "write_map_cache_snapshot_file: Couldn't rename %s: %s", tmp_file, strerror(errno));
+        unlink(tmp_file);
+        free(tmp_file);
+        return (BAD);
+    }
+    free(tmp_file);
+    return (GOOD);
+}
+
+
+int save_map_cache_snapshot()
+{
+    map_cache_snapshot_buffer   buffer;
+    map_cache_snapshot_header   *header     = NULL;
+    int                         result      = GOOD;
+
+    if (map_cache_snapshot.enabled == FALSE){
+        return (GOOD);
+    }
+    memset(&buffer, 0, sizeof(map_cache_snapshot_buffer));
+    if (reserve_map_cache_snapshot_buffer(&buffer, sizeof(map_cache_snapshot_header)) != GOOD){
+        return (ERR_MALLOC);
+    }
+    buffer.length = sizeof(map_cache_snapshot_header);
+
+    walk_map_cache_db(append_snapshot_record, &buffer);
+    if (buffer.error == TRUE){
+        free(buffer.data);
+        return (ERR_MALLOC);
+    }
+
+    header = (map_cache_snapshot_header *)buffer.data;
+    memset(header, 0, sizeof(map_cache_snapshot_header));
+    header->magic = MAP_CACHE_SNAPSHOT_MAGIC;
+    header->version = MAP_CACHE_SNAPSHOT_VERSION;
+    header->record_count = buffer.record_count;
+    header->saved = time(NULL);
+
+    result = write_map_cache_snapshot_file(buffer.data, buffer.length);
+    if (result == GOOD){
+        lispd_log_msg(LISP_LOG_DEBUG_1, "Map cache snapshot: %d entries (%lu bytes) saved to %s",
+                buffer.record_count, (unsigned long)buffer.length, map_cache_snapshot_file);
+    }
+    free(buffer.data);
+    return (result);
+}
+
+
+static int map_cache_snapshot_timer_cb(
+        timer   *t,
+        void    *arg)
+{
+    save_map_cache_snapshot();
+    start_timer(t, SECONDS_TO_MS(map_cache_snapshot_interval), map_cache_snapshot_timer_cb, NULL);
+    return (GOOD);
+}
+
+
+static void get_lisp_addr_from_snapshot(
+        uint8_t     afi,
+        uint8_t     *address,
+        lisp_addr_t *addr)
+{
+    memset(addr, 0, sizeof(lisp_addr_t));
+    addr->afi = (afi == 4) ? AF_INET : AF_INET6;
+    memcpy(&(addr->address), address, get_addr_len(addr->afi));
+}
+
+
+static int restore_snapshot_locator(
+        lispd_mapping_elt           *mapping,
+        map_cache_snapshot_locator  *snapshot_locator)
+{
+    lispd_locator_elt   *locator        = NULL;
+    lisp_addr_t         *locator_addr   = NULL;
+    uint8_t             state           = snapshot_locator->state;
+
+    if ((locator_addr = (lisp_addr_t *)malloc(sizeof(lisp_addr_t))) == NULL){
+        lispd_log_msg(LISP_LOG_WARNING, "restore_snapshot_locator: Unable to allocate memory for lisp_addr_t: %s", strerror(errno));
+        return (ERR_MALLOC);
+    }
+    get_lisp_addr_from_snapshot(snapshot_locator->afi, snapshot_locator->address, locator_addr);
+
+    /* The default RLOC AFI may have changed since the snapshot */
+    if ((locator_addr->afi == AF_INET && default_rloc_afi == AF_INET6) ||
+            (locator_addr->afi == AF_INET6 && default_rloc_afi == AF_INET)){
+        state = DOWN;
+    }
+    locator = new_static_rmt_locator(locator_addr, state, snapshot_locator->priority, snapshot_locator->weight,
+            snapshot_locator->mpriority, snapshot_locator->mweight);
+    if (locator == NULL){
+        free(locator_addr);
+        return (BAD);
+    }
+    locator->locator_type = DYNAMIC_LOCATOR;
+    if (add_locator_to_mapping(mapping, locator) != GOOD){
+        free_locator(locator);
+        return (BAD);
+    }
+    return (GOOD);
+}
+
+
+/*
+ * Restore a record of the snapshot as an active entry of the map cache. Returns BAD if the
+ * entry could not be restored.
+ */
+static int restore_snapshot_record(
+        map_cache_snapshot_record   *record,
+        map_cache_snapshot_locator  *locators)
+{
+    lispd_map_cache_entry   *entry      = NULL;
+    lisp_addr_t             eid_prefix;
+    int                     ctr         = 0;
+
+    get_lisp_addr_from_snapshot(record->eid_afi, record->eid_prefix, &eid_prefix);
+    /* Static entries of the configuration have priority */
+    if (lookup_map_cache_exact(eid_prefix, record->eid_prefix_length, record->iid) != NULL){
+        return (BAD);
+    }
+    entry = new_map_cache_entry(eid_prefix, record->eid_prefix_length, record->iid, DYNAMIC_MAP_CACHE_ENTRY,
+            record->ttl);
+    if (entry == NULL){
+        return (BAD);
+    }
+    entry->actions = record->action;
+    entry->timestamp = record->timestamp;
+    entry->active = ACTIVE;
+
+    for (ctr = 0; ctr < record->locator_count; ctr++){
+        if (restore_snapshot_locator(entry->mapping, &(locators[ctr])) != GOOD){
+            del_map_cache_entry_from_db(eid_prefix, record->eid_prefix_length, record->iid);
+            return (BAD);
+        }
+    }
+    if (entry->mapping->locator_count != 0){
+        calculate_balancing_vectors (
+                entry->mapping,
+                &(((rmt_mapping_extended_info *)entry->mapping->extended_info)->rmt_balancing_locators_vecs));
+    }
+    program_map_cache_entry_expiration(entry);
+    index_map_cache_entry_rlocs(entry);
+    if (rloc_probe_interval != 0){
+        programming_rloc_probing(entry);
+    }
+    account_map_cache_entry(entry);
+    return (GOOD);
+}
+
+
+static void restore_map_cache_snapshot()
+{
+    map_cache_snapshot_header   *header     = NULL;
+    map_cache_snapshot_record   *record     = NULL;
+    uint8_t                     *data       = NULL;
+    struct stat                 file_stat;
+    struct timespec             start;
+    struct timespec             end;
+    time_t                      now         = time(NULL);
+    time_t                      saved       = 0;
+    size_t                      offset      = 0;
+    size_t                      length      = 0;
+    uint32_t                    ctr         = 0;
+    int                         restored    = 0;
+    int                         expired     = 0;
+    int                         corrupted   = FALSE;
+    int                         fd          = -1;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if ((fd = open(map_cache_snapshot_file, O_RDONLY)) == -1){
+        if (errno != ENOENT){
+            lispd_log_msg(LISP_LOG_WARNING, "restore_map_cache_snapshot: Couldn't open %s: %s",
+                    map_cache_snapshot_file, strerror(errno));
+        }
+        return;
+    }
+    if (fstat(fd, &file_stat) == -1 || file_stat.st_size < sizeof(map_cache_snapshot_header)){
+        lispd_log_msg(LISP_LOG_WARNING, "restore_map_cache_snapshot: %s is not a map cache snapshot", map_cache_snapshot_file);
+        close(fd);
+        return;
+    }
+    length = file_stat.st_size;
+    data = (uint8_t *)mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED){
+        lispd_log_msg(LISP_LOG_WARNING, "restore_map_cache_snapshot: Couldn't map %s: %s", map_cache_snapshot_file, strerror(errno));
+        return;
+    }
+
+    header = (map_cache_snapshot_header *)data;
+    if (header->magic != MAP_CACHE_SNAPSHOT_MAGIC || header->version != MAP_CACHE_SNAPSHOT_VERSION){
+        lispd_log_msg(LISP_LOG_WARNING, "restore_map_cache_snapshot: %s is not a map cache snapshot of this version",
+                map_cache_snapshot_file);
+        munmap(data, length);
+        return;
+    }
+
+    saved = header->saved;
+    offset = sizeof(map_cache_snapshot_header);
+    for (ctr = 0; ctr < header->record_count; ctr++){
+        if (offset + sizeof(map_cache_snapshot_record) > length){
+            corrupted = TRUE;
+            break;
+        }
+        record = (map_cache_snapshot_record *)(data + offset);
+        offset += sizeof(map_cache_snapshot_record);
+        if (offset + record->locator_count * sizeof(map_cache_snapshot_locator) > length ||
+                (record->eid_afi != 4 && record->eid_afi != 6) ||
+                record->eid_prefix_length > ((record->eid_afi == 4) ? 32 : 128)){
+            corrupted = TRUE;
+            break;
+        }
+        if (record->timestamp + record->ttl * 60 <= now){
+            expired++;
+        }else if (map_cache_size != 0 && restored >= map_cache_size){
+            /* The rest of the entries doesn't fit in the map cache */
+            break;
+        }else if (restore_snapshot_record(record, (map_cache_snapshot_locator *)(data + offset)) == GOOD){
+            restored++;
+        }
+        offset += record->locator_count * sizeof(map_cache_snapshot_locator);
+    }
+    if (corrupted == TRUE){
+        lispd_log_msg(LISP_LOG_WARNING, "restore_map_cache_snapshot: %s is truncated or corrupted after %d records",
+                map_cache_snapshot_file, ctr);
+    }
+    munmap(data, length);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    lispd_log_msg(LISP_LOG_INFO, "Map cache snapshot: restored %d entries (%d expired) of %s saved %ld seconds ago in %.3f ms",
+            restored, expired, map_cache_snapshot_file, (long)(now - saved),
+            (end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_nsec - start.tv_nsec) / 1000000.0);
+}
+
+
+void init_map_cache_snapshot()
+{
+    if (map_cache_snapshot_file == NULL){
+        return;
+    }
+    restore_map_cache_snapshot();
+    map_cache_snapshot.enabled = TRUE;
+
+    if (map_cache_snapshot_interval != 0){
+        map_cache_snapshot.save_timer = create_timer(NULL);
+        start_timer(map_cache_snapshot.save_timer, SECONDS_TO_MS(map_cache_snapshot_interval),
+                map_cache_snapshot_timer_cb, NULL);
+    }
+}
+
+/*
+ * Editor modelines
+ *
+ * vi: set shiftwidth=4 tabstop=4 expandtab:
+ * :indentSize=4:tabSize=4:noTabs=true:
+ */
@@ -0,0 +1,90 @@
+/*
+ * lispd_map_cache_snapshot.h
+ *
+ * This file is part of LISP Mobile Node Implementation.
+ * Snapshot of the map cache kept on disk across restarts.
+ *
+ * Copyright (C) 2012 Cisco Systems, Inc, 2012. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * Please send any bug reports or fixes you make to the email address(es):
+ *    LISP-MN developers <devel@lispmob.org>
+ *
+ */
+
+
+#ifndef LISPD_MAP_CACHE_SNAPSHOT_H_
+#define LISPD_MAP_CACHE_SNAPSHOT_H_
+
+#include "lispd.h"
+
+#define MAP_CACHE_SNAPSHOT_MAGIC        0x4c4d4353  /* "LMCS" */
+#define MAP_CACHE_SNAPSHOT_VERSION      1
+
+/*
+ * Header of the snapshot file. It is followed by record_count records, each one followed by
+ * its locators. Written in host byte order: the file is only read by the node that wrote it.
+ */
+typedef struct map_cache_snapshot_header_ {
+    uint32_t    magic;
+    uint16_t    version;
+    uint16_t    reserved;
+    uint32_t    record_count;
+    int64_t     saved;                  /* Time of the snapshot */
+} PACKED map_cache_snapshot_header;
+
+typedef struct map_cache_snapshot_record_ {
+    uint8_t     eid_afi;                /* 4 or 6 */
+    uint8_t     eid_prefix_length;
+    uint8_t     action;
+    uint8_t     locator_count;
+    int32_t     iid;
+    int64_t     timestamp;              /* Activation of the entry. It expires at timestamp + ttl */
+    uint16_t    ttl;                    /* Minutes */
+    uint8_t     eid_prefix[16];
+} PACKED map_cache_snapshot_record;
+
+typedef struct map_cache_snapshot_locator_ {
+    uint8_t     afi;                    /* 4 or 6 */
+    uint8_t     state;
+    uint8_t     priority;
+    uint8_t     weight;
+    uint8_t     mpriority;
+    uint8_t     mweight;
+    uint8_t     address[16];
+} PACKED map_cache_snapshot_locator;
+
+
+/*
+ * Restore the active entries of the snapshot file (map_cache_snapshot_file) that have not expired
+ * and program the periodic snapshot. Called once the configuration has been processed.
+ */
+void init_map_cache_snapshot();
+
+/*
+ * Write the active dynamic entries of the map cache to the snapshot file. The file is replaced
+ * atomically. Called periodically and on exit.
+ */
+int save_map_cache_snapshot();
+
+#endif /* LISPD_MAP_CACHE_SNAPSHOT_H_ */
+
+/*
+ * Editor modelines
+ *
+ * vi: set shiftwidth=4 tabstop=4 expandtab:
+ * :indentSize=4:tabSize=4:noTabs=true:
+ */
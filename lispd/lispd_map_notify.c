@@ -175,9 +175,9 @@ int process_map_notify(uint8_t *packet)
     				lispd_log_msg(LISP_LOG_DEBUG_2, "Data Map Notify with nonce %s confirms correct registration of the prefix %s/%d",
     				        get_char_from_nonce(map_notify->nonce),
     						get_char_from_lisp_addr_t(mapping->eid_prefix), mapping->eid_prefix_length);
-    				free(nat_info->emap_reg_nonce);
+    				free_nonces_list(nat_info->emap_reg_nonce);
     				nat_info->emap_reg_nonce = NULL;
-        			start_timer(nat_info->emap_reg_timer, MAP_REGISTER_INTERVAL, map_register, nat_info->emap_reg_timer->cb_argument);
+        			start_timer(nat_info->emap_reg_timer, SECONDS_TO_MS(MAP_REGISTER_INTERVAL), map_register, nat_info->emap_reg_timer->cb_argument);
         			lispd_log_msg(LISP_LOG_DEBUG_1, "Reprogrammed encapsulated map register for %s/%d in %d seconds",
         			    		get_char_from_lisp_addr_t(mapping->eid_prefix), mapping->eid_prefix_length,MAP_REGISTER_INTERVAL);
 
@@ -193,9 +193,9 @@ int process_map_notify(uint8_t *packet)
     		    /* We don't have to check nonce. Map Register is send with nonce 0 */
     		    lispd_log_msg(LISP_LOG_DEBUG_2, "Map Notify confirms correct registration of the prefix %s/%d",
     		            get_char_from_lisp_addr_t(mapping->eid_prefix), mapping->eid_prefix_length);
-    		    free(extended_info->map_reg_nonce);
+    		    free_nonces_list(extended_info->map_reg_nonce);
     		    extended_info->map_reg_nonce = NULL;
-    		    start_timer(extended_info->map_reg_timer, MAP_REGISTER_INTERVAL, map_register, extended_info->map_reg_timer->cb_argument);
+    		    start_timer(extended_info->map_reg_timer, SECONDS_TO_MS(MAP_REGISTER_INTERVAL), map_register, extended_info->map_reg_timer->cb_argument);
     		    lispd_log_msg(LISP_LOG_DEBUG_1, "Reprogrammed map register for %s/%d in %d seconds",
     		            get_char_from_lisp_addr_t(mapping->eid_prefix), mapping->eid_prefix_length,MAP_REGISTER_INTERVAL);
 
@@ -167,7 +167,7 @@ int process_map_referral_record(
         }
     }
 
-    free(pending_referral_entry->nonces);
+    free_nonces_list(pending_referral_entry->nonces);
     pending_referral_entry->nonces = NULL;
 
     /* Stop the timer to not retry to send the map request */
@@ -207,7 +207,7 @@ int process_map_referral_record(
                         1,MAPPING_ACT_NO_ACTION);
                 if (err != GOOD){
                     del_map_cache_entry_from_db(pending_referral_entry->map_cache_entry->mapping->eid_prefix,
-                            pending_referral_entry->map_cache_entry->mapping->eid_prefix_length);
+                            pending_referral_entry->map_cache_entry->mapping->eid_prefix_length, pending_referral_entry->map_cache_entry->mapping->iid);
                 }
             }
             remove_pending_referral_cache_entry_from_list(pending_referral_entry);
@@ -258,7 +258,7 @@ int process_map_referral_record(
                         1,MAPPING_ACT_NO_ACTION);
                 if (err != GOOD){
                     del_map_cache_entry_from_db(pending_referral_entry->map_cache_entry->mapping->eid_prefix,
-                            pending_referral_entry->map_cache_entry->mapping->eid_prefix_length);
+                            pending_referral_entry->map_cache_entry->mapping->eid_prefix_length, pending_referral_entry->map_cache_entry->mapping->iid);
                 }
             }
             remove_pending_referral_cache_entry_from_list(pending_referral_entry);
@@ -376,7 +376,7 @@ int process_node_referral_reply(
                         1,MAPPING_ACT_NO_ACTION);
                 if (err != GOOD){
                     del_map_cache_entry_from_db(pending_referral_entry->map_cache_entry->mapping->eid_prefix,
-                            pending_referral_entry->map_cache_entry->mapping->eid_prefix_length);
+                            pending_referral_entry->map_cache_entry->mapping->eid_prefix_length, pending_referral_entry->map_cache_entry->mapping->iid);
                 }
             }
             remove_pending_referral_cache_entry_from_list(pending_referral_entry);
@@ -451,7 +451,7 @@ int process_ms_referral_reply(
                         1,MAPPING_ACT_NO_ACTION);
                 if (err != GOOD){
                     del_map_cache_entry_from_db(pending_referral_entry->map_cache_entry->mapping->eid_prefix,
-                            pending_referral_entry->map_cache_entry->mapping->eid_prefix_length);
+                            pending_referral_entry->map_cache_entry->mapping->eid_prefix_length, pending_referral_entry->map_cache_entry->mapping->iid);
                 }
             }
             remove_pending_referral_cache_entry_from_list(pending_referral_entry);
@@ -539,10 +539,11 @@ int process_ms_ack_reply(
     }
     else{
         if (pending_referral_entry->ddt_request_retry_timer == NULL){
-            pending_referral_entry->ddt_request_retry_timer = create_timer (DDT_MAP_REQ_RETRY_MS_ACK_TIMER);
+            pending_referral_entry->ddt_request_retry_timer = create_timer(NULL);
         }
         pending_referral_entry->previous_referral = referral_entry;
-        start_timer(pending_referral_entry->ddt_request_retry_timer, LISPD_INITIAL_MRQ_TIMEOUT,
+        start_timer(pending_referral_entry->ddt_request_retry_timer,
+                backoff_timeout(LISPD_INITIAL_MRQ_TIMEOUT, LISPD_MAX_RETRANSMIT_TIMEOUT, 0),
                 send_map_request_ddt_map_reply_miss, (void *)pending_referral_entry);
     }
 
@@ -587,7 +588,7 @@ int process_ms_not_registered_reply(
         if (activate_negative_map_cache (pending_referral_entry->map_cache_entry, referral_entry->mapping->eid_prefix,
                 referral_entry->mapping->eid_prefix_length,referral_entry->ttl,MAPPING_ACT_NO_ACTION) != GOOD){
             del_map_cache_entry_from_db(pending_referral_entry->map_cache_entry->mapping->eid_prefix,
-                    pending_referral_entry->map_cache_entry->mapping->eid_prefix_length);
+                    pending_referral_entry->map_cache_entry->mapping->eid_prefix_length, pending_referral_entry->map_cache_entry->mapping->iid);
         }
         remove_pending_referral_cache_entry_from_list(pending_referral_entry);
         /* Program expiry time */
@@ -631,7 +632,7 @@ int process_delegation_hole_reply(
     if (activate_negative_map_cache (pending_referral_entry->map_cache_entry, referral_entry->mapping->eid_prefix,
             referral_entry->mapping->eid_prefix_length,referral_entry->ttl,MAPPING_ACT_NO_ACTION)!=GOOD){
         del_map_cache_entry_from_db(pending_referral_entry->map_cache_entry->mapping->eid_prefix,
-                           pending_referral_entry->map_cache_entry->mapping->eid_prefix_length);
+                           pending_referral_entry->map_cache_entry->mapping->eid_prefix_length, pending_referral_entry->map_cache_entry->mapping->iid);
     }
     remove_pending_referral_cache_entry_from_list(pending_referral_entry);
     /* Program expiry time */
@@ -654,7 +655,7 @@ int process_not_authoritative_reply(
                     referral_entry->mapping->eid_prefix_length,1,MAPPING_ACT_NO_ACTION);
             if (err != GOOD){
                 del_map_cache_entry_from_db(pending_referral_entry->map_cache_entry->mapping->eid_prefix,
-                        pending_referral_entry->map_cache_entry->mapping->eid_prefix_length);
+                        pending_referral_entry->map_cache_entry->mapping->eid_prefix_length, pending_referral_entry->map_cache_entry->mapping->iid);
             }
         }
         remove_pending_referral_cache_entry_from_list(pending_referral_entry);
@@ -701,9 +702,9 @@ static inline int try_next_referral_node_or_go_through_root (lispd_pending_refer
 void program_referral_expiry_timer(lispd_referral_cache_entry *referral_entry)
 {
     if (referral_entry->expiry_ddt_cache_timer == NULL){
-        referral_entry->expiry_ddt_cache_timer = create_timer(DDT_EXPIRE_MAP_REFERRAL);
+        referral_entry->expiry_ddt_cache_timer = create_timer(NULL);
     }
-    start_timer(referral_entry->expiry_ddt_cache_timer, referral_entry->ttl*60, referral_expiry, (void *)referral_entry);
+    start_timer(referral_entry->expiry_ddt_cache_timer, MINUTES_TO_MS(referral_entry->ttl), referral_expiry, (void *)referral_entry);
 }
 
 /*
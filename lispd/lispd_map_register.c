@@ -120,9 +120,9 @@ int map_register(
             // XXX To check the number of retries. If we never receive a Map Reply --> New status in Inf req?
             nat_info = ((lcl_locator_extended_info *)src_locator->extended_info)->nat_info;
             if (nat_info->emap_reg_timer == NULL) {
-                nat_info->emap_reg_timer = create_timer(MAP_REGISTER_TIMER);
+                nat_info->emap_reg_timer = create_timer(free);
             }
-            start_timer(nat_info->emap_reg_timer, LISPD_INITIAL_MR_TIMEOUT, map_register, timer_arg);
+            start_timer(nat_info->emap_reg_timer, SECONDS_TO_MS(LISPD_INITIAL_MR_TIMEOUT), map_register, timer_arg);
             lispd_log_msg(LISP_LOG_DEBUG_1, "NAT locators status unknown. Reprogrammed map register for %s/%d in %d seconds",
                     get_char_from_lisp_addr_t(mapping->eid_prefix), mapping->eid_prefix_length,LISPD_INITIAL_MR_TIMEOUT);
             return(BAD);
@@ -143,7 +143,7 @@ int map_register_process(timer_map_register_argument *timer_arg)
     int                         next_timer_time = 0;
     // We don't save nonce. Map Register is sent with nonce 0
     if (nonces == NULL){
-        nonces = new_nonces_list();
+        nonces = new_nonces_list(NONCE_OWNER_MAP_REGISTER, mapping);
         if (nonces==NULL){
             lispd_log_msg(LISP_LOG_WARNING,"map_register_process: Unable to allocate memory for nonces.");
             return (BAD);
@@ -168,7 +168,7 @@ int map_register_process(timer_map_register_argument *timer_arg)
         nonces->retransmits++;
         next_timer_time = LISPD_INITIAL_MR_TIMEOUT;
     }else{
-        free (nonces);
+        free_nonces_list(nonces);
         extended_info->map_reg_nonce = NULL;
         lispd_log_msg(LISP_LOG_ERR,"map_register_process: Communication error between LISPmob and MS. Check MS address and key");
 //#ifdef VPNAPI
@@ -181,9 +181,9 @@ int map_register_process(timer_map_register_argument *timer_arg)
      * Configure timer to send the next map register.
      */
     if (extended_info->map_reg_timer == NULL) {
-        extended_info->map_reg_timer = create_timer(MAP_REGISTER_TIMER);
+        extended_info->map_reg_timer = create_timer(free);
     }
-    start_timer(extended_info->map_reg_timer, next_timer_time, map_register, timer_arg);
+    start_timer(extended_info->map_reg_timer, SECONDS_TO_MS(next_timer_time), map_register, timer_arg);
     lispd_log_msg(LISP_LOG_DEBUG_1, "Reprogrammed map register for %s/%d in %d seconds",
             get_char_from_lisp_addr_t(mapping->eid_prefix), mapping->eid_prefix_length,next_timer_time);
     return(GOOD);
@@ -199,7 +199,7 @@ int encapsulated_map_register_process(timer_map_register_argument *timer_arg)
     int                       next_timer_time   = 0;
 
     if (nonces == NULL){
-        nonces = new_nonces_list();
+        nonces = new_nonces_list(NONCE_OWNER_EMAP_REGISTER, src_locator);
         if (nonces == NULL){
             lispd_log_msg(LISP_LOG_WARNING,"encapsulated_map_register_process: Unable to allocate memory for nonces.");
             return (BAD);
@@ -232,11 +232,12 @@ int encapsulated_map_register_process(timer_map_register_argument *timer_arg)
             }else{
                 lispd_log_msg(LISP_LOG_ERR,"encapsulated_map_register_process: Couldn't send encapsulated map register. No RTR found");
             }
+            index_nonce(nonces, nonces->retransmits);
             nonces->retransmits++;
             next_timer_time = LISPD_INITIAL_MR_TIMEOUT;
         }
     }else{
-        free (nonces);
+        free_nonces_list(nonces);
         nat_info->emap_reg_nonce = NULL;
         lispd_log_msg(LISP_LOG_ERR,"encapsulated_map_register_process: Communication error between LISPmob and RTR/MS. Retry after %d seconds",MAP_REGISTER_INTERVAL);
 //#ifdef VPNAPI
@@ -249,9 +250,9 @@ int encapsulated_map_register_process(timer_map_register_argument *timer_arg)
      * Configure timer to send the next map register.
      */
     if (nat_info->emap_reg_timer == NULL) {
-        nat_info->emap_reg_timer = create_timer(MAP_REGISTER_TIMER);
+        nat_info->emap_reg_timer = create_timer(free);
     }
-    start_timer(nat_info->emap_reg_timer, next_timer_time, map_register, timer_arg);
+    start_timer(nat_info->emap_reg_timer, SECONDS_TO_MS(next_timer_time), map_register, timer_arg);
     return(GOOD);
 }
 
@@ -430,7 +431,7 @@ int build_and_send_ecm_map_register(
 
     /* XXX Quick hack */
     /* Cisco IOS RTR implementation drops Data-Map-Notify if ECM Map Register nonce = 0 */
-    map_register_pkt->nonce = build_nonce((unsigned int) time(NULL));
+    map_register_pkt->nonce = build_nonce();
     *nonce = map_register_pkt->nonce;
 
     /* Add xTR-ID and site-ID fields */
@@ -64,12 +64,17 @@
 #include <time.h>
 #include "cksum.h"
 #include "lispd_afi.h"
+#include "lispd_epoch.h"
 #include "lispd_external.h"
+#include "lispd_flow_cache.h"
 #include "lispd_lib.h"
 #include "lispd_local_db.h"
 #include "lispd_map_cache_db.h"
 #include "lispd_map_reply.h"
+#include "lispd_map_request_scheduler.h"
+#include "lispd_miss_queue.h"
 #include "lispd_pkt_lib.h"
+#include "lispd_rloc_index.h"
 #include "lispd_rloc_probing.h"
 #include "lispd_sockets.h"
 
@@ -86,14 +91,12 @@ int process_map_reply_probe_record(uint8_t **cur_ptr, uint64_t nonce);
 int process_map_reply_locator(uint8_t  **offset, lispd_mapping_elt *mapping);
 
 /*
- * Return the locator from tha mapping that match with the locator of the packet.
- * Retun null if no match found. Offset is updated to point the next locator of the packet.
+ * Return in locator the locator of the packet if it is the probed one, NULL otherwise.
+ * Offset is updated to point the next locator of the packet.
  */
 
 int process_map_reply_probe_locator(
         uint8_t                 **offset,
-        lispd_mapping_elt       *mapping,
-        uint64_t                nonce,
         lispd_locator_elt       **locator);
 
 uint8_t *build_map_reply_pkt(
@@ -147,7 +150,6 @@ int process_map_reply_record(uint8_t **cur_ptr, uint64_t nonce)
     int                                     aux_eid_prefix_length   = 0;
     int                                     aux_iid                 = 0;
     int                                     ctr                     = 0;
-    uint8_t                                 is_new_mapping          = FALSE;
 
     record = (lispd_pkt_mapping_record_t *)(*cur_ptr);
     mapping = new_map_cache_mapping(aux_eid_prefix,aux_eid_prefix_length,aux_iid);
@@ -167,15 +169,10 @@ int process_map_reply_record(uint8_t **cur_ptr, uint64_t nonce)
      * Check if the map replay corresponds to a not active map cache
      */
 
-    cache_entry = lookup_nonce_in_no_active_map_caches(mapping->eid_prefix.afi, nonce);
+    cache_entry = lookup_nonce_in_no_active_map_caches(mapping->eid_prefix, mapping->eid_prefix_length, mapping->iid, nonce);
 
 
     if (cache_entry != NULL){
-        if (cache_entry->mapping->iid != mapping->iid){
-            lispd_log_msg(LISP_LOG_DEBUG_2,"process_map_reply_record:  Instance ID of the map reply doesn't match with the inactive map cache entry");
-            free_mapping_elt(mapping);
-            return (BAD);
-        }
         /*
          * If the eid prefix of the received map reply doesn't match the inactive map cache entry (x.x.x.x/32 or x:x:x:x:x:x:x:x/128),then
          * we remove the inactie entry from the database and store it again with the correct eix prefix (for instance /24).
@@ -192,12 +189,11 @@ int process_map_reply_record(uint8_t **cur_ptr, uint64_t nonce)
         lispd_log_msg(LISP_LOG_DEBUG_2,"  Activating map cache entry %s/%d",
                             get_char_from_lisp_addr_t(mapping->eid_prefix),mapping->eid_prefix_length);
         free_mapping_elt(mapping);
-        is_new_mapping = TRUE;
     }
     /* If the nonce is not found in the no active cache enties, then it should be an active cache entry */
     else {
-        /* Serch map cache entry exist*/
-        cache_entry = lookup_map_cache_exact(mapping->eid_prefix,mapping->eid_prefix_length);
+        /* Serch map cache entry exist in the Instance ID of the reply */
+        cache_entry = lookup_map_cache_exact(mapping->eid_prefix,mapping->eid_prefix_length,mapping->iid);
         if (cache_entry == NULL){
             lispd_log_msg(LISP_LOG_DEBUG_2,"process_map_reply_record:  No map cache entry found for %s/%d",
                     get_char_from_lisp_addr_t(mapping->eid_prefix),mapping->eid_prefix_length);
@@ -210,32 +206,40 @@ int process_map_reply_record(uint8_t **cur_ptr, uint64_t nonce)
             free_mapping_elt(mapping);
             return (BAD);
         }else {
-            free(cache_entry->nonces);
+            free_nonces_list(cache_entry->nonces);
             cache_entry->nonces = NULL;
         }
+        /* Reply to the refresh of an entry in use before its expiration */
+        if (cache_entry->refreshing == TRUE){
+            map_cache_entry_refreshed(cache_entry);
+        }
         /* Stop timer of Map Requests retransmits */
         if (cache_entry->smr_inv_timer != NULL){
             stop_timer(cache_entry->smr_inv_timer);
             cache_entry->smr_inv_timer = NULL;
         }
-        /* Check instane id.*/
-        if (cache_entry->mapping->iid != mapping->iid){
-            lispd_log_msg(LISP_LOG_DEBUG_2,"process_map_reply_record:  Instance ID of the map reply doesn't match with the map cache entry");
-            free_mapping_elt(mapping);
-            return (BAD);
-        }
         lispd_log_msg(LISP_LOG_DEBUG_2,"  A map cache entry already exists for %s/%d, replacing locators list of this entry",
                 get_char_from_lisp_addr_t(cache_entry->mapping->eid_prefix),
                 cache_entry->mapping->eid_prefix_length);
-        free_locator_list(cache_entry->mapping->head_v4_locators_list);
-        free_locator_list(cache_entry->mapping->head_v6_locators_list);
+        /* The balancing vectors used by the data plane threads point to the old locators */
+        unindex_locators_list(cache_entry->mapping->head_v4_locators_list);
+        unindex_locators_list(cache_entry->mapping->head_v6_locators_list);
+        if (cache_entry->mapping->head_v4_locators_list != NULL){
+            epoch_defer(cache_entry->mapping->head_v4_locators_list, (epoch_callback)free_locator_list);
+        }
+        if (cache_entry->mapping->head_v6_locators_list != NULL){
+            epoch_defer(cache_entry->mapping->head_v6_locators_list, (epoch_callback)free_locator_list);
+        }
         cache_entry->mapping->head_v4_locators_list = NULL;
         cache_entry->mapping->head_v6_locators_list = NULL;
+        /* Counted again while adding the locators of the reply */
+        cache_entry->mapping->locator_count = 0;
         free_mapping_elt(mapping);
     }
+    /* Cached flows may point to the old locators of the entry */
+    flow_cache_invalidate_all();
     cache_entry->actions = record->action;
     cache_entry->ttl = ntohl(record->ttl);
-    cache_entry->active_witin_period = 1;
     cache_entry->timestamp = time(NULL);
     //locator_count updated when adding the processed locators
 
@@ -259,25 +263,30 @@ int process_map_reply_record(uint8_t **cur_ptr, uint64_t nonce)
     /*
      * Reprogramming timers
      */
-    /* Expiration cache timer */
-    if (!cache_entry->expiry_cache_timer){
-        cache_entry->expiry_cache_timer = create_timer (EXPIRE_MAP_CACHE_TIMER);
-    }
-    start_timer(cache_entry->expiry_cache_timer, cache_entry->ttl*60, (timer_callback)map_cache_entry_expiration,
-                     (void *)cache_entry);
+    /* Expiration cache timer. Entries in use are refreshed before */
+    program_map_cache_entry_expiration(cache_entry);
     lispd_log_msg(LISP_LOG_DEBUG_1,"The map cache entry %s/%d will expire in %d minutes.",
             get_char_from_lisp_addr_t(cache_entry->mapping->eid_prefix),
             cache_entry->mapping->eid_prefix_length, cache_entry->ttl);
 
-    /* RLOC probing timer */
-    if (is_new_mapping == TRUE && rloc_probe_interval != 0){
+    /* RLOC probing of the new locators */
+    index_map_cache_entry_rlocs(cache_entry);
+    if (rloc_probe_interval != 0){
         programming_rloc_probing(cache_entry);
     }
+
+    /* The locators of the entry changed its size */
+    account_map_cache_entry(cache_entry);
+    /* Entries of close EIDs waiting for this reply are resolved by it or request their own mapping */
+    map_request_resolved(cache_entry);
+    /* Send the packets held while the entry was being resolved */
+    release_held_packets(cache_entry);
     return (TRUE);
 }
 
 /*
- * Process a record from map-reply probe message
+ * Process a record from map-reply probe message. The probe is identified by the nonce:
+ * the reachability of the RLOC applies to all the map cache entries using it.
  */
 
 int process_map_reply_probe_record(
@@ -286,16 +295,13 @@ int process_map_reply_probe_record(
 {
     lispd_pkt_mapping_record_t              *record                 = NULL;
     lispd_mapping_elt                       *mapping                = NULL;
-    lispd_map_cache_entry                   *cache_entry            = NULL;
-    lispd_locator_elt                       *aux_locator            = NULL;
     lispd_locator_elt                       *locator                = NULL;
-    rmt_locator_extended_info               *rmt_locator_ext_inf    = NULL;
-    lispd_locators_list                     *locators_list[2]       = {NULL,NULL};
+    lispd_locator_elt                       *probed_locator         = NULL;
     lisp_addr_t                             aux_eid_prefix;
     int                                     aux_eid_prefix_length   = 0;
     int                                     aux_iid                 = 0;
     int                                     ctr                     = 0;
-    int                                     locators_probed         = 0;
+    int                                     result                  = BAD;
 
     record = (lispd_pkt_mapping_record_t *)(*cur_ptr);
     mapping = new_map_cache_mapping(aux_eid_prefix,aux_eid_prefix_length,aux_iid);
@@ -308,141 +314,37 @@ int process_map_reply_probe_record(
         free_mapping_elt(mapping);
         return (BAD);
     }
-    mapping->eid_prefix_length = record->eid_prefix_length;
+    free_mapping_elt(mapping);
 
-    if (record->locator_count != 0 ){
-        /* Serch map cache entry exist*/
-        cache_entry = lookup_map_cache_exact(mapping->eid_prefix,mapping->eid_prefix_length);
-        if (cache_entry == NULL){
-            lispd_log_msg(LISP_LOG_DEBUG_2,"process_map_reply_probe_record:  No map cache entry found for %s/%d",
-                    get_char_from_lisp_addr_t(mapping->eid_prefix),mapping->eid_prefix_length);
-            free_mapping_elt(mapping);
-            return (BAD);
-        }
-
-        /* Check instane id.*/
-        if (cache_entry->mapping->iid != mapping->iid){
-            lispd_log_msg(LISP_LOG_DEBUG_2,"process_map_reply_probe_record:  Instance ID of the map reply doesn't match with the map cache entry");
-            free_mapping_elt(mapping);
+    /*
+     * Get the probed locator of the record. Only one locator can be probed per message.
+     * A negative Map-Reply Probe is the answer of a proxy-ETR.
+     */
+    for (ctr=0 ; ctr < record->locator_count ; ctr++){
+        if (process_map_reply_probe_locator (cur_ptr, &locator) != GOOD){
+            free_locator(probed_locator);
             return (BAD);
         }
-
-
-        /* Free auxiliar mapping used to search the map cache entry*/
-        free_mapping_elt(mapping);
-
-        /*
-         * Check probed locators of the list. Only one locator can be probed per message
-         */
-        for (ctr=0 ; ctr < record->locator_count ; ctr++){
-            err = process_map_reply_probe_locator (cur_ptr, cache_entry->mapping, nonce, &locator);
-            if (err == ERR_MALLOC){
-                return (BAD);
-            }
-            if (locator == NULL){ // The current locator is not probed
-                continue;
-            }
-            rmt_locator_ext_inf = (rmt_locator_extended_info *)(locator->extended_info);
-            /* Check the nonce of the message match with the one stored in the structure of the locator */
-            if ((check_nonce(rmt_locator_ext_inf->rloc_probing_nonces,nonce)) == GOOD){
-                free(rmt_locator_ext_inf->rloc_probing_nonces);
-                rmt_locator_ext_inf->rloc_probing_nonces = NULL;
-                if (locators_probed == 0){
-                    aux_locator = locator;
-                    locators_probed ++;
-                }else{
-                    lispd_log_msg(LISP_LOG_DEBUG_1,"process_map_reply_probe_record: Invalid Map-Reply Probe. Only one locator can be probed per message");
-                    return (BAD);
-                }
-            }else{
-                lispd_log_msg(LISP_LOG_DEBUG_1,"The nonce of the Map-Reply Probe doesn't match the nonce of the generated Map-Request Probe. Discarding message ...");
-                return (BAD);
-            }
-        }
-        locator = aux_locator;
-        if (locator ==  NULL){
-            lispd_log_msg(LISP_LOG_DEBUG_1,"process_map_reply_probe_record: Invalid Map-Reply Probe. No probed locator of the received message matches with the "
-                    "locators of the mapping  stored in the map cahce database.");
-            return (BAD);
+        if (locator == NULL){ // The current locator is not probed
+            continue;
         }
-        lispd_log_msg(LISP_LOG_DEBUG_1,"Map-Reply probe reachability to RLOC %s of the EID cache entry %s/%d",
-                    get_char_from_lisp_addr_t(*(locator->locator_addr)),
-                    get_char_from_lisp_addr_t(cache_entry->mapping->eid_prefix),
-                    cache_entry->mapping->eid_prefix_length);
-
-    }else{ // Probe of a negative map cache -> proxy-etr
-        if(proxy_etrs != NULL && compare_lisp_addr_t(&(mapping->eid_prefix),&(proxy_etrs->mapping->eid_prefix)) == 0){
-            cache_entry = proxy_etrs;
-            locators_list[0] = proxy_etrs->mapping->head_v4_locators_list;
-            locators_list[1] = proxy_etrs->mapping->head_v6_locators_list;
-
-            for (ctr=0 ; ctr < 2 ; ctr++){
-                while (locators_list[ctr]!=NULL){
-                    aux_locator = locators_list[ctr]->locator;
-                    rmt_locator_ext_inf = (rmt_locator_extended_info *)(aux_locator->extended_info);
-                    if ((check_nonce(rmt_locator_ext_inf->rloc_probing_nonces,nonce)) == GOOD){
-                        free (rmt_locator_ext_inf->rloc_probing_nonces);
-                        rmt_locator_ext_inf->rloc_probing_nonces = NULL;
-                        locator = aux_locator;
-                        break;
-                    }
-                    locators_list[ctr] = locators_list[ctr]->next;
-                }
-                if (locator != NULL){
-                    break;
-                }
-            }
-            if (locator == NULL){
-                lispd_log_msg(LISP_LOG_DEBUG_1,"process_map_reply_probe_record: The nonce of the Negative Map-Reply Probe don't match any nonce of Proxy-ETR locators");
-                free_mapping_elt(mapping);
-                return (BAD);
-            }
-            free_mapping_elt(mapping);
-        }else{
-            lispd_log_msg(LISP_LOG_DEBUG_1,"process_map_reply_probe_record: The received negative Map-Reply Probe has not been requested: %s/%d",
-                    get_char_from_lisp_addr_t(mapping->eid_prefix),mapping->eid_prefix_length);
-            free_mapping_elt(mapping);
+        if (probed_locator != NULL){
+            lispd_log_msg(LISP_LOG_DEBUG_1,"process_map_reply_probe_record: Invalid Map-Reply Probe. Only one locator can be probed per message");
+            free_locator(probed_locator);
+            free_locator(locator);
             return (BAD);
         }
-
-        lispd_log_msg(LISP_LOG_DEBUG_1,"Map-Reply probe reachability to the PETR with RLOC %s",
-                    get_char_from_lisp_addr_t(*(locator->locator_addr)));
+        probed_locator = locator;
     }
-
-
-
-    if (*(locator->state) == DOWN){
-        *(locator->state) = UP;
-
-        lispd_log_msg(LISP_LOG_DEBUG_1,"Map-Reply Probe received for locator %s -> Locator state changes to UP",
-                           get_char_from_lisp_addr_t(*(locator->locator_addr)));
-
-        /* [re]Calculate balancing locator vectors  if it has been a change of status*/
-        calculate_balancing_vectors (
-                cache_entry->mapping,
-                &(((rmt_mapping_extended_info *)cache_entry->mapping->extended_info)->rmt_balancing_locators_vecs));
-    }
-    /*
-     * Reprogramming timers of rloc probing
-     */
-    rmt_locator_ext_inf = (rmt_locator_extended_info *)(locator->extended_info);
-    if (rmt_locator_ext_inf->probe_timer == NULL){
-       lispd_log_msg(LISP_LOG_DEBUG_1,"process_map_reply_probe_record: The received Map-Reply Probe was not requested");
-       return (BAD);
+    if (record->locator_count != 0 && probed_locator == NULL){
+        lispd_log_msg(LISP_LOG_DEBUG_1,"process_map_reply_probe_record: Invalid Map-Reply Probe. No locator of the record is probed");
+        return (BAD);
     }
 
-    start_timer(rmt_locator_ext_inf->probe_timer, rloc_probe_interval, (timer_callback)rloc_probing,rmt_locator_ext_inf->probe_timer->cb_argument);
-    if (record->locator_count != 0 ){
-        lispd_log_msg(LISP_LOG_DEBUG_2,"Reprogramed RLOC probing of the locator %s of the EID %s/%d in %d seconds",
-                get_char_from_lisp_addr_t(*(locator->locator_addr)),
-                get_char_from_lisp_addr_t(cache_entry->mapping->eid_prefix),
-                cache_entry->mapping->eid_prefix_length, rloc_probe_interval);
-    }else{
-        lispd_log_msg(LISP_LOG_DEBUG_2,"Reprogramed RLOC probing of the locator %s (PETR) in %d seconds",
-                get_char_from_lisp_addr_t(*(locator->locator_addr)), rloc_probe_interval);
-    }
+    result = process_rloc_probe_reply(nonce, (probed_locator != NULL) ? probed_locator->locator_addr : NULL);
+    free_locator(probed_locator);
 
-    return (GOOD);
+    return (result);
 }
 
 
@@ -501,14 +403,12 @@ int process_map_reply_locator(
 }
 
 /*
- * Return the locator from tha mapping that match with the locator of the packet.
- * Retun null if no match found. Offset is updated to point the next locator of the packet.
+ * Return in locator the locator of the packet if it is the probed one, NULL otherwise.
+ * Offset is updated to point the next locator of the packet.
  */
 
 int process_map_reply_probe_locator(
         uint8_t                 **offset,
-        lispd_mapping_elt       *mapping,
-        uint64_t                nonce,
         lispd_locator_elt       **locator)
 {
     lispd_pkt_mapping_record_locator_t  *pkt_locator    = NULL;
@@ -528,16 +428,10 @@ int process_map_reply_probe_locator(
             pkt_locator->mpriority, pkt_locator->mweight);
 
     if (aux_locator != NULL){
-        /* If the locator of the packed is probed, search the structure of the locator that represents the locator of tha packet */
         if (pkt_locator->probed == TRUE){
-            *locator = get_locator_from_mapping(mapping, aux_locator->locator_addr);
-            if (*locator == NULL){
-                lispd_log_msg(LISP_LOG_DEBUG_2,"get_map_reply_locator_from_mapping: The locator %s is not found in the mapping %s/%d",
-                        get_char_from_lisp_addr_t(*(aux_locator->locator_addr)),
-                        get_char_from_lisp_addr_t(mapping->eid_prefix),
-                        mapping->eid_prefix_length);
-                return (ERR_NO_EXIST);
-            }
+            *locator = aux_locator;
+        }else{
+            free_locator(aux_locator);
         }
     }else{
         if (err != ERR_AFI_LCAF_TYPE){
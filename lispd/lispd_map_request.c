@@ -96,6 +96,7 @@
 #include "lispd_map_referral.h"
 #include "lispd_map_reply.h"
 #include "lispd_map_request.h"
+#include "lispd_map_request_scheduler.h"
 #include "lispd_nonce.h"
 #include "lispd_pkt_lib.h"
 #include "lispd_referral_cache_db.h"
@@ -118,10 +119,11 @@ int process_map_request_record(
         uint8_t rloc_probe,
         uint64_t nonce);
 
-/* Build a Map Request packet */
+/* Build a Map Request packet with a record for each requested mapping */
 
  uint8_t *build_map_request_pkt(
-         lispd_mapping_elt       *requested_mapping,
+         lispd_mapping_elt       **requested_mappings,
+         int                     record_count,
          lisp_addr_t             *src_eid,
          map_request_opts        opts,
          int                     *len,               /* return length here */
@@ -132,7 +134,10 @@ int process_map_request_record(
   * Calculate Map Request length. Just add locators with status up
   */
 
- int get_map_request_length (lispd_mapping_elt *requested_mapping, lispd_mapping_elt *src_mapping);
+ int get_map_request_length (
+         lispd_mapping_elt       **requested_mappings,
+         int                     record_count,
+         lispd_mapping_elt       *src_mapping);
 
  /*
   * Calculate the overhead of the Encapsulated Map Request length.
@@ -193,23 +198,13 @@ int process_map_request_record(
 
      if (source_mapping->eid_prefix.afi != 0 && msg->solicit_map_request) {
          /*
-          * Lookup the map cache entry that match with the source EID prefix of the message
+          * Lookup the map cache entry of the IID of the message that match with its source EID prefix
           */
-         map_cache_entry = lookup_map_cache(source_mapping->eid_prefix);
+         map_cache_entry = lookup_map_cache(source_mapping->eid_prefix, source_mapping->iid);
          if (map_cache_entry == NULL){
              free_mapping_elt(source_mapping);
              return (BAD);
          }
-
-         /*
-          * Check IID of the received Solicit Map Request match the IID of the map cache
-          */
-         if (map_cache_entry->mapping->iid != source_mapping->iid){
-             lispd_log_msg(LISP_LOG_DEBUG_2,"process_map_request_msg: The IID of the received Solicit Map Request doesn't match the IID of "
-                     "the entry in the map cache");
-             free_mapping_elt(source_mapping);
-             return (BAD);
-         }
          /* Free source_mapping once we have a valid map cache entry */
          free_mapping_elt(source_mapping);
 
@@ -293,7 +288,7 @@ int process_map_request_record(
 
      /* Check the existence of the requested EID */
      /*  We don't use prefix mask and use by default 32 or 128*/
-     mapping = lookup_eid_in_db(requested_mapping->eid_prefix);
+     mapping = lookup_eid_in_iid_db(requested_mapping->eid_prefix, requested_mapping->iid);
      if (!mapping){
          lispd_log_msg(LISP_LOG_DEBUG_1,"The requested EID doesn't belong to this node: %s/%d",
                  get_char_from_lisp_addr_t(requested_mapping->eid_prefix),
@@ -326,12 +321,26 @@ int build_and_send_map_request_msg(
         map_request_opts        opts,
         uint64_t                *nonce)
 {
+    return (build_and_send_map_request_records_msg(&requested_mapping, 1, src_eid, dst_rloc_addr, opts, nonce));
+}
 
-    uint8_t     *map_req_pkt    = NULL;
-    int         mrp_len         = 0;               /* return the length here */
-    int         result          = 0;
+
+int build_and_send_map_request_records_msg(
+        lispd_mapping_elt       **requested_mappings,
+        int                     record_count,
+        lisp_addr_t             *src_eid,
+        lisp_addr_t             *dst_rloc_addr,
+        map_request_opts        opts,
+        uint64_t                *nonce)
+{
+
+    lispd_mapping_elt   *requested_mapping  = requested_mappings[0];
+    uint8_t             *map_req_pkt        = NULL;
+    int                 mrp_len             = 0;               /* return the length here */
+    int                 result              = 0;
     map_req_pkt = build_map_request_pkt(
-            requested_mapping,
+            requested_mappings,
+            record_count,
             src_eid,
             opts,
             &mrp_len,
@@ -359,9 +368,10 @@ int build_and_send_map_request_msg(
 
 
     if (err == GOOD){
-        lispd_log_msg(LISP_LOG_DEBUG_1, "Sent Map-Request packet for %s/%d to %s: Encap: %c, Probe: %c, SMR: %c, SMR-inv: %c . Nonce: %s",
+        lispd_log_msg(LISP_LOG_DEBUG_1, "Sent Map-Request packet for %s/%d%s to %s: Encap: %c, Probe: %c, SMR: %c, SMR-inv: %c . Nonce: %s",
                         get_char_from_lisp_addr_t(requested_mapping->eid_prefix),
                         requested_mapping->eid_prefix_length,
+                        (record_count > 1) ? " and other records" : "",
                         get_char_from_lisp_addr_t(*dst_rloc_addr),
                         (opts.encap == TRUE ? 'Y' : 'N'),
                         (opts.probe == TRUE ? 'Y' : 'N'),
@@ -387,7 +397,8 @@ int build_and_send_map_request_msg(
 /* Build a Map Request paquet */
 
 uint8_t *build_map_request_pkt(
-        lispd_mapping_elt       *requested_mapping,
+        lispd_mapping_elt       **requested_mappings,
+        int                     record_count,
         lisp_addr_t             *src_eid,
         map_request_opts        opts,
         int                     *len,               /* return length here */
@@ -408,6 +419,7 @@ uint8_t *build_map_request_pkt(
     int                     cpy_len             = 0;
     int                     locators_ctr        = 0;
 
+    lispd_mapping_elt       *requested_mapping  = requested_mappings[0];
     lispd_mapping_elt       *src_mapping        = NULL;
     lispd_locators_list     *locators_list[2]   = {NULL,NULL};
     lispd_locator_elt       *locator            = NULL;
@@ -430,7 +442,7 @@ uint8_t *build_map_request_pkt(
     }
 
     /* Calculate the packet size and reserve memory */
-    map_request_msg_len = get_map_request_length(requested_mapping,src_mapping);
+    map_request_msg_len = get_map_request_length(requested_mappings,record_count,src_mapping);
     *len = map_request_msg_len;
 
     if ((packet = calloc(1,map_request_msg_len)) == NULL){
@@ -457,8 +469,8 @@ uint8_t *build_map_request_pkt(
     mrp->smr_invoked               = opts.smr_invoked;
 
     mrp->additional_itr_rloc_count = 0;     /* To be filled later  */
-    mrp->record_count              = 1;     /* XXX: assume 1 record */
-    mrp->nonce                     = build_nonce((unsigned int) time(NULL));
+    mrp->record_count              = record_count;
+    mrp->nonce                     = build_nonce();
     *nonce                         = mrp->nonce;
 
     if (src_eid != NULL){
@@ -535,11 +547,13 @@ uint8_t *build_map_request_pkt(
     }
 
 
-    /* Requested EID record */
-    request_eid_record = (lispd_pkt_map_request_eid_prefix_record_t *)cur_ptr;
-    request_eid_record->eid_prefix_length = requested_mapping->eid_prefix_length;
+    /* Requested EID records */
+    for (ctr = 0 ; ctr < record_count ; ctr++){
+        request_eid_record = (lispd_pkt_map_request_eid_prefix_record_t *)cur_ptr;
+        request_eid_record->eid_prefix_length = requested_mappings[ctr]->eid_prefix_length;
 
-    cur_ptr = pkt_fill_eid((uint8_t *)&(request_eid_record->eid_prefix_afi),requested_mapping);
+        cur_ptr = pkt_fill_eid((uint8_t *)&(request_eid_record->eid_prefix_afi),requested_mappings[ctr]);
+    }
 
     if (mrp->map_data_present == 1){
         /* Map-Reply Record */
@@ -589,10 +603,14 @@ uint8_t *build_map_request_pkt(
  * Calculate Map Request length. Just add locators with status up
  */
 
-int get_map_request_length (lispd_mapping_elt *requested_mapping, lispd_mapping_elt *src_mapping)
+int get_map_request_length (
+        lispd_mapping_elt       **requested_mappings,
+        int                     record_count,
+        lispd_mapping_elt       *src_mapping)
 {
     int mr_len = 0;
     int locator_count = 0, aux_locator_count = 0;
+    int ctr = 0;
     mr_len = sizeof(lispd_pkt_map_request_t);
     if (src_mapping != NULL){
         mr_len += get_mapping_length(src_mapping);
@@ -612,10 +630,12 @@ int get_map_request_length (lispd_mapping_elt *requested_mapping, lispd_mapping_
         }
     }
     mr_len += sizeof(lispd_pkt_map_request_itr_rloc_t)*locator_count;  // ITR-RLOC-AFI field
-    /* Record size */
-    mr_len += sizeof(lispd_pkt_map_request_eid_prefix_record_t);
-    // We supose that the requested EID has the same AFI as the source EID
-    mr_len += get_mapping_length(requested_mapping);
+    /* Records size */
+    for (ctr = 0 ; ctr < record_count ; ctr++){
+        mr_len += sizeof(lispd_pkt_map_request_eid_prefix_record_t);
+        // We supose that the requested EID has the same AFI as the source EID
+        mr_len += get_mapping_length(requested_mappings[ctr]);
+    }
     /* Add the Map-Reply Record */
     if (src_mapping != NULL){
         mr_len += pkt_get_mapping_record_length(src_mapping);
@@ -628,19 +648,17 @@ int get_map_request_length (lispd_mapping_elt *requested_mapping, lispd_mapping_
  *  Timer function to send an Encapsulated Map Request to a Map Resolver of the list with X retries.
  *  When a reply to this message  is processed, then the timer that calls this functions to send the retries is removed.
  *  This function is called for first time when a packet miss is generated. In that case the timer parameter is NULL.
+ *  The request is sent by the scheduler of Map-Requests: the retransmits count the requests it sent or couldn't send
+ *  (no Map Resolver, send error), not the ones still waiting in its queue.
  */
 int send_map_request_miss(timer *t, void *arg)
 {
     timer_map_request_argument          *argument = (timer_map_request_argument *)arg;
     lispd_map_cache_entry               *map_cache_entry = argument->map_cache_entry;
     nonces_list                         *nonces = map_cache_entry->nonces;
-    lisp_addr_t                         *dst_rloc = NULL;
-    map_request_opts                    opts;
-
-    memset ( &opts, FALSE, sizeof(map_request_opts));
 
     if (nonces == NULL){
-        nonces = new_nonces_list();
+        nonces = new_nonces_list(NONCE_OWNER_MAP_CACHE, map_cache_entry);
         if (nonces==NULL){
             lispd_log_msg(LISP_LOG_WARNING,"Send_map_request_miss: Unable to allocate memory for nonces.");
             return (BAD);
@@ -651,31 +669,16 @@ int send_map_request_miss(timer *t, void *arg)
     if ( nonces->retransmits  <= map_request_retries ){
 
         if (map_cache_entry->request_retry_timer == NULL){
-            map_cache_entry->request_retry_timer = create_timer (MAP_REQUEST_RETRY_TIMER);
-        }
-
-        if (nonces->retransmits > 0){
-            lispd_log_msg(LISP_LOG_DEBUG_1,"Retransmiting Map Request for EID: %s (%d retries)",
-                    get_char_from_lisp_addr_t(map_cache_entry->mapping->eid_prefix),
-                    nonces->retransmits);
+            map_cache_entry->request_retry_timer = create_timer(free);
         }
 
-        /* Get the RLOC of the Map Resolver to be used */
-        dst_rloc = get_map_resolver();
-
-        opts.encap = TRUE;
-        if ((dst_rloc == NULL) || (build_and_send_map_request_msg(
-                map_cache_entry->mapping,
-                &(argument->src_eid),
-                dst_rloc,
-                opts,
-                &nonces->nonce[nonces->retransmits]))==BAD){
-            lispd_log_msg (LISP_LOG_DEBUG_1, "send_map_request_miss: Couldn't send map request for a new map cache entry");
-
+        /* A new miss close to an EID being resolved waits for its reply until the timer expires */
+        if (t != NULL || suppress_map_request(map_cache_entry, &(argument->src_eid)) == FALSE){
+            queue_map_request(map_cache_entry, &(argument->src_eid));
         }
 
-        nonces->retransmits ++;
-        start_timer(map_cache_entry->request_retry_timer, LISPD_INITIAL_MRQ_TIMEOUT,
+        start_timer(map_cache_entry->request_retry_timer,
+                backoff_timeout(LISPD_INITIAL_MRQ_TIMEOUT, LISPD_MAX_RETRANSMIT_TIMEOUT, nonces->retransmits),
                 send_map_request_miss, (void *)argument);
 
     }else{
@@ -684,7 +687,7 @@ int send_map_request_miss(timer *t, void *arg)
                         map_cache_entry->mapping->eid_prefix_length,
                         nonces->retransmits -1);
         del_map_cache_entry_from_db(map_cache_entry->mapping->eid_prefix,
-                map_cache_entry->mapping->eid_prefix_length);
+                map_cache_entry->mapping->eid_prefix_length, map_cache_entry->mapping->iid);
 
     }
     return GOOD;
@@ -719,7 +722,7 @@ int send_ddt_map_request_miss(timer *t, void *arg)
     }
 
     if (nonces_referral == NULL){
-        nonces_referral = new_nonces_list();
+        nonces_referral = new_nonces_list(NONCE_OWNER_DDT_REFERRAL, pending_referral_entry);
         if (nonces_referral==NULL){
             lispd_log_msg(LISP_LOG_WARNING,"send_ddt_map_request_miss: Unable to allocate memory for nonces.");
             return (BAD);
@@ -728,10 +731,11 @@ int send_ddt_map_request_miss(timer *t, void *arg)
     }
 
     if (nonces_map_cache == NULL){
-        nonces_map_cache = new_nonces_list();
+        nonces_map_cache = new_nonces_list(NONCE_OWNER_MAP_CACHE, map_cache_entry);
         if (nonces_map_cache==NULL){
             lispd_log_msg(LISP_LOG_WARNING,"send_ddt_map_request_miss: Unable to allocate memory for nonces.");
-            free (nonces_referral);
+            free_nonces_list(nonces_referral);
+            pending_referral_entry->nonces = NULL;
             return (BAD);
         }
         map_cache_entry->nonces = nonces_map_cache;
@@ -773,13 +777,16 @@ int send_ddt_map_request_miss(timer *t, void *arg)
 
         }
         nonces_map_cache->nonce[0] = nonces_referral->nonce[nonces_referral->retransmits];
+        index_nonce(nonces_map_cache, 0);
+        index_nonce(nonces_referral, nonces_referral->retransmits);
         nonces_referral->retransmits ++;
 
         if (pending_referral_entry->ddt_request_retry_timer == NULL){
-            pending_referral_entry->ddt_request_retry_timer = create_timer (DDT_MAP_REQUEST_RETRY_TIMER);
+            pending_referral_entry->ddt_request_retry_timer = create_timer(NULL);
         }
 
-        start_timer(pending_referral_entry->ddt_request_retry_timer, LISPD_INITIAL_DDT_MRQ_TIMEOUT,
+        start_timer(pending_referral_entry->ddt_request_retry_timer,
+                backoff_timeout(LISPD_INITIAL_DDT_MRQ_TIMEOUT, LISPD_MAX_RETRANSMIT_TIMEOUT, nonces_referral->retransmits - 1),
                 send_ddt_map_request_miss, (void *)pending_referral_entry);
 
     }else{ // End of retransmits. Try next node. If last node asked, activate negative map cache
@@ -789,7 +796,7 @@ int send_ddt_map_request_miss(timer *t, void *arg)
                 nonces_referral->retransmits -1);
 
         pending_referral_entry->tried_locators = pending_referral_entry->tried_locators +1;
-        free (pending_referral_entry->nonces);
+        free_nonces_list(pending_referral_entry->nonces);
         pending_referral_entry->nonces = NULL;
 
         err = send_ddt_map_request_miss(NULL,arg);
@@ -814,7 +821,7 @@ int send_ddt_map_request_miss(timer *t, void *arg)
                 referral_mapping = pending_referral_entry->previous_referral->mapping;
                 if (activate_negative_map_cache (map_cache_entry, referral_mapping->eid_prefix,
                         referral_mapping->eid_prefix_length,1,MAPPING_ACT_NO_ACTION) != GOOD){
-                    del_map_cache_entry_from_db(map_cache_entry->mapping->eid_prefix,map_cache_entry->mapping->eid_prefix_length);
+                    del_map_cache_entry_from_db(map_cache_entry->mapping->eid_prefix,map_cache_entry->mapping->eid_prefix_length, map_cache_entry->mapping->iid);
                 }
             }
 
@@ -854,7 +861,7 @@ int send_map_request_ddt_map_reply_miss(timer *t, void *arg)
 
     if (nonces == NULL){
         // XXX It should never reach this code
-        nonces = new_nonces_list();
+        nonces = new_nonces_list(NONCE_OWNER_MAP_CACHE, map_cache_entry);
         if (nonces==NULL){
             lispd_log_msg(LISP_LOG_WARNING,"send_map_request_ddt_map_reply_miss: Unable to allocate memory for nonces.");
             return (BAD);
@@ -890,12 +897,14 @@ int send_map_request_ddt_map_reply_miss(timer *t, void *arg)
 
         }
 
+        index_nonce(nonces, nonces->retransmits);
         nonces->retransmits ++;
 
         if (map_cache_entry->request_retry_timer == NULL){
-            map_cache_entry->request_retry_timer = create_timer (DDT_MAP_REQ_RETRY_MS_ACK_TIMER);
+            map_cache_entry->request_retry_timer = create_timer(NULL);
         }
-        start_timer(map_cache_entry->request_retry_timer, LISPD_INITIAL_MRQ_TIMEOUT,
+        start_timer(map_cache_entry->request_retry_timer,
+                backoff_timeout(LISPD_INITIAL_MRQ_TIMEOUT, LISPD_MAX_RETRANSMIT_TIMEOUT, nonces->retransmits - 1),
                 send_map_request_ddt_map_reply_miss, arg);
 
     }else{
@@ -911,7 +920,7 @@ int send_map_request_ddt_map_reply_miss(timer *t, void *arg)
                 1,MAPPING_ACT_NO_ACTION);
         if (err != GOOD){
             del_map_cache_entry_from_db(pending_referral_entry->map_cache_entry->mapping->eid_prefix,
-                    pending_referral_entry->map_cache_entry->mapping->eid_prefix_length);
+                    pending_referral_entry->map_cache_entry->mapping->eid_prefix_length, pending_referral_entry->map_cache_entry->mapping->iid);
         }
         remove_pending_referral_cache_entry_from_list(pending_referral_entry);
 
@@ -920,6 +929,68 @@ int send_map_request_ddt_map_reply_miss(timer *t, void *arg)
     return GOOD;
 }
 
+
+int send_map_request_refresh(
+        timer   *t,
+        void    *arg)
+{
+    lispd_map_cache_entry   *map_cache_entry    = (lispd_map_cache_entry *)arg;
+    nonces_list             *nonces             = map_cache_entry->nonces;
+    lisp_addr_t             *dst_rloc           = NULL;
+    map_request_opts        opts;
+
+    memset ( &opts, FALSE, sizeof(map_request_opts));
+
+    if (nonces == NULL){
+        nonces = new_nonces_list(NONCE_OWNER_MAP_CACHE, map_cache_entry);
+        if (nonces == NULL){
+            lispd_log_msg(LISP_LOG_WARNING,"send_map_request_refresh: Unable to allocate memory for nonces.");
+            return (BAD);
+        }
+        map_cache_entry->nonces = nonces;
+    }
+
+    if (nonces->retransmits - 1 < map_request_retries){
+        if (nonces->retransmits > 0){
+            lispd_log_msg(LISP_LOG_DEBUG_1,"Retransmiting refresh Map Request for EID: %s (%d retries)",
+                    get_char_from_lisp_addr_t(map_cache_entry->mapping->eid_prefix),
+                    nonces->retransmits);
+        }
+        dst_rloc = get_map_resolver();
+        opts.encap = TRUE;
+        if (dst_rloc == NULL || (build_and_send_map_request_msg(
+                map_cache_entry->mapping,
+                NULL,
+                dst_rloc,
+                opts,
+                &(nonces->nonce[nonces->retransmits]))) != GOOD){
+            lispd_log_msg(LISP_LOG_DEBUG_1, "send_map_request_refresh: Couldn't send Map Request for EID: %s",
+                    get_char_from_lisp_addr_t(map_cache_entry->mapping->eid_prefix));
+        }
+        index_nonce(nonces, nonces->retransmits);
+        nonces->retransmits ++;
+
+        if (map_cache_entry->request_retry_timer == NULL){
+            map_cache_entry->request_retry_timer = create_timer(NULL);
+        }
+        start_timer(map_cache_entry->request_retry_timer,
+                backoff_timeout(LISPD_INITIAL_MRQ_TIMEOUT, LISPD_MAX_RETRANSMIT_TIMEOUT, nonces->retransmits - 1),
+                send_map_request_refresh, arg);
+    }else{
+        /* The entry is used until it expires */
+        lispd_log_msg(LISP_LOG_DEBUG_1,"send_map_request_refresh: No Map Reply for EID %s/%d after %d retries. "
+                "The entry expires with its TTL",
+                get_char_from_lisp_addr_t(map_cache_entry->mapping->eid_prefix),
+                map_cache_entry->mapping->eid_prefix_length,
+                nonces->retransmits - 1);
+        free_nonces_list(map_cache_entry->nonces);
+        map_cache_entry->nonces = NULL;
+        free_timer(map_cache_entry->request_retry_timer);
+        map_cache_entry->request_retry_timer = NULL;
+    }
+    return (GOOD);
+}
+
 /*
  * Editor modelines
  *
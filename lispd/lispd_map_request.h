@@ -192,6 +192,18 @@ int build_and_send_map_request_msg(
         map_request_opts        opts,
         uint64_t                *nonce);
 
+/*
+ *  Send a Map Request with a record for each requested mapping. All the mappings should have the
+ *  same AFI. The inner header of an Encapsulated Map Request is addressed to the first EID.
+ */
+int build_and_send_map_request_records_msg(
+        lispd_mapping_elt       **requested_mappings,
+        int                     record_count,
+        lisp_addr_t             *src_eid,
+        lisp_addr_t             *dst_rloc_addr,
+        map_request_opts        opts,
+        uint64_t                *nonce);
+
 
 /*
  *  Receive a Map_request message and process based on control bits
@@ -204,6 +216,7 @@ int process_map_request_msg(uint8_t *packet, lisp_addr_t *local_rloc, uint16_t r
  *  Timer function to send an Encapsulated Map Request to a Map Resolver of the list with X retries.
  *  When a reply to this message  is processed, then the timer that calls this functions to send the retries is removed.
  *  This function is called for first time when a packet miss is generated. In that case the timer parameter is NULL.
+ *  The Map Requests are sent through the scheduler of lispd_map_request_scheduler.h
  *  @param t Timer responsible to call this function
  *  @param arg Represents a timer_map_request_argument element
  *  @return GOOD if finish correctly or an error code otherwise
@@ -234,4 +247,13 @@ int send_ddt_map_request_miss(timer *t, void *arg);
  */
 int send_map_request_ddt_map_reply_miss(timer *t, void *arg);
 
+/**
+ * Timer function to send an Encapsulated Map Request to refresh an active map cache entry before its TTL expires.
+ * The entry keeps being used until the Map Reply is received. It is retransmitted up to map_request_retries times.
+ * @param t Timer responsible to call this function. NULL the first time
+ * @param arg Represents the lispd_map_cache_entry to refresh
+ * @return GOOD if finish correctly or an error code otherwise
+ */
+int send_map_request_refresh(timer *t, void *arg);
+
 #endif /*LISPD_MAP_REQUEST_H_*/
@@ -0,0 +1,552 @@
+/*
+ * lispd_map_request_scheduler.c
+ *
+ * This file is part of LISP Mobile Node Implementation.
+ * Rate limiting, batching and suppression of the Map-Requests of the map cache misses.
+ *
+ * Copyright (C) 2012 Cisco Systems, Inc, 2012. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * Please send any bug reports or fixes you make to the email address(es):
+ *    LISP-MN developers <devel@lispmob.org>
+ *
+ */
+
+
+#include "lispd_external.h"
+#include "lispd_lib.h"
+#include "lispd_local_db.h"
+#include "lispd_log.h"
+#include "lispd_map_cache_db.h"
+#include "lispd_map_request.h"
+#include "lispd_map_request_scheduler.h"
+#include "lispd_miss_queue.h"
+#include "lispd_nonce.h"
+
+typedef struct map_request_state_ {
+    lispd_map_cache_entry       *entry;
+    lisp_addr_t                 src_eid;
+    lisp_addr_t                 key;            /* Network of the EID used to suppress close misses */
+    uint8_t                     queued;
+    uint8_t                     leading;        /* In the table of requests in flight */
+    struct map_request_state_   *leader;        /* Request in flight this one waits for */
+    struct map_request_state_   *followers;     /* Requests waiting for this one */
+    struct map_request_state_   *next;          /* In the send queue or in the followers of the leader */
+    struct map_request_state_   *next_leader;   /* In the bucket of the table of requests in flight */
+} map_request_state;
+
+/* Token bucket of a Map Resolver */
+typedef struct map_request_bucket_ {
+    lisp_addr_t                 map_resolver;
+    token_bucket                bucket;
+    struct map_request_bucket_  *next;
+} map_request_bucket;
+
+static struct {
+    map_request_state   *queue_head;
+    map_request_state   *queue_tail;
+    map_request_state   *leaders[MAP_REQUEST_LEADERS_SIZE];
+    map_request_bucket  *buckets;
+    timer               *flush_timer;
+    uint8_t             flush_scheduled;
+    int                 queued;
+    uint64_t            sent;           /* Map-Requests */
+    uint64_t            records;        /* EIDs requested */
+    uint64_t            coalesced;      /* Records sent in the Map-Request of another EID */
+    uint64_t            suppressed;     /* Misses which waited for the reply of a close EID */
+    uint64_t            covered;        /* Suppressed misses resolved by that reply */
+    uint64_t            throttled;      /* Times the queue waited for a token */
+} scheduler;
+
+
+static int flush_map_requests(timer *t, void *arg);
+
+
+static lisp_addr_t get_suppress_key(lispd_map_cache_entry *entry)
+{
+    lisp_addr_t     eid     = entry->mapping->eid_prefix;
+
+    return (get_network_address(eid,
+            (eid.afi == AF_INET) ? MAP_REQUEST_SUPPRESS_V4_LENGTH : MAP_REQUEST_SUPPRESS_V6_LENGTH));
+}
+
+
+static uint32_t leader_bucket(lisp_addr_t *key)
+{
+    uint32_t    hash    = 0;
+    uint32_t    word    = 0;
+    int         i       = 0;
+
+    if (key->afi == AF_INET){
+        hash = key->address.ip.s_addr;
+    }else{
+        for (i = 0; i < 4; i++){
+            memcpy(&word, CO(&(key->address.ipv6), i * sizeof(uint32_t)), sizeof(uint32_t));
+            hash ^= word;
+        }
+    }
+    hash ^= hash >> 16;
+    hash *= 0x45d9f3b;
+    hash ^= hash >> 16;
+    return (hash % MAP_REQUEST_LEADERS_SIZE);
+}
+
+
+static map_request_state *find_leader(lisp_addr_t *key)
+{
+    map_request_state   *state  = NULL;
+
+    for (state = scheduler.leaders[leader_bucket(key)]; state != NULL; state = state->next_leader){
+        if (compare_lisp_addr_t(&(state->key), key) == 0){
+            return (state);
+        }
+    }
+    return (NULL);
+}
+
+
+static void add_leader(map_request_state *state)
+{
+    uint32_t    bucket  = leader_bucket(&(state->key));
+
+    state->next_leader = scheduler.leaders[bucket];
+    scheduler.leaders[bucket] = state;
+    state->leading = TRUE;
+}
+
+
+static void remove_leader(map_request_state *state)
+{
+    map_request_state   **prev  = &(scheduler.leaders[leader_bucket(&(state->key))]);
+
+    while (*prev != NULL){
+        if (*prev == state){
+            *prev = state->next_leader;
+            break;
+        }
+        prev = &((*prev)->next_leader);
+    }
+    state->next_leader = NULL;
+    state->leading = FALSE;
+}
+
+
+/*
+ * Remove the state from the followers of its leader
+ */
+static void unfollow(map_request_state *state)
+{
+    map_request_state   **prev  = NULL;
+
+    if (state->leader == NULL){
+        return;
+    }
+    prev = &(state->leader->followers);
+    while (*prev != NULL){
+        if (*prev == state){
+            *prev = state->next;
+            break;
+        }
+        prev = &((*prev)->next);
+    }
+    state->next = NULL;
+    state->leader = NULL;
+}
+
+
+static void unqueue(map_request_state *state)
+{
+    map_request_state   **prev  = &(scheduler.queue_head);
+    map_request_state   *last   = NULL;     /* State before the one removed */
+
+    while (*prev != NULL){
+        if (*prev == state){
+            *prev = state->next;
+            break;
+        }
+        last = *prev;
+        prev = &((*prev)->next);
+    }
+    if (scheduler.queue_tail == state){
+        scheduler.queue_tail = last;
+    }
+    state->next = NULL;
+    state->queued = FALSE;
+    scheduler.queued--;
+}
+
+
+static map_request_state *get_map_request_state(
+        lispd_map_cache_entry   *entry,
+        lisp_addr_t             *src_eid)
+{
+    map_request_state   *state  = entry->request_state;
+
+    if (state == NULL){
+        if ((state = (map_request_state *)calloc(1, sizeof(map_request_state))) == NULL){
+            lispd_log_msg(LISP_LOG_WARNING, "get_map_request_state: Unable to allocate memory for map_request_state: %s",
+                    strerror(errno));
+            return (NULL);
+        }
+        state->entry = entry;
+        state->key = get_suppress_key(entry);
+        entry->request_state = state;
+    }
+    state->src_eid = *src_eid;
+    return (state);
+}
+
+
+int suppress_map_request(
+        lispd_map_cache_entry   *entry,
+        lisp_addr_t             *src_eid)
+{
+    map_request_state   *state  = NULL;
+    map_request_state   *leader = NULL;
+    lisp_addr_t         key     = get_suppress_key(entry);
+
+    leader = find_leader(&key);
+    if (leader == NULL || leader->entry == entry){
+        return (FALSE);
+    }
+    if ((state = get_map_request_state(entry, src_eid)) == NULL){
+        return (FALSE);
+    }
+    state->leader = leader;
+    state->next = leader->followers;
+    leader->followers = state;
+    scheduler.suppressed++;
+
+    lispd_log_msg(LISP_LOG_DEBUG_2, "Map-Request for %s suppressed: waiting for the Map-Reply of %s",
+            get_char_from_lisp_addr_t(entry->mapping->eid_prefix),
+            get_char_from_lisp_addr_t(leader->entry->mapping->eid_prefix));
+    return (TRUE);
+}
+
+
+int queue_map_request(
+        lispd_map_cache_entry   *entry,
+        lisp_addr_t             *src_eid)
+{
+    map_request_state   *state  = NULL;
+
+    if ((state = get_map_request_state(entry, src_eid)) == NULL){
+        return (BAD);
+    }
+    if (state->queued == TRUE){
+        return (GOOD);
+    }
+    unfollow(state);
+    if (state->leading == FALSE && find_leader(&(state->key)) == NULL){
+        add_leader(state);
+    }
+
+    state->next = NULL;
+    if (scheduler.queue_tail == NULL){
+        scheduler.queue_head = state;
+    }else{
+        scheduler.queue_tail->next = state;
+    }
+    scheduler.queue_tail = state;
+    state->queued = TRUE;
+    scheduler.queued++;
+
+    /* The queue is sent on the next tick: the misses of the same burst share it */
+    if (scheduler.flush_scheduled == FALSE){
+        if (scheduler.flush_timer == NULL){
+            scheduler.flush_timer = create_timer(NULL);
+        }
+        start_timer(scheduler.flush_timer, 0, flush_map_requests, NULL);
+        scheduler.flush_scheduled = TRUE;
+    }
+    return (GOOD);
+}
+
+
+/*
+ * Detach the state from the scheduler and from the entry
+ */
+static map_request_state *detach_map_request_state(lispd_map_cache_entry *entry)
+{
+    map_request_state   *state  = entry->request_state;
+
+    if (state == NULL){
+        return (NULL);
+    }
+    if (state->queued == TRUE){
+        unqueue(state);
+    }
+    unfollow(state);
+    if (state->leading == TRUE){
+        remove_leader(state);
+    }
+    entry->request_state = NULL;
+    return (state);
+}
+
+
+void map_request_resolved(lispd_map_cache_entry *entry)
+{
+    map_request_state   *state      = NULL;
+    map_request_state   *follower   = NULL;
+    map_request_state   *next       = NULL;
+
+    if ((state = detach_map_request_state(entry)) == NULL){
+        return;
+    }
+    follower = state->followers;
+    free(state);
+
+    while (follower != NULL){
+        next = follower->next;
+        follower->next = NULL;
+        follower->leader = NULL;
+        if (is_prefix_b_part_of_a(entry->mapping->eid_prefix, entry->mapping->eid_prefix_length,
+                follower->entry->mapping->eid_prefix, follower->entry->mapping->eid_prefix_length) == TRUE){
+            lispd_log_msg(LISP_LOG_DEBUG_2, "Map cache entry %s/%d resolved by the Map-Reply of %s/%d",
+                    get_char_from_lisp_addr_t(follower->entry->mapping->eid_prefix),
+                    follower->entry->mapping->eid_prefix_length,
+                    get_char_from_lisp_addr_t(entry->mapping->eid_prefix),
+                    entry->mapping->eid_prefix_length);
+            move_held_packets(follower->entry, entry);
+            scheduler.covered++;
+            /* Releases the state of the follower */
+            del_map_cache_entry_from_db(follower->entry->mapping->eid_prefix,
+                    follower->entry->mapping->eid_prefix_length, follower->entry->mapping->iid);
+        }else{
+            queue_map_request(follower->entry, &(follower->src_eid));
+        }
+        follower = next;
+    }
+}
+
+
+void cancel_map_request(lispd_map_cache_entry *entry)
+{
+    map_request_state   *state      = NULL;
+    map_request_state   *follower   = NULL;
+    map_request_state   *next       = NULL;
+
+    if ((state = detach_map_request_state(entry)) == NULL){
+        return;
+    }
+    for (follower = state->followers; follower != NULL; follower = next){
+        next = follower->next;
+        follower->next = NULL;
+        follower->leader = NULL;
+        /* Nothing is sent while the map cache is released on exit */
+        if (lispd_running == TRUE){
+            queue_map_request(follower->entry, &(follower->src_eid));
+        }
+    }
+    free(state);
+}
+
+
+/*
+ * Return the token bucket of the Map Resolver after refilling it
+ */
+static map_request_bucket *get_map_request_bucket(lisp_addr_t *map_resolver)
+{
+    map_request_bucket  *bucket = NULL;
+
+    for (bucket = scheduler.buckets; bucket != NULL; bucket = bucket->next){
+        if (compare_lisp_addr_t(&(bucket->map_resolver), map_resolver) == 0){
+            break;
+        }
+    }
+    if (bucket == NULL){
+        if ((bucket = (map_request_bucket *)calloc(1, sizeof(map_request_bucket))) == NULL){
+            lispd_log_msg(LISP_LOG_WARNING, "get_map_request_bucket: Unable to allocate memory for map_request_bucket: %s",
+                    strerror(errno));
+            return (NULL);
+        }
+        bucket->map_resolver = *map_resolver;
+        bucket->next = scheduler.buckets;
+        scheduler.buckets = bucket;
+    }
+    /* A new bucket is filled */
+    refill_token_bucket(&(bucket->bucket), map_request_rate);
+    return (bucket);
+}
+
+
+/*
+ * Take from the queue the first entry and the following ones which can be requested in the same
+ * Map-Request: same AFI and same local mapping as source EID.
+ */
+static int take_map_request_batch(map_request_state **batch)
+{
+    map_request_state   **prev          = &(scheduler.queue_head);
+    map_request_state   *state          = NULL;
+    map_request_state   *last           = NULL;     /* Last state left in the queue */
+    lispd_mapping_elt   *src_mapping    = NULL;
+    int                 afi             = AF_UNSPEC;
+    int                 count           = 0;
+
+    while ((state = *prev) != NULL && count < map_request_batch){
+        if (count != 0 && (state->entry->mapping->eid_prefix.afi != afi ||
+                lookup_eid_in_db(state->src_eid) != src_mapping)){
+            last = state;
+            prev = &(state->next);
+            continue;
+        }
+        *prev = state->next;
+        if (scheduler.queue_tail == state){
+            scheduler.queue_tail = last;
+        }
+        state->next = NULL;
+        state->queued = FALSE;
+        scheduler.queued--;
+        /* Resolved entries leave the queue: this should never happen */
+        if (state->entry->nonces == NULL || state->entry->nonces->retransmits > LISPD_MAX_RETRANSMITS){
+            continue;
+        }
+        if (count == 0){
+            afi = state->entry->mapping->eid_prefix.afi;
+            src_mapping = lookup_eid_in_db(state->src_eid);
+        }
+        batch[count++] = state;
+    }
+    return (count);
+}
+
+
+/*
+ * Count a Map-Request of the entry which couldn't be sent. The entry is removed by its retry
+ * timer after map_request_retries attempts, whether they were sent or not.
+ */
+static void count_unsent_map_request(lispd_map_cache_entry *entry)
+{
+    if (entry->nonces != NULL && entry->nonces->retransmits <= LISPD_MAX_RETRANSMITS){
+        entry->nonces->nonce[entry->nonces->retransmits] = 0;
+        entry->nonces->retransmits++;
+    }
+}
+
+
+static void send_map_request_batch(
+        map_request_state   **batch,
+        int                 count,
+        lisp_addr_t         *map_resolver)
+{
+    lispd_mapping_elt   *mappings[MAX_MAP_REQUEST_BATCH];
+    nonces_list         *nonces     = NULL;
+    map_request_opts    opts;
+    uint64_t            nonce       = 0;
+    int                 i           = 0;
+
+    memset(&opts, FALSE, sizeof(map_request_opts));
+    opts.encap = TRUE;
+
+    for (i = 0; i < count; i++){
+        mappings[i] = batch[i]->entry->mapping;
+        if (batch[i]->entry->nonces->retransmits > 0){
+            lispd_log_msg(LISP_LOG_DEBUG_1,"Retransmiting Map Request for EID: %s (%d retries)",
+                    get_char_from_lisp_addr_t(mappings[i]->eid_prefix),
+                    batch[i]->entry->nonces->retransmits);
+        }
+    }
+
+    if (build_and_send_map_request_records_msg(mappings, count, &(batch[0]->src_eid), map_resolver,
+            opts, &nonce) != GOOD){
+        lispd_log_msg (LISP_LOG_DEBUG_1, "send_map_request_batch: Couldn't send map request for a new map cache entry");
+        for (i = 0; i < count; i++){
+            count_unsent_map_request(batch[i]->entry);
+        }
+        return;
+    }
+
+    /* All the records share the nonce */
+    for (i = 0; i < count; i++){
+        nonces = batch[i]->entry->nonces;
+        nonces->nonce[nonces->retransmits] = nonce;
+        index_nonce(nonces, nonces->retransmits);
+        nonces->retransmits++;
+    }
+    scheduler.sent++;
+    scheduler.records += count;
+    scheduler.coalesced += count - 1;
+}
+
+
+static int flush_map_requests(timer *t, void *arg)
+{
+    map_request_state   *batch[MAX_MAP_REQUEST_BATCH];
+    map_request_state   *state          = NULL;
+    map_request_bucket  *bucket         = NULL;
+    lisp_addr_t         *map_resolver   = NULL;
+    uint64_t            wait            = 0;
+    int                 count           = 0;
+
+    scheduler.flush_scheduled = FALSE;
+    if (scheduler.queue_head == NULL){
+        return (GOOD);
+    }
+
+    if ((map_resolver = get_map_resolver()) == NULL){
+        /* The retry timers of the entries queue them again until they reach map_request_retries */
+        while ((state = scheduler.queue_head) != NULL){
+            unqueue(state);
+            count_unsent_map_request(state->entry);
+        }
+        return (GOOD);
+    }
+    bucket = get_map_request_bucket(map_resolver);
+
+    while (scheduler.queue_head != NULL){
+        if (bucket != NULL && (wait = get_token_bucket_wait(&(bucket->bucket), map_request_rate)) != 0){
+            scheduler.throttled++;
+            lispd_log_msg(LISP_LOG_DEBUG_3, "Map-Requests to %s rate limited: %d queued",
+                    get_char_from_lisp_addr_t(*map_resolver), scheduler.queued);
+            start_timer(scheduler.flush_timer, wait, flush_map_requests, NULL);
+            scheduler.flush_scheduled = TRUE;
+            break;
+        }
+        if ((count = take_map_request_batch(batch)) == 0){
+            continue;
+        }
+        send_map_request_batch(batch, count, map_resolver);
+        if (bucket != NULL){
+            take_token(&(bucket->bucket));
+        }
+    }
+    return (GOOD);
+}
+
+
+void dump_map_request_stats(int log_level)
+{
+    if (is_loggable(log_level) == FALSE){
+        return;
+    }
+    lispd_log_msg(log_level, "Map-Requests: sent %llu (%llu records, %llu coalesced)   suppressed: %llu (%llu covered by the first reply)   "
+            "rate limited: %llu   queued: %d",
+            (unsigned long long)scheduler.sent,
+            (unsigned long long)scheduler.records,
+            (unsigned long long)scheduler.coalesced,
+            (unsigned long long)scheduler.suppressed,
+            (unsigned long long)scheduler.covered,
+            (unsigned long long)scheduler.throttled,
+            scheduler.queued);
+}
+
+/*
+ * Editor modelines
+ *
+ * vi: set shiftwidth=4 tabstop=4 expandtab:
+ * :indentSize=4:tabSize=4:noTabs=true:
+ */
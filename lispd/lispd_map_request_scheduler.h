@@ -0,0 +1,81 @@
+/*
+ * lispd_map_request_scheduler.h
+ *
+ * This file is part of LISP Mobile Node Implementation.
+ * Rate limiting, batching and suppression of the Map-Requests of the map cache misses.
+ *
+ * Copyright (C) 2012 Cisco Systems, Inc, 2012. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * Please send any bug reports or fixes you make to the email address(es):
+ *    LISP-MN developers <devel@lispmob.org>
+ *
+ */
+
+
+#ifndef LISPD_MAP_REQUEST_SCHEDULER_H_
+#define LISPD_MAP_REQUEST_SCHEDULER_H_
+
+#include "lispd.h"
+#include "lispd_map_cache.h"
+
+/*
+ * A miss to an EID of the same prefix of this length than an EID whose Map-Request is in flight
+ * waits for its reply: the reply usually covers both EIDs
+ */
+#define MAP_REQUEST_SUPPRESS_V4_LENGTH      24
+#define MAP_REQUEST_SUPPRESS_V6_LENGTH      64
+#define MAP_REQUEST_LEADERS_SIZE            1024    /* Buckets of the table of requests in flight */
+
+
+/*
+ * Return TRUE if the Map-Request of an EID close to the one of the entry is in flight. The entry
+ * then waits for that reply instead of sending its own request, until its retry timer expires.
+ */
+int suppress_map_request(
+        lispd_map_cache_entry   *entry,
+        lisp_addr_t             *src_eid);
+
+/*
+ * Queue the Map-Request of an entry being resolved. The queue is sent on the next tick of the timers,
+ * as long as the token bucket of the Map Resolver allows it. Up to map_request_batch queued entries
+ * with the same source EID are requested in the same Map-Request.
+ */
+int queue_map_request(
+        lispd_map_cache_entry   *entry,
+        lisp_addr_t             *src_eid);
+
+/*
+ * Called when an entry gets resolved. The entries waiting for its reply whose EID is part of the
+ * resolved prefix are removed and their held packets moved to the entry. The rest are queued.
+ */
+void map_request_resolved(lispd_map_cache_entry *entry);
+
+/*
+ * Called when an entry is released. The entries waiting for its reply are queued.
+ */
+void cancel_map_request(lispd_map_cache_entry *entry);
+
+void dump_map_request_stats(int log_level);
+
+#endif /* LISPD_MAP_REQUEST_SCHEDULER_H_ */
+
+/*
+ * Editor modelines
+ *
+ * vi: set shiftwidth=4 tabstop=4 expandtab:
+ * :indentSize=4:tabSize=4:noTabs=true:
+ */
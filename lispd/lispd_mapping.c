@@ -28,9 +28,13 @@
  *    Albert Lopez      <alopez@ac.upc.edu>
  */
 
+#include "lispd_epoch.h"
+#include "lispd_external.h"
+#include "lispd_flow_cache.h"
 #include "lispd_lib.h"
 #include "lispd_local_db.h"
 #include "lispd_log.h"
+#include "lispd_maglev.h"
 #include "lispd_mapping.h"
 
 /*********************************** FUNCTIONS DECLARATION ************************/
@@ -68,32 +72,50 @@ rmt_mapping_extended_info *copy_rmt_mapping_extended_info(rmt_mapping_extended_i
 void free_rmt_mapping_extended_info(rmt_mapping_extended_info *extended_info);
 
 /*
- * Free the dinamic arrays that contains the balancing_locators_vecs structure;
+ * Free a balancing_locators_vecs structure and its dinamic arrays
  */
-void free_balancing_locators_vecs (balancing_locators_vecs locators_vec);
+void free_balancing_locators_vecs (balancing_locators_vecs *locators_vec);
 
 
+/*
+ * Build the vector distributing the flows among the locators. num_configured is the number
+ * of locators of the vector with a usable priority, whatever their state.
+ */
 lispd_locator_elt   **set_balancing_vector(
         lispd_locator_elt   **locators,
+        int                 *weights,
         int                 total_weight,
         int                 hcf,
+        int                 num_configured,
+        int                 *locators_vec_length);
+
+static lispd_locator_elt   **set_maglev_balancing_vector(
+        lispd_locator_elt   **locators,
+        int                 *weights,
+        int                 num_configured,
         int                 *locators_vec_length);
 
+static inline int count_usable_locators(lispd_locators_list *locators_list_elt);
+
 int select_best_priority_locators (
         lispd_locators_list     *locators_list_elt,
         lispd_locator_elt       **selected_locators);
 
-static inline void get_hcf_locators_weight (
+/*
+ * Weight used to balance the traffic among the locators: the configured weight, biased by the RTT
+ * of the locators when rloc-probe-rtt-weighting is enabled
+ */
+static void get_balancing_weights (
         lispd_locator_elt   **locators,
+        int                 *weights);
+
+static inline void get_hcf_locators_weight (
+        int                 *weights,
         int                 *total_weight,
         int                 *highest_common_factor);
 
 int highest_common_factor  (int a, int b);
 
-/*
- * Initialize to 0 balancing_locators_vecs
- */
-void reset_balancing_locators_vecs (balancing_locators_vecs *blv);
 
 /************************************ FUNCTIONS  **********************************/
 
@@ -280,7 +302,7 @@ void free_lcl_mapping_extended_info(lcl_mapping_extended_info *extended_info)
         stop_timer(extended_info->map_reg_timer);
     }
     if (extended_info->map_reg_nonce != NULL){
-        free(extended_info->map_reg_nonce);
+        free_nonces_list(extended_info->map_reg_nonce);
     }
     free (extended_info);
 }
@@ -298,12 +320,7 @@ static inline rmt_mapping_extended_info *new_rmt_mapping_extended_info()
         return (NULL);
     }
 
-    extended_info->rmt_balancing_locators_vecs.v4_balancing_locators_vec = NULL;
-    extended_info->rmt_balancing_locators_vecs.v6_balancing_locators_vec = NULL;
-    extended_info->rmt_balancing_locators_vecs.balancing_locators_vec = NULL;
-    extended_info->rmt_balancing_locators_vecs.v4_locators_vec_length = 0;
-    extended_info->rmt_balancing_locators_vecs.v6_locators_vec_length = 0;
-    extended_info->rmt_balancing_locators_vecs.locators_vec_length = 0;
+    extended_info->rmt_balancing_locators_vecs = NULL;
 
     return (extended_info);
 }
@@ -571,35 +588,25 @@ lispd_locator_elt *get_locator_from_mapping_with_nonce(
 
 
 /*
- * Free the dinamic arrays that contains the balancing_locators_vecs structure;
+ * Free a balancing_locators_vecs structure and its dinamic arrays
  */
-void free_balancing_locators_vecs (balancing_locators_vecs locators_vec)
+void free_balancing_locators_vecs (balancing_locators_vecs *locators_vec)
 {
-    if (locators_vec.balancing_locators_vec != NULL &&
-            locators_vec.balancing_locators_vec != locators_vec.v4_balancing_locators_vec && //IPv4 locators more priority -> IPv4_IPv6 vector = IPv4 locator vector
-            locators_vec.balancing_locators_vec != locators_vec.v6_balancing_locators_vec){  //IPv6 locators more priority -> IPv4_IPv6 vector = IPv4 locator vector
-            free (locators_vec.balancing_locators_vec);
+    if (locators_vec == NULL){
+        return;
     }
-    if (locators_vec.v4_balancing_locators_vec != NULL){
-        free (locators_vec.v4_balancing_locators_vec);
+    if (locators_vec->balancing_locators_vec != NULL &&
+            locators_vec->balancing_locators_vec != locators_vec->v4_balancing_locators_vec && //IPv4 locators more priority -> IPv4_IPv6 vector = IPv4 locator vector
+            locators_vec->balancing_locators_vec != locators_vec->v6_balancing_locators_vec){  //IPv6 locators more priority -> IPv4_IPv6 vector = IPv4 locator vector
+            free (locators_vec->balancing_locators_vec);
     }
-    if (locators_vec.v6_balancing_locators_vec != NULL){
-        free (locators_vec.v6_balancing_locators_vec);
+    if (locators_vec->v4_balancing_locators_vec != NULL){
+        free (locators_vec->v4_balancing_locators_vec);
     }
-}
-
-/*
- * Initialize to 0 balancing_locators_vecs
- */
-void reset_balancing_locators_vecs (balancing_locators_vecs *blv)
-{
-    free_balancing_locators_vecs(*blv);
-    blv->v4_balancing_locators_vec = NULL;
-    blv->v4_locators_vec_length = 0;
-    blv->v6_balancing_locators_vec = NULL;
-    blv->v6_locators_vec_length = 0;
-    blv->balancing_locators_vec = NULL;
-    blv->locators_vec_length = 0;
+    if (locators_vec->v6_balancing_locators_vec != NULL){
+        free (locators_vec->v6_balancing_locators_vec);
+    }
+    free (locators_vec);
 }
 
 /*
@@ -647,14 +654,18 @@ void dump_mapping_entry(
  */
 int calculate_balancing_vectors (
         lispd_mapping_elt           *mapping,
-        balancing_locators_vecs     *b_locators_vecs)
+        balancing_locators_vecs     **published_vecs)
 {
-    // Store locators with same priority. Maximum 32 locators (33 to no get out of array)
-    lispd_locator_elt       *locators[3][33];
+    balancing_locators_vecs *b_locators_vecs        = NULL;
+    balancing_locators_vecs *old_locators_vecs      = *published_vecs;
+    // Store locators with same priority. Maximum 32 locators of each AFI (+1 to no get out of array)
+    lispd_locator_elt       *locators[3][MAX_BALANCING_LOCATORS + 1];
+    int                     weights[3][MAX_BALANCING_LOCATORS + 1];
 
     int                     min_priority[2]         = {255,255};
     int                     total_weight[3]         = {0,0,0};
     int                     hcf[3]                  = {0,0,0};
+    int                     num_configured[3]       = {0,0,0};
     int                     ctr                     = 0;
     int                     ctr1                    = 0;
     int                     pos                     = 0;
@@ -662,22 +673,32 @@ int calculate_balancing_vectors (
     locators[0][0] = NULL;
     locators[1][0] = NULL;
 
-    reset_balancing_locators_vecs(b_locators_vecs);
+    /* The vectors in use by the data plane threads are not modified: new ones are built */
+    if ((b_locators_vecs = (balancing_locators_vecs *)calloc(1, sizeof(balancing_locators_vecs))) == NULL){
+        lispd_log_msg(LISP_LOG_WARNING,"calculate_balancing_vectors: Couldn't allocate memory for balancing_locators_vecs: %s", strerror(errno));
+        return (ERR_MALLOC);
+    }
 
     /* Fill the locator balancing vec using only IPv4 locators and according to their priority and weight */
     if (mapping->head_v4_locators_list != NULL){
         min_priority[0] = select_best_priority_locators (mapping->head_v4_locators_list,locators[0]);
         if (min_priority[0] != UNUSED_RLOC_PRIORITY){
-            get_hcf_locators_weight (locators[0], &total_weight[0], &hcf[0]);
-            b_locators_vecs->v4_balancing_locators_vec =  set_balancing_vector(locators[0], total_weight[0], hcf[0], &(b_locators_vecs->v4_locators_vec_length));
+            get_balancing_weights (locators[0], weights[0]);
+            get_hcf_locators_weight (weights[0], &total_weight[0], &hcf[0]);
+            num_configured[0] = count_usable_locators(mapping->head_v4_locators_list);
+            b_locators_vecs->v4_balancing_locators_vec =  set_balancing_vector(locators[0], weights[0], total_weight[0], hcf[0],
+                    num_configured[0], &(b_locators_vecs->v4_locators_vec_length));
         }
     }
     /* Fill the locator balancing vec using only IPv6 locators and according to their priority and weight*/
     if (mapping->head_v6_locators_list != NULL){
         min_priority[1] = select_best_priority_locators (mapping->head_v6_locators_list,locators[1]);
         if (min_priority[1] != UNUSED_RLOC_PRIORITY){
-            get_hcf_locators_weight (locators[1], &total_weight[1], &hcf[1]);
-            b_locators_vecs->v6_balancing_locators_vec =  set_balancing_vector(locators[1], total_weight[1], hcf[1], &(b_locators_vecs->v6_locators_vec_length));
+            get_balancing_weights (locators[1], weights[1]);
+            get_hcf_locators_weight (weights[1], &total_weight[1], &hcf[1]);
+            num_configured[1] = count_usable_locators(mapping->head_v6_locators_list);
+            b_locators_vecs->v6_balancing_locators_vec =  set_balancing_vector(locators[1], weights[1], total_weight[1], hcf[1],
+                    num_configured[1], &(b_locators_vecs->v6_locators_vec_length));
         }
     }
     /* Fill the locator balancing vec using IPv4 and IPv6 locators and according to their priority and weight*/
@@ -692,8 +713,6 @@ int calculate_balancing_vectors (
             b_locators_vecs->locators_vec_length = b_locators_vecs->v6_locators_vec_length;
         }//IPv4 and IPv6 locators are involved
         else {
-            hcf[2] = highest_common_factor (hcf[0], hcf[1]);
-            total_weight[2] = total_weight[0] + total_weight[1];
             for (ctr=0 ;ctr<2; ctr++){
                 ctr1 = 0;
                 while (locators[ctr][ctr1]!=NULL){
@@ -703,10 +722,22 @@ int calculate_balancing_vectors (
                 }
             }
             locators[2][pos] = NULL;
-            b_locators_vecs->balancing_locators_vec =  set_balancing_vector(locators[2], total_weight[2], hcf[2], &(b_locators_vecs->locators_vec_length));
+            /* The RTTs of the locators of both AFIs are compared together */
+            get_balancing_weights (locators[2], weights[2]);
+            get_hcf_locators_weight (weights[2], &total_weight[2], &hcf[2]);
+            num_configured[2] = num_configured[0] + num_configured[1];
+            b_locators_vecs->balancing_locators_vec =  set_balancing_vector(locators[2], weights[2], total_weight[2], hcf[2],
+                    num_configured[2], &(b_locators_vecs->locators_vec_length));
         }
     }
 
+    __atomic_store_n(published_vecs, b_locators_vecs, __ATOMIC_RELEASE);
+    /* The cached flows may use the locators of the old vectors */
+    flow_cache_invalidate_all();
+    if (old_locators_vecs != NULL){
+        epoch_defer(old_locators_vecs, (epoch_callback)free_balancing_locators_vecs);
+    }
+
     dump_balancing_locators_vec(*b_locators_vecs,mapping,LISP_LOG_DEBUG_1);
 
     return (GOOD);
@@ -714,8 +745,10 @@ int calculate_balancing_vectors (
 
 lispd_locator_elt   **set_balancing_vector(
         lispd_locator_elt   **locators,
+        int                 *weights,
         int                 total_weight,
         int                 hcf,
+        int                 num_configured,
         int                 *locators_vec_length)
 {
     lispd_locator_elt   **balancing_locators_vec    = NULL;
@@ -725,6 +758,15 @@ lispd_locator_elt   **set_balancing_vector(
     int                 ctr1                        = 0;
     int                 pos                         = 0;
 
+    /*
+     * With more than two locators, the position of hash % length of a vector of the weights
+     * changes for almost all the flows when a locator goes down. With one or two locators
+     * only the flows of the locator going down move: the shorter vector is kept.
+     */
+    if (num_configured > 2){
+        return (set_maglev_balancing_vector(locators, weights, num_configured, locators_vec_length));
+    }
+
     if ( total_weight != 0 ){
         /* Length of the dynamic vector */
         vector_length = total_weight / hcf;
@@ -746,7 +788,7 @@ lispd_locator_elt   **set_balancing_vector(
 
     while (locators[ctr] != NULL){
         if (total_weight != 0 ){
-            used_pos = locators[ctr]->weight/hcf;
+            used_pos = weights[ctr]/hcf;
         }else{
             used_pos = 1; // If all locators has weight equal to 0, we assign one position for each locator. Simetric balancing
         }
@@ -761,6 +803,65 @@ lispd_locator_elt   **set_balancing_vector(
     return (balancing_locators_vec);
 }
 
+/*
+ * Vector of a fixed size filled with Maglev consistent hashing. The size depends on the
+ * number of configured locators: when a locator goes down only its slots change of owner.
+ */
+static lispd_locator_elt   **set_maglev_balancing_vector(
+        lispd_locator_elt   **locators,
+        int                 *weights,
+        int                 num_configured,
+        int                 *locators_vec_length)
+{
+    lispd_locator_elt   **balancing_locators_vec    = NULL;
+    uint32_t            keys[MAX_BALANCING_LOCATORS];
+    int                 *table                      = NULL;
+    int                 table_size                  = maglev_table_size(num_configured);
+    int                 num_locators                = 0;
+    int                 ctr                         = 0;
+
+    *locators_vec_length = 0;
+    while (locators[num_locators] != NULL && num_locators < MAX_BALANCING_LOCATORS){
+        keys[num_locators] = maglev_key_hash((uint8_t *)&(locators[num_locators]->locator_addr->address),
+                get_addr_len(locators[num_locators]->locator_addr->afi));
+        num_locators++;
+    }
+
+    table = (int *)malloc(table_size * sizeof(int));
+    balancing_locators_vec = (lispd_locator_elt **)malloc(table_size * sizeof(lispd_locator_elt *));
+    if (table == NULL || balancing_locators_vec == NULL){
+        lispd_log_msg(LISP_LOG_WARNING, "set_maglev_balancing_vector: Unable to allocate memory for the vector: %s", strerror(errno));
+        free(table);
+        free(balancing_locators_vec);
+        return (NULL);
+    }
+    if (maglev_populate(keys, weights, num_locators, table, table_size) != GOOD){
+        free(table);
+        free(balancing_locators_vec);
+        return (NULL);
+    }
+    for (ctr = 0; ctr < table_size; ctr++){
+        balancing_locators_vec[ctr] = locators[table[ctr]];
+    }
+    free(table);
+    *locators_vec_length = table_size;
+
+    return (balancing_locators_vec);
+}
+
+static inline int count_usable_locators(lispd_locators_list *locators_list_elt)
+{
+    int     count   = 0;
+
+    while (locators_list_elt != NULL){
+        if (locators_list_elt->locator->priority != UNUSED_RLOC_PRIORITY){
+            count++;
+        }
+        locators_list_elt = locators_list_elt->next;
+    }
+    return (count);
+}
+
 int select_best_priority_locators (
         lispd_locators_list     *locators_list_elt,
         lispd_locator_elt       **selected_locators)
@@ -795,8 +896,56 @@ int select_best_priority_locators (
     return (min_priority);
 }
 
-static inline void get_hcf_locators_weight (
+static inline uint32_t get_locator_rtt(lispd_locator_elt *locator)
+{
+    if (locator->locator_type == LOCAL_LOCATOR || locator->extended_info == NULL){
+        return (0);
+    }
+    return (((rmt_locator_extended_info *)locator->extended_info)->rtt);
+}
+
+static void get_balancing_weights (
         lispd_locator_elt   **locators,
+        int                 *weights)
+{
+    uint32_t    min_rtt     = UINT32_MAX;
+    uint32_t    rtt         = 0;
+    uint64_t    factor      = 0;
+    int         all_zero    = TRUE;
+    int         ctr         = 0;
+
+    for (ctr = 0; locators[ctr] != NULL; ctr++){
+        weights[ctr] = locators[ctr]->weight;
+        if (weights[ctr] != 0){
+            all_zero = FALSE;
+        }
+    }
+    weights[ctr] = -1;
+    if (rloc_probe_rtt_weighting == FALSE || ctr < 2){
+        return;
+    }
+    /* Until all the locators have been measured, the configured weights are used */
+    for (ctr = 0; locators[ctr] != NULL; ctr++){
+        if ((rtt = get_locator_rtt(locators[ctr])) == 0){
+            return;
+        }
+        if (rtt < min_rtt){
+            min_rtt = rtt;
+        }
+    }
+    for (ctr = 0; locators[ctr] != NULL; ctr++){
+        rtt = get_locator_rtt(locators[ctr]);
+        factor = ((uint64_t)RTT_WEIGHT_SCALE * min_rtt + rtt / 2) / rtt;
+        if (factor == 0){
+            factor = 1;
+        }
+        /* If all the weights are 0 the traffic was balanced evenly: the RTT decides alone */
+        weights[ctr] = (all_zero == TRUE ? 1 : locators[ctr]->weight) * (int)factor;
+    }
+}
+
+static inline void get_hcf_locators_weight (
+        int                 *weights,
         int                 *total_weight,
         int                 *hcf)
 {
@@ -804,11 +953,11 @@ static inline void get_hcf_locators_weight (
     int weight  = 0;
     int tmp_hcf     = 0;
 
-    if (locators[0] != NULL){
-        tmp_hcf = locators[0]->weight;
-        while (locators[ctr] != NULL){
-            weight  = weight + locators[ctr]->weight;
-            tmp_hcf = highest_common_factor (tmp_hcf, locators[ctr]->weight);
+    if (weights[0] != -1){
+        tmp_hcf = weights[0];
+        while (weights[ctr] != -1){
+            weight  = weight + weights[ctr];
+            tmp_hcf = highest_common_factor (tmp_hcf, weights[ctr]);
             ctr++;
         }
     }
@@ -66,8 +66,20 @@ typedef struct lispd_mapping_list_ {
  *  v6_balancing_locators_vec: If we just hace IPv6 RLOCs
  *  balancing_locators_vec: If we have IPv4 & IPv6 RLOCs
  *  For each packet, a hash of its tuppla is calculaed. The result of this hash is one position of the array.
+ *  With up to two locators, each locator takes weight/hcf positions. With more locators, the array has a
+ *  fixed size and is filled with consistent hashing (lispd_maglev.c): when a locator goes down, only its
+ *  flows move to the other locators.
+ *  With rloc-probe-rtt-weighting, the weights of the best priority locators are multiplied by up to
+ *  RTT_WEIGHT_SCALE in inverse proportion to the RTT of their RLOC probes.
+ *  The vectors are read by the data plane threads without locks: they are never modified once
+ *  published. A new structure replaces them and the old one is released after a grace period.
  */
 
+/* Locators of the best priority taken into account in the vectors */
+#define MAX_BALANCING_LOCATORS      64
+/* Factor of the weight of the locator with the lowest RTT when the weights are biased by the RTT */
+#define RTT_WEIGHT_SCALE            8
+
 typedef struct balancing_locators_vecs_ {
     lispd_locator_elt               **v4_balancing_locators_vec;
     lispd_locator_elt               **v6_balancing_locators_vec;
@@ -83,7 +95,7 @@ typedef struct balancing_locators_vecs_ {
  */
 
 typedef struct lcl_mapping_extended_info_ {
-    balancing_locators_vecs         outgoing_balancing_locators_vecs;
+    balancing_locators_vecs         *outgoing_balancing_locators_vecs;
     lispd_locators_list             *head_not_init_locators_list; //List of locators not initialized: interface without ip
     nonces_list                     *map_reg_nonce;
     timer                           *map_reg_timer;
@@ -94,7 +106,7 @@ typedef struct lcl_mapping_extended_info_ {
  * Structure to expand the lispd_mapping_elt used in lispd_map_cache_entry
  */
 typedef struct rmt_mapping_extended_info_ {
-    balancing_locators_vecs               rmt_balancing_locators_vecs;
+    balancing_locators_vecs               *rmt_balancing_locators_vecs;
 }rmt_mapping_extended_info;
 
 
@@ -193,10 +205,11 @@ void dump_mapping_entry(
 
 /*
  * Calculate the vectors used to distribute the load from the priority and weight of the locators of the mapping
+ * and replace with them the vectors pointed by b_locators_vecs
  */
 int calculate_balancing_vectors (
         lispd_mapping_elt           *mapping,
-        balancing_locators_vecs     *b_locators_vecs);
+        balancing_locators_vecs     **b_locators_vecs);
 
 /*
  * Print balancing locators vector information
@@ -0,0 +1,243 @@
+/*
+ * lispd_miss_queue.c
+ *
+ * This file is part of LISP Mobile Node Implementation.
+ * Packets held by the map cache entries while their mapping is resolved.
+ *
+ * Copyright (C) 2012 Cisco Systems, Inc, 2012. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * Please send any bug reports or fixes you make to the email address(es):
+ *    LISP-MN developers <devel@lispmob.org>
+ *
+ */
+
+
+#include <pthread.h>
+#include "lispd_external.h"
+#include "lispd_log.h"
+#include "lispd_miss_queue.h"
+#include "lispd_output.h"
+#include "lispd_pkt_lib.h"
+
+static struct {
+    /* The data plane threads hold packets concurrently */
+    pthread_mutex_t     lock;
+    int                 memory;         /* Bytes held by all the entries */
+    uint64_t            held;
+    uint64_t            sent;
+    uint64_t            dropped_full;
+    uint64_t            dropped_negative;
+    uint64_t            dropped_timeout;
+} miss_queue = {
+        .lock   = PTHREAD_MUTEX_INITIALIZER,
+        .memory = 0
+};
+
+
+int hold_miss_packet(
+        lispd_map_cache_entry   *entry,
+        uint8_t                 *packet,
+        int                     length)
+{
+    miss_queued_packet  *held       = NULL;
+    miss_queued_packet  **last      = NULL;
+    int                 size        = sizeof(miss_queued_packet) + IN_PACK_BUFF_OFFSET + length;
+    int                 count       = 0;
+
+    if (miss_queue_size == 0){
+        return (BAD);
+    }
+
+    pthread_mutex_lock(&miss_queue.lock);
+    /*
+     * The Map-Reply may have activated the entry and released its packets since the caller
+     * checked it: the entry is activated before the packets are released under this lock.
+     */
+    if (entry->active != NO_ACTIVE){
+        pthread_mutex_unlock(&miss_queue.lock);
+        return (BAD);
+    }
+    if (entry->held_packets_count >= miss_queue_size ||
+            miss_queue.memory + size > miss_queue_memory * 1024){
+        miss_queue.dropped_full++;
+        pthread_mutex_unlock(&miss_queue.lock);
+        return (BAD);
+    }
+    if ((held = (miss_queued_packet *)malloc(size)) == NULL){
+        pthread_mutex_unlock(&miss_queue.lock);
+        lispd_log_msg(LISP_LOG_WARNING, "hold_miss_packet: Unable to allocate memory for the packet: %s", strerror(errno));
+        return (BAD);
+    }
+    held->next = NULL;
+    held->length = length;
+    held->size = size;
+    memcpy(CO(held->buffer, IN_PACK_BUFF_OFFSET), packet, length);
+
+    /* Append to keep the order of the packets */
+    last = &(entry->held_packets);
+    while (*last != NULL){
+        last = &((*last)->next);
+    }
+    *last = held;
+    count = ++entry->held_packets_count;
+    miss_queue.memory += size;
+    miss_queue.held++;
+    pthread_mutex_unlock(&miss_queue.lock);
+
+    lispd_log_msg(LISP_LOG_DEBUG_3, "Holding packet to %s until its mapping is resolved (%d held)",
+            get_char_from_lisp_addr_t(entry->mapping->eid_prefix), count);
+    return (GOOD);
+}
+
+
+/*
+ * Remove the list of held packets from the entry. The entry must be activated before: once
+ * the list is detached, no data plane thread can hold a packet in it.
+ */
+static miss_queued_packet *detach_held_packets(lispd_map_cache_entry *entry)
+{
+    miss_queued_packet  *held   = NULL;
+    miss_queued_packet  *aux    = NULL;
+
+    pthread_mutex_lock(&miss_queue.lock);
+    held = entry->held_packets;
+    for (aux = held; aux != NULL; aux = aux->next){
+        miss_queue.memory -= aux->size;
+    }
+    entry->held_packets = NULL;
+    entry->held_packets_count = 0;
+    pthread_mutex_unlock(&miss_queue.lock);
+    return (held);
+}
+
+
+/*
+ * Add the packets released from an entry to one of the counters of the queue
+ */
+static void count_released_packets(
+        uint64_t    *counter,
+        int         count)
+{
+    pthread_mutex_lock(&miss_queue.lock);
+    *counter += count;
+    pthread_mutex_unlock(&miss_queue.lock);
+}
+
+
+static int free_held_packets(miss_queued_packet *held)
+{
+    miss_queued_packet  *next   = NULL;
+    int                 count   = 0;
+
+    while (held != NULL){
+        next = held->next;
+        free(held);
+        held = next;
+        count++;
+    }
+    return (count);
+}
+
+
+void release_held_packets(lispd_map_cache_entry *entry)
+{
+    miss_queued_packet  *held   = NULL;
+    miss_queued_packet  *next   = NULL;
+    int                 count   = 0;
+
+    if ((held = detach_held_packets(entry)) == NULL){
+        return;
+    }
+
+    if (entry->active == NO_ACTIVE || entry->mapping->locator_count == 0){
+        count = free_held_packets(held);
+        count_released_packets(&miss_queue.dropped_negative, count);
+        lispd_log_msg(LISP_LOG_DEBUG_2, "Dropped %d packets held for the negative entry %s/%d", count,
+                get_char_from_lisp_addr_t(entry->mapping->eid_prefix), entry->mapping->eid_prefix_length);
+        return;
+    }
+
+    /* Packets are sent from the control plane: no tx batch is active */
+    while (held != NULL){
+        next = held->next;
+        lisp_output(held->buffer, held->length);
+        free(held);
+        held = next;
+        count++;
+    }
+    count_released_packets(&miss_queue.sent, count);
+    lispd_log_msg(LISP_LOG_DEBUG_2, "Sent %d packets held while resolving %s/%d", count,
+            get_char_from_lisp_addr_t(entry->mapping->eid_prefix), entry->mapping->eid_prefix_length);
+}
+
+
+void drop_held_packets(lispd_map_cache_entry *entry)
+{
+    int     count   = 0;
+
+    if ((count = free_held_packets(detach_held_packets(entry))) == 0){
+        return;
+    }
+    count_released_packets(&miss_queue.dropped_timeout, count);
+    lispd_log_msg(LISP_LOG_DEBUG_2, "Dropped %d packets held for the unresolved entry %s/%d", count,
+            get_char_from_lisp_addr_t(entry->mapping->eid_prefix), entry->mapping->eid_prefix_length);
+}
+
+
+void move_held_packets(
+        lispd_map_cache_entry   *from,
+        lispd_map_cache_entry   *to)
+{
+    miss_queued_packet  **last      = NULL;
+
+    pthread_mutex_lock(&miss_queue.lock);
+    if (from->held_packets == NULL){
+        pthread_mutex_unlock(&miss_queue.lock);
+        return;
+    }
+    last = &(to->held_packets);
+    while (*last != NULL){
+        last = &((*last)->next);
+    }
+    *last = from->held_packets;
+    to->held_packets_count += from->held_packets_count;
+    from->held_packets = NULL;
+    from->held_packets_count = 0;
+    pthread_mutex_unlock(&miss_queue.lock);
+}
+
+
+void dump_miss_queue_stats(int log_level)
+{
+    if (miss_queue_size == 0 || is_loggable(log_level) == FALSE){
+        return;
+    }
+    lispd_log_msg(log_level, "Miss queue: held: %llu   sent: %llu   dropped: full %llu, negative %llu, timeout %llu   memory: %d bytes",
+            (unsigned long long)miss_queue.held,
+            (unsigned long long)miss_queue.sent,
+            (unsigned long long)miss_queue.dropped_full,
+            (unsigned long long)miss_queue.dropped_negative,
+            (unsigned long long)miss_queue.dropped_timeout,
+            miss_queue.memory);
+}
+
+/*
+ * Editor modelines
+ *
+ * vi: set shiftwidth=4 tabstop=4 expandtab:
+ * :indentSize=4:tabSize=4:noTabs=true:
+ */
@@ -0,0 +1,84 @@
+/*
+ * lispd_miss_queue.h
+ *
+ * This file is part of LISP Mobile Node Implementation.
+ * Packets held by the map cache entries while their mapping is resolved.
+ *
+ * Copyright (C) 2012 Cisco Systems, Inc, 2012. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * Please send any bug reports or fixes you make to the email address(es):
+ *    LISP-MN developers <devel@lispmob.org>
+ *
+ */
+
+
+#ifndef LISPD_MISS_QUEUE_H_
+#define LISPD_MISS_QUEUE_H_
+
+#include "lispd.h"
+#include "lispd_map_cache.h"
+
+/*
+ * Copy of a packet held by a map cache entry. The buffer reserves IN_PACK_BUFF_OFFSET bytes
+ * in front of the packet, like the tun buffers, so it can be encapsulated in place.
+ */
+typedef struct miss_queued_packet_ {
+    struct miss_queued_packet_  *next;
+    int                         length;     /* Of the packet */
+    int                         size;       /* Allocated, accounted in the memory limit */
+    uint8_t                     buffer[];
+} miss_queued_packet;
+
+
+/*
+ * Hold a copy of a packet to the EID of an entry which is being resolved. Returns BAD if
+ * the queue is disabled or full or the memory limit is reached: the caller processes the packet
+ * as before. Can be called from the data plane threads.
+ */
+int hold_miss_packet(
+        lispd_map_cache_entry   *entry,
+        uint8_t                 *packet,
+        int                     length);
+
+/*
+ * Send the packets held by an entry which has just been activated through the normal
+ * encapsulation path. They are dropped if the entry is negative.
+ */
+void release_held_packets(lispd_map_cache_entry *entry);
+
+/*
+ * Drop the packets held by an entry which is removed without having been resolved
+ */
+void drop_held_packets(lispd_map_cache_entry *entry);
+
+/*
+ * Append the packets held by an entry to the packets held by another one
+ */
+void move_held_packets(
+        lispd_map_cache_entry   *from,
+        lispd_map_cache_entry   *to);
+
+void dump_miss_queue_stats(int log_level);
+
+#endif /* LISPD_MISS_QUEUE_H_ */
+
+/*
+ * Editor modelines
+ *
+ * vi: set shiftwidth=4 tabstop=4 expandtab:
+ * :indentSize=4:tabSize=4:noTabs=true:
+ */
@@ -29,56 +29,306 @@
  */
 
 #include "lispd_nonce.h"
+#include <fcntl.h>
 #include <time.h>
 
+#define ROTL32(v, n)    (((v) << (n)) | ((v) >> (32 - (n))))
+
+#define QUARTER_ROUND(a, b, c, d)           \
+    a += b; d ^= a; d = ROTL32(d, 16);      \
+    c += d; b ^= c; b = ROTL32(b, 12);      \
+    a += b; d ^= a; d = ROTL32(d, 8);       \
+    c += d; b ^= c; b = ROTL32(b, 7);
 
 /*
- *      requires librt
+ * ChaCha20 generator. Each block rekeys the generator with its first half and
+ * returns the second half as nonces, so the nonces already sent can't be
+ * recovered from the state. Only used by the main thread.
  */
+static struct {
+    uint32_t    state[16];
+    uint64_t    nonces[4];
+    int         available;
+} nonce_generator;
+
+static struct {
+    nonce_index_entry   **buckets;
+    uint32_t            mask;       /* Number of buckets - 1 */
+    int                 entries;
+    uint64_t            lookups;
+    uint64_t            hits;
+    uint64_t            expired;
+} nonce_index;
+
 
-uint64_t build_nonce(int seed)
+static void chacha20_block()
 {
+    uint32_t    x[16];
+    int         i       = 0;
+
+    memcpy(x, nonce_generator.state, sizeof(x));
+    for (i = 0; i < 10; i++){
+        QUARTER_ROUND(x[0], x[4], x[8],  x[12]);
+        QUARTER_ROUND(x[1], x[5], x[9],  x[13]);
+        QUARTER_ROUND(x[2], x[6], x[10], x[14]);
+        QUARTER_ROUND(x[3], x[7], x[11], x[15]);
+        QUARTER_ROUND(x[0], x[5], x[10], x[15]);
+        QUARTER_ROUND(x[1], x[6], x[11], x[12]);
+        QUARTER_ROUND(x[2], x[7], x[8],  x[13]);
+        QUARTER_ROUND(x[3], x[4], x[9],  x[14]);
+    }
+    for (i = 0; i < 16; i++){
+        x[i] += nonce_generator.state[i];
+    }
+    /* Rekey with the first half of the block */
+    memcpy(&(nonce_generator.state[4]), x, 8 * sizeof(uint32_t));
+    nonce_generator.state[12] = 0;
+    nonce_generator.state[13] = 0;
+    memcpy(nonce_generator.nonces, &(x[8]), sizeof(nonce_generator.nonces));
+    nonce_generator.available = 4;
+}
+
 
-    uint64_t            nonce;
-    uint32_t            nonce_lower;
-    uint32_t            nonce_upper;
+static void seed_nonce_generator()
+{
     struct timespec     ts;
+    int                 fd      = 0;
+    int                 result  = BAD;
 
-    /*
-     * Put nanosecond clock in lower 32-bits and put an XOR of the nanosecond
-     * clock with the seond clock in the upper 32-bits.
-     */
+    /* "expand 32-byte k" */
+    nonce_generator.state[0] = 0x61707865;
+    nonce_generator.state[1] = 0x3320646e;
+    nonce_generator.state[2] = 0x79622d32;
+    nonce_generator.state[3] = 0x6b206574;
+
+    /* Key, block counter and nonce */
+    if ((fd = open("/dev/urandom", O_RDONLY)) != -1){
+        if (read(fd, &(nonce_generator.state[4]), 12 * sizeof(uint32_t)) == 12 * sizeof(uint32_t)){
+            result = GOOD;
+        }
+        close(fd);
+    }
+    if (result != GOOD){
+        lispd_log_msg(LISP_LOG_WARNING, "seed_nonce_generator: Couldn't read /dev/urandom. Using the clock to seed the nonces");
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        nonce_generator.state[4] ^= ts.tv_sec;
+        nonce_generator.state[5] ^= ts.tv_nsec;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        nonce_generator.state[6] ^= ts.tv_sec;
+        nonce_generator.state[7] ^= ts.tv_nsec;
+        nonce_generator.state[8] ^= getpid();
+    }
+    nonce_generator.available = 0;
+}
 
-    clock_gettime(CLOCK_MONOTONIC,&ts);
-    nonce_lower = ts.tv_nsec;
-    nonce_upper = ts.tv_sec ^ htonl(nonce_lower);
 
-    /*
-     * OR in a caller provided seed to the low-order 32-bits.
-     */
-    nonce_lower |= seed;
+int init_nonces()
+{
+    seed_nonce_generator();
 
-    /*
-     * Return 64-bit nonce.
-     */
-    nonce = nonce_upper;
-    nonce = (nonce << 32) | nonce_lower;
-    return(nonce);
+    nonce_index.buckets = (nonce_index_entry **)calloc(NONCE_INDEX_INITIAL_SIZE, sizeof(nonce_index_entry *));
+    if (nonce_index.buckets == NULL){
+        lispd_log_msg(LISP_LOG_CRIT, "init_nonces: Unable to allocate memory for the nonce index: %s", strerror(errno));
+        return (ERR_MALLOC);
+    }
+    nonce_index.mask = NONCE_INDEX_INITIAL_SIZE - 1;
+    nonce_index.entries = 0;
+    return (GOOD);
+}
+
+
+uint64_t build_nonce()
+{
+    if (nonce_generator.available == 0){
+        chacha20_block();
+    }
+    nonce_generator.available--;
+    return (nonce_generator.nonces[nonce_generator.available]);
 }
 
 
 
-nonces_list *new_nonces_list()
+nonces_list *new_nonces_list(
+        int         owner_type,
+        void        *owner)
 {
     nonces_list *nonces;
     if ((nonces = (nonces_list*)calloc(1,sizeof(nonces_list))) == NULL) {
         lispd_log_msg(LISP_LOG_WARNING, "new_nonces_list: Unable to allocate memory for nonces_list: %s", strerror(errno));
         return (NULL);
     }
+    nonces->owner_type = owner_type;
+    nonces->owner = owner;
 
     return (nonces);
 }
 
+
+static inline uint32_t nonce_bucket(uint64_t nonce)
+{
+    return ((uint32_t)(nonce ^ (nonce >> 32)) & nonce_index.mask);
+}
+
+
+static time_t get_monotonic_seconds()
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec);
+}
+
+
+static void unindex_nonce_entry(nonce_index_entry *entry)
+{
+    nonce_index_entry   **prev  = &(nonce_index.buckets[nonce_bucket(entry->nonce)]);
+
+    while (*prev != NULL){
+        if (*prev == entry){
+            *prev = entry->next;
+            break;
+        }
+        prev = &((*prev)->next);
+    }
+    entry->next = NULL;
+    entry->indexed = FALSE;
+    nonce_index.entries--;
+}
+
+
+/*
+ * Double the number of buckets of the index. The index is left as it is if there
+ * is not enough memory.
+ */
+static void grow_nonce_index()
+{
+    nonce_index_entry   **old_buckets   = nonce_index.buckets;
+    nonce_index_entry   *entry          = NULL;
+    nonce_index_entry   *next           = NULL;
+    uint32_t            old_size        = nonce_index.mask + 1;
+    uint32_t            i               = 0;
+
+    nonce_index.buckets = (nonce_index_entry **)calloc(old_size * 2, sizeof(nonce_index_entry *));
+    if (nonce_index.buckets == NULL){
+        nonce_index.buckets = old_buckets;
+        return;
+    }
+    nonce_index.mask = old_size * 2 - 1;
+    for (i = 0; i < old_size; i++){
+        for (entry = old_buckets[i]; entry != NULL; entry = next){
+            next = entry->next;
+            entry->next = nonce_index.buckets[nonce_bucket(entry->nonce)];
+            nonce_index.buckets[nonce_bucket(entry->nonce)] = entry;
+        }
+    }
+    free(old_buckets);
+}
+
+
+void index_nonce(
+        nonces_list     *nonces,
+        int             position)
+{
+    nonce_index_entry   *entry  = NULL;
+    uint32_t            bucket  = 0;
+
+    if (nonce_index.buckets == NULL || position < 0 || position > LISPD_MAX_RETRANSMITS){
+        return;
+    }
+    entry = &(nonces->index[position]);
+    if (entry->indexed == TRUE){
+        unindex_nonce_entry(entry);
+    }
+    entry->nonce = nonces->nonce[position];
+    entry->expires = get_monotonic_seconds() + LISPD_NONCE_LIFETIME;
+    entry->nonces = nonces;
+    entry->indexed = TRUE;
+
+    bucket = nonce_bucket(entry->nonce);
+    entry->next = nonce_index.buckets[bucket];
+    nonce_index.buckets[bucket] = entry;
+    nonce_index.entries++;
+
+    if (nonce_index.entries > 2 * (int)(nonce_index.mask + 1)){
+        grow_nonce_index();
+    }
+}
+
+
+nonces_list *lookup_nonce(
+        uint64_t        nonce,
+        int             owner_type)
+{
+    nonce_index_entry   **prev  = NULL;
+    nonce_index_entry   *entry  = NULL;
+    time_t              now     = get_monotonic_seconds();
+
+    if (nonce_index.buckets == NULL){
+        return (NULL);
+    }
+    nonce_index.lookups++;
+    prev = &(nonce_index.buckets[nonce_bucket(nonce)]);
+    while ((entry = *prev) != NULL){
+        /* Expired nonces are removed from the index while looking up */
+        if (entry->expires < now){
+            *prev = entry->next;
+            entry->next = NULL;
+            entry->indexed = FALSE;
+            nonce_index.entries--;
+            nonce_index.expired++;
+            continue;
+        }
+        if (entry->nonce == nonce && entry->nonces->owner_type == owner_type){
+            nonce_index.hits++;
+            return (entry->nonces);
+        }
+        prev = &(entry->next);
+    }
+    return (NULL);
+}
+
+
+nonces_list *lookup_next_nonce(
+        uint64_t        nonce,
+        int             owner_type,
+        nonces_list     *previous)
+{
+    nonce_index_entry   *entry  = NULL;
+    time_t              now     = get_monotonic_seconds();
+    int                 i       = 0;
+
+    for (i = 0; i <= LISPD_MAX_RETRANSMITS; i++){
+        if (previous->index[i].indexed == TRUE && previous->index[i].nonce == nonce){
+            break;
+        }
+    }
+    if (i > LISPD_MAX_RETRANSMITS){
+        return (NULL);
+    }
+    for (entry = previous->index[i].next; entry != NULL; entry = entry->next){
+        if (entry->expires >= now && entry->nonce == nonce && entry->nonces->owner_type == owner_type){
+            return (entry->nonces);
+        }
+    }
+    return (NULL);
+}
+
+
+void free_nonces_list(nonces_list *nonces)
+{
+    int i = 0;
+
+    if (nonces == NULL){
+        return;
+    }
+    for (i = 0; i <= LISPD_MAX_RETRANSMITS; i++){
+        if (nonces->index[i].indexed == TRUE){
+            unindex_nonce_entry(&(nonces->index[i]));
+        }
+    }
+    free(nonces);
+}
+
 /*
  * Return true if nonce is found in the nonces list
  */
@@ -135,3 +385,15 @@ char * get_char_from_nonce (uint64_t nonce)
 }
 
 
+void dump_nonces_stats(int log_level)
+{
+    if (nonce_index.buckets == NULL || is_loggable(log_level) == FALSE){
+        return;
+    }
+    lispd_log_msg(log_level, "Nonce index: %d nonces in %u buckets   lookups: %llu   hits: %llu   expired: %llu",
+            nonce_index.entries,
+            nonce_index.mask + 1,
+            (unsigned long long)nonce_index.lookups,
+            (unsigned long long)nonce_index.hits,
+            (unsigned long long)nonce_index.expired);
+}
@@ -33,25 +33,87 @@
 
 #include "lispd.h"
 
-typedef struct{
-    uint8_t     retransmits;
-    uint64_t    nonce[LISPD_MAX_RETRANSMITS + 1];
+/* Seconds a nonce stays in the nonce index after being sent */
+#define LISPD_NONCE_LIFETIME            60
+/* Initial number of buckets of the nonce index. It doubles when it holds twice as many nonces. */
+#define NONCE_INDEX_INITIAL_SIZE        256
+
+/* Owner of a nonces list. The owner type selects the structure pointed by the owner field */
+#define NONCE_OWNER_MAP_CACHE           1   /* lispd_map_cache_entry */
+#define NONCE_OWNER_RLOC_PROBE          2   /* rloc_probe_target of lispd_rloc_probing.c */
+#define NONCE_OWNER_MAP_REGISTER        3   /* lispd_mapping_elt of the local database */
+#define NONCE_OWNER_EMAP_REGISTER       4   /* lispd_locator_elt behind NAT */
+#define NONCE_OWNER_INFO_REQUEST        5   /* lispd_locator_elt behind NAT */
+#define NONCE_OWNER_DDT_REFERRAL        6   /* lispd_pending_referral_cache_entry */
+
+struct nonces_list_;
+
+typedef struct nonce_index_entry_ {
+    uint64_t                    nonce;
+    time_t                      expires;
+    struct nonces_list_         *nonces;
+    struct nonce_index_entry_   *next;
+    uint8_t                     indexed;
+} nonce_index_entry;
+
+typedef struct nonces_list_ {
+    uint8_t             retransmits;
+    uint64_t            nonce[LISPD_MAX_RETRANSMITS + 1];
+    int                 owner_type;
+    void                *owner;
+    /* Entry of each nonce in the nonce index */
+    nonce_index_entry   index[LISPD_MAX_RETRANSMITS + 1];
 }nonces_list;
 
 
+/*
+ * Seed the nonce generator from /dev/urandom and create the nonce index
+ */
+int init_nonces();
 
 /*
- *      Generates a nonce random number
- *      requires librt
+ *      Generates a nonce random number with a ChaCha20 based generator
  */
 
-uint64_t build_nonce(int seed);
+uint64_t build_nonce();
 
 
 /*
  * Create and reserve space for a nonces_lits structure
  */
-nonces_list *new_nonces_list();
+nonces_list *new_nonces_list(
+        int         owner_type,
+        void        *owner);
+
+/*
+ * Remove the nonces of the list from the nonce index and release it
+ */
+void free_nonces_list(nonces_list *nonces);
+
+/*
+ * Add the nonce at position of the list to the nonce index, replacing the nonce
+ * previously indexed for that position. Called once the message has been sent.
+ */
+void index_nonce(
+        nonces_list     *nonces,
+        int             position);
+
+/*
+ * Return the nonces list of type owner_type containing the nonce. Nonces sent more than
+ * LISPD_NONCE_LIFETIME seconds ago are not found.
+ */
+nonces_list *lookup_nonce(
+        uint64_t        nonce,
+        int             owner_type);
+
+/*
+ * Return the next nonces list of type owner_type after previous containing the nonce. Several
+ * lists share the nonce of a Map-Request with more than one record.
+ */
+nonces_list *lookup_next_nonce(
+        uint64_t        nonce,
+        int             owner_type,
+        nonces_list     *previous);
 
 /*
  * Return true if nonce is found in the nonces list
@@ -67,4 +129,6 @@ void lispd_print_nonce (uint64_t nonce, int log_level);
 
 char * get_char_from_nonce (uint64_t nonce);
 
+void dump_nonces_stats(int log_level);
+
 #endif /* LISPD_NONCE_H_ */
@@ -29,11 +29,13 @@
 
 
 #include <assert.h>
-#include "bob/lookup3.c"
+#include "lispd_data_plane.h"
+#include "lispd_hash.h"
 #include "lispd_info_nat.h"
 #include "lispd_locator.h"
 #include "lispd_map_request.h"
 #include "lispd_mapping.h"
+#include "lispd_miss_queue.h"
 #include "lispd_output.h"
 #include "lispd_pkt_lib.h"
 #include "lispd_referral_cache_db.h"
@@ -47,7 +49,7 @@
 
 int select_src_locators_from_balancing_locators_vec (
         lispd_mapping_elt   *src_mapping,
-        packet_tuple        tuple,
+        uint32_t            hash,
         lispd_locator_elt   **src_locator);
 
 
@@ -59,10 +61,30 @@ int select_src_locators_from_balancing_locators_vec (
 int select_src_rmt_locators_from_balancing_locators_vec (
         lispd_mapping_elt   *src_mapping,
         lispd_mapping_elt   *dst_mapping,
-        packet_tuple        tuple,
+        packet_tuple        *tuple,
+        uint32_t            hash,
         lispd_locator_elt   **src_locator,
         lispd_locator_elt   **dst_locator);
 
+/*
+ * Address of the RTR to be used by a source locator behind NAT or NULL. The list of RTRs is
+ * replaced by the main thread while the data plane threads use it: it is read once.
+ */
+static inline lisp_addr_t *get_natt_rtr_addr(nat_info_str *nat_info)
+{
+    lispd_rtr_locators_list     *rtr_locators_list  = NULL;
+
+    if (nat_info == NULL){
+        return (NULL);
+    }
+    rtr_locators_list = __atomic_load_n(&(nat_info->rtr_locators_list), __ATOMIC_ACQUIRE);
+    if (rtr_locators_list == NULL){
+        return (NULL);
+    }
+    return (&(rtr_locators_list->locator->address));
+}
+
+
 int forward_native(
         uint8_t        *packet_buf,
         int             pckt_length )
@@ -102,16 +124,18 @@ int fordward_to_petr(
         uint8_t                 *buffer,
         int                     original_packet_length,
         lispd_mapping_elt       *src_mapping,
-        packet_tuple            tuple)
+        packet_tuple            *tuple,
+        uint32_t                hash)
 {
     lispd_locator_elt           *outer_src_locator  = NULL;
     lispd_locator_elt           *outer_dst_locator  = NULL;
     int                         output_socket       = 0;
     lisp_addr_t                 *src_addr           = NULL;
     lisp_addr_t                 *dst_addr           = NULL;
-    nat_info_str                *nat_info           = NULL;
+    lisp_addr_t                 *rtr_addr           = NULL;
     uint8_t 					*encap_packet 		= NULL;
     int 						encap_packet_size 	= 0;
+    int                         src_port            = get_outer_src_port(hash);
 
     if (proxy_etrs == NULL){
         lispd_log_msg(LISP_LOG_DEBUG_3, "fordward_to_petr: Proxy-etr not found");
@@ -122,6 +146,7 @@ int fordward_to_petr(
                 src_mapping,
                 proxy_etrs->mapping,
                 tuple,
+                hash,
                 &outer_src_locator,
                 &outer_dst_locator)) != GOOD){
         lispd_log_msg(LISP_LOG_DEBUG_3, "fordward_to_petr: No Proxy-etr compatible with local locators afi");
@@ -132,9 +157,10 @@ int fordward_to_petr(
     src_addr = outer_src_locator->locator_addr;
 
     /* If the selected src locator is behind NAT, fordware to the RTR */
-    nat_info = ((lcl_locator_extended_info *)outer_src_locator->extended_info)->nat_info;
-    if (nat_info != NULL && nat_info->rtr_locators_list != NULL){
-        dst_addr = &(nat_info->rtr_locators_list->locator->address);
+    rtr_addr = get_natt_rtr_addr(((lcl_locator_extended_info *)outer_src_locator->extended_info)->nat_info);
+    if (rtr_addr != NULL){
+        dst_addr = rtr_addr;
+        src_port = LISP_DATA_PORT;
     }
 
     /*
@@ -142,10 +168,10 @@ int fordward_to_petr(
      */
     encap_packet = CO(buffer,(IN_PACK_BUFF_OFFSET - sizeof(struct lisphdr)));
     encap_packet_size = original_packet_length + sizeof(struct lisphdr);
-    add_lisp_header(encap_packet, 0);
+    add_lisp_header(encap_packet, src_mapping->iid);
 
     output_socket = *(((lcl_locator_extended_info *)(outer_src_locator->extended_info))->out_socket);
-    if (send_data_packet(buffer, encap_packet_size, src_addr, dst_addr, output_socket) != GOOD){
+    if (send_data_packet(buffer, encap_packet_size, src_addr, dst_addr, src_port, output_socket) != GOOD){
         return (BAD);
     }
 
@@ -157,7 +183,8 @@ int fordward_to_petr(
 int forward_to_natt_rtr(
         uint8_t             *buffer,
         int                 original_packet_length,
-        lispd_locator_elt   *src_locator)
+        lispd_locator_elt   *src_locator,
+        int                 iid)
 {
     uint8_t                     *encap_packet       = NULL;
     int                         encap_packet_size   = 0;
@@ -168,7 +195,7 @@ int forward_to_natt_rtr(
     lisp_addr_t                 *dst_addr			= NULL;
 
     extended_info = (lcl_locator_extended_info *)src_locator->extended_info;
-    rtr_locators_list = extended_info->nat_info->rtr_locators_list;
+    rtr_locators_list = __atomic_load_n(&(extended_info->nat_info->rtr_locators_list), __ATOMIC_ACQUIRE);
     if (rtr_locators_list == NULL){
         //Could be due to RTR discarded by source afi type
         lispd_log_msg(LISP_LOG_DEBUG_2,"forward_to_natt_rtr: No RTR for the selected src locator (%s).",
@@ -184,10 +211,11 @@ int forward_to_natt_rtr(
      */
     encap_packet = CO(buffer,(IN_PACK_BUFF_OFFSET - sizeof(struct lisphdr)));
     encap_packet_size = original_packet_length + sizeof(struct lisphdr);
-    add_lisp_header(encap_packet, 0);
+    add_lisp_header(encap_packet, iid);
 
     output_socket = *(extended_info->out_socket);
-    if (send_data_packet(buffer, encap_packet_size, src_addr, dst_addr, output_socket) != GOOD){
+    /* The RTR is reached through the NAT binding of the LISP data port */
+    if (send_data_packet(buffer, encap_packet_size, src_addr, dst_addr, LISP_DATA_PORT, output_socket) != GOOD){
         return (BAD);
     }
 
@@ -202,7 +230,8 @@ int forward_to_natt_rtr(
  */
 int handle_map_cache_miss(
         lisp_addr_t *requested_eid,
-        lisp_addr_t *src_eid)
+        lisp_addr_t *src_eid,
+        int         iid)
 {
 
     lispd_map_cache_entry           *entry          = NULL;
@@ -222,6 +251,13 @@ int handle_map_cache_miss(
         return (BAD);
     }
 
+    /* Evict an entry not used recently if the map cache is full */
+    if (make_room_in_map_cache() != GOOD){
+        lispd_log_msg(LISP_LOG_DEBUG_1,"handle_map_cache_miss: Map cache full. Miss of %s not processed",
+                get_char_from_lisp_addr_t(*requested_eid));
+        return (BAD);
+    }
+
     if ((arguments = malloc(sizeof(timer_map_request_argument)))==NULL){
         lispd_log_msg(LISP_LOG_WARNING,"handle_map_cache_miss: Unable to allocate memory for timer_map_request_argument: %s",
                 strerror(errno));
@@ -231,6 +267,7 @@ int handle_map_cache_miss(
     entry = new_map_cache_entry(
             *requested_eid,
             prefix_length,
+            iid,
             DYNAMIC_MAP_CACHE_ENTRY,
             DEFAULT_DATA_CACHE_TTL);
 
@@ -255,7 +292,8 @@ int handle_map_cache_miss(
  */
 int handle_map_cache_miss_with_ddt(
         lisp_addr_t *requested_eid,
-        lisp_addr_t *src_eid)
+        lisp_addr_t *src_eid,
+        int         iid)
 {
 
     lispd_map_cache_entry               *map_cache_entry    = NULL;
@@ -284,9 +322,16 @@ int handle_map_cache_miss_with_ddt(
         return (GOOD);
     }
 
+    if (make_room_in_map_cache() != GOOD){
+        lispd_log_msg(LISP_LOG_DEBUG_1,"handle_map_cache_miss_with_ddt: Map cache full. Miss of %s not processed",
+                get_char_from_lisp_addr_t(*requested_eid));
+        return (BAD);
+    }
+
     map_cache_entry = new_map_cache_entry(
             *requested_eid,
             prefix_length,
+            iid,
             DYNAMIC_MAP_CACHE_ENTRY,
             DEFAULT_DATA_CACHE_TTL);
 
@@ -308,12 +353,12 @@ int handle_map_cache_miss_with_ddt(
     pending_referral = new_pending_referral_cache_entry(map_cache_entry,*src_eid,referral_cache);
     if (pending_referral == NULL){
         lispd_log_msg(LISP_LOG_DEBUG_1,"handle_map_cache_miss_with_ddt: Couldn't create pending referral");
-        del_map_cache_entry_from_db(map_cache_entry->mapping->eid_prefix, map_cache_entry->mapping->eid_prefix_length);
+        del_map_cache_entry_from_db(map_cache_entry->mapping->eid_prefix, map_cache_entry->mapping->eid_prefix_length, map_cache_entry->mapping->iid);
         return (BAD);
     }
     if ((add_pending_referral_cache_entry_to_list(pending_referral))!=GOOD){
         lispd_log_msg(LISP_LOG_DEBUG_1,"handle_map_cache_miss_with_ddt: Couldn't add the pending referral cache entry to the list");
-        del_map_cache_entry_from_db(map_cache_entry->mapping->eid_prefix, map_cache_entry->mapping->eid_prefix_length);
+        del_map_cache_entry_from_db(map_cache_entry->mapping->eid_prefix, map_cache_entry->mapping->eid_prefix_length, map_cache_entry->mapping->iid);
         free_pending_referral_cache_entry(pending_referral);
         return (BAD);
     }
@@ -325,66 +370,27 @@ int handle_map_cache_miss_with_ddt(
 }
 
 
-/*
- * Calculate the hash of the 5 tuples of a packet
- */
-
-uint32_t get_hash_from_tuple (packet_tuple tuple)
-{
-    int         hash    = 0;
-    int         len     = 0;
-    int         port    = tuple.src_port;
-    uint32_t    *tuples = NULL;
-
-    port = port + ((int)tuple.dst_port << 16);
-    switch (tuple.src_addr.afi){
-    case AF_INET:
-        len = 4; // 1 integer src_addr + 1 integer dst_adr + 1 integer (ports) + 1 integer protocol
-        if ((tuples = (uint32_t *)malloc(sizeof(uint32_t)*(4))) == NULL ){
-            lispd_log_msg(LISP_LOG_WARNING,"get_hash_from_tuple: Couldn't allocate memory for tuples array: %s", strerror(errno));
-            return (0);
-        }
-        tuples[0] = tuple.src_addr.address.ip.s_addr;
-        tuples[1] = tuple.dst_addr.address.ip.s_addr;
-        tuples[2] = port;
-        tuples[3] = tuple.protocol;
-        break;
-    case AF_INET6:
-        len = 10; // 4 integer src_addr + 4 integer dst_adr + 1 integer (ports) + 1 integer protocol
-        if ((tuples = (uint32_t *)malloc(sizeof(uint32_t)*(10))) == NULL ){
-            lispd_log_msg(LISP_LOG_WARNING,"get_hash_from_tuple: Couldn't allocate memory for tuples array: %s", strerror(errno));
-            return (0);
-        }
-        memcpy(&tuples[0],&(tuple.src_addr.address.ipv6),sizeof(struct in6_addr));
-        memcpy(&tuples[4],&(tuple.dst_addr.address.ipv6),sizeof(struct in6_addr));
-        tuples[8] = port;
-        tuples[9] = tuple.protocol;
-        break;
-    }
-
-    hash = hashword (tuples,len, 2013); //2013 used as initial value
-    free (tuples);
-
-    return (hash);
-}
-
-
 /*
  * Select the source RLOC according to the priority and weight.
  */
 
 int select_src_locators_from_balancing_locators_vec (
         lispd_mapping_elt   *src_mapping,
-        packet_tuple        tuple,
+        uint32_t            hash,
         lispd_locator_elt   **src_locator)
 {
     int                     src_vec_len     = 0;
     uint32_t                pos             = 0;
-    uint32_t                hash            = 0;
     balancing_locators_vecs *src_blv        = NULL;
     lispd_locator_elt       **src_loc_vec   = NULL;
 
-    src_blv = &((lcl_mapping_extended_info *)(src_mapping->extended_info))->outgoing_balancing_locators_vecs;
+    /* The vectors may be replaced by the main thread: they are read once */
+    src_blv = __atomic_load_n(&(((lcl_mapping_extended_info *)(src_mapping->extended_info))->outgoing_balancing_locators_vecs),
+            __ATOMIC_ACQUIRE);
+    if (src_blv == NULL){
+        lispd_log_msg(LISP_LOG_DEBUG_3,"select_src_locators_from_balancing_locators_vec: No source locators availables to send packet");
+        return(BAD);
+    }
 
     if (src_blv->balancing_locators_vec != NULL){
         src_loc_vec = src_blv->balancing_locators_vec;
@@ -400,11 +406,7 @@ int select_src_locators_from_balancing_locators_vec (
         lispd_log_msg(LISP_LOG_DEBUG_3,"select_src_locators_from_balancing_locators_vec: No source locators availables to send packet");
         return(BAD);
     }
-    hash = get_hash_from_tuple (tuple);
-    if (hash == 0){
-        lispd_log_msg(LISP_LOG_DEBUG_1,"select_src_locators_from_balancing_locators_vec: Couldn't get the hash of the tuple to select the rloc. Using the default rloc");
-    }
-    pos = hash%src_vec_len; // if hash = 0 then pos = 0
+    pos = hash%src_vec_len;
     *src_locator =  src_loc_vec[pos];
 
     lispd_log_msg(LISP_LOG_DEBUG_3,"select_src_locators_from_balancing_locators_vec: src RLOC: %s",
@@ -422,21 +424,28 @@ int select_src_locators_from_balancing_locators_vec (
 int select_src_rmt_locators_from_balancing_locators_vec (
         lispd_mapping_elt   *src_mapping,
         lispd_mapping_elt   *dst_mapping,
-        packet_tuple        tuple,
+        packet_tuple        *tuple,
+        uint32_t            hash,
         lispd_locator_elt   **src_locator,
         lispd_locator_elt   **dst_locator)
 {
     int                     src_vec_len     = 0;
     int                     dst_vec_len     = 0;
     uint32_t                pos             = 0;
-    uint32_t                hash            = 0;
     balancing_locators_vecs *src_blv        = NULL;
     balancing_locators_vecs *dst_blv        = NULL;
     lispd_locator_elt       **src_loc_vec   = NULL;
     lispd_locator_elt       **dst_loc_vec   = NULL;
 
-    src_blv = &((lcl_mapping_extended_info *)(src_mapping->extended_info))->outgoing_balancing_locators_vecs;
-    dst_blv = &((rmt_mapping_extended_info *)(dst_mapping->extended_info))->rmt_balancing_locators_vecs;
+    /* The vectors may be replaced by the main thread: they are read once */
+    src_blv = __atomic_load_n(&(((lcl_mapping_extended_info *)(src_mapping->extended_info))->outgoing_balancing_locators_vecs),
+            __ATOMIC_ACQUIRE);
+    dst_blv = __atomic_load_n(&(((rmt_mapping_extended_info *)(dst_mapping->extended_info))->rmt_balancing_locators_vecs),
+            __ATOMIC_ACQUIRE);
+    if (src_blv == NULL || dst_blv == NULL){
+        lispd_log_msg(LISP_LOG_DEBUG_2,"get_rloc_from_balancing_locator_vec: No src or dst locators available");
+        return (BAD);
+    }
 
     if (src_blv->balancing_locators_vec != NULL && dst_blv->balancing_locators_vec != NULL){
         src_loc_vec = src_blv->balancing_locators_vec;
@@ -456,11 +465,6 @@ int select_src_rmt_locators_from_balancing_locators_vec (
         return (BAD);
     }
 
-    hash = get_hash_from_tuple (tuple);
-    if (hash == 0){
-        lispd_log_msg(LISP_LOG_DEBUG_1,"get_rloc_from_tuple: Couldn't get the hash of the tuple to select the RLOC. Using the default RLOC");
-        //pos = hash%x_vec_len -> 0%x_vec_len = 0;
-    }
     pos = hash%src_vec_len;
     *src_locator =  src_loc_vec[pos];
 
@@ -484,7 +488,7 @@ int select_src_rmt_locators_from_balancing_locators_vec (
             "src EID: %s, rmt EID: %s, protocol: %d, src port: %d , dst port: %d --> src RLOC: %s, dst RLOC: %s",
             get_char_from_lisp_addr_t(src_mapping->eid_prefix),
             get_char_from_lisp_addr_t(dst_mapping->eid_prefix),
-            tuple.protocol, tuple.src_port, tuple.dst_port,
+            tuple->protocol, tuple->src_port, tuple->dst_port,
             get_char_from_lisp_addr_t(*((*src_locator)->locator_addr)),
             get_char_from_lisp_addr_t(*((*dst_locator)->locator_addr)));
 
@@ -562,6 +566,10 @@ int is_lisp_packet(
 }
 
 
+/* Flow cache of the batch being encapsulated by this thread. NULL outside of a batch */
+static __thread flow_cache  *current_flow_cache = NULL;
+
+
 int lisp_output (
         uint8_t *buffer,
         int     original_packet_length )
@@ -576,10 +584,15 @@ int lisp_output (
     lispd_locator_elt           *outer_dst_locator  = NULL;
     lisp_addr_t                 *src_addr           = NULL;
     lisp_addr_t                 *dst_addr           = NULL;
+    lisp_addr_t                 *rtr_addr           = NULL;
     int                         output_socket       = 0;
     lcl_locator_extended_info   *loc_extended_info  = NULL;
     packet_tuple                tuple;
     int                         result              = 0;
+    int                         src_port            = 0;
+    flow_key                    key;
+    uint32_t                    flow_hash           = 0;
+    flow_cache_entry            *flow               = NULL;
 
 
     //arnatal TODO TODO: Check if local -> Do not encapsulate (can be solved with proper route configuration)
@@ -590,6 +603,30 @@ int lisp_output (
         return (BAD);
     }
 
+    /* Established flow: reuse the forwarding decision of the previous packets */
+    /* The hash selects the locators of the flow and indexes the flow cache */
+    flow_hash = get_hash_from_tuple(&tuple);
+
+    if (current_flow_cache != NULL){
+        flow_key_from_tuple(&tuple, &key);
+        flow = flow_cache_lookup(current_flow_cache, &key, flow_hash);
+        if (flow != NULL){
+            if (flow->map_cache_entry != NULL){
+                if (flow->map_cache_entry->referenced == FALSE){
+                    flow->map_cache_entry->referenced = TRUE;
+                }
+                if (flow->map_cache_entry->active_witin_period == FALSE){
+                    flow->map_cache_entry->active_witin_period = TRUE;
+                }
+            }
+            encap_packet = CO(buffer,IN_PACK_BUFF_OFFSET - sizeof(struct lisphdr));
+            encap_packet_size = original_packet_length + sizeof(struct lisphdr);
+            add_lisp_header(encap_packet, flow->src_mapping->iid);
+            return (send_data_packet(buffer, encap_packet_size, flow->src_locator->locator_addr,
+                    flow->dst_addr, flow->src_port, flow->out_socket));
+        }
+    }
+
     lispd_log_msg(LISP_LOG_DEBUG_3,"\nOUTPUT: Orig src: %s   %d | Orig dst: %s   %d",
                 get_char_from_lisp_addr_t(tuple.src_addr), tuple.src_port,get_char_from_lisp_addr_t(tuple.dst_addr), tuple.dst_port);
 
@@ -608,23 +645,48 @@ int lisp_output (
 
     /* If we are behind a full nat system, send the packet directly to the RTR */
     if (nat_aware == TRUE){
-        if (select_src_locators_from_balancing_locators_vec (src_mapping,tuple,&outer_src_locator) != GOOD){
+        if (select_src_locators_from_balancing_locators_vec (src_mapping,flow_hash,&outer_src_locator) != GOOD){
             return (BAD);
         }
-        return (forward_to_natt_rtr(buffer, original_packet_length, outer_src_locator));
+        return (forward_to_natt_rtr(buffer, original_packet_length, outer_src_locator, src_mapping->iid));
     }
 
 
-    entry = lookup_map_cache(tuple.dst_addr);
+    /* The destination is looked up in the Instance ID of the source EID */
+    entry = lookup_map_cache(tuple.dst_addr, src_mapping->iid);
+    /*
+     * Reference bit of the CLOCK eviction and use of the entry before its refresh. Only written when
+     * they change: the entry is shared by the data plane threads
+     */
+    if (entry != NULL){
+        if (entry->referenced == FALSE){
+            entry->referenced = TRUE;
+        }
+        if (entry->active_witin_period == FALSE){
+            entry->active_witin_period = TRUE;
+        }
+    }
 
     if (entry == NULL){ /* There is no entry in the map cache */
         lispd_log_msg(LISP_LOG_DEBUG_1, "No map cache retrieved for eid %s",get_char_from_lisp_addr_t(tuple.dst_addr));
-        if (ddt_client == TRUE){
-            handle_map_cache_miss_with_ddt(&(tuple.dst_addr), &(tuple.src_addr));
+        if (is_data_plane_worker() == TRUE){
+            /* The map cache is only modified from the main thread */
+            queue_map_cache_miss(&(tuple.dst_addr), &(tuple.src_addr), src_mapping->iid);
+        }else if (ddt_client == TRUE){
+            handle_map_cache_miss_with_ddt(&(tuple.dst_addr), &(tuple.src_addr), src_mapping->iid);
         }else{
-            handle_map_cache_miss(&(tuple.dst_addr), &(tuple.src_addr));
+            handle_map_cache_miss(&(tuple.dst_addr), &(tuple.src_addr), src_mapping->iid);
+        }
+        /* The main thread has just created the entry: the packet can be held by it */
+        if (proxy_etrs == NULL && miss_queue_size > 0 && is_data_plane_worker() == FALSE){
+            entry = lookup_map_cache(tuple.dst_addr, src_mapping->iid);
         }
     }
+    /* Without PETR, hold the packets to the EIDs being resolved until the Map-Reply arrives */
+    if (entry != NULL && entry->active == NO_ACTIVE && proxy_etrs == NULL &&
+            hold_miss_packet(entry, original_packet, original_packet_length) == GOOD){
+        return (GOOD);
+    }
     /* Packets with negative map cache entry, no active map cache entry or no map cache entry are forwarded to PETR */
     if ((entry == NULL) || (entry->active == NO_ACTIVE) || (entry->mapping->locator_count == 0) ){ /* There is no entry or is not active*/
 
@@ -633,7 +695,8 @@ int lisp_output (
                 buffer,
                 original_packet_length,
                 src_mapping,
-                tuple) != GOOD){
+                &tuple,
+                flow_hash) != GOOD){
             /* If error, fordward native*/
             return (forward_native(original_packet,original_packet_length));
         }
@@ -648,7 +711,8 @@ int lisp_output (
     if (select_src_rmt_locators_from_balancing_locators_vec (
             src_mapping,
             dst_mapping,
-            tuple,
+            &tuple,
+            flow_hash,
             &outer_src_locator,
             &outer_dst_locator)!=GOOD){
         /* If no match between afi of source and destinatiion RLOC, try to fordward to petr*/
@@ -656,7 +720,8 @@ int lisp_output (
                 buffer,
                 original_packet_length,
                 src_mapping,
-                tuple) != GOOD){
+                &tuple,
+                flow_hash) != GOOD){
             /* If error, fordward native*/
             return (forward_native(original_packet,original_packet_length));
         }else{
@@ -678,8 +743,11 @@ int lisp_output (
 
     /* If the selected src locator is behind NAT, fordware to the RTR */
     loc_extended_info = (lcl_locator_extended_info *)outer_src_locator->extended_info;
-    if (loc_extended_info->nat_info != NULL && loc_extended_info->nat_info->rtr_locators_list != NULL){
-        dst_addr = &(loc_extended_info->nat_info->rtr_locators_list->locator->address);
+    src_port = get_outer_src_port(flow_hash);
+    rtr_addr = get_natt_rtr_addr(loc_extended_info->nat_info);
+    if (rtr_addr != NULL){
+        dst_addr = rtr_addr;
+        src_port = LISP_DATA_PORT;
     }
 
     /*
@@ -687,20 +755,181 @@ int lisp_output (
      */
     encap_packet = CO(buffer,IN_PACK_BUFF_OFFSET - sizeof(struct lisphdr));
     encap_packet_size = original_packet_length + sizeof(struct lisphdr);
-    add_lisp_header(encap_packet, 0);
+    add_lisp_header(encap_packet, src_mapping->iid);
 
     output_socket = *(loc_extended_info->out_socket);
-    result = send_data_packet(buffer, encap_packet_size, src_addr, dst_addr, output_socket);
+    result = send_data_packet(buffer, encap_packet_size, src_addr, dst_addr, src_port, output_socket);
+
+    if (current_flow_cache != NULL){
+        flow = flow_cache_insert(current_flow_cache, &key, flow_hash);
+        flow->src_mapping = src_mapping;
+        flow->map_cache_entry = entry;
+        flow->src_locator = outer_src_locator;
+        flow->dst_locator = outer_dst_locator;
+        flow->dst_addr = dst_addr;
+        flow->out_socket = output_socket;
+        flow->src_port = src_port;
+    }
 
     return (result);
 }
 
-void process_output_packet ()
+/* Batch used by the main thread to drain the tun interface */
+tun_batch_ctx   main_tun_batch;
+
+
+int init_tun_batch(
+        tun_batch_ctx   *batch,
+        int             batch_size)
+{
+    int     i   = 0;
+
+    if (batch_size < 1 || batch_size > MAX_TUN_BATCH_SIZE){
+        batch_size = DEFAULT_TUN_BATCH_SIZE;
+    }
+    memset(batch, 0, sizeof(tun_batch_ctx));
+
+    if ((batch->buffers = (uint8_t **)calloc(batch_size, sizeof(uint8_t *))) == NULL ||
+            (batch->lengths = (int *)calloc(batch_size, sizeof(int))) == NULL){
+        lispd_log_msg(LISP_LOG_CRIT, "init_tun_batch: Unable to allocate memory for tun buffers: %s", strerror(errno));
+        free_tun_batch(batch);
+        return (ERR_MALLOC);
+    }
+    for (i = 0; i < batch_size; i++){
+        if ((batch->buffers[i] = (uint8_t *)malloc(MAX_IP_PACKET)) == NULL){
+            lispd_log_msg(LISP_LOG_CRIT, "init_tun_batch: Unable to allocate memory for tun buffers: %s", strerror(errno));
+            batch->size = i;
+            free_tun_batch(batch);
+            return (ERR_MALLOC);
+        }
+    }
+    batch->size = batch_size;
+    batch->tx_batch = new_tx_batch(tx_batch_size, tx_batch_timeout);
+    batch->flow_cache = new_flow_cache(flow_cache_size);
+    lispd_log_msg(LISP_LOG_DEBUG_2, "Reading up to %d packets from the tun interface per wakeup", batch_size);
+
+    return (GOOD);
+}
+
+
+void free_tun_batch(tun_batch_ctx *batch)
+{
+    int     i   = 0;
+
+    if (batch->buffers != NULL){
+        for (i = 0; i < batch->size; i++){
+            free(batch->buffers[i]);
+        }
+        free(batch->buffers);
+    }
+    free(batch->lengths);
+    free_tx_batch(batch->tx_batch);
+    free_flow_cache(batch->flow_cache);
+    batch->buffers = NULL;
+    batch->lengths = NULL;
+    batch->tx_batch = NULL;
+    batch->flow_cache = NULL;
+    batch->size = 0;
+}
+
+
+void lisp_output_vec (
+        uint8_t **buffers,
+        int     *lengths,
+        int     count)
+{
+    int     i   = 0;
+
+    for (i = 0; i < count; i++){
+        lisp_output(buffers[i], lengths[i]);
+    }
+}
+
+
+void dump_tun_batch_stats(
+        tun_batch_ctx   *batch,
+        char            *name,
+        int             log_level)
 {
-	int 			nread   = 0;
-    uint8_t         buffer[MAX_IP_PACKET];
-    uint8_t         *packet = CO(buffer,IN_PACK_BUFF_OFFSET);
+    int     i   = 0;
 
-	nread = read ( tun_fd, packet, MAX_IP_PACKET - IN_PACK_BUFF_OFFSET );
-	lisp_output ( buffer, nread );
+    if (is_loggable(log_level) == FALSE){
+        return;
+    }
+
+    lispd_log_msg(log_level,"*********** Tun packets per wakeup (%s) ***********", name);
+    lispd_log_msg(log_level,"Wakeups: %llu   Packets: %llu   Batch size: %d",
+            (unsigned long long)batch->wakeups, (unsigned long long)batch->packets, batch->size);
+    for (i = 0; i < TUN_BATCH_HISTOGRAM_BUCKETS; i++){
+        if ((1 << i) > batch->size){
+            break;
+        }
+        lispd_log_msg(log_level,"  %3d - %3d packets: %llu", 1 << i, (2 << i) - 1,
+                (unsigned long long)batch->histogram[i]);
+    }
+    dump_tx_batch_stats(batch->tx_batch, log_level);
+    dump_flow_cache_stats(batch->flow_cache, log_level);
+    lispd_log_msg(log_level,"********************************************************");
+}
+
+
+/*
+ * Drain a tun queue: read up to batch->size packets (the tun is non blocking) and
+ * encapsulate them as a vector.
+ */
+
+void drain_tun_queue(
+        int             fd,
+        tun_batch_ctx   *batch)
+{
+    int             nread   = 0;
+    int             count   = 0;
+
+    while (count < batch->size){
+        nread = read (fd, CO(batch->buffers[count],IN_PACK_BUFF_OFFSET), MAX_IP_PACKET - IN_PACK_BUFF_OFFSET);
+        if (nread <= 0){
+            if (nread == -1 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR){
+                lispd_log_msg(LISP_LOG_DEBUG_2, "drain_tun_queue: Error reading from the tun: %s", strerror(errno));
+            }
+            break;
+        }
+        batch->lengths[count] = nread;
+        count++;
+    }
+
+    if (count == 0){
+        return;
+    }
+
+    encapsulate_tun_batch(batch, batch->buffers, batch->lengths, count);
+}
+
+
+void encapsulate_tun_batch(
+        tun_batch_ctx   *batch,
+        uint8_t         **buffers,
+        int             *lengths,
+        int             count)
+{
+    int             bucket  = 0;
+
+    while (bucket < TUN_BATCH_HISTOGRAM_BUCKETS - 1 && (count >> (bucket + 1)) != 0){
+        bucket++;
+    }
+    batch->histogram[bucket]++;
+    batch->wakeups++;
+    batch->packets += count;
+
+    /* Encapsulated packets are queued per output socket and sent with a single sendmmsg */
+    tx_batch_begin (batch->tx_batch);
+    current_flow_cache = batch->flow_cache;
+    lisp_output_vec (buffers, lengths, count);
+    current_flow_cache = NULL;
+    tx_batch_end ();
+}
+
+
+void process_output_packet ()
+{
+    drain_tun_queue(tun_fd, &main_tun_batch);
 }
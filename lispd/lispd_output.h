@@ -43,25 +43,94 @@
 #include "cksum.h"
 #include "lispd_map_cache_db.h"
 #include "lispd_external.h"
+#include "lispd_flow_cache.h"
+
+/* Buckets of the packets per wakeup histogram: 1, 2-3, 4-7, ..., 256 */
+#define TUN_BATCH_HISTOGRAM_BUCKETS     9
 
 int lisp_output (
         uint8_t *original_packet,
         int     original_packet_length );
 
+/*
+ * Preallocated buffers used to drain a tun queue in batches. Each buffer reserves IN_PACK_BUFF_OFFSET
+ * bytes in front of the packet to push the encapsulation headers.
+ * Bucket i of the histogram counts the wakeups that read between 2^i and 2^(i+1)-1 packets.
+ */
+typedef struct tun_batch_ctx_ {
+    uint8_t     **buffers;
+    int         *lengths;
+    int         size;
+    uint64_t    wakeups;
+    uint64_t    packets;
+    uint64_t    histogram[TUN_BATCH_HISTOGRAM_BUCKETS];
+    struct tx_batch_ctx_ *tx_batch; /* Encapsulated packets pending to be sent. NULL if disabled */
+    flow_cache  *flow_cache;            /* Forwarding decisions of the flows of this batch. NULL if disabled */
+} tun_batch_ctx;
+
+extern tun_batch_ctx   main_tun_batch;
+
+/*
+ * Encapsulate and send a vector of packets read from the tun. Each buffer keeps the packet
+ * at IN_PACK_BUFF_OFFSET as lisp_output expects.
+ */
+void lisp_output_vec (
+        uint8_t **buffers,
+        int     *lengths,
+        int     count);
+
+/*
+ * Read and encapsulate the packets of the tun interface from the main thread
+ */
 void process_output_packet();
 
+/*
+ * Read up to batch->size packets from a tun queue and encapsulate them
+ */
+void drain_tun_queue(
+        int             fd,
+        tun_batch_ctx   *batch);
+
+/*
+ * Encapsulate and send a vector of packets read from a tun queue, accounting them in the
+ * statistics of batch. The buffers may be other than the ones of the batch.
+ */
+void encapsulate_tun_batch(
+        tun_batch_ctx   *batch,
+        uint8_t         **buffers,
+        int             *lengths,
+        int             count);
+
+/*
+ * Allocate the buffers used to drain the tun interface. batch_size is the maximum number of packets
+ * read per wakeup.
+ */
+int init_tun_batch(
+        tun_batch_ctx   *batch,
+        int             batch_size);
+
+void free_tun_batch(tun_batch_ctx *batch);
+
+/*
+ * Log the histogram of packets read from the tun per wakeup
+ */
+void dump_tun_batch_stats(
+        tun_batch_ctx   *batch,
+        char            *name,
+        int             log_level);
+
 
 /*
  * Add a not active map cache entry and init the process to request to the mapping system the information
  * for this mapping
  */
-int handle_map_cache_miss(lisp_addr_t *requested_eid, lisp_addr_t *src_eid);
+int handle_map_cache_miss(lisp_addr_t *requested_eid, lisp_addr_t *src_eid, int iid);
 
 /*
  * Add a not active map cache entry and init the process to request to the ddt mapping system the information
  * for this mapping
  */
-int handle_map_cache_miss_with_ddt(lisp_addr_t *requested_eid,lisp_addr_t *src_eid);
+int handle_map_cache_miss_with_ddt(lisp_addr_t *requested_eid,lisp_addr_t *src_eid, int iid);
 
 lisp_addr_t *get_proxy_etr(int afi);
 
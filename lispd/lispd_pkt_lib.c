@@ -550,13 +550,17 @@ void add_lisp_header(
 
     lisphdr = (struct lisphdr *) position;
 
-    lisphdr->instance_id = 0;
-    //lisphdr->instance_id = iid; //XXX iid not supported yet
+    if (iid > 0){
+        lisphdr->instance_id = 1;
+        lisphdr->lsb_bits = htonl((uint32_t)iid << 8);
+    }else{
+        lisphdr->instance_id = 0;
+        lisphdr->lsb_bits = 0;
+    }
 
     /* arnatal TODO: support for the rest of values*/
     lisphdr->echo_nonce = 0;
     lisphdr->lsb = 0;
-    lisphdr->lsb_bits = 0;
     lisphdr->map_version = 0;
     lisphdr->nonce[0] = 0;
     lisphdr->nonce[1] = 0;
@@ -566,6 +570,11 @@ void add_lisp_header(
 
 }
 
+int get_lisp_header_iid(struct lisphdr *lisphdr)
+{
+    return ((int)(ntohl(lisphdr->lsb_bits) >> 8));
+}
+
 int encapsulate_packet(
         uint8_t     *buffer, // Original packet + lisp header
         int         packet_length, // Size of original packet + size of lisp header
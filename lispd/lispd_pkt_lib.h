@@ -87,12 +87,18 @@ int extract_5_tuples_from_packet (
         packet_tuple    *tuple);
 
 /*
- * Add lisp header to a packet. The header is added in the position indicated by the parameter
+ * Add lisp header to a packet. The header is added in the position indicated by the parameter.
+ * A non zero iid is carried in the 24 high bits of the LSBs field with the I bit set.
  */
 void add_lisp_header(
         uint8_t *position,
         int     iid);
 
+/*
+ * Returns the Instance ID of a LISP data header with the I bit set
+ */
+int get_lisp_header_iid(struct lisphdr *lisphdr);
+
 /*
  * Add the IP and UDP header in a data packet
  */
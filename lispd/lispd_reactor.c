@@ -0,0 +1,233 @@
+/*
+ * lispd_reactor.c
+ *
+ * This file is part of LISP Mobile Node Implementation.
+ * Event loop of the main thread based on epoll.
+ *
+ * Copyright (C) 2012 Cisco Systems, Inc, 2012. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * Please send any bug reports or fixes you make to the email address(es):
+ *    LISP-MN developers <devel@lispmob.org>
+ *
+ */
+
+#include <fcntl.h>
+#include <time.h>
+#include "lispd_log.h"
+#include "lispd_reactor.h"
+
+typedef struct reactor_handler_ {
+    int                         fd;
+    uint32_t                    events;
+    reactor_callback            callback;   /* NULL once the fd has been removed */
+    void                        *ctx;
+    char                        name[REACTOR_NAME_LEN];
+    uint64_t                    dispatches;
+    uint64_t                    total_ns;
+    uint64_t                    max_ns;
+    struct reactor_handler_     *next;
+} reactor_handler;
+
+static struct {
+    int                 epoll_fd;
+    reactor_handler     *handlers;
+    /* Removed while dispatching: freed once the pending events have been processed */
+    reactor_handler     *removed;
+    struct epoll_event  events[REACTOR_MAX_EVENTS];
+    int                 num_events;
+    uint64_t            wakeups;
+} reactor = {
+        .epoll_fd   = -1,
+        .handlers   = NULL,
+        .removed    = NULL,
+        .num_events = 0
+};
+
+
+int init_reactor()
+{
+    if ((reactor.epoll_fd = epoll_create(REACTOR_MAX_EVENTS)) == -1){
+        lispd_log_msg(LISP_LOG_CRIT, "init_reactor: epoll_create: %s", strerror(errno));
+        return (BAD);
+    }
+    fcntl(reactor.epoll_fd, F_SETFD, FD_CLOEXEC);
+    return (GOOD);
+}
+
+
+static void free_reactor_handlers(reactor_handler *handler)
+{
+    reactor_handler     *next   = NULL;
+
+    while (handler != NULL){
+        next = handler->next;
+        free(handler);
+        handler = next;
+    }
+}
+
+
+void close_reactor()
+{
+    if (reactor.epoll_fd == -1){
+        return;
+    }
+    close(reactor.epoll_fd);
+    reactor.epoll_fd = -1;
+    free_reactor_handlers(reactor.handlers);
+    free_reactor_handlers(reactor.removed);
+    reactor.handlers = NULL;
+    reactor.removed = NULL;
+    reactor.num_events = 0;
+}
+
+
+int reactor_add_fd(
+        int                 fd,
+        uint32_t            events,
+        reactor_callback    callback,
+        void                *ctx,
+        char                *name)
+{
+    reactor_handler     *handler    = NULL;
+    struct epoll_event  event;
+
+    if (fd == -1 || reactor.epoll_fd == -1){
+        return (BAD);
+    }
+    if ((handler = (reactor_handler *)calloc(1, sizeof(reactor_handler))) == NULL){
+        lispd_log_msg(LISP_LOG_WARNING, "reactor_add_fd: Unable to allocate memory for reactor_handler: %s", strerror(errno));
+        return (ERR_MALLOC);
+    }
+    handler->fd = fd;
+    handler->events = events;
+    handler->callback = callback;
+    handler->ctx = ctx;
+    strncpy(handler->name, name, REACTOR_NAME_LEN - 1);
+
+    memset(&event, 0, sizeof(event));
+    event.events = events;
+    event.data.ptr = handler;
+    if (epoll_ctl(reactor.epoll_fd, EPOLL_CTL_ADD, fd, &event) == -1){
+        lispd_log_msg(LISP_LOG_ERR, "reactor_add_fd: Couldn't add %s (fd %d): %s", name, fd, strerror(errno));
+        free(handler);
+        return (BAD);
+    }
+    handler->next = reactor.handlers;
+    reactor.handlers = handler;
+    lispd_log_msg(LISP_LOG_DEBUG_2, "Reactor: added %s (fd %d%s)", name, fd,
+            (events & REACTOR_EDGE) ? ", edge triggered" : "");
+    return (GOOD);
+}
+
+
+void reactor_del_fd(int fd)
+{
+    reactor_handler     **prev      = &(reactor.handlers);
+    reactor_handler     *handler    = NULL;
+
+    while ((handler = *prev) != NULL){
+        if (handler->fd == fd){
+            break;
+        }
+        prev = &(handler->next);
+    }
+    if (handler == NULL){
+        return;
+    }
+    epoll_ctl(reactor.epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+    *prev = handler->next;
+    handler->callback = NULL;
+    handler->next = reactor.removed;
+    reactor.removed = handler;
+}
+
+
+int reactor_wait(int timeout)
+{
+    reactor.num_events = epoll_wait(reactor.epoll_fd, reactor.events, REACTOR_MAX_EVENTS, timeout);
+    if (reactor.num_events == -1){
+        if (errno != EINTR){
+            lispd_log_msg(LISP_LOG_DEBUG_2, "reactor_wait: epoll_wait error: %s", strerror(errno));
+        }
+        reactor.num_events = 0;
+    }
+    reactor.wakeups++;
+    return (reactor.num_events);
+}
+
+
+void reactor_dispatch()
+{
+    reactor_handler     *handler    = NULL;
+    struct timespec     start;
+    struct timespec     end;
+    uint64_t            elapsed     = 0;
+    int                 i           = 0;
+
+    for (i = 0; i < reactor.num_events; i++){
+        handler = (reactor_handler *)reactor.events[i].data.ptr;
+        if (handler->callback == NULL){
+            continue;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        handler->callback(handler->fd, handler->ctx);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        elapsed = (end.tv_sec - start.tv_sec) * 1000000000ULL + end.tv_nsec - start.tv_nsec;
+        handler->dispatches++;
+        handler->total_ns += elapsed;
+        if (elapsed > handler->max_ns){
+            handler->max_ns = elapsed;
+        }
+    }
+    reactor.num_events = 0;
+
+    free_reactor_handlers(reactor.removed);
+    reactor.removed = NULL;
+}
+
+
+int get_reactor_fd()
+{
+    return (reactor.epoll_fd);
+}
+
+
+void dump_reactor_stats(int log_level)
+{
+    reactor_handler     *handler    = NULL;
+
+    if (reactor.epoll_fd == -1 || is_loggable(log_level) == FALSE){
+        return;
+    }
+    lispd_log_msg(log_level, "Event loop wakeups: %llu", (unsigned long long)reactor.wakeups);
+    for (handler = reactor.handlers; handler != NULL; handler = handler->next){
+        lispd_log_msg(log_level, "  %-24s calls: %10llu   avg: %8.1f us   max: %8.1f us",
+                handler->name,
+                (unsigned long long)handler->dispatches,
+                (handler->dispatches == 0) ? 0.0 : (double)handler->total_ns / handler->dispatches / 1000.0,
+                (double)handler->max_ns / 1000.0);
+    }
+}
+
+/*
+ * Editor modelines
+ *
+ * vi: set shiftwidth=4 tabstop=4 expandtab:
+ * :indentSize=4:tabSize=4:noTabs=true:
+ */
@@ -0,0 +1,100 @@
+/*
+ * lispd_reactor.h
+ *
+ * This file is part of LISP Mobile Node Implementation.
+ * Event loop of the main thread based on epoll.
+ *
+ * Copyright (C) 2012 Cisco Systems, Inc, 2012. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * Please send any bug reports or fixes you make to the email address(es):
+ *    LISP-MN developers <devel@lispmob.org>
+ *
+ */
+
+#ifndef LISPD_REACTOR_H_
+#define LISPD_REACTOR_H_
+
+#include <sys/epoll.h>
+#include "lispd.h"
+
+/* Events of reactor_add_fd */
+#define REACTOR_READ            EPOLLIN
+/*
+ * Edge triggered: the callback is only called when new data arrives, so it must read
+ * the fd until it returns EAGAIN.
+ */
+#define REACTOR_EDGE            EPOLLET
+
+/* Maximum number of events dispatched per wakeup */
+#define REACTOR_MAX_EVENTS      32
+
+#define REACTOR_NAME_LEN        32
+
+typedef void (*reactor_callback)(int fd, void *ctx);
+
+
+int init_reactor();
+
+void close_reactor();
+
+/*
+ * Call callback(fd, ctx) each time one of the events happens in fd. name is only used for
+ * the statistics. Returns GOOD or BAD.
+ */
+int reactor_add_fd(
+        int                 fd,
+        uint32_t            events,
+        reactor_callback    callback,
+        void                *ctx,
+        char                *name);
+
+/*
+ * Stop monitoring fd. It can be called from a callback, even for a fd with pending events.
+ * It must be called before closing the fd.
+ */
+void reactor_del_fd(int fd);
+
+/*
+ * Wait until at least one of the fds is ready or timeout ms have passed (-1 waits forever).
+ * Returns the number of ready fds, 0 if it has been interrupted by a signal.
+ */
+int reactor_wait(int timeout);
+
+/*
+ * Call the callbacks of the fds returned by the last reactor_wait
+ */
+void reactor_dispatch();
+
+/*
+ * The epoll fd is readable when any of the fds of the reactor is ready. It allows to nest
+ * the reactor in another event loop.
+ */
+int get_reactor_fd();
+
+/*
+ * Number of calls and time spent in each callback
+ */
+void dump_reactor_stats(int log_level);
+
+#endif /* LISPD_REACTOR_H_ */
+
+/*
+ * Editor modelines
+ *
+ * vi: set shiftwidth=4 tabstop=4 expandtab:
+ * :indentSize=4:tabSize=4:noTabs=true:
+ */
@@ -317,7 +317,7 @@ void reset_pending_referrals_with_expired_previous_referral(lispd_referral_cache
             pending_referral_entry->tried_locators = 0;
             pending_referral_entry->request_through_root = TRUE;
             if (pending_referral_entry->nonces != NULL){
-                free(pending_referral_entry->nonces);
+                free_nonces_list(pending_referral_entry->nonces);
                 pending_referral_entry->nonces = NULL;
             }
             if (pending_referral_entry->ddt_request_retry_timer != NULL){
@@ -361,17 +361,12 @@ lispd_pending_referral_cache_entry *lookup_pending_referral_cache_entry_by_eid (
  */
 lispd_pending_referral_cache_entry *lookup_pending_referral_cache_entry_by_nonce (uint64_t nonce)
 {
-    lispd_pending_referral_cache_entry      *pending_referral   = NULL;
+    nonces_list                             *nonces             = NULL;
 
-    lispd_pending_referral_cache_list *aux_list = pening_referrals_list;
-    while (aux_list != NULL){
-        if (check_nonce(aux_list->pending_referral_cache_entry->nonces, nonce) == GOOD){
-            pending_referral = aux_list->pending_referral_cache_entry;
-            break;
-        }
-        aux_list = aux_list->next;
+    if ((nonces = lookup_nonce(nonce, NONCE_OWNER_DDT_REFERRAL)) == NULL){
+        return (NULL);
     }
-    return (pending_referral);
+    return ((lispd_pending_referral_cache_entry *)nonces->owner);
 }
 
 
@@ -379,7 +374,7 @@ void free_pending_referral_cache_entry(lispd_pending_referral_cache_entry *pendi
 {
     //map_cache_entry nad previous referral cache should not be free.
     if (pending_referral_cache_entry->nonces != NULL){
-        free (pending_referral_cache_entry->nonces);
+        free_nonces_list(pending_referral_cache_entry->nonces);
     }
     if (pending_referral_cache_entry->ddt_request_retry_timer != NULL){
         stop_timer(pending_referral_cache_entry->ddt_request_retry_timer);
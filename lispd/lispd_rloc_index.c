@@ -0,0 +1,282 @@
+/*
+ * lispd_rloc_index.c
+ *
+ * This file is part of LISP Mobile Node Implementation.
+ * Index of the map cache entries by the RLOCs of their locators.
+ *
+ * Copyright (C) 2012 Cisco Systems, Inc, 2012. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * Please send any bug reports or fixes you make to the email address(es):
+ *    LISP-MN developers <devel@lispmob.org>
+ *
+ */
+
+
+
+#include "lispd_lib.h"
+#include "lispd_log.h"
+#include "lispd_rloc_index.h"
+#include "lispd_rloc_probing.h"
+#include "lispd_smr.h"
+
+static struct {
+    rloc_index_elt      **buckets;
+    uint32_t            mask;
+    int                 num_rlocs;
+    int                 num_users;
+} rloc_index;
+
+
+static uint32_t rloc_bucket(lisp_addr_t *rloc)
+{
+    uint32_t    hash    = 0;
+    uint32_t    word    = 0;
+    int         i       = 0;
+
+    if (rloc->afi == AF_INET){
+        hash = rloc->address.ip.s_addr;
+    }else{
+        for (i = 0; i < 4; i++){
+            memcpy(&word, CO(&(rloc->address.ipv6), i * sizeof(uint32_t)), sizeof(uint32_t));
+            hash ^= word;
+        }
+    }
+    hash ^= hash >> 16;
+    hash *= 0x45d9f3b;
+    hash ^= hash >> 16;
+    return (hash & rloc_index.mask);
+}
+
+
+/*
+ * Double the number of buckets of the index. The index is left as it is if there
+ * is no memory for it.
+ */
+static void grow_rloc_index()
+{
+    rloc_index_elt      **old_buckets   = rloc_index.buckets;
+    rloc_index_elt      *elt            = NULL;
+    rloc_index_elt      *next           = NULL;
+    uint32_t            old_size        = rloc_index.mask + 1;
+    uint32_t            bucket          = 0;
+    uint32_t            ctr             = 0;
+
+    rloc_index.buckets = (rloc_index_elt **)calloc(old_size * 2, sizeof(rloc_index_elt *));
+    if (rloc_index.buckets == NULL){
+        rloc_index.buckets = old_buckets;
+        return;
+    }
+    rloc_index.mask = old_size * 2 - 1;
+    for (ctr = 0; ctr < old_size; ctr++){
+        for (elt = old_buckets[ctr]; elt != NULL; elt = next){
+            next = elt->next;
+            bucket = rloc_bucket(&(elt->rloc));
+            elt->next = rloc_index.buckets[bucket];
+            rloc_index.buckets[bucket] = elt;
+        }
+    }
+    free(old_buckets);
+}
+
+
+rloc_index_elt *lookup_rloc_index(lisp_addr_t *rloc)
+{
+    rloc_index_elt      *elt    = NULL;
+
+    if (rloc_index.buckets == NULL){
+        return (NULL);
+    }
+    for (elt = rloc_index.buckets[rloc_bucket(rloc)]; elt != NULL; elt = elt->next){
+        if (compare_lisp_addr_t(&(elt->rloc), rloc) == 0){
+            return (elt);
+        }
+    }
+    return (NULL);
+}
+
+
+/*
+ * Return the element of the RLOC, created if it doesn't exist
+ */
+static rloc_index_elt *get_rloc_index_elt(lisp_addr_t *rloc)
+{
+    rloc_index_elt      *elt    = NULL;
+    uint32_t            bucket  = 0;
+
+    if (rloc_index.buckets == NULL){
+        rloc_index.buckets = (rloc_index_elt **)calloc(RLOC_INDEX_INITIAL_SIZE, sizeof(rloc_index_elt *));
+        if (rloc_index.buckets == NULL){
+            lispd_log_msg(LISP_LOG_WARNING, "get_rloc_index_elt: Unable to allocate memory for the RLOC index: %s",
+                    strerror(errno));
+            return (NULL);
+        }
+        rloc_index.mask = RLOC_INDEX_INITIAL_SIZE - 1;
+    }
+    if ((elt = lookup_rloc_index(rloc)) != NULL){
+        return (elt);
+    }
+    if ((elt = (rloc_index_elt *)calloc(1, sizeof(rloc_index_elt))) == NULL){
+        lispd_log_msg(LISP_LOG_WARNING, "get_rloc_index_elt: Unable to allocate memory for rloc_index_elt: %s",
+                strerror(errno));
+        return (NULL);
+    }
+    elt->rloc = *rloc;
+    bucket = rloc_bucket(rloc);
+    elt->next = rloc_index.buckets[bucket];
+    rloc_index.buckets[bucket] = elt;
+    rloc_index.num_rlocs++;
+    if (rloc_index.num_rlocs > 2 * (int)(rloc_index.mask + 1)){
+        grow_rloc_index();
+    }
+    return (elt);
+}
+
+
+static void free_rloc_index_elt(rloc_index_elt *elt)
+{
+    rloc_index_elt      **prev  = &(rloc_index.buckets[rloc_bucket(&(elt->rloc))]);
+
+    while (*prev != elt){
+        prev = &((*prev)->next);
+    }
+    *prev = elt->next;
+    rloc_index.num_rlocs--;
+
+    remove_rloc_probe(elt);
+    cancel_rloc_smrs(elt);
+    free(elt);
+}
+
+
+static void index_locators_list(
+        lispd_map_cache_entry   *map_cache_entry,
+        lispd_locators_list     *locators_list)
+{
+    rmt_locator_extended_info   *locator_ext_inf    = NULL;
+    rloc_index_elt              *elt                = NULL;
+    rloc_index_user             *user               = NULL;
+
+    for (; locators_list != NULL; locators_list = locators_list->next){
+        locator_ext_inf = (rmt_locator_extended_info *)locators_list->locator->extended_info;
+        if (locator_ext_inf == NULL || locator_ext_inf->rloc_user != NULL){
+            continue;
+        }
+        if ((elt = get_rloc_index_elt(locators_list->locator->locator_addr)) == NULL){
+            continue;
+        }
+        if ((user = (rloc_index_user *)malloc(sizeof(rloc_index_user))) == NULL){
+            lispd_log_msg(LISP_LOG_WARNING, "index_locators_list: Unable to allocate memory for rloc_index_user: %s",
+                    strerror(errno));
+            if (elt->users == NULL){
+                free_rloc_index_elt(elt);
+            }
+            continue;
+        }
+        user->map_cache_entry = map_cache_entry;
+        user->locator = locators_list->locator;
+        user->rloc_elt = elt;
+        user->next = elt->users;
+        elt->users = user;
+        elt->num_users++;
+        rloc_index.num_users++;
+        locator_ext_inf->rloc_user = user;
+    }
+}
+
+
+void index_map_cache_entry_rlocs(lispd_map_cache_entry *map_cache_entry)
+{
+    index_locators_list(map_cache_entry, map_cache_entry->mapping->head_v4_locators_list);
+    index_locators_list(map_cache_entry, map_cache_entry->mapping->head_v6_locators_list);
+}
+
+
+void remove_rloc_index_user(rloc_index_user *user)
+{
+    rloc_index_elt      *elt    = NULL;
+    rloc_index_user     **prev  = NULL;
+
+    if (user == NULL){
+        return;
+    }
+    elt = user->rloc_elt;
+    prev = &(elt->users);
+    while (*prev != user){
+        prev = &((*prev)->next);
+    }
+    *prev = user->next;
+    elt->num_users--;
+    rloc_index.num_users--;
+    free(user);
+
+    if (elt->users == NULL){
+        free_rloc_index_elt(elt);
+    }
+}
+
+
+void unindex_locators_list(lispd_locators_list *locators_list)
+{
+    rmt_locator_extended_info   *locator_ext_inf    = NULL;
+
+    for (; locators_list != NULL; locators_list = locators_list->next){
+        locator_ext_inf = (rmt_locator_extended_info *)locators_list->locator->extended_info;
+        if (locator_ext_inf == NULL){
+            continue;
+        }
+        remove_rloc_index_user(locator_ext_inf->rloc_user);
+        locator_ext_inf->rloc_user = NULL;
+    }
+}
+
+
+void walk_rloc_index(
+        rloc_index_walk_fn  fn,
+        void                *arg)
+{
+    rloc_index_elt      *elt    = NULL;
+    uint32_t            ctr     = 0;
+
+    if (rloc_index.buckets == NULL){
+        return;
+    }
+    for (ctr = 0; ctr <= rloc_index.mask; ctr++){
+        for (elt = rloc_index.buckets[ctr]; elt != NULL; elt = elt->next){
+            if (fn(elt, arg) != GOOD){
+                return;
+            }
+        }
+    }
+}
+
+
+void dump_rloc_index_stats(int log_level)
+{
+    if (is_loggable(log_level) == FALSE){
+        return;
+    }
+    lispd_log_msg(log_level, "RLOC index: %d RLOCs   %d locators   %u buckets",
+            rloc_index.num_rlocs, rloc_index.num_users,
+            (rloc_index.buckets != NULL) ? rloc_index.mask + 1 : 0);
+}
+
+/*
+ * Editor modelines
+ *
+ * vi: set shiftwidth=4 tabstop=4 expandtab:
+ * :indentSize=4:tabSize=4:noTabs=true:
+ */
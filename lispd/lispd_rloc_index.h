@@ -0,0 +1,99 @@
+/*
+ * lispd_rloc_index.h
+ *
+ * This file is part of LISP Mobile Node Implementation.
+ * Index of the map cache entries by the RLOCs of their locators.
+ *
+ * Copyright (C) 2012 Cisco Systems, Inc, 2012. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * Please send any bug reports or fixes you make to the email address(es):
+ *    LISP-MN developers <devel@lispmob.org>
+ *
+ */
+
+
+#ifndef LISPD_RLOC_INDEX_H_
+#define LISPD_RLOC_INDEX_H_
+
+#include "lispd_map_cache.h"
+
+/* Initial number of buckets of the index. It doubles when it holds twice as many RLOCs. */
+#define RLOC_INDEX_INITIAL_SIZE     1024
+
+/*
+ * Each remote locator of a map cache entry is a user of the element of its RLOC. The element
+ * is released with its last user. The RLOC probing and the SMRs keep their per RLOC state in it.
+ */
+struct rloc_index_elt_;
+
+typedef struct rloc_index_user_ {
+    lispd_map_cache_entry       *map_cache_entry;
+    lispd_locator_elt           *locator;
+    struct rloc_index_elt_      *rloc_elt;
+    struct rloc_index_user_     *next;
+} rloc_index_user;
+
+typedef struct rloc_index_elt_ {
+    lisp_addr_t                 rloc;
+    rloc_index_user             *users;
+    int                         num_users;
+    struct rloc_probe_target_   *probe;     /* lispd_rloc_probing.c. NULL if the RLOC is not probed */
+    struct smr_request_         *smrs;      /* lispd_smr.c. SMRs queued to the RLOC */
+    struct rloc_index_elt_      *next;
+} rloc_index_elt;
+
+typedef int (*rloc_index_walk_fn)(rloc_index_elt *rloc_elt, void *arg);
+
+
+/*
+ * Add the remote locators of the entry not indexed yet to the elements of their RLOCs
+ */
+void index_map_cache_entry_rlocs(lispd_map_cache_entry *map_cache_entry);
+
+/*
+ * Remove the locators of the list from the index. Used when the locators of an entry are
+ * replaced: they are released later, once the data plane threads don't use them.
+ */
+void unindex_locators_list(lispd_locators_list *locators_list);
+
+/*
+ * Remove a locator from the index. Called when the locator is released.
+ */
+void remove_rloc_index_user(rloc_index_user *user);
+
+/*
+ * Return the element of the RLOC or NULL if no map cache entry uses it
+ */
+rloc_index_elt *lookup_rloc_index(lisp_addr_t *rloc);
+
+/*
+ * Call fn for each indexed RLOC while it returns GOOD. fn must not add or remove users.
+ */
+void walk_rloc_index(
+        rloc_index_walk_fn  fn,
+        void                *arg);
+
+void dump_rloc_index_stats(int log_level);
+
+#endif /* LISPD_RLOC_INDEX_H_ */
+
+/*
+ * Editor modelines
+ *
+ * vi: set shiftwidth=4 tabstop=4 expandtab:
+ * :indentSize=4:tabSize=4:noTabs=true:
+ */
@@ -31,48 +31,246 @@
  */
 
 #include "lispd_external.h"
-#include "lispd_local_db.h"
 #include "lispd_lib.h"
-#include "lispd_map_cache_db.h"
+#include "lispd_log.h"
 #include "lispd_map_request.h"
+#include "lispd_nonce.h"
 #include "lispd_rloc_probing.h"
 
+typedef struct rloc_probe_target_ {
+    rloc_index_elt              *rloc_elt;      /* RLOC probed and its locators */
+    nonces_list                 *nonces;        /* Probe waiting for its Map-Reply */
+    uint64_t                    sent_at[LISPD_MAX_RETRANSMITS + 1];    /* us, per nonce of the probe */
+    uint32_t                    srtt;           /* Smoothed RTT (us). 0 until the first reply */
+    uint32_t                    rttvar;         /* Mean deviation of the RTT (us) */
+    uint32_t                    balanced_rtt;   /* srtt of the last recalculation of the balancing vectors */
+    timer                       *probe_timer;
+    uint8_t                     probed;         /* The last probe has been answered or has timed out */
+    uint8_t                     state;          /* UP or DOWN according to the last probe */
+    uint8_t                     queued;
+    struct rloc_probe_target_   *next_queued;
+} rloc_probe_target;
 
 /*
- * Send a Map-Request probe to check the status of the locator passed through arg
- * If the number of retries without answer is higher than rloc_probe_retries. Change the status of the locator to down
+ * The probes due are queued and sent at rloc_probe_rate probes per second. The timers of the
+ * RLOCs are spread with a jitter so that the RLOCs learned together are not probed in bursts.
  */
+static struct {
+    rloc_probe_target   *queue_head;
+    rloc_probe_target   *queue_tail;
+    timer               *flush_timer;
+    uint8_t             flush_scheduled;
+    token_bucket        bucket;
+    int                 num_targets;
+    int                 queued;
+    uint64_t            sent;           /* Map-Request probes */
+    uint64_t            retransmits;
+    uint64_t            replies;
+    uint64_t            rtt_samples;
+    uint64_t            down;           /* RLOCs changing to DOWN */
+    uint64_t            up;             /* RLOCs changing to UP */
+    uint64_t            throttled;      /* Times the queue waited for a token */
+} prober;
 
-int rloc_probing(
-    timer *rloc_prob_timer,
-    void *arg)
+
+static int rloc_probe_timer_expired(timer *t, void *arg);
+
+static int flush_rloc_probes(timer *t, void *arg);
+
+
+/* Interval with a +-25% jitter */
+static inline uint64_t jittered_interval(int seconds)
 {
-    timer_rloc_probe_argument   *timer_argument     = (timer_rloc_probe_argument *)arg;
-    lispd_mapping_elt           *mapping            = NULL;
-    lispd_locator_elt           *locator            = NULL;
+    return (backoff_timeout(SECONDS_TO_MS(seconds), SECONDS_TO_MS(seconds), 0));
+}
+
+
+/*
+ * Return the probe of the RLOC, created if it doesn't exist
+ */
+static rloc_probe_target *get_rloc_probe_target(rloc_index_elt *rloc_elt)
+{
+    rloc_probe_target   *target     = NULL;
+
+    if (rloc_elt->probe != NULL){
+        return (rloc_elt->probe);
+    }
+    if ((target = (rloc_probe_target *)calloc(1, sizeof(rloc_probe_target))) == NULL){
+        lispd_log_msg(LISP_LOG_WARNING, "get_rloc_probe_target: Unable to allocate memory for rloc_probe_target: %s",
+                strerror(errno));
+        return (NULL);
+    }
+    if ((target->probe_timer = create_timer(NULL)) == NULL){
+        free(target);
+        return (NULL);
+    }
+    target->rloc_elt = rloc_elt;
+    target->state = UP;
+    rloc_elt->probe = target;
+    prober.num_targets++;
+    start_timer(target->probe_timer, jittered_interval(rloc_probe_interval), rloc_probe_timer_expired, target);
+    lispd_log_msg(LISP_LOG_DEBUG_2, "Programmed RLOC probing of the locator %s in %d seconds",
+            get_char_from_lisp_addr_t(rloc_elt->rloc), rloc_probe_interval);
+    return (target);
+}
+
+
+static void unqueue_rloc_probe_target(rloc_probe_target *target)
+{
+    rloc_probe_target   **prev  = &(prober.queue_head);
+
+    if (target->queued == FALSE){
+        return;
+    }
+    while (*prev != target){
+        prev = &((*prev)->next_queued);
+    }
+    *prev = target->next_queued;
+    if (prober.queue_tail == target){
+        prober.queue_tail = NULL;
+        for (target = prober.queue_head; target != NULL; target = target->next_queued){
+            prober.queue_tail = target;
+        }
+    }
+    prober.queued--;
+}
+
+
+static void free_rloc_probe_target(rloc_probe_target *target)
+{
+    target->rloc_elt->probe = NULL;
+    prober.num_targets--;
+
+    unqueue_rloc_probe_target(target);
+    stop_timer(target->probe_timer);
+    free_nonces_list(target->nonces);
+    free(target);
+}
+
+
+/*
+ * Change the state of all the locators of the RLOC and recalculate the balancing vectors
+ * of the entries whose locators changed, or of all of them if rtt_changed is TRUE
+ */
+static void set_rloc_probe_target_state(
+        rloc_probe_target   *target,
+        uint8_t             state,
+        int                 rtt_changed)
+{
+    rloc_index_user     *user       = NULL;
+    lispd_mapping_elt   *mapping    = NULL;
+    int                 changed     = 0;
+
+    for (user = target->rloc_elt->users; user != NULL; user = user->next){
+        if (*(user->locator->state) != state){
+            *(user->locator->state) = state;
+            changed++;
+        }else if (rtt_changed == FALSE){
+            continue;
+        }
+        mapping = user->map_cache_entry->mapping;
+        calculate_balancing_vectors (
+                mapping,
+                &(((rmt_mapping_extended_info *)mapping->extended_info)->rmt_balancing_locators_vecs));
+    }
+    if (changed != 0 || (target->probed == TRUE && target->state != state)){
+        if (state == UP){
+            prober.up++;
+        }else{
+            prober.down++;
+        }
+    }
+    if (changed != 0){
+        lispd_log_msg(LISP_LOG_DEBUG_1,"RLOC %s -> Locator state changes to %s in %d map cache entries",
+                get_char_from_lisp_addr_t(target->rloc_elt->rloc), (state == UP) ? "UP" : "DOWN", changed);
+    }
+    target->probed = TRUE;
+    target->state = state;
+}
+
+
+/*
+ * Copy the RTT figures of the RLOC to all its locators
+ */
+static void publish_rloc_probe_rtt(rloc_probe_target *target)
+{
+    rloc_index_user             *user               = NULL;
     rmt_locator_extended_info   *locator_ext_inf    = NULL;
-    nonces_list                 *nonces             = NULL;
-    uint8_t                     have_control_iface  = FALSE;
-    map_request_opts            opts;
 
-    memset ( &opts, FALSE, sizeof(map_request_opts));
+    for (user = target->rloc_elt->users; user != NULL; user = user->next){
+        locator_ext_inf = (rmt_locator_extended_info *)user->locator->extended_info;
+        locator_ext_inf->rtt = target->srtt;
+        locator_ext_inf->rtt_jitter = target->rttvar;
+    }
+}
 
-    if (rloc_probe_interval == 0){
-        lispd_log_msg(LISP_LOG_DEBUG_2,"rloc_probing: No RLOC Probing for %s/%d cache entry. RLOC Probing dissabled",
-                get_char_from_lisp_addr_t(mapping->eid_prefix),mapping->eid_prefix_length);
-        return (GOOD);
+
+/*
+ * Add an RTT sample to the smoothed RTT and its mean deviation of the RLOC (RFC 6298 gains).
+ * Returns TRUE if the balancing vectors of the entries using the RLOC should be recalculated:
+ * the RTT selection is enabled and the smoothed RTT moved more than 1/8 since the last time.
+ */
+static int update_rloc_probe_rtt(
+        rloc_probe_target   *target,
+        uint64_t            sample)
+{
+    uint32_t    rtt     = (sample > UINT32_MAX) ? UINT32_MAX : (sample == 0 ? 1 : (uint32_t)sample);
+    uint32_t    delta   = 0;
+
+    if (target->srtt == 0){
+        target->srtt = rtt;
+        target->rttvar = rtt / 2;
+    }else{
+        delta = (target->srtt > rtt) ? target->srtt - rtt : rtt - target->srtt;
+        target->rttvar = (uint32_t)(((uint64_t)target->rttvar * 3 + delta) / 4);
+        target->srtt = (uint32_t)(((uint64_t)target->srtt * 7 + rtt) / 8);
     }
+    prober.rtt_samples++;
+    publish_rloc_probe_rtt(target);
+    lispd_log_msg(LISP_LOG_DEBUG_2,"RLOC %s: RTT %.3f ms, smoothed RTT %.3f ms (+-%.3f)",
+            get_char_from_lisp_addr_t(target->rloc_elt->rloc), rtt / 1000.0, target->srtt / 1000.0, target->rttvar / 1000.0);
+
+    if (rloc_probe_rtt_weighting == FALSE){
+        return (FALSE);
+    }
+    delta = (target->srtt > target->balanced_rtt) ? target->srtt - target->balanced_rtt : target->balanced_rtt - target->srtt;
+    if (target->balanced_rtt != 0 && delta <= target->balanced_rtt / 8){
+        return (FALSE);
+    }
+    target->balanced_rtt = target->srtt;
+    return (TRUE);
+}
+
 
-    mapping         = timer_argument->map_cache_entry->mapping;
-    locator         = timer_argument->locator;
-    locator_ext_inf = (rmt_locator_extended_info *)(locator->extended_info);
-    nonces          = locator_ext_inf->rloc_probing_nonces;
+/* The RTT of an RLOC going down is measured again from scratch when it comes back */
+static void reset_rloc_probe_rtt(rloc_probe_target *target)
+{
+    target->srtt = 0;
+    target->rttvar = 0;
+    target->balanced_rtt = 0;
+    publish_rloc_probe_rtt(target);
+}
+
+
+/*
+ * Send a Map-Request probe to the RLOC. If the number of retries without answer is higher than
+ * rloc_probe_retries, change the status of its locators to down.
+ * Returns TRUE if a message has been sent.
+ */
+static int send_rloc_probe(rloc_probe_target *target)
+{
+    lispd_mapping_elt           *mapping            = target->rloc_elt->users->map_cache_entry->mapping;
+    nonces_list                 *nonces             = target->nonces;
+    uint8_t                     have_control_iface  = FALSE;
+    map_request_opts            opts;
+
+    memset ( &opts, FALSE, sizeof(map_request_opts));
 
     /*
      * If we don't have control iface compatible with the locator to probe, just reprograme the timer for next time
      */
 
-    switch (locator->locator_addr->afi){
+    switch (target->rloc_elt->rloc.afi){
     case AF_INET:
         if(default_ctrl_iface_v4 != NULL){
             have_control_iface = TRUE;
@@ -85,112 +283,184 @@ int rloc_probing(
         break;
     }
     if (have_control_iface == FALSE){
-        lispd_log_msg(LISP_LOG_DEBUG_2,"rloc_probing: No control iface compatible with locator %s of the map-cache entry %s/%d. "
-                "Reprogramming RLOC Probing",
-                get_char_from_lisp_addr_t(*(locator->locator_addr)),
-                get_char_from_lisp_addr_t(mapping->eid_prefix),
-                mapping->eid_prefix_length);
-        start_timer(locator_ext_inf->probe_timer, rloc_probe_interval,(timer_callback)rloc_probing, arg);
-        return (BAD);
+        lispd_log_msg(LISP_LOG_DEBUG_2,"send_rloc_probe: No control iface compatible with locator %s. Reprogramming RLOC Probing",
+                get_char_from_lisp_addr_t(target->rloc_elt->rloc));
+        start_timer(target->probe_timer, jittered_interval(rloc_probe_interval), rloc_probe_timer_expired, target);
+        return (FALSE);
     }
 
     /* Generate Nonce structure */
 
     if (nonces == NULL){
-        nonces = new_nonces_list();
+        nonces = new_nonces_list(NONCE_OWNER_RLOC_PROBE, target);
         if (nonces==NULL){
-            lispd_log_msg(LISP_LOG_WARNING,"rloc_probing: Unable to allocate memory for nonces. Reprogramming RLOC Probing");
-            start_timer(locator_ext_inf->probe_timer, rloc_probe_interval,(timer_callback)rloc_probing, arg);
-            return (BAD);
+            lispd_log_msg(LISP_LOG_WARNING,"send_rloc_probe: Unable to allocate memory for nonces. Reprogramming RLOC Probing");
+            start_timer(target->probe_timer, jittered_interval(rloc_probe_interval), rloc_probe_timer_expired, target);
+            return (FALSE);
         }
-        locator_ext_inf->rloc_probing_nonces = nonces;
+        target->nonces = nonces;
     }
 
     /*
-     * If the number of retransmits is less than rloc_probe_retries, then try to send the Map Request Probe again
+     * If we have reached maximum number of retransmissions, change the status of the locators
      */
 
-    if (nonces->retransmits - 1 < rloc_probe_retries ){
-        if (nonces->retransmits > 0){
-            lispd_log_msg(LISP_LOG_DEBUG_1,"Retransmiting Map-Request Probe for locator %s and EID: %s/%d (%d retries)",
-                    get_char_from_lisp_addr_t(*(locator->locator_addr)),
-                    get_char_from_lisp_addr_t(mapping->eid_prefix),
-                    mapping->eid_prefix_length,
-                    nonces->retransmits);
+    if (nonces->retransmits - 1 >= rloc_probe_retries){
+        free_nonces_list(target->nonces);
+        target->nonces = NULL;
+        lispd_log_msg(LISP_LOG_DEBUG_1,"send_rloc_probe: No Map-Reply Probe received for locator %s (%d map cache entries)",
+                get_char_from_lisp_addr_t(target->rloc_elt->rloc), target->rloc_elt->num_users);
+        set_rloc_probe_target_state(target, DOWN, FALSE);
+        reset_rloc_probe_rtt(target);
+
+        /* Reprogram time for next probe interval */
+        start_timer(target->probe_timer, jittered_interval(rloc_probe_interval), rloc_probe_timer_expired, target);
+        lispd_log_msg(LISP_LOG_DEBUG_2,"Reprogramed RLOC probing of the locator %s in %d seconds",
+                get_char_from_lisp_addr_t(target->rloc_elt->rloc), rloc_probe_interval);
+        return (FALSE);
+    }
+
+    if (nonces->retransmits > 0){
+        lispd_log_msg(LISP_LOG_DEBUG_1,"Retransmiting Map-Request Probe for locator %s (%d retries)",
+                get_char_from_lisp_addr_t(target->rloc_elt->rloc), nonces->retransmits);
+        prober.retransmits++;
+    }
+    /* The EID of any entry using the RLOC: the reply is identified by its nonce */
+    opts.probe = TRUE;
+    target->sent_at[nonces->retransmits] = get_monotonic_us();
+    if (build_and_send_map_request_msg(mapping,NULL,&(target->rloc_elt->rloc),opts,&(nonces->nonce[nonces->retransmits])) != GOOD){
+        lispd_log_msg(LISP_LOG_DEBUG_1,"send_rloc_probe: Couldn't send Map-Request Probe for locator %s and EID: %s/%d",
+                get_char_from_lisp_addr_t(target->rloc_elt->rloc),
+                get_char_from_lisp_addr_t(mapping->eid_prefix),
+                mapping->eid_prefix_length);
+    }
+    index_nonce(nonces, nonces->retransmits);
+    nonces->retransmits++;
+    prober.sent++;
+
+    /* Reprogram time for next retry */
+    start_timer(target->probe_timer, jittered_interval(rloc_probe_retries_interval), rloc_probe_timer_expired, target);
+    return (TRUE);
+}
+
+
+static int rloc_probe_timer_expired(timer *t, void *arg)
+{
+    rloc_probe_target   *target     = (rloc_probe_target *)arg;
+
+    if (target->queued == TRUE){
+        return (GOOD);
+    }
+    target->queued = TRUE;
+    target->next_queued = NULL;
+    if (prober.queue_tail == NULL){
+        prober.queue_head = target;
+    }else{
+        prober.queue_tail->next_queued = target;
+    }
+    prober.queue_tail = target;
+    prober.queued++;
+
+    if (prober.flush_scheduled == FALSE){
+        if (prober.flush_timer == NULL){
+            prober.flush_timer = create_timer(NULL);
         }
+        start_timer(prober.flush_timer, 0, flush_rloc_probes, NULL);
+        prober.flush_scheduled = TRUE;
+    }
+    return (GOOD);
+}
+
+
+static int flush_rloc_probes(timer *t, void *arg)
+{
+    rloc_probe_target   *target     = NULL;
+    uint64_t            wait        = 0;
 
-        opts.probe = TRUE;
-        err = build_and_send_map_request_msg(mapping,NULL,locator->locator_addr,opts,&(nonces->nonce[nonces->retransmits]));
+    prober.flush_scheduled = FALSE;
+    refill_token_bucket(&(prober.bucket), rloc_probe_rate);
 
-        if (err != GOOD){
-            lispd_log_msg(LISP_LOG_DEBUG_1,"rloc_probing: Couldn't send Map-Request Probe for locator %s and EID: %s/%d",
-                    get_char_from_lisp_addr_t(*(locator->locator_addr)),
-                    get_char_from_lisp_addr_t(mapping->eid_prefix),
-                    mapping->eid_prefix_length);
+    while ((target = prober.queue_head) != NULL){
+        if ((wait = get_token_bucket_wait(&(prober.bucket), rloc_probe_rate)) != 0){
+            prober.throttled++;
+            lispd_log_msg(LISP_LOG_DEBUG_3, "RLOC probes rate limited: %d queued", prober.queued);
+            start_timer(prober.flush_timer, wait, flush_rloc_probes, NULL);
+            prober.flush_scheduled = TRUE;
+            break;
         }
-        locator_ext_inf->rloc_probing_nonces->retransmits++;
-
-        /* Reprogram time for next retry */
-        start_timer(locator_ext_inf->probe_timer, rloc_probe_retries_interval,(timer_callback)rloc_probing, arg);
-    }else{ /* If we have reached maximum number of retransmissions, change remote locator status */
-        if (*(locator->state) == UP){
-            *(locator->state) = DOWN;
-            lispd_log_msg(LISP_LOG_DEBUG_1,"rloc_probing: No Map-Reply Probe received for locator %s and EID: %s/%d"
-                    "-> Locator state changes to DOWN",
-                    get_char_from_lisp_addr_t(*(locator->locator_addr)),
-                    get_char_from_lisp_addr_t(mapping->eid_prefix),
-                    mapping->eid_prefix_length);
-
-            /* [re]Calculate balancing locator vectors  if it has been a change of status*/
-            calculate_balancing_vectors (
-                    mapping,
-                    &(((rmt_mapping_extended_info *)mapping->extended_info)->rmt_balancing_locators_vecs));
+        prober.queue_head = target->next_queued;
+        if (prober.queue_head == NULL){
+            prober.queue_tail = NULL;
+        }
+        target->queued = FALSE;
+        prober.queued--;
+        if (send_rloc_probe(target) == TRUE){
+            take_token(&(prober.bucket));
         }
-        free (locator_ext_inf->rloc_probing_nonces);
-        locator_ext_inf->rloc_probing_nonces = NULL;
-
-        /* Reprogram time for next probe interval */
-        start_timer(locator_ext_inf->probe_timer, rloc_probe_interval,(timer_callback)rloc_probing, arg);
-        lispd_log_msg(LISP_LOG_DEBUG_2,"Reprogramed RLOC probing of the locator %s of the EID %s/%d in %d seconds",
-                get_char_from_lisp_addr_t(*(locator->locator_addr)),
-                get_char_from_lisp_addr_t(mapping->eid_prefix),
-                mapping->eid_prefix_length, rloc_probe_interval);
     }
-
     return (GOOD);
 }
 
+
+/*
+ * Probe the RLOCs of the locators of the list. Returns TRUE if the state (or, with the RTT
+ * selection, the RTT) of a locator has been changed to the one of its RLOC.
+ */
+static int add_rloc_probe_users(lispd_locators_list *locators_list)
+{
+    lispd_locator_elt           *locator            = NULL;
+    rmt_locator_extended_info   *locator_ext_inf    = NULL;
+    rloc_probe_target           *target             = NULL;
+    int                         changed             = FALSE;
+
+    for (; locators_list != NULL; locators_list = locators_list->next){
+        locator = locators_list->locator;
+        locator_ext_inf = (rmt_locator_extended_info *)locator->extended_info;
+        if (locator_ext_inf->rloc_user == NULL){
+            continue;
+        }
+        if ((target = get_rloc_probe_target(locator_ext_inf->rloc_user->rloc_elt)) == NULL){
+            continue;
+        }
+        if (target->probed == TRUE && *(locator->state) != target->state){
+            *(locator->state) = target->state;
+            changed = TRUE;
+        }
+        if (locator_ext_inf->rtt != target->srtt){
+            locator_ext_inf->rtt = target->srtt;
+            locator_ext_inf->rtt_jitter = target->rttvar;
+            if (rloc_probe_rtt_weighting == TRUE){
+                changed = TRUE;
+            }
+        }
+    }
+    return (changed);
+}
+
+
 /*
  * Program RLOC probing for each locator of the mapping
  */
 
 void programming_rloc_probing(lispd_map_cache_entry *map_cache_entry)
 {
-    lispd_locators_list         *locators_lists[2]  = {NULL,NULL};
-    lispd_locator_elt           *locator            = NULL;
-    timer_rloc_probe_argument   *timer_arg          = NULL;
-    rmt_locator_extended_info   *locator_ext_inf    = NULL;
-    int                         ctr                 = 0;
+    lispd_mapping_elt   *mapping    = map_cache_entry->mapping;
+    int                 changed     = FALSE;
 
+    if (rloc_probe_interval == 0){
+        return;
+    }
+    index_map_cache_entry_rlocs(map_cache_entry);
     if (default_rloc_afi != AF_INET6){
-        locators_lists[0] = map_cache_entry->mapping->head_v4_locators_list;
+        changed |= add_rloc_probe_users(mapping->head_v4_locators_list);
     }
     if (default_rloc_afi != AF_INET){
-        locators_lists[1] = map_cache_entry->mapping->head_v6_locators_list;
-    }
-    /* Start rloc probing for each locator of the mapping */
-    for (ctr=0; ctr < 2 ; ctr++){
-        while (locators_lists[ctr] != NULL){
-            locator = locators_lists[ctr]->locator;
-            locator_ext_inf = (rmt_locator_extended_info *)locator->extended_info;
-            timer_arg = new_timer_rloc_probe_argument (map_cache_entry, locator);
-            /* Create and program the timer */
-            if (locator_ext_inf->probe_timer == NULL){
-                locator_ext_inf->probe_timer = create_timer (RLOC_PROBING_TIMER);
-            }
-            start_timer(locator_ext_inf->probe_timer, rloc_probe_interval,(timer_callback)rloc_probing, (void *)timer_arg);
-            locators_lists[ctr] = locators_lists[ctr]->next;
-        }
+        changed |= add_rloc_probe_users(mapping->head_v6_locators_list);
+    }
+    if (changed == TRUE){
+        calculate_balancing_vectors (
+                mapping,
+                &(((rmt_mapping_extended_info *)mapping->extended_info)->rmt_balancing_locators_vecs));
     }
 }
 
@@ -200,48 +470,121 @@ void programming_rloc_probing(lispd_map_cache_entry *map_cache_entry)
 
 void programming_petr_rloc_probing()
 {
-    lispd_locators_list         *locators_lists[2]  = {NULL,NULL};
-    lispd_locator_elt           *locator            = NULL;
-    timer_rloc_probe_argument   *timer_arg          = NULL;
-    rmt_locator_extended_info   *locator_ext_inf    = NULL;
-    int                         ctr                 = 0;
-
-    if (rloc_probe_interval == 0 || proxy_etrs == NULL){
+    if (proxy_etrs == NULL){
         return;
     }
+    programming_rloc_probing(proxy_etrs);
+}
 
-    locators_lists[0] = proxy_etrs->mapping->head_v4_locators_list;
-    locators_lists[1] = proxy_etrs->mapping->head_v6_locators_list;
-    /* Start rloc probing for each locator of the mapping */
-    for (ctr=0; ctr < 2 ; ctr++){
-        while (locators_lists[ctr] != NULL){
-            locator = locators_lists[ctr]->locator;
-            locator_ext_inf = (rmt_locator_extended_info *)locator->extended_info;
-            timer_arg = new_timer_rloc_probe_argument (proxy_etrs, locator);
-            /* Create and program the timer */
-            if (locator_ext_inf->probe_timer == NULL){
-                locator_ext_inf->probe_timer = create_timer (RLOC_PROBING_TIMER);
-            }
-            start_timer(locator_ext_inf->probe_timer, rloc_probe_interval,(timer_callback)rloc_probing, (void *)timer_arg);
-            locators_lists[ctr] = locators_lists[ctr]->next;
+
+void remove_rloc_probe(rloc_index_elt *rloc_elt)
+{
+    if (rloc_elt->probe != NULL){
+        free_rloc_probe_target(rloc_elt->probe);
+    }
+}
+
+
+int process_rloc_probe_reply(
+        uint64_t        nonce,
+        lisp_addr_t     *probed_rloc)
+{
+    nonces_list         *nonces     = NULL;
+    rloc_probe_target   *target     = NULL;
+    uint64_t            now         = get_monotonic_us();
+    int                 rtt_changed = FALSE;
+    int                 pos         = 0;
+
+    if ((nonces = lookup_nonce(nonce, NONCE_OWNER_RLOC_PROBE)) == NULL){
+        lispd_log_msg(LISP_LOG_DEBUG_1,"process_rloc_probe_reply: The nonce of the Map-Reply Probe doesn't match the nonce of any generated Map-Request Probe. Discarding message ...");
+        return (BAD);
+    }
+    target = (rloc_probe_target *)nonces->owner;
+    if (probed_rloc != NULL && compare_lisp_addr_t(probed_rloc, &(target->rloc_elt->rloc)) != 0){
+        lispd_log_msg(LISP_LOG_DEBUG_1,"process_rloc_probe_reply: The probed locator %s of the Map-Reply Probe is not the probed RLOC %s",
+                get_char_from_lisp_addr_t(*probed_rloc), get_char_from_lisp_addr_t(target->rloc_elt->rloc));
+        return (BAD);
+    }
+    /* Each retransmission has its own nonce: the RTT is measured from the probe answered */
+    for (pos = 0; pos < nonces->retransmits; pos++){
+        if (nonces->nonce[pos] == nonce){
+            rtt_changed = update_rloc_probe_rtt(target, now - target->sent_at[pos]);
+            break;
         }
     }
+    free_nonces_list(target->nonces);
+    target->nonces = NULL;
+    /* A retransmission may be waiting for a token */
+    unqueue_rloc_probe_target(target);
+    prober.replies++;
+
+    lispd_log_msg(LISP_LOG_DEBUG_1,"Map-Reply probe reachability to RLOC %s (%d map cache entries)",
+            get_char_from_lisp_addr_t(target->rloc_elt->rloc), target->rloc_elt->num_users);
+    set_rloc_probe_target_state(target, UP, rtt_changed);
+
+    start_timer(target->probe_timer, jittered_interval(rloc_probe_interval), rloc_probe_timer_expired, target);
+    lispd_log_msg(LISP_LOG_DEBUG_2,"Reprogramed RLOC probing of the locator %s in %d seconds",
+            get_char_from_lisp_addr_t(target->rloc_elt->rloc), rloc_probe_interval);
+    return (GOOD);
+}
+
+
+static int count_rloc_probe_users(rloc_index_elt *rloc_elt, void *arg)
+{
+    if (rloc_elt->probe != NULL){
+        *(int *)arg += rloc_elt->num_users;
+    }
+    return (GOOD);
 }
 
 
-timer_rloc_probe_argument *new_timer_rloc_probe_argument(
-        lispd_map_cache_entry   *map_cache_entry,
-        lispd_locator_elt       *locator)
+void dump_rloc_probe_stats(int log_level)
 {
-    timer_rloc_probe_argument *timer_argument = NULL;
+    int     num_users   = 0;
 
-    if ((timer_argument = (timer_rloc_probe_argument *)malloc(sizeof(timer_rloc_probe_argument)))==NULL){
-        lispd_log_msg(LISP_LOG_WARNING,"new_timer_rloc_probe_argument: Unable to allocate memory for timer_rloc_probe_argument: %s",
-                strerror(errno));
+    if (is_loggable(log_level) == FALSE){
+        return;
+    }
+    walk_rloc_index(count_rloc_probe_users, &num_users);
+    lispd_log_msg(log_level, "RLOC probing: RLOCs: %d (%d locators)   probes sent: %llu (%llu retransmitted)   replies: %llu   "
+            "RTT samples: %llu   changes to down: %llu   to up: %llu   rate limited: %llu   queued: %d",
+            prober.num_targets, num_users,
+            (unsigned long long)prober.sent,
+            (unsigned long long)prober.retransmits,
+            (unsigned long long)prober.replies,
+            (unsigned long long)prober.rtt_samples,
+            (unsigned long long)prober.down,
+            (unsigned long long)prober.up,
+            (unsigned long long)prober.throttled,
+            prober.queued);
+}
+
+
+static int dump_rloc_probe_rtt(rloc_index_elt *rloc_elt, void *arg)
+{
+    rloc_probe_target   *target     = rloc_elt->probe;
+    int                 log_level   = *(int *)arg;
+
+    if (target == NULL){
+        return (GOOD);
+    }
+    if (target->srtt == 0){
+        lispd_log_msg(log_level, "RLOC %s: %s   RTT: not measured   (%d locators)",
+                get_char_from_lisp_addr_t(rloc_elt->rloc), (target->state == UP) ? "Up" : "Down",
+                rloc_elt->num_users);
     }else{
-        timer_argument->map_cache_entry = map_cache_entry;
-        timer_argument->locator = locator;
+        lispd_log_msg(log_level, "RLOC %s: %s   RTT: %.3f ms   jitter: %.3f ms   (%d locators)",
+                get_char_from_lisp_addr_t(rloc_elt->rloc), (target->state == UP) ? "Up" : "Down",
+                target->srtt / 1000.0, target->rttvar / 1000.0, rloc_elt->num_users);
     }
+    return (GOOD);
+}
+
 
-    return (timer_argument);
+void dump_rloc_probe_rtts(int log_level)
+{
+    if (is_loggable(log_level) == FALSE){
+        return;
+    }
+    walk_rloc_index(dump_rloc_probe_rtt, &log_level);
 }
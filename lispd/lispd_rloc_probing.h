@@ -33,21 +33,18 @@
 #ifndef LISPD_RLOC_PROBING_H_
 #define LISPD_RLOC_PROBING_H_
 
-typedef struct _timer_rloc_prob_argument{
-    lispd_map_cache_entry   *map_cache_entry;
-    lispd_locator_elt       *locator;
-} timer_rloc_probe_argument;
+#include "lispd_map_cache.h"
+#include "lispd_rloc_index.h"
 
-timer_rloc_probe_argument *new_timer_rloc_probe_argument(
-        lispd_map_cache_entry   *map_cache_entry,
-        lispd_locator_elt       *locator);
-
-int rloc_probing(
-    timer *t,
-    void *arg);
+/*
+ * The RLOCs are probed once per interval whatever the number of map cache entries using them.
+ * The probe of an RLOC hangs from its element of the RLOC index: the result of the probe changes
+ * the state of all the locators of the RLOC.
+ */
 
 /*
- * Program RLOC probing for each locator of the mapping
+ * Program RLOC probing for each locator of the mapping. A locator of an RLOC already
+ * probed takes the state of the last probe.
  */
 
 void programming_rloc_probing(lispd_map_cache_entry *map_cache_entry);
@@ -58,4 +55,25 @@ void programming_rloc_probing(lispd_map_cache_entry *map_cache_entry);
 
 void programming_petr_rloc_probing();
 
+/*
+ * Stop probing the RLOC. Called when the last locator of the RLOC is released.
+ */
+void remove_rloc_probe(rloc_index_elt *rloc_elt);
+
+/*
+ * Process the Map-Reply of a probe. probed_rloc is the locator of the record with the probe bit,
+ * NULL for a negative Map-Reply. All the locators of the RLOC change to UP and get the RTT of the
+ * probe added to their smoothed RTT.
+ */
+int process_rloc_probe_reply(
+        uint64_t        nonce,
+        lisp_addr_t     *probed_rloc);
+
+void dump_rloc_probe_stats(int log_level);
+
+/*
+ * Print the state, smoothed RTT and jitter of each probed RLOC
+ */
+void dump_rloc_probe_rtts(int log_level);
+
 #endif /*LISPD_RLOC_PROBING_H_*/
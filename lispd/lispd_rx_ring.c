@@ -0,0 +1,397 @@
+/*
+ * lispd_rx_ring.c
+ *
+ * This file is part of LISP Mobile Node Implementation.
+ * Reception of the LISP data packets through a PACKET_RX_RING (TPACKET_V3)
+ * shared with the kernel.
+ *
+ * Copyright (C) 2012 Cisco Systems, Inc, 2012. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * Please send any bug reports or fixes you make to the email address(es):
+ *    LISP-MN developers <devel@lispmob.org>
+ *
+ */
+
+#include "lispd_rx_ring.h"
+
+#ifdef LISPD_RX_RING
+
+#include <pthread.h>
+#include <sys/mman.h>
+#include <linux/filter.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include "lispd_external.h"
+#include "lispd_iface_list.h"
+#include "lispd_input.h"
+#include "lispd_lib.h"
+#include "lispd_log.h"
+#include "lispd_pkt_lib.h"
+#include "lispd_sockets.h"
+
+/* Set by Linux >= 4.4: the kernel assigns an id not used by other fanout groups */
+#ifndef PACKET_FANOUT_FLAG_UNIQUEID
+#define PACKET_FANOUT_FLAG_UNIQUEID     0x2000
+#endif
+
+typedef struct {
+    int                 fd;
+    int                 dummy_sock;     /* Bound to the LISP data port to avoid ICMP port unreachable. First ring */
+    uint8_t             *map;
+    size_t              map_length;
+    int                 block_num;
+    int                 current_block;
+    pthread_mutex_t     lock;           /* Taken by the thread processing the ring */
+    uint64_t            blocks;
+    uint64_t            packets;
+    uint64_t            not_local;      /* LISP packets to an address that is not an RLOC of the node */
+    uint64_t            truncated;
+} rx_ring;
+
+/*
+ * The rings only receive IPv4: packet sockets can reassemble IPv4 fragments (fanout with
+ * PACKET_FANOUT_FLAG_DEFRAG) but not IPv6 ones, which are left to the raw socket. The first
+ * ring is opened with the data sockets. Each data plane thread but the first one adds its
+ * ring to the fanout group of the first one: the kernel hashes the flows to the rings.
+ */
+static rx_ring  rx_rings[MAX_DATA_PLANE_THREADS];
+static int      num_rx_rings    = 0;
+static int      fanout_id       = 0;
+
+
+/*
+ * Packet sockets see every IPv4 packet: accept only the UDP packets to the LISP data port
+ * addressed to this host. The fragments are reassembled before the filter: a fragment (MF
+ * flag or offset) reaching it couldn't be reassembled and is dropped. The packet starts at
+ * the IP header (SOCK_DGRAM).
+ */
+
+static struct sock_filter rx_ring_ipv4_filter[] = {
+        BPF_STMT(BPF_LD  | BPF_W   | BPF_ABS, SKF_AD_OFF + SKF_AD_PKTTYPE),
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K,   PACKET_HOST, 0, 7),
+        BPF_STMT(BPF_LD  | BPF_B   | BPF_ABS, 9),                   /* Protocol */
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K,   IPPROTO_UDP, 0, 5),
+        BPF_STMT(BPF_LD  | BPF_H   | BPF_ABS, 6),                   /* MF flag and fragment offset */
+        BPF_JUMP(BPF_JMP | BPF_JSET| BPF_K,   0x3fff, 3, 0),
+        BPF_STMT(BPF_LDX | BPF_B   | BPF_MSH, 0),                   /* X = IP header length */
+        BPF_STMT(BPF_LD  | BPF_H   | BPF_IND, 2),                   /* UDP destination port */
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K,   LISP_DATA_PORT, 1, 0),
+        BPF_STMT(BPF_RET | BPF_K,             0),
+        BPF_STMT(BPF_RET | BPF_K,             0xffffffff),
+};
+
+/* Attached to the socket bound to the LISP data port: packets are received through the ring */
+static struct sock_filter drop_all_filter[] = {
+        BPF_STMT(BPF_RET | BPF_K,             0),
+};
+
+
+static int attach_filter(
+        int                 sock,
+        struct sock_filter  *filter,
+        int                 length)
+{
+    struct sock_fprog   prog;
+
+    prog.len = length;
+    prog.filter = filter;
+    if (setsockopt(sock, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog)) == -1){
+        lispd_log_msg(LISP_LOG_WARNING, "attach_filter: setsockopt SO_ATTACH_FILTER: %s", strerror(errno));
+        return (BAD);
+    }
+    return (GOOD);
+}
+
+
+static void close_ring(rx_ring *ring)
+{
+    if (ring->map != NULL){
+        munmap(ring->map, ring->map_length);
+        ring->map = NULL;
+    }
+    if (ring->dummy_sock != -1){
+        close(ring->dummy_sock);
+        ring->dummy_sock = -1;
+    }
+    if (ring->fd != -1){
+        close(ring->fd);
+        ring->fd = -1;
+    }
+    pthread_mutex_destroy(&(ring->lock));
+}
+
+
+void close_rx_ring_queues()
+{
+    while (num_rx_rings > 1){
+        num_rx_rings--;
+        close_ring(&(rx_rings[num_rx_rings]));
+    }
+}
+
+
+void close_rx_ring()
+{
+    close_rx_ring_queues();
+    if (num_rx_rings == 1){
+        close_ring(&(rx_rings[0]));
+        num_rx_rings = 0;
+    }
+}
+
+
+/*
+ * Open the packet socket and the ring of rx_ring_size KB and join the fanout group. The
+ * first ring creates the group. Returns GOOD or BAD after closing what was opened.
+ */
+static int open_ring(rx_ring *ring)
+{
+    struct tpacket_req3 req;
+    struct sockaddr_ll  sll;
+    socklen_t           len         = sizeof(int);
+    int                 version     = TPACKET_V3;
+    int                 protocol    = htons(ETH_P_IP);
+    int                 fanout      = 0;
+
+    memset(ring, 0, sizeof(rx_ring));
+    ring->dummy_sock = -1;
+    pthread_mutex_init(&(ring->lock), NULL);
+
+    if ((ring->fd = socket(AF_PACKET, SOCK_DGRAM, protocol)) == -1){
+        lispd_log_msg(LISP_LOG_ERR, "open_rx_ring: socket: %s", strerror(errno));
+        close_ring(ring);
+        return (BAD);
+    }
+    if (attach_filter(ring->fd, rx_ring_ipv4_filter,
+                sizeof(rx_ring_ipv4_filter) / sizeof(struct sock_filter)) != GOOD){
+        close_ring(ring);
+        return (BAD);
+    }
+    if (setsockopt(ring->fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) == -1){
+        lispd_log_msg(LISP_LOG_ERR, "open_rx_ring: setsockopt PACKET_VERSION: %s", strerror(errno));
+        close_ring(ring);
+        return (BAD);
+    }
+
+    ring->block_num = (rx_ring_size * 1024) / RX_RING_BLOCK_SIZE;
+    if (ring->block_num < 2){
+        ring->block_num = 2;
+    }
+    memset(&req, 0, sizeof(req));
+    req.tp_block_size = RX_RING_BLOCK_SIZE;
+    req.tp_block_nr = ring->block_num;
+    req.tp_frame_size = RX_RING_FRAME_SIZE;
+    req.tp_frame_nr = (RX_RING_BLOCK_SIZE / RX_RING_FRAME_SIZE) * ring->block_num;
+    req.tp_retire_blk_tov = RX_RING_BLOCK_TIMEOUT;
+    if (setsockopt(ring->fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) == -1){
+        lispd_log_msg(LISP_LOG_ERR, "open_rx_ring: setsockopt PACKET_RX_RING: %s", strerror(errno));
+        close_ring(ring);
+        return (BAD);
+    }
+
+    ring->map_length = (size_t)req.tp_block_size * req.tp_block_nr;
+    ring->map = mmap(NULL, ring->map_length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_LOCKED, ring->fd, 0);
+    if (ring->map == MAP_FAILED){
+        /* MAP_LOCKED fails without CAP_IPC_LOCK or if the limit of locked memory is low */
+        ring->map = mmap(NULL, ring->map_length, PROT_READ | PROT_WRITE, MAP_SHARED, ring->fd, 0);
+    }
+    if (ring->map == MAP_FAILED){
+        lispd_log_msg(LISP_LOG_ERR, "open_rx_ring: mmap: %s", strerror(errno));
+        ring->map = NULL;
+        close_ring(ring);
+        return (BAD);
+    }
+    ring->current_block = 0;
+
+    memset(&sll, 0, sizeof(sll));
+    sll.sll_family = AF_PACKET;
+    sll.sll_protocol = protocol;
+    sll.sll_ifindex = 0; /* All the interfaces */
+    if (bind(ring->fd, (struct sockaddr *)&sll, sizeof(sll)) == -1){
+        lispd_log_msg(LISP_LOG_ERR, "open_rx_ring: bind: %s", strerror(errno));
+        close_ring(ring);
+        return (BAD);
+    }
+
+    /*
+     * The group reassembles the fragments before the filter and distributes the flows among
+     * the rings of the data plane threads
+     */
+    if (ring == &(rx_rings[0])){
+        fanout = (PACKET_FANOUT_HASH | PACKET_FANOUT_FLAG_DEFRAG | PACKET_FANOUT_FLAG_UNIQUEID) << 16;
+    }else{
+        fanout = fanout_id | ((PACKET_FANOUT_HASH | PACKET_FANOUT_FLAG_DEFRAG) << 16);
+    }
+    if (setsockopt(ring->fd, SOL_PACKET, PACKET_FANOUT, &fanout, sizeof(fanout)) == -1){
+        lispd_log_msg(LISP_LOG_ERR, "open_rx_ring: setsockopt PACKET_FANOUT: %s", strerror(errno));
+        close_ring(ring);
+        return (BAD);
+    }
+    if (ring == &(rx_rings[0])){
+        /* Id assigned by the kernel to the group */
+        if (getsockopt(ring->fd, SOL_PACKET, PACKET_FANOUT, &fanout, &len) == -1){
+            lispd_log_msg(LISP_LOG_ERR, "open_rx_ring: getsockopt PACKET_FANOUT: %s", strerror(errno));
+            close_ring(ring);
+            return (BAD);
+        }
+        fanout_id = fanout & 0xffff;
+    }
+    return (GOOD);
+}
+
+
+int open_rx_ring()
+{
+    rx_ring             *ring       = &(rx_rings[0]);
+
+    if (num_rx_rings != 0 || open_ring(ring) != GOOD){
+        return (-1);
+    }
+
+    /* The port is still bound so the kernel doesn't answer with ICMP port unreachable */
+    if ((ring->dummy_sock = new_udp_socket(AF_INET)) == -1 ||
+            bind_socket(ring->dummy_sock, AF_INET, NULL, LISP_DATA_PORT) != GOOD ||
+            attach_filter(ring->dummy_sock, drop_all_filter, 1) != GOOD){
+        lispd_log_msg(LISP_LOG_DEBUG_2, "open_rx_ring: Couldn't open dummy socket");
+        close_ring(ring);
+        return (-1);
+    }
+    num_rx_rings = 1;
+
+    lispd_log_msg(LISP_LOG_DEBUG_1, "Receiving IPv4 LISP data packets through a ring of %d blocks of %d KB",
+            ring->block_num, RX_RING_BLOCK_SIZE / 1024);
+    return (ring->fd);
+}
+
+
+int open_rx_ring_queue()
+{
+    rx_ring             *ring       = NULL;
+
+    if (num_rx_rings == 0 || num_rx_rings == MAX_DATA_PLANE_THREADS){
+        return (-1);
+    }
+    ring = &(rx_rings[num_rx_rings]);
+    if (open_ring(ring) != GOOD){
+        return (-1);
+    }
+    num_rx_rings++;
+    return (ring->fd);
+}
+
+
+static void process_rx_ring_block(
+        rx_ring                 *ring,
+        struct tpacket_block_desc *block)
+{
+    struct tpacket3_hdr     *hdr        = NULL;
+    uint8_t                 *packet     = NULL;
+    lisp_addr_t             dst_addr;
+    uint32_t                i           = 0;
+
+    hdr = (struct tpacket3_hdr *) CO(block, block->hdr.bh1.offset_to_first_pkt);
+    for (i = 0; i < block->hdr.bh1.num_pkts; i++){
+        packet = CO(hdr, hdr->tp_net);
+        ring->packets++;
+
+        if (hdr->tp_snaplen != hdr->tp_len){
+            ring->truncated++;
+        }else{
+            /* Packets forwarded by this node to other xTRs are also seen by the packet socket */
+            dst_addr = extract_dst_addr_from_packet(packet);
+            if (get_interface_with_address(&dst_addr) == NULL){
+                ring->not_local++;
+            }else{
+                process_input_frame(packet, hdr->tp_snaplen);
+            }
+        }
+        hdr = (struct tpacket3_hdr *) CO(hdr, hdr->tp_next_offset);
+    }
+}
+
+
+void process_rx_ring(int fd)
+{
+    rx_ring                     *ring       = NULL;
+    struct tpacket_block_desc   *block      = NULL;
+    int                         processed   = 0;
+    int                         i           = 0;
+
+    for (i = 0; i < num_rx_rings; i++){
+        if (rx_rings[i].fd == fd){
+            ring = &(rx_rings[i]);
+            break;
+        }
+    }
+    if (ring == NULL || pthread_mutex_trylock(&(ring->lock)) != 0){
+        return;
+    }
+
+    /* Don't starve the other sockets: at most one lap of the ring */
+    while (processed < ring->block_num){
+        block = (struct tpacket_block_desc *) CO(ring->map, (size_t)ring->current_block * RX_RING_BLOCK_SIZE);
+        if ((block->hdr.bh1.block_status & TP_STATUS_USER) == 0){
+            break;
+        }
+        process_rx_ring_block(ring, block);
+
+        /* Return the block to the kernel */
+        __sync_synchronize();
+        block->hdr.bh1.block_status = TP_STATUS_KERNEL;
+
+        ring->current_block = (ring->current_block + 1) % ring->block_num;
+        ring->blocks++;
+        processed++;
+    }
+    pthread_mutex_unlock(&(ring->lock));
+}
+
+
+void dump_rx_ring_stats(int log_level)
+{
+    rx_ring                 *ring   = NULL;
+    struct tpacket_stats_v3 stats;
+    socklen_t               len     = sizeof(stats);
+    int                     i       = 0;
+
+    if (is_loggable(log_level) == FALSE){
+        return;
+    }
+    for (i = 0; i < num_rx_rings; i++){
+        ring = &(rx_rings[i]);
+        /* The kernel counters are reset each time they are read */
+        memset(&stats, 0, sizeof(stats));
+        len = sizeof(stats);
+        getsockopt(ring->fd, SOL_PACKET, PACKET_STATISTICS, &stats, &len);
+        lispd_log_msg(log_level, "IPv4 rx ring %d: blocks: %llu   packets: %llu   not local: %llu   truncated: %llu   "
+                "kernel drops since last dump: %u   ring full: %u", i,
+                (unsigned long long)ring->blocks,
+                (unsigned long long)ring->packets,
+                (unsigned long long)ring->not_local,
+                (unsigned long long)ring->truncated,
+                stats.tp_drops, stats.tp_freeze_q_cnt);
+    }
+}
+
+#endif
+
+/*
+ * Editor modelines
+ *
+ * vi: set shiftwidth=4 tabstop=4 expandtab:
+ * :indentSize=4:tabSize=4:noTabs=true:
+ */
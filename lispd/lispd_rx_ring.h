@@ -0,0 +1,87 @@
+/*
+ * lispd_rx_ring.h
+ *
+ * This file is part of LISP Mobile Node Implementation.
+ * Reception of the LISP data packets through a PACKET_RX_RING (TPACKET_V3)
+ * shared with the kernel.
+ *
+ * Copyright (C) 2012 Cisco Systems, Inc, 2012. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * Please send any bug reports or fixes you make to the email address(es):
+ *    LISP-MN developers <devel@lispmob.org>
+ *
+ */
+
+#ifndef LISPD_RX_RING_H_
+#define LISPD_RX_RING_H_
+
+#include "lispd.h"
+
+/* TPACKET_V3 is not available in bionic */
+#if !defined(ANDROID) && !defined(VPNAPI)
+#define LISPD_RX_RING
+#endif
+
+#define RX_RING_BLOCK_SIZE      (1 << 17)   /* 128 KB */
+#define RX_RING_FRAME_SIZE      2048
+/* Max time a block is owned by the kernel before being passed to lispd with the packets it has */
+#define RX_RING_BLOCK_TIMEOUT   1           /* ms */
+
+#ifdef LISPD_RX_RING
+
+/*
+ * Open a packet socket with a ring of rx_ring_size KB that only receives the IPv4 LISP data
+ * packets (UDP 4341) addressed to this host, after reassembling the fragments. Returns the
+ * socket or -1. The IPv6 packets are received through the raw socket: packet sockets can't
+ * reassemble IPv6 fragments.
+ */
+int open_rx_ring();
+
+/*
+ * Open the ring of a data plane thread. It joins the fanout group of the first ring: the
+ * kernel hashes each flow to one of the rings. Returns the socket or -1.
+ */
+int open_rx_ring_queue();
+
+/*
+ * Close the rings of the data plane threads. The first ring is left open.
+ */
+void close_rx_ring_queues();
+
+/*
+ * Unmap the rings and close their sockets
+ */
+void close_rx_ring();
+
+/*
+ * Decapsulate all the packets of the blocks released by the kernel. If another thread is
+ * processing the ring, it returns without doing anything.
+ */
+void process_rx_ring(int fd);
+
+void dump_rx_ring_stats(int log_level);
+
+#endif
+
+#endif /* LISPD_RX_RING_H_ */
+
+/*
+ * Editor modelines
+ *
+ * vi: set shiftwidth=4 tabstop=4 expandtab:
+ * :indentSize=4:tabSize=4:noTabs=true:
+ */
@@ -31,6 +31,7 @@
 #include "lispd_map_cache_db.h"
 #include "lispd_map_register.h"
 #include "lispd_map_request.h"
+#include "lispd_rloc_index.h"
 #include "lispd_timers.h"
 #include "lispd_smr.h"
 #include "lispd_external.h"
@@ -51,6 +52,38 @@ int retry_smr(
 timer_smr_retry_arg * new_timer_smr_retry_arg(lispd_mapping_list *list);
 
 
+/*
+ * SMR of a local EID waiting to be sent to an RLOC
+ */
+typedef struct smr_request_ {
+    lisp_addr_t             eid_prefix;     /* Local EID */
+    int                     iid;
+    rloc_index_elt          *rloc_elt;
+    struct smr_request_     *next_rloc;     /* Next SMR to the same RLOC */
+    struct smr_request_     *next_queued;
+} smr_request;
+
+/*
+ * The SMRs are queued and sent at smr_rate per second so that a handover with a large map
+ * cache doesn't stall the main loop nor flood the network
+ */
+static struct {
+    smr_request         *queue_head;
+    smr_request         *queue_tail;
+    timer               *flush_timer;
+    uint8_t             flush_scheduled;
+    token_bucket        bucket;
+    int                 queued;
+    uint64_t            sent;
+    uint64_t            suppressed;     /* Entries of an RLOC already SMR'ed for the EID */
+    uint64_t            throttled;      /* Times the queue waited for a token */
+    uint64_t            discarded;      /* RLOCs no longer used when their SMR was due */
+} smr_queue;
+
+
+static int flush_smrs(timer *t, void *arg);
+
+
 /****************************************************************************************/
 
 
@@ -131,18 +164,21 @@ void init_smr(
 
     if(err_mappings_list != NULL){
         if (smr_retry_timer == NULL){
-            if ((smr_retry_timer = create_timer (SMR_RETRY_TIMER)) == NULL){
+            if ((smr_retry_timer = create_timer((timer_arg_destructor)free_timer_smr_retry_arg)) == NULL){
                 return;
             }
             if ((smr_retry_arg = new_timer_smr_retry_arg(err_mappings_list))==NULL){
-                free(smr_retry_timer);
+                free_timer(smr_retry_timer);
+                smr_retry_timer = NULL;
                 return;
             }
         }else{
             smr_retry_arg->retries = 0;
         }
 
-        start_timer(smr_retry_timer, LISPD_MIN_RETRANSMIT_INTERVAL,retry_smr, (void *)smr_retry_arg);
+        start_timer(smr_retry_timer,
+                backoff_timeout(LISPD_INITIAL_RETRANSMIT_TIMEOUT, LISPD_MAX_RETRANSMIT_TIMEOUT, smr_retry_arg->retries),
+                retry_smr, (void *)smr_retry_arg);
     }else{
         if (smr_retry_timer != NULL){
             stop_timer(smr_retry_timer);
@@ -168,7 +204,7 @@ int retry_smr(
 
     if (smr_retry_arg->retries > 3){
         free_timer_smr_retry_arg(smr_retry_arg);
-        free(smr_retry_timer);
+        free_timer(smr_retry_timer);
         smr_retry_timer = NULL;
         return (BAD);
     }
@@ -184,10 +220,12 @@ int retry_smr(
         free_mapping_list(smr_mapping_list, FALSE);
         smr_retry_arg->retries = smr_retry_arg->retries +1;
         smr_retry_arg->mapping_list = err_mappings_list;
-        start_timer(smr_retry_timer, LISPD_MIN_RETRANSMIT_INTERVAL,retry_smr, (void *)smr_retry_arg);
+        start_timer(smr_retry_timer,
+                backoff_timeout(LISPD_INITIAL_RETRANSMIT_TIMEOUT, LISPD_MAX_RETRANSMIT_TIMEOUT, smr_retry_arg->retries),
+                retry_smr, (void *)smr_retry_arg);
     }else{
         free_timer_smr_retry_arg(smr_retry_arg);
-        free(smr_retry_timer);
+        free_timer(smr_retry_timer);
         smr_retry_timer = NULL;
     }
     return(GOOD);
@@ -257,24 +295,186 @@ int smr_send_map_reg(lispd_mapping_elt *mapping, lispd_locator_elt *src_locator)
     return (GOOD);
 }
 
+/*
+ * Return the mapping of an active map cache entry of the Instance ID and AFI using the RLOC.
+ * It is the EID record of the SMR. The proxy-ETRs are not SMR'ed.
+ */
+static lispd_mapping_elt *get_smr_remote_mapping(
+        rloc_index_elt  *rloc_elt,
+        int             iid,
+        int             afi,
+        int             *num_entries)
+{
+    rloc_index_user     *user       = NULL;
+    lispd_mapping_elt   *mapping    = NULL;
+
+    *num_entries = 0;
+    for (user = rloc_elt->users; user != NULL; user = user->next){
+        if (user->map_cache_entry == proxy_etrs || user->map_cache_entry->active == FALSE ||
+                user->map_cache_entry->mapping->iid != iid ||
+                user->map_cache_entry->mapping->eid_prefix.afi != afi){
+            continue;
+        }
+        if (mapping == NULL){
+            mapping = user->map_cache_entry->mapping;
+        }
+        (*num_entries)++;
+    }
+    return (mapping);
+}
+
+
+/*
+ * Queue an SMR of the local mapping passed as argument to the RLOC if any entry of its
+ * Instance ID uses it and no SMR of the EID is already waiting for the RLOC
+ */
+static int queue_rloc_smr(rloc_index_elt *rloc_elt, void *arg)
+{
+    lispd_mapping_elt   *mapping        = (lispd_mapping_elt *)arg;
+    smr_request         *request        = NULL;
+    int                 num_entries     = 0;
+
+    if (get_smr_remote_mapping(rloc_elt, mapping->iid, mapping->eid_prefix.afi, &num_entries) == NULL){
+        return (GOOD);
+    }
+    smr_queue.suppressed += num_entries - 1;
+    for (request = rloc_elt->smrs; request != NULL; request = request->next_rloc){
+        if (request->iid == mapping->iid && compare_lisp_addr_t(&(request->eid_prefix), &(mapping->eid_prefix)) == 0){
+            smr_queue.suppressed++;
+            return (GOOD);
+        }
+    }
+    if ((request = (smr_request *)malloc(sizeof(smr_request))) == NULL){
+        lispd_log_msg(LISP_LOG_WARNING, "queue_rloc_smr: Unable to allocate memory for smr_request: %s", strerror(errno));
+        return (GOOD);
+    }
+    request->eid_prefix = mapping->eid_prefix;
+    request->iid = mapping->iid;
+    request->rloc_elt = rloc_elt;
+    request->next_rloc = rloc_elt->smrs;
+    rloc_elt->smrs = request;
+    request->next_queued = NULL;
+    if (smr_queue.queue_tail == NULL){
+        smr_queue.queue_head = request;
+    }else{
+        smr_queue.queue_tail->next_queued = request;
+    }
+    smr_queue.queue_tail = request;
+    smr_queue.queued++;
+
+    if (smr_queue.flush_scheduled == FALSE){
+        if (smr_queue.flush_timer == NULL && (smr_queue.flush_timer = create_timer(NULL)) == NULL){
+            return (GOOD);
+        }
+        start_timer(smr_queue.flush_timer, 0, flush_smrs, NULL);
+        smr_queue.flush_scheduled = TRUE;
+    }
+    return (GOOD);
+}
+
+
+static void unlink_rloc_smr(smr_request *request)
+{
+    smr_request     **prev  = &(request->rloc_elt->smrs);
+
+    while (*prev != request){
+        prev = &((*prev)->next_rloc);
+    }
+    *prev = request->next_rloc;
+}
+
+
+static void send_rloc_smr(smr_request *request)
+{
+    lispd_mapping_elt   *remote_mapping = NULL;
+    uint64_t            nonce           = 0;
+    int                 num_entries     = 0;
+    map_request_opts    opts;
+
+    memset ( &opts, FALSE, sizeof(map_request_opts));
+    opts.solicit_map_request = TRUE;
+
+    /* The entries using the RLOC may have changed since the SMR was queued */
+    remote_mapping = get_smr_remote_mapping(request->rloc_elt, request->iid, request->eid_prefix.afi, &num_entries);
+    if (remote_mapping == NULL){
+        smr_queue.discarded++;
+        return;
+    }
+    if (build_and_send_map_request_msg(remote_mapping,&(request->eid_prefix),&(request->rloc_elt->rloc),opts,&nonce)==GOOD){
+        lispd_log_msg(LISP_LOG_DEBUG_1, "  SMR'ing RLOC %s from EID %s/%d (%d map cache entries)",
+                get_char_from_lisp_addr_t(request->rloc_elt->rloc),
+                get_char_from_lisp_addr_t(remote_mapping->eid_prefix),
+                remote_mapping->eid_prefix_length, num_entries);
+        smr_queue.sent++;
+    }
+}
+
+
+static int flush_smrs(timer *t, void *arg)
+{
+    smr_request     *request    = NULL;
+    uint64_t        wait        = 0;
+
+    smr_queue.flush_scheduled = FALSE;
+    refill_token_bucket(&(smr_queue.bucket), smr_rate);
+
+    while ((request = smr_queue.queue_head) != NULL){
+        if ((wait = get_token_bucket_wait(&(smr_queue.bucket), smr_rate)) != 0){
+            smr_queue.throttled++;
+            lispd_log_msg(LISP_LOG_DEBUG_3, "SMRs rate limited: %d queued", smr_queue.queued);
+            start_timer(smr_queue.flush_timer, wait, flush_smrs, NULL);
+            smr_queue.flush_scheduled = TRUE;
+            break;
+        }
+        smr_queue.queue_head = request->next_queued;
+        if (smr_queue.queue_head == NULL){
+            smr_queue.queue_tail = NULL;
+        }
+        smr_queue.queued--;
+        unlink_rloc_smr(request);
+        send_rloc_smr(request);
+        free(request);
+        take_token(&(smr_queue.bucket));
+    }
+    return (GOOD);
+}
+
+
+void cancel_rloc_smrs(rloc_index_elt *rloc_elt)
+{
+    smr_request     *request    = NULL;
+    smr_request     *iterator   = NULL;
+    smr_request     **prev      = NULL;
+
+    while ((request = rloc_elt->smrs) != NULL){
+        rloc_elt->smrs = request->next_rloc;
+        prev = &(smr_queue.queue_head);
+        while (*prev != request){
+            prev = &((*prev)->next_queued);
+        }
+        *prev = request->next_queued;
+        if (smr_queue.queue_tail == request){
+            smr_queue.queue_tail = NULL;
+            for (iterator = smr_queue.queue_head; iterator != NULL; iterator = iterator->next_queued){
+                smr_queue.queue_tail = iterator;
+            }
+        }
+        smr_queue.queued--;
+        smr_queue.discarded++;
+        free(request);
+    }
+}
+
+
 /*
  * Send a solicit map request of the mapping for each rloc of all eids in the map cahce database
  */
 int smr_send_map_req(lispd_mapping_elt *mapping)
 {
     lcl_mapping_extended_info   *map_ext_inf 		= NULL;
-    patricia_tree_t             *map_cache_dbs [2]  = {NULL,NULL};
-    patricia_node_t             *map_cache_node     = NULL;
-    lispd_map_cache_entry       *map_cache_entry    = NULL;
-    lispd_locators_list         *locator_iterator   = NULL;
-    lispd_locator_elt           *locator            = NULL;
     lispd_addr_list_t           *pitr_elt           = NULL;
-    lispd_locators_list         *locators_lists[2]  = {NULL,NULL};
     lispd_rtr_locators_list     *rtr_list           = NULL;
-
     uint64_t                    nonce               = 0;
-    int                         afi_db              = 0;
-    int                         ctr					= 0;
     map_request_opts            opts;
 
     lispd_log_msg(LISP_LOG_DEBUG_1, "Start SMR for local EID %s/%d",
@@ -284,44 +484,15 @@ int smr_send_map_req(lispd_mapping_elt *mapping)
     memset ( &opts, FALSE, sizeof(map_request_opts));
     opts.solicit_map_request = TRUE;
 
-    map_cache_dbs[0] = get_map_cache_db(AF_INET);
-    map_cache_dbs[1] = get_map_cache_db(AF_INET6);
-
-
 	map_ext_inf = (lcl_mapping_extended_info *)(mapping->extended_info);
 	map_ext_inf->to_do_smr = FALSE;
 
+	/*
+	 * One SMR to each RLOC used by the active map cache entries of the Instance ID and AFI of the
+	 * local EID, whatever the number of entries behind the RLOC. They are sent at smr_rate per second.
+	 */
+	walk_rloc_index(queue_rloc_smr, mapping);
 
-
-	/* For each map cache entry with same afi as local EID mapping */
-	if (mapping->eid_prefix.afi ==AF_INET){
-		afi_db = 0;
-	}else{
-		afi_db = 1;
-	}
-	PATRICIA_WALK(map_cache_dbs[afi_db]->head, map_cache_node) {
-		map_cache_entry = ((lispd_map_cache_entry *)(map_cache_node->data));
-		locators_lists[0] = map_cache_entry->mapping->head_v4_locators_list;
-		locators_lists[1] = map_cache_entry->mapping->head_v6_locators_list;
-		for (ctr = 0 ; ctr < 2 ; ctr++){ /*For echa IPv4 and IPv6 locator*/
-
-			if (map_cache_entry->active && locators_lists[ctr] != NULL){
-				locator_iterator = locators_lists[ctr];
-
-				while (locator_iterator){
-					locator = locator_iterator->locator;
-					if (build_and_send_map_request_msg(map_cache_entry->mapping,&(mapping->eid_prefix),locator->locator_addr,opts,&nonce)==GOOD){
-						lispd_log_msg(LISP_LOG_DEBUG_1, "  SMR'ing RLOC %s from EID %s/%d",
-								get_char_from_lisp_addr_t(*(locator->locator_addr)),
-								get_char_from_lisp_addr_t(map_cache_entry->mapping->eid_prefix),
-								map_cache_entry->mapping->eid_prefix_length);
-					}
-
-					locator_iterator = locator_iterator->next;
-				}
-			}
-		}
-	}PATRICIA_WALK_END;
 	/* SMR proxy-itr */
 	pitr_elt  = proxy_itrs;
 
@@ -373,7 +544,7 @@ int solicit_map_request_reply(
     memset ( &opts, FALSE, sizeof(map_request_opts));
 
     if (map_cache_entry->nonces == NULL){
-        map_cache_entry->nonces = new_nonces_list();
+        map_cache_entry->nonces = new_nonces_list(NONCE_OWNER_MAP_CACHE, map_cache_entry);
         if (map_cache_entry->nonces==NULL){
             lispd_log_msg(LISP_LOG_ERR,"Send_map_request_miss: Coudn't allocate memory for nonces");
             return (BAD);
@@ -396,17 +567,19 @@ int solicit_map_request_reply(
                 &(map_cache_entry->nonces->nonce[map_cache_entry->nonces->retransmits])))!=GOOD) {
             lispd_log_msg(LISP_LOG_DEBUG_1, "solicit_map_request_reply: couldn't build/send SMR triggered Map-Request");
         }
+        index_nonce(map_cache_entry->nonces, map_cache_entry->nonces->retransmits);
         map_cache_entry->nonces->retransmits ++;
         /* Reprograming timer*/
         if (map_cache_entry->smr_inv_timer == NULL){
-            map_cache_entry->smr_inv_timer = create_timer (SMR_INV_RETRY_TIMER);
+            map_cache_entry->smr_inv_timer = create_timer(NULL);
         }
-        start_timer(map_cache_entry->smr_inv_timer, LISPD_INITIAL_SMR_TIMEOUT,
+        start_timer(map_cache_entry->smr_inv_timer,
+                backoff_timeout(LISPD_INITIAL_SMR_TIMEOUT, LISPD_MAX_RETRANSMIT_TIMEOUT, map_cache_entry->nonces->retransmits - 1),
                 (timer_callback)solicit_map_request_reply, (void *)map_cache_entry);
     }else{
-        free(map_cache_entry->nonces);
+        free_nonces_list(map_cache_entry->nonces);
         map_cache_entry->nonces = NULL;
-        free(map_cache_entry->smr_inv_timer);
+        free_timer(map_cache_entry->smr_inv_timer);
         map_cache_entry->smr_inv_timer = NULL;
         lispd_log_msg(LISP_LOG_DEBUG_1,"SMR process: No Map Reply fot EID %s/%d. Ignoring solicit map request ...",
                 get_char_from_lisp_addr_t(map_cache_entry->mapping->eid_prefix),
@@ -440,3 +613,18 @@ void free_timer_smr_retry_arg(timer_smr_retry_arg *timer_arg)
     free_mapping_list(timer_arg->mapping_list, FALSE);
     free(timer_arg);
 }
+
+
+void dump_smr_stats(int log_level)
+{
+    if (is_loggable(log_level) == FALSE){
+        return;
+    }
+    lispd_log_msg(log_level, "SMRs: sent: %llu   suppressed: %llu (RLOC already SMR'ed for the EID)   rate limited: %llu   "
+            "discarded: %llu   queued: %d",
+            (unsigned long long)smr_queue.sent,
+            (unsigned long long)smr_queue.suppressed,
+            (unsigned long long)smr_queue.throttled,
+            (unsigned long long)smr_queue.discarded,
+            smr_queue.queued);
+}
@@ -30,6 +30,7 @@
 #ifndef LISPD_SMR_H_
 #define LISPD_SMR_H_
 
+#include "lispd_rloc_index.h"
 #include "lispd_timers.h"
 
 typedef struct _timer_smr_retry_arg{
@@ -62,10 +63,19 @@ int solicit_map_request_reply(
         void *arg);
 
 /*
- * Send a solicit map request of the mapping for each rloc of all eids in the map cahce database
+ * Send a solicit map request of the mapping for each rloc of all eids in the map cahce database.
+ * The RLOCs are taken from the RLOC index: each RLOC is SMR'ed once whatever the number of entries
+ * using it, and the SMRs are queued and sent at smr_rate per second.
  */
 int smr_send_map_req(lispd_mapping_elt *mapping);
 
+/*
+ * Drop the SMRs queued to the RLOC. Called when the last locator of the RLOC is released.
+ */
+void cancel_rloc_smrs(rloc_index_elt *rloc_elt);
+
+void dump_smr_stats(int log_level);
+
 /*
  * Free memory of a timer_smr_retry_arg structure
  */
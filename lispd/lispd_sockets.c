@@ -29,6 +29,7 @@
 #include "lispd_sockets.h"
 #include "lispd_log.h"
 #include "lispd_pkt_lib.h"
+#include "lispd_rx_ring.h"
 #include "api/ipc.h"
 
 
@@ -281,6 +282,15 @@ int open_data_input_socket(int afi){
     int         dummy_sock  = 0; /* To avoid ICMP port unreacheable packets */
     const int   on          = 1;
 
+#ifdef LISPD_RX_RING
+    if (rx_ring_size > 0 && afi == AF_INET){
+        if ((sock = open_rx_ring()) != -1){
+            return (sock);
+        }
+        lispd_log_msg(LISP_LOG_WARNING, "open_data_input_socket: Couldn't open the rx ring. Using a raw socket");
+        rx_ring_size = 0;
+    }
+#endif
 #ifndef VPNAPI
     if ((sock = new_raw_input_socket(afi)) < 0){
         return(-1);
@@ -589,6 +599,41 @@ int get_control_packet (
 }
 
 
+void get_data_packet_ttl_tos(
+        struct msghdr   *msg,
+        int             afi,
+        uint8_t         *ttl,
+        uint8_t         *tos)
+{
+    struct cmsghdr      *cmsgptr    = NULL;
+
+    if (afi == AF_INET){
+        for (cmsgptr = CMSG_FIRSTHDR(msg); cmsgptr != NULL; cmsgptr = CMSG_NXTHDR(msg, cmsgptr)) {
+
+            if (cmsgptr->cmsg_level == IPPROTO_IP && cmsgptr->cmsg_type == IP_TTL) {
+                *ttl = *((uint8_t *)CMSG_DATA(cmsgptr));
+            }
+
+            if (cmsgptr->cmsg_level == IPPROTO_IP && cmsgptr->cmsg_type == IP_TOS) {
+                *tos = *((uint8_t *)CMSG_DATA(cmsgptr));
+            }
+        }
+
+    }else {
+        for (cmsgptr = CMSG_FIRSTHDR(msg); cmsgptr != NULL; cmsgptr = CMSG_NXTHDR(msg, cmsgptr)) {
+
+            if (cmsgptr->cmsg_level == IPPROTO_IPV6 && cmsgptr->cmsg_type == IPV6_HOPLIMIT) {
+                *ttl = *((uint8_t *)CMSG_DATA(cmsgptr));
+            }
+
+            if (cmsgptr->cmsg_level == IPPROTO_IPV6 && cmsgptr->cmsg_type == IPV6_TCLASS) {
+                *tos = *((uint8_t *)CMSG_DATA(cmsgptr));
+            }
+        }
+    }
+}
+
+
 int get_data_packet (
         int             sock,
         int             afi,
@@ -608,7 +653,6 @@ int get_data_packet (
     struct msghdr       msg;
     struct iovec        iov[1];
     union  control_data  cmsg;
-    struct cmsghdr      *cmsgptr    = NULL;
     int                 nbytes      = 0;
 
     iov[0].iov_base = packet;
@@ -629,36 +673,16 @@ int get_data_packet (
 
     nbytes = recvmsg(sock, &msg, 0);
     if (nbytes == -1) {
-        lispd_log_msg(LISP_LOG_WARNING, "read_packet: recvmsg error: %s", strerror(errno));
+        /* Data sockets shared by the data plane threads are non blocking */
+        if (errno != EAGAIN && errno != EWOULDBLOCK){
+            lispd_log_msg(LISP_LOG_WARNING, "read_packet: recvmsg error: %s", strerror(errno));
+        }
         return (BAD);
     }
 
     *length = nbytes;
 
-    if (afi == AF_INET){
-        for (cmsgptr = CMSG_FIRSTHDR(&msg); cmsgptr != NULL; cmsgptr = CMSG_NXTHDR(&msg, cmsgptr)) {
-
-            if (cmsgptr->cmsg_level == IPPROTO_IP && cmsgptr->cmsg_type == IP_TTL) {
-                *ttl = *((uint8_t *)CMSG_DATA(cmsgptr));
-            }
-
-            if (cmsgptr->cmsg_level == IPPROTO_IP && cmsgptr->cmsg_type == IP_TOS) {
-                *tos = *((uint8_t *)CMSG_DATA(cmsgptr));
-            }
-        }
-
-    }else {
-        for (cmsgptr = CMSG_FIRSTHDR(&msg); cmsgptr != NULL; cmsgptr = CMSG_NXTHDR(&msg, cmsgptr)) {
-
-            if (cmsgptr->cmsg_level == IPPROTO_IPV6 && cmsgptr->cmsg_type == IPV6_HOPLIMIT) {
-                *ttl = *((uint8_t *)CMSG_DATA(cmsgptr));
-            }
-
-            if (cmsgptr->cmsg_level == IPPROTO_IPV6 && cmsgptr->cmsg_type == IPV6_TCLASS) {
-                *tos = *((uint8_t *)CMSG_DATA(cmsgptr));
-            }
-        }
-    }
+    get_data_packet_ttl_tos(&msg, afi, ttl, tos);
 
     return (GOOD);
 }
@@ -758,6 +782,282 @@ int send_control_msg(
 }
 #endif
 
+/*
+ * Transmit batch of the calling thread. Only set while a batch of packets read from the tun
+ * is encapsulated
+ */
+static __thread tx_batch_ctx   *current_tx_batch   = NULL;
+
+
+tx_batch_ctx *new_tx_batch(
+        int     size,
+        int     timeout)
+{
+#ifdef LISPD_SENDMMSG
+    tx_batch_ctx    *batch  = NULL;
+    int             i       = 0;
+
+    if (size <= 1){
+        return (NULL);
+    }
+    if ((batch = (tx_batch_ctx *)calloc(1, sizeof(tx_batch_ctx))) == NULL){
+        lispd_log_msg(LISP_LOG_WARNING, "new_tx_batch: Unable to allocate memory for tx_batch_ctx: %s", strerror(errno));
+        return (NULL);
+    }
+    batch->size = size;
+    batch->timeout = timeout;
+    for (i = 0; i < TX_BATCH_MAX_SOCKETS; i++){
+        batch->queues[i].sock = -1;
+        batch->queues[i].msgs = (struct mmsghdr *)calloc(size, sizeof(struct mmsghdr));
+        batch->queues[i].iovs = (struct iovec *)calloc(size, sizeof(struct iovec));
+        batch->queues[i].addrs = (struct sockaddr_storage *)calloc(size, sizeof(struct sockaddr_storage));
+        if (batch->queues[i].msgs == NULL || batch->queues[i].iovs == NULL || batch->queues[i].addrs == NULL){
+            lispd_log_msg(LISP_LOG_WARNING, "new_tx_batch: Unable to allocate memory for the socket queues: %s", strerror(errno));
+            free_tx_batch(batch);
+            return (NULL);
+        }
+    }
+    return (batch);
+#else
+    return (NULL);
+#endif
+}
+
+
+void free_tx_batch(tx_batch_ctx *batch)
+{
+#ifdef LISPD_SENDMMSG
+    int     i   = 0;
+
+    if (batch == NULL){
+        return;
+    }
+    for (i = 0; i < TX_BATCH_MAX_SOCKETS; i++){
+        free(batch->queues[i].msgs);
+        free(batch->queues[i].iovs);
+        free(batch->queues[i].addrs);
+    }
+    free(batch);
+#endif
+}
+
+
+#ifdef LISPD_SENDMMSG
+
+/*
+ * Send all the packets of a socket queue. If only part of the packets are sent, retry with the rest.
+ * sendmmsg reports the error of the first packet it couldn't send: only that packet is dropped, as
+ * with sendto, and the rest of the queue is sent again.
+ */
+
+void flush_tx_socket_queue(tx_socket_queue *queue)
+{
+    int     sent        = 0;
+    int     delivered   = 0;
+    int     nsent       = 0;
+    int     bucket      = 0;
+
+    if (queue->count == 0){
+        return;
+    }
+
+    while (sent < queue->count){
+        nsent = sendmmsg(queue->sock, &(queue->msgs[sent]), queue->count - sent, 0);
+        if (nsent <= 0){
+            if (nsent == -1 && errno == EINTR){
+                continue;
+            }
+            lispd_log_msg(LISP_LOG_DEBUG_2, "flush_tx_socket_queue: sendmmsg failed %s. Socket: %d, dropped packet %d of %d",
+                    strerror(errno), queue->sock, sent + 1, queue->count);
+            queue->errors++;
+            sent++;
+            continue;
+        }
+        sent += nsent;
+        delivered += nsent;
+        if (sent < queue->count){
+            queue->partial_retries++;
+        }
+    }
+
+    while (bucket < TUN_BATCH_HISTOGRAM_BUCKETS - 1 && (queue->count >> (bucket + 1)) != 0){
+        bucket++;
+    }
+    queue->histogram[bucket]++;
+    queue->flushes++;
+    queue->packets += delivered;
+    queue->count = 0;
+}
+
+
+/*
+ * Returns the queue of the socket. If the socket doesn't have a queue yet, an empty queue is
+ * reassigned. Returns NULL if all the queues have pending packets of other sockets
+ */
+
+tx_socket_queue *get_tx_socket_queue(
+        tx_batch_ctx    *batch,
+        int             sock)
+{
+    tx_socket_queue *free_queue = NULL;
+    int             i           = 0;
+
+    for (i = 0; i < TX_BATCH_MAX_SOCKETS; i++){
+        if (batch->queues[i].sock == sock){
+            return (&(batch->queues[i]));
+        }
+        if (batch->queues[i].count != 0){
+            continue;
+        }
+        /* Prefer queues never used to keep the statistics of the rest */
+        if (free_queue == NULL || (free_queue->sock != -1 && batch->queues[i].sock == -1)){
+            free_queue = &(batch->queues[i]);
+        }
+    }
+    if (free_queue != NULL){
+        memset(free_queue->histogram, 0, sizeof(free_queue->histogram));
+        free_queue->flushes = free_queue->packets = free_queue->partial_retries = free_queue->errors = 0;
+        free_queue->sock = sock;
+    }
+    return (free_queue);
+}
+
+
+/*
+ * Queue an encapsulated packet in the current transmit batch.
+ */
+
+int queue_tx_packet (
+        tx_batch_ctx    *batch,
+        int             sock,
+        uint8_t         *packet,
+        int             packet_length)
+{
+    tx_socket_queue         *queue  = NULL;
+    struct sockaddr_in      *addr4  = NULL;
+    struct sockaddr_in6     *addr6  = NULL;
+    struct iphdr            *iph    = (struct iphdr *)packet;
+    struct timespec         now;
+    int                     pos     = 0;
+    long                    elapsed = 0;
+
+    if ((queue = get_tx_socket_queue(batch, sock)) == NULL){
+        return (send_packet(sock, packet, packet_length));
+    }
+
+    pos = queue->count;
+    memset(&(queue->addrs[pos]), 0, sizeof(struct sockaddr_storage));
+    switch (iph->version){
+    case 4:
+        addr4 = (struct sockaddr_in *)&(queue->addrs[pos]);
+        addr4->sin_family = AF_INET;
+        addr4->sin_addr.s_addr = iph->daddr;
+        queue->msgs[pos].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+        break;
+    case 6:
+        addr6 = (struct sockaddr_in6 *)&(queue->addrs[pos]);
+        addr6->sin6_family = AF_INET6;
+        addr6->sin6_addr = ((struct ip6_hdr *)packet)->ip6_dst;
+        queue->msgs[pos].msg_hdr.msg_namelen = sizeof(struct sockaddr_in6);
+        break;
+    default:
+        return (BAD);
+    }
+    queue->iovs[pos].iov_base = packet;
+    queue->iovs[pos].iov_len = packet_length;
+    queue->msgs[pos].msg_hdr.msg_name = &(queue->addrs[pos]);
+    queue->msgs[pos].msg_hdr.msg_iov = &(queue->iovs[pos]);
+    queue->msgs[pos].msg_hdr.msg_iovlen = 1;
+    queue->msgs[pos].msg_hdr.msg_control = NULL;
+    queue->msgs[pos].msg_hdr.msg_controllen = 0;
+    queue->msgs[pos].msg_hdr.msg_flags = 0;
+    queue->count++;
+
+    if (batch->queued == 0 && batch->timeout > 0){
+        clock_gettime(CLOCK_MONOTONIC, &(batch->oldest));
+    }
+    batch->queued++;
+
+    if (queue->count == batch->size){
+        batch->queued -= queue->count;
+        flush_tx_socket_queue(queue);
+    }else if (batch->timeout > 0){
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        elapsed = (now.tv_sec - batch->oldest.tv_sec) * 1000000 + (now.tv_nsec - batch->oldest.tv_nsec) / 1000;
+        if (elapsed >= batch->timeout){
+            flush_tx_batch(batch);
+        }
+    }
+    return (GOOD);
+}
+
+#endif
+
+
+void flush_tx_batch(tx_batch_ctx *batch)
+{
+#ifdef LISPD_SENDMMSG
+    int     i   = 0;
+
+    if (batch == NULL || batch->queued == 0){
+        return;
+    }
+    for (i = 0; i < TX_BATCH_MAX_SOCKETS; i++){
+        flush_tx_socket_queue(&(batch->queues[i]));
+    }
+    batch->queued = 0;
+#endif
+}
+
+
+void tx_batch_begin(tx_batch_ctx *batch)
+{
+    current_tx_batch = batch;
+}
+
+
+void tx_batch_end()
+{
+    if (current_tx_batch != NULL){
+        flush_tx_batch(current_tx_batch);
+        current_tx_batch = NULL;
+    }
+}
+
+
+void dump_tx_batch_stats(
+        tx_batch_ctx    *batch,
+        int             log_level)
+{
+    tx_socket_queue *queue  = NULL;
+    int             i       = 0;
+    int             j       = 0;
+
+    if (batch == NULL || is_loggable(log_level) == FALSE){
+        return;
+    }
+    for (i = 0; i < TX_BATCH_MAX_SOCKETS; i++){
+        queue = &(batch->queues[i]);
+        if (queue->sock == -1){
+            continue;
+        }
+        lispd_log_msg(log_level,"Socket %d: sendmmsg calls: %llu   Packets: %llu   Partial send retries: %llu   Dropped: %llu",
+                queue->sock,
+                (unsigned long long)queue->flushes,
+                (unsigned long long)queue->packets,
+                (unsigned long long)queue->partial_retries,
+                (unsigned long long)queue->errors);
+        for (j = 0; j < TUN_BATCH_HISTOGRAM_BUCKETS; j++){
+            if ((1 << j) > batch->size){
+                break;
+            }
+            lispd_log_msg(log_level,"  %3d - %3d packets per sendmmsg: %llu", 1 << j, (2 << j) - 1,
+                    (unsigned long long)queue->histogram[j]);
+        }
+    }
+}
+
+
 #ifndef VPNAPI
 
 int send_data_packet(
@@ -765,6 +1065,7 @@ int send_data_packet(
         int             packet_length, // original packet + lisp header
         lisp_addr_t     *src_addr,
         lisp_addr_t     *dst_addr,
+        int             src_port,
         int             output_socket)
 {
     uint8_t         *encap_packet         = NULL;
@@ -775,12 +1076,17 @@ int send_data_packet(
             packet_length,
             src_addr,
             dst_addr,
-            LISP_DATA_PORT,
+            src_port,
             LISP_DATA_PORT,
             0,
             &encap_packet,
             &encap_packet_length);
 
+#ifdef LISPD_SENDMMSG
+    if (current_tx_batch != NULL){
+        return (queue_tx_packet(current_tx_batch, output_socket, encap_packet, encap_packet_length));
+    }
+#endif
     result = send_packet (output_socket,encap_packet,encap_packet_length);
 
     return (result);
@@ -793,6 +1099,7 @@ int send_data_packet(
         int             packet_length,
         lisp_addr_t     *src_addr,
         lisp_addr_t     *dst_addr,
+        int             src_port,
         int             output_socket)
 {
     int         result              = 0;
@@ -49,6 +49,40 @@
 #include "lispd_lib.h"
 #include "lispd_output.h"
 
+/* sendmmsg is not available in bionic */
+#if !defined(ANDROID) && !defined(VPNAPI)
+#define LISPD_SENDMMSG
+#endif
+
+#define TX_BATCH_MAX_SOCKETS    16
+
+/*
+ * Queue of encapsulated packets pending to be sent through a socket with a single sendmmsg.
+ * Packets are not copied: they must stay in their buffers until the queue is flushed.
+ */
+typedef struct {
+    int                     sock;
+    int                     count;
+#ifdef LISPD_SENDMMSG
+    struct mmsghdr          *msgs;
+    struct iovec            *iovs;
+    struct sockaddr_storage *addrs;
+#endif
+    uint64_t                flushes;
+    uint64_t                packets;
+    uint64_t                partial_retries;
+    uint64_t                errors;
+    uint64_t                histogram[TUN_BATCH_HISTOGRAM_BUCKETS]; /* Packets per flush */
+} tx_socket_queue;
+
+typedef struct tx_batch_ctx_ {
+    int                     size;       /* Max packets queued per socket */
+    int                     timeout;    /* Max time a packet waits in the queue (us) */
+    int                     queued;
+    struct timespec         oldest;
+    tx_socket_queue         queues[TX_BATCH_MAX_SOCKETS];
+} tx_batch_ctx;
+
 
 int new_device_binded_raw_socket(
     char *device,
@@ -108,6 +142,15 @@ int get_control_packet (
         lisp_addr_t     *local_rloc,
         uint16_t        *remote_port);
 
+/*
+ * Extract the TTL and TOS of the outer header from the ancillary data of a data packet
+ */
+void get_data_packet_ttl_tos(
+        struct msghdr   *msg,
+        int             afi,
+        uint8_t         *ttl,
+        uint8_t         *tos);
+
 int get_data_packet (
     int             sock,
     int             afi,
@@ -129,13 +172,38 @@ int send_control_msg(
         int             dst_port);
 
 /*
- * Send a lisp data packet
+ * Allocate a transmit batch. Returns NULL if batching is disabled (size <= 1) or not supported
+ */
+tx_batch_ctx *new_tx_batch(
+        int     size,
+        int     timeout);
+
+void free_tx_batch(tx_batch_ctx *batch);
+
+/*
+ * Packets sent with send_data_packet between tx_batch_begin and tx_batch_end are queued in
+ * the batch of the calling thread and sent with sendmmsg. tx_batch_end flushes all the queues.
+ */
+void tx_batch_begin(tx_batch_ctx *batch);
+
+void tx_batch_end();
+
+void flush_tx_batch(tx_batch_ctx *batch);
+
+void dump_tx_batch_stats(
+        tx_batch_ctx    *batch,
+        int             log_level);
+
+/*
+ * Send a lisp data packet. src_port is the outer UDP source port (LISP_DATA_PORT unless
+ * it is selected per flow)
  */
 int send_data_packet(
         uint8_t         *buffer,
         int             packet_length,
         lisp_addr_t     *src_addr,
         lisp_addr_t     *dst_addr,
+        int             src_port,
         int             output_socket);
 
 #ifdef VPNAPI
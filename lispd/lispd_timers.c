@@ -1,78 +1,164 @@
 /*
  * lispd_timers.c
  *
- * Timer maintenance routines. A simple, fixed granularity (1 second)
- * timer wheel implementation for scalable timers.
+ * Timer maintenance routines. A hierarchical timer wheel with a fixed
+ * granularity (10 ms): the first level has one spoke per tick and each
+ * of the upper levels one spoke per rotation of the level below. Timers
+ * are inserted in the level covering their expiry and cascaded down to
+ * the first level as the wheel advances, so inserting and expiring a
+ * timer is O(1) whatever its duration. The wheel is driven by a timerfd
+ * armed for the next non empty spoke, so an idle node doesn't wake up on
+ * every tick. Timers are allocated from a pool growing by slabs.
  *
  * Author: Chris White
  * Copyright 2012 Cisco Systems, Inc.
  */
 #include <fcntl.h>
-#include <signal.h>
 #include <sys/time.h>
+#ifdef ANDROID
+#include "timerfd.h"
+#else
+#include <sys/timerfd.h>
+#endif
 
 #include "lispd.h"
-#include "lispd_iface_mgmt.h"
-#include "lispd_info_request.h"
 #include "lispd_log.h"
-#include "lispd_map_register.h"
-#include "lispd_map_request.h"
-#include "lispd_rloc_probing.h"
-#include "lispd_smr.h"
 #include "lispd_timers.h"
 
+#ifndef TFD_TIMER_ABSTIME
+#define TFD_TIMER_ABSTIME   1
+#endif
 
-const int TimerTickInterval = 1;  // Seconds
-const int WheelSize = 4096;       // Good for a little over an hour
+#define WHEEL_LEVELS        4
+#define WHEEL_L0_BITS       8       /* 256 spokes of one tick: 2.56 seconds */
+#define WHEEL_LN_BITS       6       /* 64 spokes per upper level */
+#define WHEEL_L0_SIZE       (1 << WHEEL_L0_BITS)
+#define WHEEL_LN_SIZE       (1 << WHEEL_LN_BITS)
+#define WHEEL_L0_MASK       (WHEEL_L0_SIZE - 1)
+#define WHEEL_LN_MASK       (WHEEL_LN_SIZE - 1)
+/* Ticks covered by the wheel, a little over 7 days. Longer timers are cascaded again. */
+#define WHEEL_MAX_TICKS     ((uint64_t)1 << (WHEEL_L0_BITS + (WHEEL_LEVELS - 1) * WHEEL_LN_BITS))
+
+/* Timers allocated each time the pool is empty */
+#define TIMER_SLAB_SIZE     256
 
 struct {
-    int      num_spokes;
-    int      current_spoke;
-    timer_links   *spokes;
-    timer_t  tick_timer_id;
-    int      running_timers;
-    int      expirations;
+    timer_links     level0[WHEEL_L0_SIZE];
+    timer_links     levels[WHEEL_LEVELS - 1][WHEEL_LN_SIZE];    /* Levels 1 to WHEEL_LEVELS - 1 */
+    uint64_t        current_tick;   /* Last tick processed */
+    uint64_t        armed_tick;     /* Tick the timerfd expires at. 0 if disarmed */
+    struct timespec start;          /* Time of tick 0 */
+    int             running_timers;
+    uint64_t        expirations;
+    uint64_t        cascades;
+    timer           *free_timers;   /* Pool, linked through links.next */
+    int             pool_size;
 } timer_wheel;
 
-void     handle_timers(void);
+void     handle_timers(uint64_t now_tick);
+
+static int          timer_fd = -1;
 
-static int 			signal_pipe[2]; // We don't have signalfd in bionic, fake it.
-static timer_t      tid;
 
 /*
- * create_timer_wheel()
- *
- * Creates the timer wheel structure and starts
- * the rotation timer.
+ * Number of ticks elapsed since the wheel was created
  */
-int create_wheel_timer(void)
+static uint64_t get_current_tick()
 {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (((now.tv_sec - timer_wheel.start.tv_sec) * 1000 +
+            (now.tv_nsec - timer_wheel.start.tv_nsec) / 1000000) / TIMER_TICK_MS);
+}
+
 
-    struct sigevent sev;
+/*
+ * Program the timerfd to expire at the given tick. Tick 0 disarms it.
+ */
+static void arm_wheel_timer(uint64_t tick)
+{
     struct itimerspec timerspec;
-    //memset(&tid,0,sizeof(timer_t));
-
-    sev.sigev_notify = SIGEV_SIGNAL;
-    sev.sigev_signo = SIGRTMIN;
-    sev.sigev_value.sival_ptr = &tid;
-    if (timer_create(CLOCK_MONOTONIC, &sev, &tid) == -1)
-    {
-        lispd_log_msg(LISP_LOG_INFO, "timer_create(): %s", strerror(errno));
-        return (BAD);
+    uint64_t          ms = tick * TIMER_TICK_MS;
+
+    memset(&timerspec, 0, sizeof(timerspec));
+    if (tick != 0){
+        timerspec.it_value.tv_sec = timer_wheel.start.tv_sec + ms / 1000;
+        timerspec.it_value.tv_nsec = timer_wheel.start.tv_nsec + (ms % 1000) * 1000000;
+        if (timerspec.it_value.tv_nsec >= 1000000000){
+            timerspec.it_value.tv_sec++;
+            timerspec.it_value.tv_nsec -= 1000000000;
+        }
     }
+    if (timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &timerspec, NULL) == -1) {
+        lispd_log_msg(LISP_LOG_INFO, "arm_wheel_timer: timerfd_settime failed: %s", strerror(errno));
+        return;
+    }
+    timer_wheel.armed_tick = tick;
+}
 
-    timerspec.it_value.tv_nsec = 0;
-    timerspec.it_value.tv_sec = TimerTickInterval;
-    timerspec.it_interval.tv_nsec = 0;
-    timerspec.it_interval.tv_sec = TimerTickInterval;
 
+/*
+ * Bits of the tick indexing the spokes of a level
+ */
+static inline int level_shift(int level)
+{
+    return (WHEEL_L0_BITS + (level - 1) * WHEEL_LN_BITS);
+}
 
-    if (timer_settime(tid, 0, &timerspec, NULL) == -1) {
-        lispd_log_msg(LISP_LOG_INFO, "create_wheel_timer: timer start failed for %d %s",
-               tid, strerror(errno));
-        return (BAD);
+
+/*
+ * First tick after the current one at which a timer expires or has to be
+ * cascaded. 0 if the wheel is empty.
+ */
+static uint64_t next_wheel_tick()
+{
+    timer_links *spoke;
+    uint64_t    base;
+    uint64_t    tick        = 0;
+    int         level       = 0;
+    int         i           = 0;
+
+    for (i = 1; i <= WHEEL_L0_SIZE; i++) {
+        spoke = &timer_wheel.level0[(timer_wheel.current_tick + i) & WHEEL_L0_MASK];
+        if (spoke->next != spoke) {
+            tick = timer_wheel.current_tick + i;
+            break;
+        }
+    }
+    for (level = 1; level < WHEEL_LEVELS; level++) {
+        base = timer_wheel.current_tick >> level_shift(level);
+        for (i = 1; i <= WHEEL_LN_SIZE; i++) {
+            spoke = &timer_wheel.levels[level - 1][(base + i) & WHEEL_LN_MASK];
+            if (spoke->next != spoke) {
+                if (tick == 0 || ((base + i) << level_shift(level)) < tick) {
+                    tick = (base + i) << level_shift(level);
+                }
+                break;
+            }
+        }
+    }
+    return (tick);
+}
+
+
+/*
+ * Arm the timerfd for the first non empty spoke after the current one
+ */
+static void arm_next_spoke()
+{
+    arm_wheel_timer(next_wheel_tick());
+}
+
+
+static void init_spokes(timer_links *spokes, int num_spokes)
+{
+    int i = 0;
+
+    for (i = 0; i < num_spokes; i++) {
+        spokes[i].next = &spokes[i];
+        spokes[i].prev = &spokes[i];
     }
-    return(GOOD);
 }
 
 /*
@@ -81,88 +167,173 @@ int create_wheel_timer(void)
  */
 int init_timers()
 {
-    int i = 0;
-    timer_links *spoke;
+    int level = 0;
 
     lispd_log_msg(LISP_LOG_DEBUG_1, "Initializing lispd timers...");
 
-    if (create_wheel_timer() != GOOD) {
-        lispd_log_msg(LISP_LOG_INFO, "Failed to set up lispd timers.");
-        return(BAD);
+    init_spokes(timer_wheel.level0, WHEEL_L0_SIZE);
+    for (level = 1; level < WHEEL_LEVELS; level++) {
+        init_spokes(timer_wheel.levels[level - 1], WHEEL_LN_SIZE);
     }
-
-    timer_wheel.num_spokes = WheelSize;
-    timer_wheel.spokes = (timer_links *)malloc(sizeof(timer_links) * WheelSize);
-    timer_wheel.current_spoke = 0;
+    timer_wheel.current_tick = 0;
+    timer_wheel.armed_tick = 0;
     timer_wheel.running_timers = 0;
     timer_wheel.expirations = 0;
+    timer_wheel.cascades = 0;
+    timer_wheel.free_timers = NULL;
+    timer_wheel.pool_size = 0;
+    clock_gettime(CLOCK_MONOTONIC, &timer_wheel.start);
 
-    spoke = &timer_wheel.spokes[0];
-    for (i = 0; i < WheelSize; i++) {
-        spoke->next = spoke;
-        spoke->prev = spoke;
-        spoke++;
-    }
     return(GOOD);
 }
 
+/*
+ * Add a slab of timers to the pool. Slabs are never released.
+ */
+static int grow_timer_pool()
+{
+    timer   *slab   = NULL;
+    int     i       = 0;
+
+    if ((slab = (timer *)malloc(sizeof(timer) * TIMER_SLAB_SIZE)) == NULL) {
+        lispd_log_msg(LISP_LOG_WARNING, "grow_timer_pool: Unable to allocate memory for timers: %s", strerror(errno));
+        return (ERR_MALLOC);
+    }
+    for (i = 0; i < TIMER_SLAB_SIZE; i++) {
+        slab[i].links.next = (timer_links *)timer_wheel.free_timers;
+        timer_wheel.free_timers = &slab[i];
+    }
+    timer_wheel.pool_size += TIMER_SLAB_SIZE;
+    return (GOOD);
+}
+
 /*
  * create_timer()
  *
- * Convenience function to allocate and zero a new timer.
+ * Get a zeroed timer from the pool.
  */
-timer *create_timer(char *name)
+timer *create_timer(timer_arg_destructor destroy_arg)
 {
-    timer *new_timer = malloc(sizeof(timer));
+    timer *new_timer = NULL;
+
+    if (timer_wheel.free_timers == NULL && grow_timer_pool() != GOOD) {
+        return (NULL);
+    }
+    new_timer = timer_wheel.free_timers;
+    timer_wheel.free_timers = (timer *)new_timer->links.next;
+
     memset(new_timer, 0, sizeof(timer));
-    strncpy(new_timer->name, name, TIMER_NAME_LEN - 1);
+    new_timer->destroy_arg = destroy_arg;
     new_timer->links.prev = NULL;
     new_timer->links.next = NULL;
     return(new_timer);
 }
 
+/*
+ * free_timer()
+ *
+ * Return a timer to the pool. The timer must not be running.
+ */
+void free_timer(timer *tptr)
+{
+    if (tptr == NULL) {
+        return;
+    }
+    tptr->links.prev = NULL;
+    tptr->links.next = (timer_links *)timer_wheel.free_timers;
+    timer_wheel.free_timers = tptr;
+}
+
+/*
+ * link_timer()
+ *
+ * Link a timer in the spoke of its expiry tick, in the lowest level
+ * covering the ticks remaining to the expiry.
+ */
+static void link_timer(timer *tptr)
+{
+    timer_links *prev, *spoke;
+    uint64_t    expires     = tptr->expires;
+    uint64_t    ticks       = 0;
+    int         level       = 0;
+
+    if (expires < timer_wheel.current_tick) {
+        expires = timer_wheel.current_tick;
+    }
+    ticks = expires - timer_wheel.current_tick;
+
+    if (ticks < WHEEL_L0_SIZE) {
+        spoke = &timer_wheel.level0[expires & WHEEL_L0_MASK];
+    } else {
+        if (ticks >= WHEEL_MAX_TICKS) {
+            /* Parked in the last spoke until it is cascaded */
+            expires = timer_wheel.current_tick + WHEEL_MAX_TICKS - 1;
+            ticks = WHEEL_MAX_TICKS - 1;
+        }
+        for (level = 1; level < WHEEL_LEVELS - 1; level++) {
+            if (ticks < ((uint64_t)1 << level_shift(level + 1))) {
+                break;
+            }
+        }
+        spoke = &timer_wheel.levels[level - 1][(expires >> level_shift(level)) & WHEEL_LN_MASK];
+    }
+
+    prev = spoke->prev;
+    tptr->links.next = spoke;      /* append to end of spoke  */
+    tptr->links.prev = prev;
+    prev->next   = (timer_links *)tptr;
+    spoke->prev = (timer_links *)tptr;
+}
+
 /*
  * insert_timer()
  *
  * Insert a timer in the wheel at the appropriate location.
  */
-void insert_timer(timer *tptr)
+void insert_timer(timer *tptr, uint64_t msecs_to_expiry)
 {
-    timer_links *prev, *spoke;
-    uint32_t pos;
-    uint32_t ticks;
-    uint32_t td;
-
-    // Number of ticks for this timer.
-    ticks = tptr->duration;
-
-     /*
-      * tick posisiton, referenced from the
-      * current index.
-      */
-     td = (ticks % timer_wheel.num_spokes);
-
-     /*
-      * Full rotations required before this timer expires
-      */
-     tptr->rotation_count = (ticks / timer_wheel.num_spokes);
-
-     /*
-      * Find the right spoke
-      */
-     pos = ((timer_wheel.current_spoke + td) % timer_wheel.num_spokes);
-     spoke = &timer_wheel.spokes[pos];
-
-     /*
-      * Link the timer into the list at this position
-      */
-
-     prev = spoke->prev;
-     tptr->links.next = spoke;      /* append to end of spoke  */
-     tptr->links.prev = prev;
-     prev->next   = (timer_links *)tptr;
-     spoke->prev = (timer_links *)tptr;
-     return;
+    uint64_t ticks;
+
+    /*
+     * Ticks are referenced from now and not from the last tick processed:
+     * the wheel only advances when the timerfd expires.
+     */
+    ticks = (msecs_to_expiry + TIMER_TICK_MS - 1) / TIMER_TICK_MS;
+    if (ticks == 0) {
+        ticks = 1;
+    }
+    tptr->expires = get_current_tick() + ticks;
+    link_timer(tptr);
+
+    /*
+     * Bring the timerfd forward if this timer expires before the armed tick
+     */
+    if (timer_wheel.armed_tick == 0 || tptr->expires < timer_wheel.armed_tick) {
+        arm_wheel_timer(tptr->expires);
+    }
+}
+
+/*
+ * Remove a timer from its spoke if it is running
+ */
+static void unlink_timer(timer *tptr)
+{
+    timer_links *next, *prev;
+
+    next = tptr->links.next;
+    prev = tptr->links.prev;
+    if (next == NULL || prev == NULL) {
+        return;
+    }
+    next->prev = prev;
+    prev->next = next;
+    tptr->links.next = NULL;
+    tptr->links.prev = NULL;
+
+    /*
+     * Update stats
+     */
+    timer_wheel.running_timers--;
 }
 
 /*
@@ -174,163 +345,185 @@ void insert_timer(timer *tptr)
  */
 void start_timer(
     timer               *tptr,
-    int                 seconds_to_expiry,
+    uint64_t            msecs_to_expiry,
     timer_callback      cb,
     void                *cb_arg)
 {
-    timer_links *next, *prev;
-
     /*
      * See if this timer is also running.
      */
-
-    next = tptr->links.next;
-    if (next != NULL) {
-        prev = tptr->links.prev;
-        next->prev = prev;
-        prev->next = next;
-
-        /*
-         * Update stats
-         */
-        timer_wheel.running_timers--;
-    }
+    unlink_timer(tptr);
 
     /*
      * Hook up the callback
      */
     tptr->cb      = cb;
     tptr->cb_argument     = cb_arg;
-    tptr->duration = seconds_to_expiry;
-    insert_timer(tptr);
+    insert_timer(tptr, msecs_to_expiry);
 
     timer_wheel.running_timers++;
     return;
 }
 
+/*
+ * backoff_timeout()
+ *
+ * Timeout before the retransmission number "retransmit" of a message (0
+ * for the first transmission): initial_ms doubled on each retransmission
+ * up to max_ms. A random +-25% avoids retransmitting in bursts the
+ * messages sent at the same time.
+ */
+uint64_t backoff_timeout(
+    int                 initial_ms,
+    int                 max_ms,
+    int                 retransmit)
+{
+    uint64_t timeout = initial_ms;
+
+    while (retransmit > 0 && timeout < (uint64_t)max_ms) {
+        timeout = timeout * 2;
+        retransmit--;
+    }
+    if (timeout > (uint64_t)max_ms) {
+        timeout = max_ms;
+    }
+    return (timeout - timeout / 4 + random() % (timeout / 2 + 1));
+}
+
 /*
  * stop_timer()
  *
- * Mark one of the global timers as stopped and remove it.
+ * Stop a timer, release its argument with the destructor it was created
+ * with and return it to the pool.
  */
 void stop_timer(timer *tptr)
 {
-    timer_links *next, *prev;
-
     if (tptr == NULL) {
         return;
     }
 
-    if (strcmp(tptr->name,MAP_REQUEST_RETRY_TIMER)==0){
-        free ((timer_map_request_argument *)tptr->cb_argument);
-    }else if (strcmp(tptr->name,RLOC_PROBING_TIMER)==0){
-        free ((timer_rloc_probe_argument *)tptr->cb_argument);
-    }else if (strcmp(tptr->name,MAP_REGISTER_TIMER)==0){
-        free ((timer_map_register_argument *)tptr->cb_argument);
-    }else if (strcmp(tptr->name,INFO_REPLY_TTL_TIMER)==0){
-        free ((timer_info_request_argument *)tptr->cb_argument);
-    }else if (strcmp(tptr->name,SMR_RETRY_TIMER)==0){
-        free_timer_smr_retry_arg ((timer_smr_retry_arg *)tptr->cb_argument);
+    if (tptr->destroy_arg != NULL && tptr->cb_argument != NULL) {
+        tptr->destroy_arg(tptr->cb_argument);
     }
+    unlink_timer(tptr);
+    free_timer(tptr);
+}
 
-    next = tptr->links.next;
-    prev = tptr->links.prev;
-    if (next != NULL){
-        next->prev = prev;
+
+/*
+ * Move the timers of a spoke of an upper level to the levels below
+ */
+static void cascade_spoke(timer_links *spoke)
+{
+    timer_links     pending;
+    timer           *tptr;
+
+    if (spoke->next == spoke) {
+        return;
     }
-    if (prev != NULL){
-        prev->next = next;
+    /* Detach the list from the spoke: timers may be linked back to it */
+    pending.next = spoke->next;
+    pending.prev = spoke->prev;
+    pending.next->prev = &pending;
+    pending.prev->next = &pending;
+    spoke->next = spoke;
+    spoke->prev = spoke;
+
+    while (pending.next != &pending) {
+        tptr = (timer *)pending.next;
+        pending.next = tptr->links.next;
+        pending.next->prev = &pending;
+        link_timer(tptr);
+        timer_wheel.cascades++;
+    }
+}
+
+
+/*
+ * Advance the wheel one tick: cascade the upper levels when the level
+ * below completes a rotation and expire the timers of the new tick.
+ */
+static void advance_wheel()
+{
+    timer_links     expired;
+    timer_links     *spoke;
+    timer           *tptr;
+    timer_callback  callback;
+    uint64_t        index;
+    int             level;
+
+    timer_wheel.current_tick++;
+
+    if ((timer_wheel.current_tick & WHEEL_L0_MASK) == 0) {
+        for (level = 1; level < WHEEL_LEVELS; level++) {
+            index = (timer_wheel.current_tick >> level_shift(level)) & WHEEL_LN_MASK;
+            cascade_spoke(&timer_wheel.levels[level - 1][index]);
+            if (index != 0) {
+                break;
+            }
+        }
     }
-    tptr->links.next = NULL;
-    tptr->links.prev = NULL;
 
+    spoke = &timer_wheel.level0[timer_wheel.current_tick & WHEEL_L0_MASK];
+    if (spoke->next == spoke) {
+        return;
+    }
     /*
-     * Update stats
+     * Detach the expired timers: the callbacks may stop or restart any of
+     * them, which just unlinks it from this list.
      */
-    if (next != NULL || prev != NULL){
-        timer_wheel.running_timers--;
+    expired.next = spoke->next;
+    expired.prev = spoke->prev;
+    expired.next->prev = &expired;
+    expired.prev->next = &expired;
+    spoke->next = spoke;
+    spoke->prev = spoke;
+
+    while (expired.next != &expired) {
+        tptr = (timer *)expired.next;
+        unlink_timer(tptr);
+
+        // Update stats
+        timer_wheel.expirations++;
+
+        callback = tptr->cb;
+        (*callback)(tptr, tptr->cb_argument);
     }
-    free (tptr);
 }
 
-
-
 /*
  * handle_timers()
  *
- * Update the wheel index, and expire any timers there, calling
- * the appropriate function to deal with it.
+ * Update the wheel index up to now_tick, and expire any timers there,
+ * calling the appropriate function to deal with it.
  */
-void handle_timers(void)
+void handle_timers(uint64_t now_tick)
 {
-    struct timeval  nowtime;
-    timer_links    *current_spoke, *next, *prev;
-    timer          *tptr;
-    timer_callback  callback;
-    gettimeofday(&nowtime, NULL);
-    timer_wheel.current_spoke = (timer_wheel.current_spoke + 1) % timer_wheel.num_spokes;
-    current_spoke = &timer_wheel.spokes[timer_wheel.current_spoke];
-
-    tptr = (timer *)current_spoke->next;
-    while ( (timer_links *)tptr != current_spoke) {
-        next = tptr->links.next;
-        prev = tptr->links.prev;
-
-        if (tptr->rotation_count > 0) {
-            tptr->rotation_count--;
-        } else {
-
-            prev->next = next;
-            next->prev = prev;
-            tptr->links.next = NULL;
-            tptr->links.prev = NULL;
-
-            // Update stats
-            timer_wheel.running_timers--;
-            timer_wheel.expirations++;
-
-            callback = tptr->cb;
-            (*callback)(tptr, tptr->cb_argument);
-        }
-        // We can not use directly "next" as it could be released  in the callback function  previously to be used
-        tptr = (timer *)(prev->next);
+    while (timer_wheel.current_tick < now_tick) {
+        advance_wheel();
     }
 }
 
 
 
-int process_timer_signal(int timers_fd)
+int process_timer_event(int timers_fd)
 {
-    int sig;
-    int bytes;
+    uint64_t expirations;
 
-    bytes = read(timers_fd, &sig, sizeof(sig));
-    if (bytes != sizeof(sig)) {
-        lispd_log_msg(LISP_LOG_WARNING, "process_event_signal(): nothing to read");
+    if (read(timers_fd, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            lispd_log_msg(LISP_LOG_WARNING, "process_timer_event(): nothing to read");
+        }
         return(-1);
     }
 
-    if (sig == SIGRTMIN) {
-        handle_timers();
-    }
+    handle_timers(get_current_tick());
+    arm_next_spoke();
     return(0);
 }
 
 
 
-/*
- * event_sig_handler
- *
- * Forward signal to the fd for handling in the event loop
- */
-static void event_sig_handler(int sig)
-{
-    if (write(signal_pipe[1], &sig, sizeof(sig)) != sizeof(sig)) {
-        lispd_log_msg(LISP_LOG_WARNING, "write signal %d: %s", sig, strerror(errno));
-    }
-}
-
-
 /*
  * build_timer_event_socket
  *
@@ -342,66 +535,38 @@ static void event_sig_handler(int sig)
  */
 int build_timers_event_socket(int *timers_fd)
 {
-    int flags;
-    struct sigaction sa;
-
-    if (pipe(signal_pipe) == -1) {
-        lispd_log_msg(LISP_LOG_ERR, "build_timers_event_socket: signal pipe setup failed %s", strerror(errno));
+    if ((timer_fd = timerfd_create(CLOCK_MONOTONIC, 0)) == -1) {
+        lispd_log_msg(LISP_LOG_ERR, "build_timers_event_socket: timerfd_create failed %s", strerror(errno));
         return (BAD);
     }
-    *timers_fd = signal_pipe[0];
-
-    if ((flags = fcntl(*timers_fd, F_GETFL, 0)) == -1) {
-        lispd_log_msg(LISP_LOG_ERR, "build_timers_event_socket: fcntl() F_GETFL failed %s", strerror(errno));
-        return (BAD);
-    }
-    if (fcntl(*timers_fd, F_SETFL, flags | O_NONBLOCK) == -1) {
-        lispd_log_msg(LISP_LOG_ERR, "build_timers_event_socket: fcntl() set O_NONBLOCK failed %s", strerror(errno));
+    if (fcntl(timer_fd, F_SETFL, fcntl(timer_fd, F_GETFL, 0) | O_NONBLOCK) == -1 ||
+            fcntl(timer_fd, F_SETFD, FD_CLOEXEC) == -1) {
+        lispd_log_msg(LISP_LOG_ERR, "build_timers_event_socket: fcntl() failed %s", strerror(errno));
         return (BAD);
     }
-
-    memset(&sa, 0, sizeof(sa));
-    sa.sa_handler = event_sig_handler;
-    sa.sa_flags = 0;
-    sigemptyset(&sa.sa_mask);
-    if (sigaction(SIGRTMIN, &sa, NULL) == -1) {
-        lispd_log_msg(LISP_LOG_ERR, "build_timers_event_socket: sigaction() failed %s", strerror(errno));
-    }
+    *timers_fd = timer_fd;
     return(GOOD);
 }
 
-int remove_sig_timer()
+int close_timers_event_socket()
 {
-    struct itimerspec timerspec;
-
-    timerspec.it_value.tv_nsec = 0;
-    timerspec.it_value.tv_sec = 0;
-    timerspec.it_interval.tv_nsec = 0;
-    timerspec.it_interval.tv_sec = 0;
-
-
-    if (timer_settime(tid, 0, &timerspec, NULL) == -1) {
-        lispd_log_msg(LISP_LOG_INFO, "remove_sig_timer: timer stop failed for %d %s",
-                tid, strerror(errno));
-        return (BAD);
+    if (timer_fd == -1) {
+        return (GOOD);
     }
+    close (timer_fd);
+    timer_fd = -1;
+    return(GOOD);
+}
 
 
-
-
-
-
-	struct sigaction sa;
-	memset(&sa, 0, sizeof(sa));
-	sa.sa_handler = SIG_IGN;
-
-	if (sigaction(SIGRTMIN, &sa, NULL) == -1) {
-		lispd_log_msg(LISP_LOG_ERR, "remove_sig_timer: sigaction() failed %s", strerror(errno));
-		return (BAD);
-	}
-
-	close (signal_pipe[0]);
-	close (signal_pipe[1]);
-
-	return(GOOD);
+void dump_timers_stats(int log_level)
+{
+    if (is_loggable(log_level) == FALSE){
+        return;
+    }
+    lispd_log_msg(log_level, "Timers: running: %d   expired: %llu   cascaded: %llu   pool: %d",
+            timer_wheel.running_timers,
+            (unsigned long long)timer_wheel.expirations,
+            (unsigned long long)timer_wheel.cascades,
+            timer_wheel.pool_size);
 }
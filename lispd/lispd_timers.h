@@ -11,24 +11,17 @@
 #ifndef LISPD_TIMERS_H_
 #define LISPD_TIMERS_H_
 
-#include <signal.h>
+#include <stdint.h>
 #include <time.h>
 
 #define RLOC_PROBE_CHECK_INTERVAL 1 // 1 second
 
-#define EXPIRE_MAP_CACHE_TIMER              "EXPIRE_MAP_CACHE_TIMER"
-#define MAP_REGISTER_TIMER                  "MAP_REGISTER_TIMER"
-#define MAP_REQUEST_RETRY_TIMER             "MAP_REQUEST_RETRY_TIMER"
-#define DDT_MAP_REQUEST_RETRY_TIMER         "DDT_MAP_REQUEST_RETRY_TIMER"
-#define DDT_MAP_REQ_RETRY_MS_ACK_TIMER      "DDT_MAP_REQ_RETRY_MS_ACK_TIMER" // We receive ddt ms-ack referral but not Map Reply. Send Map request
-#define DDT_EXPIRE_MAP_REFERRAL             "DDT_EXPIRE_MAP_REFERRAL"
-#define RLOC_PROBING_TIMER                  "RLOC_PROBING_TIMER"
-#define SMR_TIMER                           "SMR_TIMER"
-#define SMR_RETRY_TIMER                     "SMR_RETRY_TIMER"
-#define SMR_INV_RETRY_TIMER                 "SMR_INV_RETRY_TIMER"
-#define INFO_REPLY_TTL_TIMER                "INFO_REPLY_TTL_TIMER"
+/* Resolution of the timers */
+#define TIMER_TICK_MS           10
 
-#define TIMER_NAME_LEN          64
+/* Conversion of the durations given in seconds or minutes to the milliseconds of start_timer */
+#define SECONDS_TO_MS(s)        ((uint64_t)(s) * 1000)
+#define MINUTES_TO_MS(m)        ((uint64_t)(m) * 60000)
 
 typedef struct _timer_links {
     struct _timer_links *prev;
@@ -38,30 +31,59 @@ typedef struct _timer_links {
 struct _timer;
 typedef int (*timer_callback)(struct _timer *t, void *arg);
 
+/*
+ * Releases the argument of a timer when the timer is stopped. Timers whose argument
+ * is owned by someone else are created with a NULL destructor.
+ */
+typedef void (*timer_arg_destructor)(void *arg);
+
 typedef struct _timer {
-    timer_links     links;
-    int             duration;
-    int             rotation_count;
-    timer_callback  cb;
-    void           *cb_argument;
-    char            name[TIMER_NAME_LEN];
+    timer_links             links;
+    uint64_t                expires;        /* Tick */
+    timer_callback          cb;
+    void                    *cb_argument;
+    timer_arg_destructor    destroy_arg;
 } timer;
 
 
 
 int init_timers();
 
-timer *create_timer(char *);
+/*
+ * Get a timer from the pool. destroy_arg is called with the argument of the timer
+ * when the timer is stopped.
+ */
+timer *create_timer(timer_arg_destructor destroy_arg);
 
 void start_timer(
     timer               *tptr,
-    int                 seconds_to_expiry,
+    uint64_t            msecs_to_expiry,
     timer_callback      cb,
     void                *cb_arg);
 
+/*
+ * Stop the timer, release its argument and return it to the pool
+ */
 void stop_timer(timer *);
 
-int process_timer_signal();
+/*
+ * Return a timer which is not running to the pool. Its argument is not released.
+ */
+void free_timer(timer *tptr);
+
+/*
+ * Timeout in ms before retransmitting a message for the retransmit-th time (0 for the
+ * first transmission): exponential backoff from initial_ms to max_ms with a +-25% jitter
+ */
+uint64_t backoff_timeout(
+    int                 initial_ms,
+    int                 max_ms,
+    int                 retransmit);
+
+/*
+ * Expire the timers due when the timers fd becomes readable
+ */
+int process_timer_event(int timers_fd);
 
 /*
  * build_timer_event_socket
@@ -75,8 +97,10 @@ int process_timer_signal();
 int build_timers_event_socket(int *timers_fd);
 
 /*
- * Restore previous action of SIGRTMIN signl
+ * Close the timerfd of the timers
  */
-int remove_sig_timer();
+int close_timers_event_socket();
+
+void dump_timers_stats(int log_level);
 
 #endif /*LISPD_TIMERS_H_*/
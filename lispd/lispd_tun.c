@@ -47,6 +47,16 @@ int create_tun(
     int flags = IFF_TUN | IFF_NO_PI; // Create a tunnel without persistence
     char *clonedev = CLONEDEV;
 
+    if (data_plane_threads > 0){
+#ifdef IFF_MULTI_QUEUE
+        /* One queue per data plane thread. The first one is tun_fd */
+        flags |= IFF_MULTI_QUEUE;
+#else
+        lispd_log_msg(LISP_LOG_CRIT, "TUN/TAP: Multi queue tun not supported. Set data-plane-threads to 0");
+        return (BAD);
+#endif
+    }
+
 
     /* Arguments taken by the function:
      *
@@ -76,6 +86,12 @@ int create_tun(
         return (BAD);
     }
 
+    /* Non blocking tun to be able to drain it in batches */
+    if (tun_set_nonblocking(tun_fd) != GOOD){
+        close(tun_fd);
+        return (BAD);
+    }
+
     // get the ifindex for the tun/tap
     tmpsocket = socket(AF_INET, SOCK_DGRAM, 0); // Dummy socket for the ioctl, type/details unimportant
     if ((error = ioctl(tmpsocket, SIOCGIFINDEX, (void *)&ifr)) < 0) {
@@ -109,6 +125,51 @@ int create_tun(
     return(GOOD);
 }
 
+/*
+ * Open an additional queue of a multi queue tun interface. Returns the fd of the queue or -1
+ */
+int tun_open_queue(char *tun_dev_name)
+{
+#ifdef IFF_MULTI_QUEUE
+    struct ifreq    ifr;
+    int             fd      = -1;
+
+    if ((fd = open(CLONEDEV, O_RDWR)) < 0) {
+        lispd_log_msg(LISP_LOG_CRIT, "TUN/TAP: Failed to open clone device");
+        return (-1);
+    }
+
+    memset(&ifr, 0, sizeof(ifr));
+    ifr.ifr_flags = IFF_TUN | IFF_NO_PI | IFF_MULTI_QUEUE;
+    strncpy(ifr.ifr_name, tun_dev_name, IFNAMSIZ - 1);
+
+    if (ioctl(fd, TUNSETIFF, (void *) &ifr) < 0) {
+        lispd_log_msg(LISP_LOG_CRIT, "TUN/TAP: Failed to open a new queue of %s: %s", tun_dev_name, strerror(errno));
+        close(fd);
+        return (-1);
+    }
+    if (tun_set_nonblocking(fd) != GOOD){
+        close(fd);
+        return (-1);
+    }
+    lispd_log_msg(LISP_LOG_DEBUG_2, "New queue of %s opened with fd %d", tun_dev_name, fd);
+    return (fd);
+#else
+    return (-1);
+#endif
+}
+
+int tun_set_nonblocking(int fd)
+{
+    int flags = fcntl(fd, F_GETFL, 0);
+
+    if (flags == -1 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1){
+        lispd_log_msg(LISP_LOG_CRIT, "TUN/TAP: unable to set the tunnel fd as non blocking: %s", strerror(errno));
+        return (BAD);
+    }
+    return (GOOD);
+}
+
 /*
  * Creates the routes to send the traffic to the tun interface to be encapsulated
  */
@@ -94,6 +94,17 @@ int create_tun(
     unsigned int        tun_receive_size,
     int                 tun_mtu);
 
+/*
+ * Open an additional queue of a multi queue tun interface (data-plane-threads > 0).
+ * Returns the fd of the queue or -1
+ */
+int tun_open_queue(char *tun_dev_name);
+
+/*
+ * Set the tun file descriptor as non blocking. Required to drain the tun in batches
+ */
+int tun_set_nonblocking(int fd);
+
 /**
  * Creates the routes to send the traffic to the tun interface to be encapsulated
  */
@@ -0,0 +1,657 @@
+/*
+ * lispd_uring.c
+ *
+ * This file is part of LISP Mobile Node Implementation.
+ * Packet I/O of the main thread through io_uring.
+ *
+ * Copyright (C) 2012 Cisco Systems, Inc, 2012. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * Please send any bug reports or fixes you make to the email address(es):
+ *    LISP-MN developers <devel@lispmob.org>
+ *
+ */
+
+
+#include "lispd_uring.h"
+
+#ifdef LISPD_IO_URING
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include "lispd_input.h"
+#include "lispd_lib.h"
+#include "lispd_log.h"
+#include "lispd_output.h"
+#include "lispd_pkt_lib.h"
+#include "lispd_reactor.h"
+#include "lispd_sockets.h"
+
+/* The operation is stored in the high byte of the user data of the requests */
+#define URING_OP_SHIFT          56
+#define URING_OP_RECV           1   /* data: afi of the data socket */
+#define URING_OP_TUN_READ       2
+#define URING_OP_TUN_WRITE      3   /* data: id of the rx buffer being written */
+#define URING_OP_REACTOR        4
+#define URING_USER_DATA(op,data)    (((uint64_t)(op) << URING_OP_SHIFT) | (uint64_t)(data))
+#define URING_USER_OP(user_data)    ((int)((user_data) >> URING_OP_SHIFT))
+#define URING_USER_ARG(user_data)   ((int)((user_data) & 0xffffffff))
+
+#define URING_RX_GROUP          0
+#define URING_TUN_GROUP         1
+
+/* Space for TTL and TOS data */
+#define URING_CONTROL_LEN       (CMSG_SPACE(sizeof(int)) + CMSG_SPACE(sizeof(int)))
+/* recvmsg buffers start with a io_uring_recvmsg_out followed by the control data */
+#define URING_RX_BUFFER_SIZE    (sizeof(struct io_uring_recvmsg_out) + URING_CONTROL_LEN + MAX_IP_PACKET)
+
+typedef struct uring_buf_group_ {
+    struct io_uring_buf_ring    *ring;
+    size_t                      ring_length;
+    uint8_t                     *buffers;
+    int                         num;
+    int                         size;
+    int                         offset;     /* Headroom left in front of the data */
+    uint16_t                    tail;
+} uring_buf_group;
+
+typedef struct uring_data_socket_ {
+    int         fd;
+    int         afi;
+} uring_data_socket;
+
+static struct {
+    int                 fd;
+    void                *sq_map;
+    size_t              sq_map_length;
+    void                *cq_map;
+    size_t              cq_map_length;
+    struct io_uring_sqe *sqes;
+    size_t              sqes_length;
+    uint32_t            *sq_head;
+    uint32_t            *sq_tail;
+    uint32_t            sq_mask;
+    uint32_t            sq_entries;
+    uint32_t            sqe_tail;   /* SQEs filled, published in the tail when submitting */
+    uint32_t            *cq_head;
+    uint32_t            *cq_tail;
+    uint32_t            cq_mask;
+    struct io_uring_cqe *cqes;
+    uring_buf_group     rx;
+    uring_buf_group     tun;
+    int                 tun_fd;
+    uring_data_socket   data[2];
+    struct msghdr       recv_msg;
+    /* Statistics */
+    uint64_t            enters;
+    uint64_t            completions;
+    uint64_t            rx_packets;
+    uint64_t            tx_packets;
+    uint64_t            sync_writes;
+    uint64_t            no_buffers;
+} uring = {
+        .fd         = -1,
+        .sq_map     = NULL,
+        .cq_map     = NULL,
+        .sqes       = NULL,
+        .tun_fd     = -1,
+        .data       = {{-1, AF_INET}, {-1, AF_INET6}}
+};
+
+
+static int sys_io_uring_setup(
+        uint32_t                entries,
+        struct io_uring_params  *params)
+{
+    return (syscall(__NR_io_uring_setup, entries, params));
+}
+
+
+static int sys_io_uring_enter(
+        uint32_t    to_submit,
+        uint32_t    min_complete,
+        uint32_t    flags)
+{
+    uring.enters++;
+    return (syscall(__NR_io_uring_enter, uring.fd, to_submit, min_complete, flags, NULL, 0));
+}
+
+
+static int sys_io_uring_register(
+        uint32_t    opcode,
+        void        *arg,
+        uint32_t    nr_args)
+{
+    return (syscall(__NR_io_uring_register, uring.fd, opcode, arg, nr_args));
+}
+
+
+/*
+ * Publish the filled SQEs and return the number of them not consumed yet by the kernel
+ */
+static uint32_t uring_sq_pending()
+{
+    __atomic_store_n(uring.sq_tail, uring.sqe_tail, __ATOMIC_RELEASE);
+    return (uring.sqe_tail - __atomic_load_n(uring.sq_head, __ATOMIC_ACQUIRE));
+}
+
+
+/*
+ * Returns an empty SQE or NULL if the submission queue is full even after submitting it
+ */
+static struct io_uring_sqe *uring_get_sqe()
+{
+    struct io_uring_sqe     *sqe    = NULL;
+
+    if (uring.sqe_tail - __atomic_load_n(uring.sq_head, __ATOMIC_ACQUIRE) >= uring.sq_entries){
+        sys_io_uring_enter(uring_sq_pending(), 0, 0);
+        if (uring.sqe_tail - __atomic_load_n(uring.sq_head, __ATOMIC_ACQUIRE) >= uring.sq_entries){
+            return (NULL);
+        }
+    }
+    sqe = &(uring.sqes[uring.sqe_tail & uring.sq_mask]);
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    uring.sqe_tail++;
+    return (sqe);
+}
+
+
+static void uring_recycle_buffer(
+        uring_buf_group     *group,
+        int                 bid)
+{
+    struct io_uring_buf     *buf    = &(group->ring->bufs[group->tail & (group->num - 1)]);
+
+    buf->addr = (uint64_t)(unsigned long) CO(group->buffers, bid * group->size + group->offset);
+    buf->len = group->size - group->offset;
+    buf->bid = bid;
+    group->tail++;
+}
+
+
+/*
+ * Make the recycled buffers available to the kernel
+ */
+static void uring_publish_buffers(uring_buf_group *group)
+{
+    __atomic_store_n(&(group->ring->tail), group->tail, __ATOMIC_RELEASE);
+}
+
+
+static int init_buf_group(
+        uring_buf_group     *group,
+        int                 bgid,
+        int                 num,
+        int                 size,
+        int                 offset)
+{
+    struct io_uring_buf_reg     reg;
+    int                         i   = 0;
+
+    group->num = num;
+    group->size = size;
+    group->offset = offset;
+    group->tail = 0;
+    group->ring_length = num * sizeof(struct io_uring_buf);
+    group->ring = mmap(NULL, group->ring_length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (group->ring == MAP_FAILED){
+        group->ring = NULL;
+        lispd_log_msg(LISP_LOG_ERR, "init_buf_group: mmap: %s", strerror(errno));
+        return (BAD);
+    }
+    if ((group->buffers = (uint8_t *)malloc(num * size)) == NULL){
+        lispd_log_msg(LISP_LOG_WARNING, "init_buf_group: Unable to allocate memory for the buffers: %s", strerror(errno));
+        return (ERR_MALLOC);
+    }
+
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(unsigned long) group->ring;
+    reg.ring_entries = num;
+    reg.bgid = bgid;
+    if (sys_io_uring_register(IORING_REGISTER_PBUF_RING, &reg, 1) == -1){
+        lispd_log_msg(LISP_LOG_WARNING, "init_buf_group: Couldn't register the provided buffer ring: %s", strerror(errno));
+        return (BAD);
+    }
+
+    for (i = 0; i < num; i++){
+        uring_recycle_buffer(group, i);
+    }
+    uring_publish_buffers(group);
+    return (GOOD);
+}
+
+
+static void close_buf_group(uring_buf_group *group)
+{
+    if (group->ring != NULL){
+        munmap(group->ring, group->ring_length);
+        group->ring = NULL;
+    }
+    free(group->buffers);
+    group->buffers = NULL;
+}
+
+
+static int map_uring(struct io_uring_params *params)
+{
+    uint32_t    *sq_array   = NULL;
+    uint32_t    i           = 0;
+
+    uring.sq_map_length = params->sq_off.array + params->sq_entries * sizeof(uint32_t);
+    uring.cq_map_length = params->cq_off.cqes + params->cq_entries * sizeof(struct io_uring_cqe);
+    /* With IORING_FEAT_SINGLE_MMAP both queues share the same mapping */
+    if ((params->features & IORING_FEAT_SINGLE_MMAP) && uring.cq_map_length > uring.sq_map_length){
+        uring.sq_map_length = uring.cq_map_length;
+    }
+
+    uring.sq_map = mmap(NULL, uring.sq_map_length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+            uring.fd, IORING_OFF_SQ_RING);
+    if (uring.sq_map == MAP_FAILED){
+        uring.sq_map = NULL;
+        lispd_log_msg(LISP_LOG_ERR, "map_uring: mmap: %s", strerror(errno));
+        return (BAD);
+    }
+    if (params->features & IORING_FEAT_SINGLE_MMAP){
+        uring.cq_map = uring.sq_map;
+    }else{
+        uring.cq_map = mmap(NULL, uring.cq_map_length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                uring.fd, IORING_OFF_CQ_RING);
+        if (uring.cq_map == MAP_FAILED){
+            uring.cq_map = NULL;
+            lispd_log_msg(LISP_LOG_ERR, "map_uring: mmap: %s", strerror(errno));
+            return (BAD);
+        }
+    }
+    uring.sqes_length = params->sq_entries * sizeof(struct io_uring_sqe);
+    uring.sqes = mmap(NULL, uring.sqes_length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+            uring.fd, IORING_OFF_SQES);
+    if (uring.sqes == MAP_FAILED){
+        uring.sqes = NULL;
+        lispd_log_msg(LISP_LOG_ERR, "map_uring: mmap: %s", strerror(errno));
+        return (BAD);
+    }
+
+    /* Slot i of the submission queue always holds SQE i */
+    sq_array = (uint32_t *) CO(uring.sq_map, params->sq_off.array);
+    for (i = 0; i < params->sq_entries; i++){
+        sq_array[i] = i;
+    }
+
+    uring.sq_head = (uint32_t *) CO(uring.sq_map, params->sq_off.head);
+    uring.sq_tail = (uint32_t *) CO(uring.sq_map, params->sq_off.tail);
+    uring.sq_mask = *(uint32_t *) CO(uring.sq_map, params->sq_off.ring_mask);
+    uring.sq_entries = params->sq_entries;
+    uring.sqe_tail = *uring.sq_tail;
+    uring.cq_head = (uint32_t *) CO(uring.cq_map, params->cq_off.head);
+    uring.cq_tail = (uint32_t *) CO(uring.cq_map, params->cq_off.tail);
+    uring.cq_mask = *(uint32_t *) CO(uring.cq_map, params->cq_off.ring_mask);
+    uring.cqes = (struct io_uring_cqe *) CO(uring.cq_map, params->cq_off.cqes);
+    return (GOOD);
+}
+
+
+/*
+ * The requests are completed asynchronously by the ring: non blocking fds would make
+ * them fail with EAGAIN instead of waiting for data
+ */
+static void set_blocking(int fd)
+{
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) & ~O_NONBLOCK);
+}
+
+
+static void uring_post_recv(uring_data_socket *socket)
+{
+    struct io_uring_sqe     *sqe    = NULL;
+
+    if ((sqe = uring_get_sqe()) == NULL){
+        lispd_log_msg(LISP_LOG_WARNING, "uring_post_recv: Submission queue full");
+        return;
+    }
+    sqe->opcode = IORING_OP_RECVMSG;
+    sqe->fd = socket->fd;
+    sqe->addr = (uint64_t)(unsigned long) &(uring.recv_msg);
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_RX_GROUP;
+    sqe->user_data = URING_USER_DATA(URING_OP_RECV, socket->afi);
+}
+
+
+static void uring_post_tun_read()
+{
+    struct io_uring_sqe     *sqe    = NULL;
+
+    if ((sqe = uring_get_sqe()) == NULL){
+        lispd_log_msg(LISP_LOG_WARNING, "uring_post_tun_read: Submission queue full");
+        return;
+    }
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = uring.tun_fd;
+    sqe->off = (uint64_t) -1;
+    sqe->len = uring.tun.size - uring.tun.offset;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_TUN_GROUP;
+    sqe->user_data = URING_USER_DATA(URING_OP_TUN_READ, 0);
+}
+
+
+static void uring_post_reactor_poll()
+{
+    struct io_uring_sqe     *sqe    = NULL;
+
+    if ((sqe = uring_get_sqe()) == NULL){
+        lispd_log_msg(LISP_LOG_WARNING, "uring_post_reactor_poll: Submission queue full");
+        return;
+    }
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = get_reactor_fd();
+    sqe->poll32_events = POLLIN;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->user_data = URING_USER_DATA(URING_OP_REACTOR, 0);
+}
+
+
+/*
+ * Write a decapsulated packet held in a rx buffer. The buffer is recycled once written.
+ */
+static void uring_post_tun_write(
+        uint8_t     *packet,
+        int         length,
+        int         bid)
+{
+    struct io_uring_sqe     *sqe    = NULL;
+
+    if ((sqe = uring_get_sqe()) == NULL){
+        uring.sync_writes++;
+        if (write(uring.tun_fd, packet, length) < 0){
+            lispd_log_msg(LISP_LOG_DEBUG_2,"uring_post_tun_write: write error: %s", strerror(errno));
+        }
+        uring_recycle_buffer(&(uring.rx), bid);
+        return;
+    }
+    sqe->opcode = IORING_OP_WRITE;
+    sqe->fd = uring.tun_fd;
+    sqe->off = (uint64_t) -1;
+    sqe->addr = (uint64_t)(unsigned long) packet;
+    sqe->len = length;
+    sqe->user_data = URING_USER_DATA(URING_OP_TUN_WRITE, bid);
+}
+
+
+static uring_data_socket *get_uring_data_socket(int afi)
+{
+    return ((afi == AF_INET) ? &(uring.data[0]) : &(uring.data[1]));
+}
+
+
+static void data_fallback_callback(int fd, void *ctx)
+{
+    process_input_packet(fd, ((uring_data_socket *)ctx)->afi);
+}
+
+
+static void process_recv_completion(struct io_uring_cqe *cqe)
+{
+    uring_data_socket           *socket         = get_uring_data_socket(URING_USER_ARG(cqe->user_data));
+    struct io_uring_recvmsg_out *out            = NULL;
+    struct msghdr               msg;
+    uint8_t                     *buffer         = NULL;
+    uint8_t                     *inner_packet   = NULL;
+    int                         inner_length    = 0;
+    int                         bid             = 0;
+    uint8_t                     ttl             = 0;
+    uint8_t                     tos             = 0;
+
+    if (cqe->res == -EINVAL){
+        /* Multishot recvmsg is not supported by the kernel: let the reactor read the socket */
+        lispd_log_msg(LISP_LOG_WARNING, "io_uring: multishot recvmsg not supported. Reading the data socket from the reactor");
+        set_blocking(socket->fd);
+        reactor_add_fd(socket->fd, REACTOR_READ, data_fallback_callback, socket,
+                (socket->afi == AF_INET) ? "IPv4 data" : "IPv6 data");
+        return;
+    }
+    if ((cqe->flags & IORING_CQE_F_MORE) == 0){
+        /* The multishot request has finished, usually because the rx buffers ran out */
+        if (cqe->res == -ENOBUFS){
+            uring.no_buffers++;
+        }
+        uring_post_recv(socket);
+    }
+    if ((cqe->flags & IORING_CQE_F_BUFFER) == 0){
+        return;
+    }
+
+    bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+    buffer = CO(uring.rx.buffers, bid * uring.rx.size);
+    out = (struct io_uring_recvmsg_out *) buffer;
+
+    if (cqe->res < 0 || (out->flags & MSG_TRUNC) != 0){
+        uring_recycle_buffer(&(uring.rx), bid);
+        return;
+    }
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_control = CO(buffer, sizeof(struct io_uring_recvmsg_out) + uring.recv_msg.msg_namelen);
+    msg.msg_controllen = out->controllen;
+    get_data_packet_ttl_tos(&msg, socket->afi, &ttl, &tos);
+
+    inner_packet = decapsulate_data_packet(
+            CO(msg.msg_control, uring.recv_msg.msg_controllen), out->payloadlen,
+            socket->afi, ttl, tos, &inner_length);
+    if (inner_packet == NULL){
+        uring_recycle_buffer(&(uring.rx), bid);
+        return;
+    }
+    uring.rx_packets++;
+    uring_post_tun_write(inner_packet, inner_length, bid);
+}
+
+
+int init_uring(
+        int     tun,
+        int     ipv4_data,
+        int     ipv6_data)
+{
+    struct io_uring_params  params;
+    int                     i       = 0;
+
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = URING_CQ_ENTRIES;
+    if ((uring.fd = sys_io_uring_setup(URING_SQ_ENTRIES, &params)) == -1){
+        lispd_log_msg(LISP_LOG_WARNING, "init_uring: io_uring_setup: %s", strerror(errno));
+        return (BAD);
+    }
+    if (map_uring(&params) != GOOD ||
+            init_buf_group(&(uring.rx), URING_RX_GROUP, URING_RX_BUFFERS, URING_RX_BUFFER_SIZE, 0) != GOOD ||
+            init_buf_group(&(uring.tun), URING_TUN_GROUP, URING_TUN_BUFFERS, MAX_IP_PACKET, IN_PACK_BUFF_OFFSET) != GOOD){
+        close_uring();
+        return (BAD);
+    }
+
+    /* No source address: the recvmsg buffers only hold the control data and the packet */
+    memset(&(uring.recv_msg), 0, sizeof(struct msghdr));
+    uring.recv_msg.msg_controllen = URING_CONTROL_LEN;
+
+    uring.tun_fd = tun;
+    uring.data[0].fd = ipv4_data;
+    uring.data[1].fd = ipv6_data;
+
+    if (uring.tun_fd != -1){
+        set_blocking(uring.tun_fd);
+        for (i = 0; i < URING_TUN_READS; i++){
+            uring_post_tun_read();
+        }
+    }
+    for (i = 0; i < 2; i++){
+        if (uring.data[i].fd != -1){
+            set_blocking(uring.data[i].fd);
+            uring_post_recv(&(uring.data[i]));
+        }
+    }
+    uring_post_reactor_poll();
+
+    lispd_log_msg(LISP_LOG_DEBUG_1, "io_uring engine: %u submission entries, %d rx buffers, %d tun buffers",
+            params.sq_entries, URING_RX_BUFFERS, URING_TUN_BUFFERS);
+    return (GOOD);
+}
+
+
+void close_uring()
+{
+    if (uring.fd == -1){
+        return;
+    }
+    if (uring.sqes != NULL){
+        munmap(uring.sqes, uring.sqes_length);
+        uring.sqes = NULL;
+    }
+    if (uring.cq_map != NULL && uring.cq_map != uring.sq_map){
+        munmap(uring.cq_map, uring.cq_map_length);
+    }
+    uring.cq_map = NULL;
+    if (uring.sq_map != NULL){
+        munmap(uring.sq_map, uring.sq_map_length);
+        uring.sq_map = NULL;
+    }
+    close(uring.fd);
+    uring.fd = -1;
+    close_buf_group(&(uring.rx));
+    close_buf_group(&(uring.tun));
+}
+
+
+int uring_wait()
+{
+    uint32_t    to_submit   = uring_sq_pending();
+
+    if (__atomic_load_n(uring.cq_tail, __ATOMIC_ACQUIRE) == *uring.cq_head || to_submit > 0){
+        if (sys_io_uring_enter(to_submit, 1, IORING_ENTER_GETEVENTS) == -1 && errno != EINTR){
+            lispd_log_msg(LISP_LOG_DEBUG_2, "uring_wait: io_uring_enter error: %s", strerror(errno));
+        }
+    }
+    return (__atomic_load_n(uring.cq_tail, __ATOMIC_ACQUIRE) - *uring.cq_head);
+}
+
+
+void uring_dispatch()
+{
+    struct io_uring_cqe     *cqe                        = NULL;
+    uint8_t                 *buffers[URING_TUN_READS];
+    int                     lengths[URING_TUN_READS];
+    int                     bids[URING_TUN_READS];
+    uint32_t                head                        = *uring.cq_head;
+    uint32_t                tail                        = __atomic_load_n(uring.cq_tail, __ATOMIC_ACQUIRE);
+    int                     tun_reads                   = 0;
+    int                     count                       = 0;
+    int                     reactor_ready               = FALSE;
+    int                     i                           = 0;
+
+    for (; head != tail; head++){
+        cqe = &(uring.cqes[head & uring.cq_mask]);
+        uring.completions++;
+
+        switch (URING_USER_OP(cqe->user_data)){
+        case URING_OP_RECV:
+            process_recv_completion(cqe);
+            break;
+        case URING_OP_TUN_READ:
+            tun_reads++;
+            if ((cqe->flags & IORING_CQE_F_BUFFER) == 0){
+                if (cqe->res < 0 && cqe->res != -EINTR){
+                    lispd_log_msg(LISP_LOG_DEBUG_2, "uring_dispatch: Error reading from the tun: %s", strerror(-cqe->res));
+                }
+                break;
+            }
+            bids[count] = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+            if (cqe->res <= 0 || count == URING_TUN_READS){
+                uring_recycle_buffer(&(uring.tun), bids[count]);
+                break;
+            }
+            buffers[count] = CO(uring.tun.buffers, bids[count] * uring.tun.size);
+            lengths[count] = cqe->res;
+            count++;
+            break;
+        case URING_OP_TUN_WRITE:
+            if (cqe->res < 0){
+                lispd_log_msg(LISP_LOG_DEBUG_2,"uring_dispatch: write error: %s", strerror(-cqe->res));
+            }
+            uring_recycle_buffer(&(uring.rx), URING_USER_ARG(cqe->user_data));
+            break;
+        case URING_OP_REACTOR:
+            reactor_ready = TRUE;
+            if ((cqe->flags & IORING_CQE_F_MORE) == 0){
+                uring_post_reactor_poll();
+            }
+            break;
+        }
+    }
+    __atomic_store_n(uring.cq_head, head, __ATOMIC_RELEASE);
+
+    /* Packets read from the tun are encapsulated and sent as a single batch */
+    if (count > 0){
+        uring.tx_packets += count;
+        encapsulate_tun_batch(&main_tun_batch, buffers, lengths, count);
+        for (i = 0; i < count; i++){
+            uring_recycle_buffer(&(uring.tun), bids[i]);
+        }
+    }
+    uring_publish_buffers(&(uring.tun));
+    uring_publish_buffers(&(uring.rx));
+    for (i = 0; i < tun_reads; i++){
+        uring_post_tun_read();
+    }
+
+    /*
+     * The poll only reports new events of the reactor: dispatch until no fd is ready in
+     * case a callback left data to be read
+     */
+    if (reactor_ready == TRUE){
+        while (reactor_wait(0) > 0){
+            reactor_dispatch();
+        }
+    }
+}
+
+
+void dump_uring_stats(int log_level)
+{
+    uint64_t    packets     = uring.rx_packets + uring.tx_packets;
+
+    if (uring.fd == -1 || is_loggable(log_level) == FALSE){
+        return;
+    }
+    lispd_log_msg(log_level, "io_uring: io_uring_enter calls: %llu   completions: %llu",
+            (unsigned long long)uring.enters, (unsigned long long)uring.completions);
+    lispd_log_msg(log_level, "  packets decapsulated: %llu   encapsulated: %llu   syscalls per packet: %.3f",
+            (unsigned long long)uring.rx_packets, (unsigned long long)uring.tx_packets,
+            (packets == 0) ? 0.0 : (double)uring.enters / packets);
+    lispd_log_msg(log_level, "  rx buffers exhausted: %llu   synchronous tun writes: %llu",
+            (unsigned long long)uring.no_buffers, (unsigned long long)uring.sync_writes);
+}
+
+#endif
+
+/*
+ * Editor modelines
+ *
+ * vi: set shiftwidth=4 tabstop=4 expandtab:
+ * :indentSize=4:tabSize=4:noTabs=true:
+ */
@@ -0,0 +1,90 @@
+/*
+ * lispd_uring.h
+ *
+ * This file is part of LISP Mobile Node Implementation.
+ * Packet I/O of the main thread through io_uring.
+ *
+ * Copyright (C) 2012 Cisco Systems, Inc, 2012. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * Please send any bug reports or fixes you make to the email address(es):
+ *    LISP-MN developers <devel@lispmob.org>
+ *
+ */
+
+
+#ifndef LISPD_URING_H_
+#define LISPD_URING_H_
+
+#include "lispd.h"
+
+/* io_uring is not available in bionic */
+#if !defined(ANDROID) && !defined(VPNAPI)
+#define LISPD_IO_URING
+#endif
+
+#define URING_SQ_ENTRIES        256
+#define URING_CQ_ENTRIES        1024
+/* Provided buffers of the data sockets. Power of 2 */
+#define URING_RX_BUFFERS        512
+/* Provided buffers of the tun. Power of 2 */
+#define URING_TUN_BUFFERS       128
+/* Reads of the tun kept posted. Maximum number of packets encapsulated per batch */
+#define URING_TUN_READS         32
+
+#ifdef LISPD_IO_URING
+
+/*
+ * Set up the ring used by the main thread to read the tun and the data sockets. A -1 fd is
+ * not handled by the ring. The data sockets keep a multishot recvmsg posted, the tun a
+ * set of reads, all of them taking the buffers from rings provided to the kernel. The
+ * decapsulated packets are written to the tun through the ring as well.
+ * The remaining fds are processed by the reactor, whose epoll fd is polled by the ring.
+ * Returns BAD if the kernel doesn't support io_uring or provided buffer rings.
+ */
+int init_uring(
+        int     tun,
+        int     ipv4_data,
+        int     ipv6_data);
+
+void close_uring();
+
+/*
+ * Submit the pending requests and wait for at least one completion with a single syscall.
+ * Returns the number of completions, 0 if it has been interrupted by a signal.
+ */
+int uring_wait();
+
+/*
+ * Process the completions returned by the last uring_wait, including the fds of the reactor
+ */
+void uring_dispatch();
+
+/*
+ * Syscalls issued per packet forwarded
+ */
+void dump_uring_stats(int log_level);
+
+#endif
+
+#endif /* LISPD_URING_H_ */
+
+/*
+ * Editor modelines
+ *
+ * vi: set shiftwidth=4 tabstop=4 expandtab:
+ * :indentSize=4:tabSize=4:noTabs=true:
+ */
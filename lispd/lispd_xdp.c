@@ -0,0 +1,857 @@
+/*
+ * lispd_xdp.c
+ *
+ * This file is part of LISP Mobile Node Implementation.
+ * Reception of the LISP data packets of the RLOC interfaces through AF_XDP sockets.
+ *
+ * Copyright (C) 2012 Cisco Systems, Inc, 2012. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * Please send any bug reports or fixes you make to the email address(es):
+ *    LISP-MN developers <devel@lispmob.org>
+ *
+ */
+
+#include "lispd_xdp.h"
+
+#ifdef LISPD_XDP
+
+#include <dirent.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <linux/bpf.h>
+#include <linux/if_ether.h>
+#include <linux/if_link.h>
+#include <linux/if_xdp.h>
+#include "lispd_iface_list.h"
+#include "lispd_input.h"
+#include "lispd_lib.h"
+#include "lispd_log.h"
+#include "lispd_reactor.h"
+
+#ifndef AF_XDP
+#define AF_XDP      44
+#endif
+#ifndef SOL_XDP
+#define SOL_XDP     283
+#endif
+
+#define XDP_PROG_MAX_INSNS      64
+#define XDP_PROG_LOG_SIZE       65536
+
+/* Key of the map of RLOC addresses of the XDP program */
+typedef struct {
+    uint32_t    afi;
+    uint8_t     address[16];
+} xdp_local_key;
+
+typedef struct {
+    uint32_t    *producer;
+    uint32_t    *consumer;
+    void        *ring;
+    uint32_t    mask;
+    void        *map;
+    size_t      map_length;
+} xdp_ring;
+
+typedef struct {
+    int                 fd;
+    uint32_t            queue;
+    uint8_t             *umem;
+    xdp_ring            fill;
+    xdp_ring            completion;
+    xdp_ring            rx;
+    pthread_mutex_t     lock;           /* The socket is shared by the data plane threads */
+    uint64_t            wakeups;
+    uint64_t            packets;
+} xdp_socket;
+
+typedef struct xdp_iface_ {
+    char                name[IF_NAMESIZE];
+    int                 iface_index;
+    int                 generic;        /* TRUE if the program runs in skb mode */
+    int                 xsk_map_fd;
+    int                 prog_fd;
+    int                 link_fd;        /* Closing it detaches the program */
+    int                 num_sockets;
+    xdp_socket          *sockets;
+    struct xdp_iface_   *next;
+} xdp_iface;
+
+static xdp_iface    *xdp_ifaces         = NULL;
+static int          local_map_fd        = -1;
+
+
+int add_xdp_interface(char *iface_name)
+{
+    xdp_iface   *iface  = NULL;
+
+    if (strlen(iface_name) >= IF_NAMESIZE){
+        lispd_log_msg(LISP_LOG_ERR, "add_xdp_interface: Wrong interface name: %s", iface_name);
+        return (BAD);
+    }
+    for (iface = xdp_ifaces; iface != NULL; iface = iface->next){
+        if (strcmp(iface->name, iface_name) == 0){
+            return (GOOD);
+        }
+    }
+    if ((iface = (xdp_iface *)calloc(1, sizeof(xdp_iface))) == NULL){
+        lispd_log_msg(LISP_LOG_WARNING, "add_xdp_interface: Unable to allocate memory for xdp_iface: %s", strerror(errno));
+        return (ERR_MALLOC);
+    }
+    strcpy(iface->name, iface_name);
+    iface->xsk_map_fd = -1;
+    iface->prog_fd = -1;
+    iface->link_fd = -1;
+    iface->next = xdp_ifaces;
+    xdp_ifaces = iface;
+    return (GOOD);
+}
+
+
+static int sys_bpf(
+        int             cmd,
+        union bpf_attr  *attr)
+{
+    return (syscall(__NR_bpf, cmd, attr, sizeof(union bpf_attr)));
+}
+
+
+static int new_bpf_map(
+        uint32_t    type,
+        uint32_t    key_size,
+        uint32_t    value_size,
+        uint32_t    max_entries)
+{
+    union bpf_attr  attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.map_type = type;
+    attr.key_size = key_size;
+    attr.value_size = value_size;
+    attr.max_entries = max_entries;
+    return (sys_bpf(BPF_MAP_CREATE, &attr));
+}
+
+
+static int bpf_map_update(
+        int         map_fd,
+        void        *key,
+        void        *value)
+{
+    union bpf_attr  attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.map_fd = map_fd;
+    attr.key = (uint64_t)(unsigned long)key;
+    attr.value = (uint64_t)(unsigned long)value;
+    attr.flags = BPF_ANY;
+    return (sys_bpf(BPF_MAP_UPDATE_ELEM, &attr) == 0 ? GOOD : BAD);
+}
+
+
+/*
+ * Builder of the XDP program. Jumps to a label not yet emitted are recorded and
+ * patched once the label is known.
+ */
+
+typedef struct {
+    struct bpf_insn     insns[XDP_PROG_MAX_INSNS];
+    int                 len;
+} xdp_prog;
+
+static int xdp_emit(
+        xdp_prog    *prog,
+        uint8_t     code,
+        uint8_t     dst,
+        uint8_t     src,
+        int16_t     off,
+        int32_t     imm)
+{
+    struct bpf_insn     *insn   = &(prog->insns[prog->len]);
+
+    memset(insn, 0, sizeof(struct bpf_insn));
+    insn->code = code;
+    insn->dst_reg = dst;
+    insn->src_reg = src;
+    insn->off = off;
+    insn->imm = imm;
+    return (prog->len++);
+}
+
+
+static void xdp_emit_map_fd(
+        xdp_prog    *prog,
+        uint8_t     dst,
+        int         map_fd)
+{
+    xdp_emit(prog, BPF_LD | BPF_DW | BPF_IMM, dst, BPF_PSEUDO_MAP_FD, 0, map_fd);
+    xdp_emit(prog, 0, 0, 0, 0, 0);
+}
+
+
+static void xdp_patch_jumps(
+        xdp_prog    *prog,
+        int         *jumps,
+        int         num_jumps,
+        int         target)
+{
+    int     i   = 0;
+
+    for (i = 0; i < num_jumps; i++){
+        prog->insns[jumps[i]].off = target - jumps[i] - 1;
+    }
+}
+
+
+/*
+ * Program attached to the interface:
+ *
+ *   if the frame is an IPv4 (without options, not fragmented) or IPv6 UDP packet to
+ *   port 4341 and its destination is in the map of local addresses:
+ *       return bpf_redirect_map(xsk_map, ctx->rx_queue_index, XDP_PASS)
+ *   return XDP_PASS
+ *
+ * The key of the local address is built in the stack at r10 - 24.
+ */
+
+static int build_xdp_prog(
+        xdp_prog    *prog,
+        int         xsk_map_fd)
+{
+    int     pass_jumps[16];
+    int     num_pass    = 0;
+    int     ipv6_jump   = 0;
+    int     lookup_jump = 0;
+
+    memset(prog, 0, sizeof(xdp_prog));
+
+    xdp_emit(prog, BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_6, BPF_REG_1, 0, 0);
+    xdp_emit(prog, BPF_LDX | BPF_MEM | BPF_W, BPF_REG_2, BPF_REG_6, offsetof(struct xdp_md, data), 0);
+    xdp_emit(prog, BPF_LDX | BPF_MEM | BPF_W, BPF_REG_3, BPF_REG_6, offsetof(struct xdp_md, data_end), 0);
+
+    /* Ethernet */
+    xdp_emit(prog, BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_4, BPF_REG_2, 0, 0);
+    xdp_emit(prog, BPF_ALU64 | BPF_ADD | BPF_K, BPF_REG_4, 0, 0, ETH_HLEN);
+    pass_jumps[num_pass++] = xdp_emit(prog, BPF_JMP | BPF_JGT | BPF_X, BPF_REG_4, BPF_REG_3, 0, 0);
+    xdp_emit(prog, BPF_LDX | BPF_MEM | BPF_H, BPF_REG_5, BPF_REG_2, 12, 0);
+    ipv6_jump = xdp_emit(prog, BPF_JMP | BPF_JEQ | BPF_K, BPF_REG_5, 0, 0, htons(ETH_P_IPV6));
+    pass_jumps[num_pass++] = xdp_emit(prog, BPF_JMP | BPF_JNE | BPF_K, BPF_REG_5, 0, 0, htons(ETH_P_IP));
+
+    /* IPv4 */
+    xdp_emit(prog, BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_4, BPF_REG_2, 0, 0);
+    xdp_emit(prog, BPF_ALU64 | BPF_ADD | BPF_K, BPF_REG_4, 0, 0, ETH_HLEN + sizeof(struct iphdr) + sizeof(struct udphdr));
+    pass_jumps[num_pass++] = xdp_emit(prog, BPF_JMP | BPF_JGT | BPF_X, BPF_REG_4, BPF_REG_3, 0, 0);
+    xdp_emit(prog, BPF_LDX | BPF_MEM | BPF_B, BPF_REG_5, BPF_REG_2, ETH_HLEN, 0);
+    pass_jumps[num_pass++] = xdp_emit(prog, BPF_JMP | BPF_JNE | BPF_K, BPF_REG_5, 0, 0, 0x45);
+    xdp_emit(prog, BPF_LDX | BPF_MEM | BPF_B, BPF_REG_5, BPF_REG_2, ETH_HLEN + offsetof(struct iphdr, protocol), 0);
+    pass_jumps[num_pass++] = xdp_emit(prog, BPF_JMP | BPF_JNE | BPF_K, BPF_REG_5, 0, 0, IPPROTO_UDP);
+    xdp_emit(prog, BPF_LDX | BPF_MEM | BPF_H, BPF_REG_5, BPF_REG_2, ETH_HLEN + offsetof(struct iphdr, frag_off), 0);
+    xdp_emit(prog, BPF_ALU64 | BPF_AND | BPF_K, BPF_REG_5, 0, 0, htons(IP_MF | IP_OFFMASK));
+    pass_jumps[num_pass++] = xdp_emit(prog, BPF_JMP | BPF_JNE | BPF_K, BPF_REG_5, 0, 0, 0);
+    xdp_emit(prog, BPF_LDX | BPF_MEM | BPF_H, BPF_REG_5, BPF_REG_2,
+            ETH_HLEN + sizeof(struct iphdr) + offsetof(struct udphdr, dest), 0);
+    pass_jumps[num_pass++] = xdp_emit(prog, BPF_JMP | BPF_JNE | BPF_K, BPF_REG_5, 0, 0, htons(LISP_DATA_PORT));
+    xdp_emit(prog, BPF_ST | BPF_MEM | BPF_W, BPF_REG_10, 0, -24, AF_INET);
+    xdp_emit(prog, BPF_LDX | BPF_MEM | BPF_W, BPF_REG_5, BPF_REG_2, ETH_HLEN + offsetof(struct iphdr, daddr), 0);
+    xdp_emit(prog, BPF_STX | BPF_MEM | BPF_W, BPF_REG_10, BPF_REG_5, -20, 0);
+    xdp_emit(prog, BPF_ST | BPF_MEM | BPF_W, BPF_REG_10, 0, -16, 0);
+    xdp_emit(prog, BPF_ST | BPF_MEM | BPF_W, BPF_REG_10, 0, -12, 0);
+    xdp_emit(prog, BPF_ST | BPF_MEM | BPF_W, BPF_REG_10, 0, -8, 0);
+    lookup_jump = xdp_emit(prog, BPF_JMP | BPF_JA, 0, 0, 0, 0);
+
+    /* IPv6 */
+    prog->insns[ipv6_jump].off = prog->len - ipv6_jump - 1;
+    xdp_emit(prog, BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_4, BPF_REG_2, 0, 0);
+    xdp_emit(prog, BPF_ALU64 | BPF_ADD | BPF_K, BPF_REG_4, 0, 0, ETH_HLEN + sizeof(struct ip6_hdr) + sizeof(struct udphdr));
+    pass_jumps[num_pass++] = xdp_emit(prog, BPF_JMP | BPF_JGT | BPF_X, BPF_REG_4, BPF_REG_3, 0, 0);
+    xdp_emit(prog, BPF_LDX | BPF_MEM | BPF_B, BPF_REG_5, BPF_REG_2, ETH_HLEN + offsetof(struct ip6_hdr, ip6_nxt), 0);
+    pass_jumps[num_pass++] = xdp_emit(prog, BPF_JMP | BPF_JNE | BPF_K, BPF_REG_5, 0, 0, IPPROTO_UDP);
+    xdp_emit(prog, BPF_LDX | BPF_MEM | BPF_H, BPF_REG_5, BPF_REG_2,
+            ETH_HLEN + sizeof(struct ip6_hdr) + offsetof(struct udphdr, dest), 0);
+    pass_jumps[num_pass++] = xdp_emit(prog, BPF_JMP | BPF_JNE | BPF_K, BPF_REG_5, 0, 0, htons(LISP_DATA_PORT));
+    xdp_emit(prog, BPF_ST | BPF_MEM | BPF_W, BPF_REG_10, 0, -24, AF_INET6);
+    xdp_emit(prog, BPF_LDX | BPF_MEM | BPF_W, BPF_REG_5, BPF_REG_2, ETH_HLEN + offsetof(struct ip6_hdr, ip6_dst), 0);
+    xdp_emit(prog, BPF_STX | BPF_MEM | BPF_W, BPF_REG_10, BPF_REG_5, -20, 0);
+    xdp_emit(prog, BPF_LDX | BPF_MEM | BPF_W, BPF_REG_5, BPF_REG_2, ETH_HLEN + offsetof(struct ip6_hdr, ip6_dst) + 4, 0);
+    xdp_emit(prog, BPF_STX | BPF_MEM | BPF_W, BPF_REG_10, BPF_REG_5, -16, 0);
+    xdp_emit(prog, BPF_LDX | BPF_MEM | BPF_W, BPF_REG_5, BPF_REG_2, ETH_HLEN + offsetof(struct ip6_hdr, ip6_dst) + 8, 0);
+    xdp_emit(prog, BPF_STX | BPF_MEM | BPF_W, BPF_REG_10, BPF_REG_5, -12, 0);
+    xdp_emit(prog, BPF_LDX | BPF_MEM | BPF_W, BPF_REG_5, BPF_REG_2, ETH_HLEN + offsetof(struct ip6_hdr, ip6_dst) + 12, 0);
+    xdp_emit(prog, BPF_STX | BPF_MEM | BPF_W, BPF_REG_10, BPF_REG_5, -8, 0);
+
+    /* Lookup of the destination and redirection to the socket of the queue */
+    prog->insns[lookup_jump].off = prog->len - lookup_jump - 1;
+    xdp_emit_map_fd(prog, BPF_REG_1, local_map_fd);
+    xdp_emit(prog, BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_2, BPF_REG_10, 0, 0);
+    xdp_emit(prog, BPF_ALU64 | BPF_ADD | BPF_K, BPF_REG_2, 0, 0, -24);
+    xdp_emit(prog, BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_map_lookup_elem);
+    pass_jumps[num_pass++] = xdp_emit(prog, BPF_JMP | BPF_JEQ | BPF_K, BPF_REG_0, 0, 0, 0);
+    xdp_emit(prog, BPF_LDX | BPF_MEM | BPF_W, BPF_REG_2, BPF_REG_6, offsetof(struct xdp_md, rx_queue_index), 0);
+    xdp_emit_map_fd(prog, BPF_REG_1, xsk_map_fd);
+    xdp_emit(prog, BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_3, 0, 0, XDP_PASS);
+    xdp_emit(prog, BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_redirect_map);
+    xdp_emit(prog, BPF_JMP | BPF_EXIT, 0, 0, 0, 0);
+
+    /* Not a LISP data packet for this node */
+    xdp_patch_jumps(prog, pass_jumps, num_pass, prog->len);
+    xdp_emit(prog, BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_0, 0, 0, XDP_PASS);
+    xdp_emit(prog, BPF_JMP | BPF_EXIT, 0, 0, 0, 0);
+
+    return (prog->len);
+}
+
+
+static int load_xdp_prog(xdp_iface *iface)
+{
+    xdp_prog        prog;
+    union bpf_attr  attr;
+    char            *log_buf    = NULL;
+    int             fd          = -1;
+
+    build_xdp_prog(&prog, iface->xsk_map_fd);
+
+    log_buf = (char *)calloc(XDP_PROG_LOG_SIZE, sizeof(char));
+    memset(&attr, 0, sizeof(attr));
+    attr.prog_type = BPF_PROG_TYPE_XDP;
+    attr.insns = (uint64_t)(unsigned long)prog.insns;
+    attr.insn_cnt = prog.len;
+    attr.license = (uint64_t)(unsigned long)"GPL";
+    if (log_buf != NULL){
+        attr.log_buf = (uint64_t)(unsigned long)log_buf;
+        attr.log_size = XDP_PROG_LOG_SIZE;
+        attr.log_level = 1;
+    }
+    if ((fd = sys_bpf(BPF_PROG_LOAD, &attr)) == -1){
+        lispd_log_msg(LISP_LOG_ERR, "load_xdp_prog: Couldn't load the XDP program: %s", strerror(errno));
+        if (log_buf != NULL){
+            lispd_log_msg(LISP_LOG_DEBUG_1, "%s", log_buf);
+        }
+    }
+    free(log_buf);
+    return (fd);
+}
+
+
+/*
+ * Attach the program with a bpf link: the program is detached when lispd exits, even if
+ * it is killed. Native mode is tried first.
+ */
+
+static int attach_xdp_prog(xdp_iface *iface)
+{
+    union bpf_attr  attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.link_create.prog_fd = iface->prog_fd;
+    attr.link_create.target_ifindex = iface->iface_index;
+    attr.link_create.attach_type = BPF_XDP;
+    attr.link_create.flags = XDP_FLAGS_DRV_MODE;
+    if ((iface->link_fd = sys_bpf(BPF_LINK_CREATE, &attr)) != -1){
+        iface->generic = FALSE;
+        return (GOOD);
+    }
+    attr.link_create.flags = XDP_FLAGS_SKB_MODE;
+    if ((iface->link_fd = sys_bpf(BPF_LINK_CREATE, &attr)) != -1){
+        iface->generic = TRUE;
+        return (GOOD);
+    }
+    lispd_log_msg(LISP_LOG_ERR, "attach_xdp_prog: Couldn't attach the XDP program to %s: %s",
+            iface->name, strerror(errno));
+    return (BAD);
+}
+
+
+static int get_num_rx_queues(char *iface_name)
+{
+    char            path[128];
+    DIR             *dir        = NULL;
+    struct dirent   *entry      = NULL;
+    int             num_queues  = 0;
+
+    snprintf(path, sizeof(path), "/sys/class/net/%s/queues", iface_name);
+    if ((dir = opendir(path)) == NULL){
+        return (1);
+    }
+    while ((entry = readdir(dir)) != NULL){
+        if (strncmp(entry->d_name, "rx-", 3) == 0){
+            num_queues++;
+        }
+    }
+    closedir(dir);
+    if (num_queues < 1){
+        num_queues = 1;
+    }
+    if (num_queues > XDP_MAX_QUEUES){
+        num_queues = XDP_MAX_QUEUES;
+    }
+    return (num_queues);
+}
+
+
+static int map_xdp_ring(
+        xdp_ring                *ring,
+        int                     fd,
+        struct xdp_ring_offset  *off,
+        uint32_t                size,
+        size_t                  entry_size,
+        off_t                   pgoff)
+{
+    ring->map_length = off->desc + size * entry_size;
+    ring->map = mmap(NULL, ring->map_length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, pgoff);
+    if (ring->map == MAP_FAILED){
+        ring->map = NULL;
+        lispd_log_msg(LISP_LOG_ERR, "map_xdp_ring: mmap: %s", strerror(errno));
+        return (BAD);
+    }
+    ring->producer = (uint32_t *) CO(ring->map, off->producer);
+    ring->consumer = (uint32_t *) CO(ring->map, off->consumer);
+    ring->ring = CO(ring->map, off->desc);
+    ring->mask = size - 1;
+    return (GOOD);
+}
+
+
+static void close_xdp_socket(xdp_socket *xsk)
+{
+    xdp_ring    *rings[3]   = {&(xsk->fill), &(xsk->completion), &(xsk->rx)};
+    int         i           = 0;
+
+    for (i = 0; i < 3; i++){
+        if (rings[i]->map != NULL){
+            munmap(rings[i]->map, rings[i]->map_length);
+            rings[i]->map = NULL;
+        }
+    }
+    if (xsk->fd != -1){
+        close(xsk->fd);
+        xsk->fd = -1;
+    }
+    free(xsk->umem);
+    xsk->umem = NULL;
+}
+
+
+static int open_xdp_socket(
+        xdp_iface   *iface,
+        xdp_socket  *xsk)
+{
+    struct xdp_umem_reg     umem_reg;
+    struct xdp_mmap_offsets offsets;
+    struct sockaddr_xdp     sxdp;
+    socklen_t               len         = sizeof(offsets);
+    uint32_t                ring_size   = 0;
+    uint64_t                *fill       = NULL;
+    int                     i           = 0;
+
+    if (posix_memalign((void **)&(xsk->umem), getpagesize(), (size_t)XDP_NUM_FRAMES * XDP_FRAME_SIZE) != 0){
+        xsk->umem = NULL;
+        lispd_log_msg(LISP_LOG_ERR, "open_xdp_socket: Unable to allocate memory for the UMEM");
+        return (ERR_MALLOC);
+    }
+    if ((xsk->fd = socket(AF_XDP, SOCK_RAW, 0)) == -1){
+        lispd_log_msg(LISP_LOG_ERR, "open_xdp_socket: socket: %s", strerror(errno));
+        close_xdp_socket(xsk);
+        return (BAD);
+    }
+
+    memset(&umem_reg, 0, sizeof(umem_reg));
+    umem_reg.addr = (uint64_t)(unsigned long)xsk->umem;
+    umem_reg.len = (uint64_t)XDP_NUM_FRAMES * XDP_FRAME_SIZE;
+    umem_reg.chunk_size = XDP_FRAME_SIZE;
+    if (setsockopt(xsk->fd, SOL_XDP, XDP_UMEM_REG, &umem_reg, sizeof(umem_reg)) == -1){
+        lispd_log_msg(LISP_LOG_ERR, "open_xdp_socket: setsockopt XDP_UMEM_REG: %s", strerror(errno));
+        close_xdp_socket(xsk);
+        return (BAD);
+    }
+    ring_size = XDP_NUM_FRAMES;
+    setsockopt(xsk->fd, SOL_XDP, XDP_UMEM_FILL_RING, &ring_size, sizeof(ring_size));
+    ring_size = XDP_COMPLETION_RING_SIZE;
+    setsockopt(xsk->fd, SOL_XDP, XDP_UMEM_COMPLETION_RING, &ring_size, sizeof(ring_size));
+    ring_size = XDP_RX_RING_SIZE;
+    if (setsockopt(xsk->fd, SOL_XDP, XDP_RX_RING, &ring_size, sizeof(ring_size)) == -1 ||
+            getsockopt(xsk->fd, SOL_XDP, XDP_MMAP_OFFSETS, &offsets, &len) == -1){
+        lispd_log_msg(LISP_LOG_ERR, "open_xdp_socket: Couldn't create the rings: %s", strerror(errno));
+        close_xdp_socket(xsk);
+        return (BAD);
+    }
+
+    if (map_xdp_ring(&(xsk->fill), xsk->fd, &(offsets.fr), XDP_NUM_FRAMES,
+                sizeof(uint64_t), XDP_UMEM_PGOFF_FILL_RING) != GOOD ||
+            map_xdp_ring(&(xsk->completion), xsk->fd, &(offsets.cr), XDP_COMPLETION_RING_SIZE,
+                sizeof(uint64_t), XDP_UMEM_PGOFF_COMPLETION_RING) != GOOD ||
+            map_xdp_ring(&(xsk->rx), xsk->fd, &(offsets.rx), XDP_RX_RING_SIZE,
+                sizeof(struct xdp_desc), XDP_PGOFF_RX_RING) != GOOD){
+        close_xdp_socket(xsk);
+        return (BAD);
+    }
+
+    /* All the frames are given to the kernel */
+    fill = (uint64_t *)xsk->fill.ring;
+    for (i = 0; i < XDP_NUM_FRAMES; i++){
+        fill[i] = (uint64_t)i * XDP_FRAME_SIZE;
+    }
+    __atomic_store_n(xsk->fill.producer, XDP_NUM_FRAMES, __ATOMIC_RELEASE);
+
+    memset(&sxdp, 0, sizeof(sxdp));
+    sxdp.sxdp_family = AF_XDP;
+    sxdp.sxdp_ifindex = iface->iface_index;
+    sxdp.sxdp_queue_id = xsk->queue;
+    /* Zero copy is only possible in native mode */
+    sxdp.sxdp_flags = (iface->generic == TRUE) ? XDP_COPY : 0;
+    if (bind(xsk->fd, (struct sockaddr *)&sxdp, sizeof(sxdp)) == -1){
+        lispd_log_msg(LISP_LOG_ERR, "open_xdp_socket: bind to %s queue %u: %s",
+                iface->name, xsk->queue, strerror(errno));
+        close_xdp_socket(xsk);
+        return (BAD);
+    }
+    if (bpf_map_update(iface->xsk_map_fd, &(xsk->queue), &(xsk->fd)) != GOOD){
+        lispd_log_msg(LISP_LOG_ERR, "open_xdp_socket: Couldn't add the socket to the XSK map: %s", strerror(errno));
+        close_xdp_socket(xsk);
+        return (BAD);
+    }
+    return (GOOD);
+}
+
+
+static int init_xdp_iface(xdp_iface *iface)
+{
+    int     num_queues  = 0;
+    int     i           = 0;
+
+    if ((iface->iface_index = if_nametoindex(iface->name)) == 0){
+        lispd_log_msg(LISP_LOG_ERR, "init_xdp_iface: Interface %s doesn't exist", iface->name);
+        return (BAD);
+    }
+    if (get_interface(iface->name) == NULL){
+        lispd_log_msg(LISP_LOG_WARNING, "init_xdp_iface: %s is not an RLOC interface. Only packets to "
+                "RLOC addresses are received through AF_XDP", iface->name);
+    }
+    num_queues = get_num_rx_queues(iface->name);
+
+    if ((iface->xsk_map_fd = new_bpf_map(BPF_MAP_TYPE_XSKMAP, sizeof(uint32_t), sizeof(uint32_t), num_queues)) == -1){
+        lispd_log_msg(LISP_LOG_ERR, "init_xdp_iface: Couldn't create the XSK map: %s", strerror(errno));
+        return (BAD);
+    }
+    if ((iface->prog_fd = load_xdp_prog(iface)) == -1 || attach_xdp_prog(iface) != GOOD){
+        return (BAD);
+    }
+
+    if ((iface->sockets = (xdp_socket *)calloc(num_queues, sizeof(xdp_socket))) == NULL){
+        lispd_log_msg(LISP_LOG_ERR, "init_xdp_iface: Unable to allocate memory for the sockets: %s", strerror(errno));
+        return (ERR_MALLOC);
+    }
+    for (i = 0; i < num_queues; i++){
+        iface->sockets[i].fd = -1;
+        iface->sockets[i].queue = i;
+        pthread_mutex_init(&(iface->sockets[i].lock), NULL);
+        if (open_xdp_socket(iface, &(iface->sockets[i])) != GOOD){
+            return (BAD);
+        }
+        iface->num_sockets++;
+    }
+
+    lispd_log_msg(LISP_LOG_INFO, "Receiving LISP data packets of %s through %d AF_XDP sockets (%s mode)",
+            iface->name, iface->num_sockets, (iface->generic == TRUE) ? "generic" : "native");
+    return (GOOD);
+}
+
+
+int init_xdp()
+{
+    xdp_iface       *iface  = NULL;
+    struct rlimit   rlim    = {RLIM_INFINITY, RLIM_INFINITY};
+
+    if (xdp_ifaces == NULL){
+        return (GOOD);
+    }
+    /* Old kernels charge the bpf maps to the locked memory limit */
+    setrlimit(RLIMIT_MEMLOCK, &rlim);
+
+    if ((local_map_fd = new_bpf_map(BPF_MAP_TYPE_HASH, sizeof(xdp_local_key), sizeof(uint32_t),
+            XDP_MAX_LOCAL_ADDRESSES)) == -1){
+        lispd_log_msg(LISP_LOG_CRIT, "init_xdp: Couldn't create the map of local addresses: %s", strerror(errno));
+        return (BAD);
+    }
+    xdp_update_local_addresses();
+
+    for (iface = xdp_ifaces; iface != NULL; iface = iface->next){
+        if (init_xdp_iface(iface) != GOOD){
+            lispd_log_msg(LISP_LOG_CRIT, "init_xdp: Couldn't use AF_XDP in %s", iface->name);
+            return (BAD);
+        }
+    }
+    return (GOOD);
+}
+
+
+void close_xdp()
+{
+    xdp_iface   *iface  = NULL;
+    int         i       = 0;
+
+    while (xdp_ifaces != NULL){
+        iface = xdp_ifaces;
+        xdp_ifaces = iface->next;
+        if (iface->link_fd != -1){
+            close(iface->link_fd);
+        }
+        for (i = 0; i < iface->num_sockets; i++){
+            close_xdp_socket(&(iface->sockets[i]));
+        }
+        free(iface->sockets);
+        if (iface->prog_fd != -1){
+            close(iface->prog_fd);
+        }
+        if (iface->xsk_map_fd != -1){
+            close(iface->xsk_map_fd);
+        }
+        free(iface);
+    }
+    if (local_map_fd != -1){
+        close(local_map_fd);
+        local_map_fd = -1;
+    }
+}
+
+
+static void lisp_addr_to_xdp_key(
+        lisp_addr_t     *addr,
+        xdp_local_key   *key)
+{
+    memset(key, 0, sizeof(xdp_local_key));
+    key->afi = addr->afi;
+    if (addr->afi == AF_INET){
+        memcpy(key->address, &(addr->address.ip), sizeof(struct in_addr));
+    }else{
+        memcpy(key->address, &(addr->address.ipv6), sizeof(struct in6_addr));
+    }
+}
+
+
+void xdp_update_local_addresses()
+{
+    lispd_iface_list_elt    *iface_list = NULL;
+    lisp_addr_t             *addrs[2]   = {NULL, NULL};
+    lisp_addr_t             addr;
+    xdp_local_key           keys[XDP_MAX_LOCAL_ADDRESSES];
+    xdp_local_key           key;
+    union bpf_attr          attr;
+    uint32_t                value       = 1;
+    int                     num_keys    = 0;
+    int                     i           = 0;
+
+    if (local_map_fd == -1){
+        return;
+    }
+
+    /* Remove the addresses no longer assigned to an interface */
+    memset(&attr, 0, sizeof(attr));
+    attr.map_fd = local_map_fd;
+    attr.key = 0;
+    attr.next_key = (uint64_t)(unsigned long)&(keys[0]);
+    while (num_keys < XDP_MAX_LOCAL_ADDRESSES && sys_bpf(BPF_MAP_GET_NEXT_KEY, &attr) == 0){
+        attr.key = (uint64_t)(unsigned long)&(keys[num_keys]);
+        num_keys++;
+        if (num_keys < XDP_MAX_LOCAL_ADDRESSES){
+            attr.next_key = (uint64_t)(unsigned long)&(keys[num_keys]);
+        }
+    }
+    for (i = 0; i < num_keys; i++){
+        memset(&addr, 0, sizeof(lisp_addr_t));
+        addr.afi = keys[i].afi;
+        memcpy(&(addr.address), keys[i].address,
+                (addr.afi == AF_INET) ? sizeof(struct in_addr) : sizeof(struct in6_addr));
+        if (get_interface_with_address(&addr) != NULL){
+            continue;
+        }
+        memset(&attr, 0, sizeof(attr));
+        attr.map_fd = local_map_fd;
+        attr.key = (uint64_t)(unsigned long)&(keys[i]);
+        sys_bpf(BPF_MAP_DELETE_ELEM, &attr);
+    }
+
+    for (iface_list = get_head_interface_list(); iface_list != NULL; iface_list = iface_list->next){
+        addrs[0] = iface_list->iface->ipv4_address;
+        addrs[1] = iface_list->iface->ipv6_address;
+        for (i = 0; i < 2; i++){
+            if (addrs[i] == NULL || addrs[i]->afi == AF_UNSPEC){
+                continue;
+            }
+            lisp_addr_to_xdp_key(addrs[i], &key);
+            if (bpf_map_update(local_map_fd, &key, &value) != GOOD){
+                lispd_log_msg(LISP_LOG_WARNING, "xdp_update_local_addresses: Couldn't add %s to the XDP programs: %s",
+                        get_char_from_lisp_addr_t(*addrs[i]), strerror(errno));
+            }
+        }
+    }
+}
+
+
+int get_xdp_max_fd()
+{
+    xdp_iface   *iface  = NULL;
+    int         max_fd  = -1;
+    int         i       = 0;
+
+    for (iface = xdp_ifaces; iface != NULL; iface = iface->next){
+        for (i = 0; i < iface->num_sockets; i++){
+            max_fd = (max_fd > iface->sockets[i].fd) ? max_fd : iface->sockets[i].fd;
+        }
+    }
+    return (max_fd);
+}
+
+
+void xdp_fd_set(
+        fd_set  *readfds,
+        int     thread,
+        int     num_threads)
+{
+    xdp_iface   *iface  = NULL;
+    int         index   = 0;
+    int         i       = 0;
+
+    for (iface = xdp_ifaces; iface != NULL; iface = iface->next){
+        for (i = 0; i < iface->num_sockets; i++, index++){
+            if (index % num_threads == thread){
+                FD_SET(iface->sockets[i].fd, readfds);
+            }
+        }
+    }
+}
+
+
+/*
+ * Decapsulate the frames of the rx ring and return them to the fill ring. The fill ring
+ * can hold all the frames of the UMEM, so there is always room for the returned frames.
+ */
+
+static void process_xdp_socket(xdp_socket *xsk)
+{
+    struct xdp_desc     *descs      = (struct xdp_desc *)xsk->rx.ring;
+    struct xdp_desc     *desc       = NULL;
+    uint64_t            *fill       = (uint64_t *)xsk->fill.ring;
+    uint32_t            rx_cons     = 0;
+    uint32_t            rx_prod     = 0;
+    uint32_t            fill_prod   = 0;
+    uint32_t            num         = 0;
+    uint32_t            i           = 0;
+
+    if (pthread_mutex_trylock(&(xsk->lock)) != 0){
+        return;
+    }
+    rx_cons = *(xsk->rx.consumer);
+    rx_prod = __atomic_load_n(xsk->rx.producer, __ATOMIC_ACQUIRE);
+    fill_prod = *(xsk->fill.producer);
+    num = rx_prod - rx_cons;
+
+    for (i = 0; i < num; i++){
+        desc = &(descs[(rx_cons + i) & xsk->rx.mask]);
+        if (desc->len > ETH_HLEN){
+            process_input_frame(CO(xsk->umem, desc->addr + ETH_HLEN), desc->len - ETH_HLEN);
+        }
+        fill[(fill_prod + i) & xsk->fill.mask] = desc->addr;
+    }
+    __atomic_store_n(xsk->rx.consumer, rx_cons + num, __ATOMIC_RELEASE);
+    __atomic_store_n(xsk->fill.producer, fill_prod + num, __ATOMIC_RELEASE);
+
+    xsk->wakeups++;
+    xsk->packets += num;
+    pthread_mutex_unlock(&(xsk->lock));
+}
+
+
+void process_xdp_sockets(fd_set *readfds)
+{
+    xdp_iface   *iface  = NULL;
+    int         i       = 0;
+
+    for (iface = xdp_ifaces; iface != NULL; iface = iface->next){
+        for (i = 0; i < iface->num_sockets; i++){
+            if (FD_ISSET(iface->sockets[i].fd, readfds)){
+                process_xdp_socket(&(iface->sockets[i]));
+            }
+        }
+    }
+}
+
+
+static void xdp_socket_callback(int fd, void *ctx)
+{
+    process_xdp_socket((xdp_socket *)ctx);
+}
+
+
+int reactor_add_xdp_sockets()
+{
+    xdp_iface   *iface  = NULL;
+    char        name[IFNAMSIZ + 20];    /* "AF_XDP " + interface + "/" + queue */
+    int         i       = 0;
+
+    for (iface = xdp_ifaces; iface != NULL; iface = iface->next){
+        for (i = 0; i < iface->num_sockets; i++){
+            snprintf(name, sizeof(name), "AF_XDP %s/%d", iface->name, i);
+            if (reactor_add_fd(iface->sockets[i].fd, REACTOR_READ, xdp_socket_callback,
+                    &(iface->sockets[i]), name) != GOOD){
+                return (BAD);
+            }
+        }
+    }
+    return (GOOD);
+}
+
+
+void dump_xdp_stats(int log_level)
+{
+    xdp_iface               *iface  = NULL;
+    xdp_socket              *xsk    = NULL;
+    struct xdp_statistics   stats;
+    socklen_t               len     = 0;
+    int                     i       = 0;
+
+    if (is_loggable(log_level) == FALSE){
+        return;
+    }
+    for (iface = xdp_ifaces; iface != NULL; iface = iface->next){
+        for (i = 0; i < iface->num_sockets; i++){
+            xsk = &(iface->sockets[i]);
+            memset(&stats, 0, sizeof(stats));
+            len = sizeof(stats);
+            getsockopt(xsk->fd, SOL_XDP, XDP_STATISTICS, &stats, &len);
+            lispd_log_msg(log_level, "AF_XDP %s queue %u: wakeups: %llu   packets: %llu   dropped: %llu   "
+                    "rx ring full: %llu   fill ring empty: %llu",
+                    iface->name, xsk->queue,
+                    (unsigned long long)xsk->wakeups,
+                    (unsigned long long)xsk->packets,
+                    (unsigned long long)stats.rx_dropped,
+                    (unsigned long long)stats.rx_ring_full,
+                    (unsigned long long)stats.rx_fill_ring_empty_descs);
+        }
+    }
+}
+
+#endif
+
+/*
+ * Editor modelines
+ *
+ * vi: set shiftwidth=4 tabstop=4 expandtab:
+ * :indentSize=4:tabSize=4:noTabs=true:
+ */
@@ -0,0 +1,112 @@
+/*
+ * lispd_xdp.h
+ *
+ * This file is part of LISP Mobile Node Implementation.
+ * Reception of the LISP data packets of the RLOC interfaces through AF_XDP sockets.
+ *
+ * Copyright (C) 2012 Cisco Systems, Inc, 2012. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * Please send any bug reports or fixes you make to the email address(es):
+ *    LISP-MN developers <devel@lispmob.org>
+ *
+ */
+
+#ifndef LISPD_XDP_H_
+#define LISPD_XDP_H_
+
+#include <sys/select.h>
+#include "lispd.h"
+
+/* AF_XDP and the bpf syscall are not available in bionic */
+#if !defined(ANDROID) && !defined(VPNAPI)
+#define LISPD_XDP
+#endif
+
+#define XDP_FRAME_SIZE              2048
+/* Frames of the UMEM of each queue. All of them fit in the fill ring */
+#define XDP_NUM_FRAMES              2048
+#define XDP_RX_RING_SIZE            1024
+/* The completion ring is mandatory even if nothing is transmitted */
+#define XDP_COMPLETION_RING_SIZE    64
+#define XDP_MAX_QUEUES              64
+/* RLOC addresses accepted by the XDP program */
+#define XDP_MAX_LOCAL_ADDRESSES     64
+
+#ifdef LISPD_XDP
+
+/*
+ * Add an interface to the list of interfaces whose LISP data packets are received through
+ * AF_XDP. Called while processing the configuration.
+ */
+int add_xdp_interface(char *iface_name);
+
+/*
+ * Load the XDP program on each configured interface and open one AF_XDP socket per
+ * rx queue. The program redirects the UDP 4341 packets addressed to an RLOC of the node
+ * to the socket of the queue; all the other packets continue to the kernel stack.
+ * Native mode is used if the driver supports it, generic (skb) mode otherwise.
+ */
+int init_xdp();
+
+/*
+ * Detach the programs and close the sockets
+ */
+void close_xdp();
+
+/*
+ * Synchronize the addresses accepted by the XDP programs with the addresses of the
+ * interfaces. Called each time the address of an interface changes.
+ */
+void xdp_update_local_addresses();
+
+/*
+ * Returns the highest AF_XDP socket or -1 if AF_XDP is not used
+ */
+int get_xdp_max_fd();
+
+/*
+ * Add to readfds the AF_XDP sockets processed by a data plane thread: the sockets of all the
+ * interfaces are distributed among the threads.
+ */
+void xdp_fd_set(
+        fd_set  *readfds,
+        int     thread,
+        int     num_threads);
+
+/*
+ * Register the AF_XDP sockets in the event loop of the main thread
+ */
+int reactor_add_xdp_sockets();
+
+/*
+ * Decapsulate the packets of the sockets in readfds. A socket being processed by another
+ * thread is skipped.
+ */
+void process_xdp_sockets(fd_set *readfds);
+
+void dump_xdp_stats(int log_level);
+
+#endif
+
+#endif /* LISPD_XDP_H_ */
+
+/*
+ * Editor modelines
+ *
+ * vi: set shiftwidth=4 tabstop=4 expandtab:
+ * :indentSize=4:tabSize=4:noTabs=true:
+ */
@@ -0,0 +1,145 @@
+#!/bin/sh
+#
+# engine_bench.sh
+#
+# Compares the packet I/O engines of the main thread of lispd (io-engine = "epoll" and
+# "io_uring") on the decapsulation path. For each engine lispd is started in a network
+# namespace with a veth pair, and engine_blast sends it LISP data packets through the peer of
+# its RLOC interface. Prints the packets per second written to the tun and the syscalls of
+# lispd per packet, counted with the raw_syscalls tracepoint in a second run (the tracing
+# slows lispd down). Both engines use the same sockets: no rx ring and no data plane threads.
+#
+# Run as root from tests/ after building lispd and engine_blast (make engines).
+#
+# Usage: engine_bench.sh [seconds]
+
+SECONDS_RUN=${1:-5}
+LISPD=../lispd/lispd
+NETNS=lispd_bench
+RLOC=192.0.2.1
+PEER_RLOC=192.0.2.2
+GATEWAY=192.0.2.254
+MAP_SERVER=192.0.2.100
+EID=10.10.10.1
+TUN=lispTun0
+CONF=$(mktemp /tmp/engine_bench.XXXXXX)
+LOG=$(mktemp /tmp/engine_bench_log.XXXXXX)
+TRACING=/sys/kernel/tracing
+SYS_ENTER=$TRACING/events/raw_syscalls/sys_enter
+
+if [ ! -x $LISPD ] || [ ! -x ./engine_blast ]; then
+    echo "Build lispd and engine_blast first" >&2
+    exit 1
+fi
+if [ ! -d $TRACING/events ]; then
+    mount -t tracefs nodev $TRACING || exit 1
+fi
+
+cleanup() {
+    ip netns pids $NETNS 2>/dev/null | xargs -r kill
+    echo 0 > $SYS_ENTER/enable
+    echo 0 > $SYS_ENTER/filter
+    ip netns del $NETNS 2>/dev/null
+    rm -f $CONF $LOG
+}
+trap cleanup EXIT
+
+# The gateway and the Map-Server only need a neighbour entry: nothing answers
+setup_netns() {
+    ip netns del $NETNS 2>/dev/null
+    ip netns add $NETNS
+    ip netns exec $NETNS sh -c "
+        ip link add va type veth peer name vb
+        ip addr add $RLOC/24 dev va
+        ip link set va up
+        ip link set vb up
+        ip link set lo up
+        ip route add default via $GATEWAY dev va
+        ip neigh add $GATEWAY lladdr 02:00:00:00:00:03 dev va
+        ip neigh add $MAP_SERVER lladdr 02:00:00:00:00:03 dev va"
+}
+
+write_conf() {
+    cat > $CONF <<EOF
+debug = 0
+map-resolver = {$MAP_SERVER}
+map-server {
+    address     = $MAP_SERVER
+    key-type    = 1
+    key         = secret
+    proxy-reply = on
+}
+database-mapping {
+    eid-prefix  = $EID/32
+    iid         = 0
+    interface   = va
+    priority_v4 = 1
+    weight_v4   = 100
+    priority_v6 = -1
+    weight_v6   = 100
+}
+data-plane {
+    data-plane-threads  = 0
+    rx-ring-size        = 0
+    io-engine           = "$1"
+}
+EOF
+}
+
+tun_rx_packets() {
+    ip netns exec $NETNS cat /sys/class/net/$TUN/statistics/rx_packets
+}
+
+blast() {
+    ip netns exec $NETNS ./engine_blast vb va $PEER_RLOC $RLOC $EID $SECONDS_RUN
+}
+
+# Events recorded by the tracepoint in all the CPUs, including the lost ones
+traced_syscalls() {
+    cat $TRACING/per_cpu/cpu*/stats | awk '/^entries/{n += $2} /^overrun/{n += $2} END{print n}'
+}
+
+run_engine() {
+    setup_netns
+    write_conf $1
+    ip netns exec $NETNS $LISPD -f $CONF > $LOG 2>&1 &
+    # lispd is ready once it has created the tun
+    i=0
+    while ! ip netns exec $NETNS test -e /sys/class/net/$TUN; do
+        i=$((i + 1))
+        if [ $i -gt 60 ] || ! kill -0 $! 2>/dev/null; then
+            echo "$1: lispd didn't start" >&2
+            cat $LOG >&2
+            exit 1
+        fi
+        sleep 1
+    done
+    sleep 2
+    pid=$(ip netns pids $NETNS)
+
+    rx=$(tun_rx_packets)
+    blast > /dev/null
+    packets=$(($(tun_rx_packets) - rx))
+
+    echo "common_pid == $pid" > $SYS_ENTER/filter
+    echo > $TRACING/trace
+    echo 1 > $SYS_ENTER/enable
+    rx=$(tun_rx_packets)
+    blast > /dev/null
+    traced_packets=$(($(tun_rx_packets) - rx))
+    echo 0 > $SYS_ENTER/enable
+    syscalls=$(traced_syscalls)
+
+    kill $pid
+    wait
+    if [ $packets -eq 0 ] || [ $traced_packets -eq 0 ]; then
+        echo "$1: no packet decapsulated" >&2
+        exit 1
+    fi
+    awk -v engine=$1 -v p=$packets -v s=$SECONDS_RUN -v sc=$syscalls -v tp=$traced_packets \
+        'BEGIN{printf "%-10s %12.0f %16.3f\n", engine, p / s, sc / tp}'
+}
+
+printf "%-10s %12s %16s\n" "engine" "pps" "syscalls/packet"
+run_engine epoll
+run_engine io_uring
@@ -0,0 +1,195 @@
+/*
+ * engine_blast.c
+ *
+ * Packet generator of engine_bench.sh. Sends IPv4 LISP data packets through a packet socket of
+ * an interface, in batches of sendmmsg, for the given number of seconds. The inner packets are
+ * UDP packets of FLOWS different flows and each flow has its own outer source port. The
+ * destination MAC is the one of the peer interface (the other end of a veth pair). Prints the
+ * number of packets sent.
+ *
+ * Usage: engine_blast <interface> <peer interface> <source RLOC> <destination RLOC>
+ *                     <destination EID> [seconds]
+ */
+
+#define _GNU_SOURCE
+
+#include <arpa/inet.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <net/if.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#include "test_stubs.h"
+
+#define FLOWS               256
+#define BATCH               64
+#define INNER_PAYLOAD       64
+#define INNER_SRC_EID       "10.20.0.5"
+#define INNER_DST_PORT      2000
+#define OUTER_SRC_PORT      49152
+#define LISP_DATA_PORT      4341
+#define LISP_HDR_LEN        8
+#define FRAME_LEN           (ETH_HLEN + 20 + 8 + LISP_HDR_LEN + 20 + 8 + INNER_PAYLOAD)
+#define DEFAULT_SECONDS     5
+
+static uint16_t checksum(
+        uint8_t     *buffer,
+        int         length)
+{
+    uint32_t    sum = 0;
+    int         i   = 0;
+
+    for (i = 0; i < length; i += 2){
+        sum += (buffer[i] << 8) | buffer[i + 1];
+    }
+    while (sum >> 16){
+        sum = (sum & 0xffff) + (sum >> 16);
+    }
+    return (~sum);
+}
+
+static int read_mac(
+        char        *interface,
+        uint8_t     *mac)
+{
+    char        path[64];
+    FILE        *file       = NULL;
+    unsigned    bytes[6];
+    int         i           = 0;
+
+    snprintf(path, sizeof(path), "/sys/class/net/%s/address", interface);
+    if ((file = fopen(path, "r")) == NULL){
+        perror(path);
+        return (-1);
+    }
+    if (fscanf(file, "%x:%x:%x:%x:%x:%x", &bytes[0], &bytes[1], &bytes[2], &bytes[3], &bytes[4], &bytes[5]) != 6){
+        fclose(file);
+        return (-1);
+    }
+    fclose(file);
+    for (i = 0; i < 6; i++){
+        mac[i] = bytes[i];
+    }
+    return (0);
+}
+
+/* IPv4 header of a UDP packet of length bytes */
+static void fill_ip_header(
+        uint8_t     *header,
+        int         length,
+        in_addr_t   src,
+        in_addr_t   dst)
+{
+    uint16_t    sum     = 0;
+
+    memset(header, 0, 20);
+    header[0] = 0x45;
+    header[2] = length >> 8;
+    header[3] = length & 0xff;
+    header[8] = 64;
+    header[9] = IPPROTO_UDP;
+    memcpy(header + 12, &src, 4);
+    memcpy(header + 16, &dst, 4);
+    sum = checksum(header, 20);
+    header[10] = sum >> 8;
+    header[11] = sum & 0xff;
+}
+
+/* UDP header without checksum */
+static void fill_udp_header(
+        uint8_t     *header,
+        int         src_port,
+        int         dst_port,
+        int         length)
+{
+    header[0] = src_port >> 8;
+    header[1] = src_port & 0xff;
+    header[2] = dst_port >> 8;
+    header[3] = dst_port & 0xff;
+    header[4] = length >> 8;
+    header[5] = length & 0xff;
+    header[6] = 0;
+    header[7] = 0;
+}
+
+int main(int argc, char **argv)
+{
+    static uint8_t      frames[FLOWS][FRAME_LEN];
+    struct mmsghdr      msgs[BATCH];
+    struct iovec        iov[BATCH];
+    struct sockaddr_ll  sll;
+    struct timespec     start;
+    struct timespec     now;
+    uint8_t             *frame      = NULL;
+    uint8_t             *lisp_hdr   = NULL;
+    unsigned long       sent        = 0;
+    double              seconds     = DEFAULT_SECONDS;
+    int                 sock        = -1;
+    int                 sent_batch  = 0;
+    int                 flow        = 0;
+    int                 i           = 0;
+
+    if (argc < 6){
+        fprintf(stderr, "Usage: %s <interface> <peer interface> <source RLOC> <destination RLOC> "
+                "<destination EID> [seconds]\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    if (argc > 6){
+        seconds = atof(argv[6]);
+    }
+
+    for (flow = 0; flow < FLOWS; flow++){
+        frame = frames[flow];
+        if (read_mac(argv[2], frame) != 0 || read_mac(argv[1], frame + ETH_ALEN) != 0){
+            exit(EXIT_FAILURE);
+        }
+        frame[12] = ETH_P_IP >> 8;
+        frame[13] = ETH_P_IP & 0xff;
+        fill_ip_header(frame + ETH_HLEN, FRAME_LEN - ETH_HLEN, inet_addr(argv[3]), inet_addr(argv[4]));
+        fill_udp_header(frame + ETH_HLEN + 20, OUTER_SRC_PORT + flow, LISP_DATA_PORT, FRAME_LEN - ETH_HLEN - 20);
+        /* LISP header with the N bit set: no Instance ID */
+        lisp_hdr = frame + ETH_HLEN + 28;
+        memset(lisp_hdr, 0, LISP_HDR_LEN);
+        lisp_hdr[0] = 0x80;
+        fill_ip_header(lisp_hdr + LISP_HDR_LEN, 28 + INNER_PAYLOAD, inet_addr(INNER_SRC_EID), inet_addr(argv[5]));
+        fill_udp_header(lisp_hdr + LISP_HDR_LEN + 20, 1000 + flow, INNER_DST_PORT, 8 + INNER_PAYLOAD);
+    }
+
+    if ((sock = socket(AF_PACKET, SOCK_RAW, 0)) == -1){
+        perror("socket");
+        exit(EXIT_FAILURE);
+    }
+    memset(&sll, 0, sizeof(sll));
+    sll.sll_family = AF_PACKET;
+    sll.sll_ifindex = if_nametoindex(argv[1]);
+    if (bind(sock, (struct sockaddr *)&sll, sizeof(sll)) == -1){
+        perror("bind");
+        exit(EXIT_FAILURE);
+    }
+
+    memset(msgs, 0, sizeof(msgs));
+    for (i = 0; i < BATCH; i++){
+        iov[i].iov_len = FRAME_LEN;
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    flow = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    do {
+        for (i = 0; i < BATCH; i++){
+            iov[i].iov_base = frames[flow];
+            flow = (flow + 1) % FLOWS;
+        }
+        if ((sent_batch = sendmmsg(sock, msgs, BATCH, 0)) > 0){
+            sent += sent_batch;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &now);
+    } while (elapsed_ns(&start, &now) < seconds * 1e9);
+
+    printf("%lu\n", sent);
+    return (EXIT_SUCCESS);
+}
@@ -0,0 +1,209 @@
+/*
+ * epoch_stress.c
+ *
+ * Stress test of the epoch based reclamation used by the data plane threads of lispd
+ * (lispd_epoch.c). Reader threads look up random addresses in a multibit trie (lispd_lpm.c)
+ * and read a published balancing vector while the main thread churns them: prefixes are
+ * inserted and removed and the vector is replaced. Removed objects are poisoned before being
+ * freed: a reader finding a poisoned object or an inconsistent vector reports a violation.
+ *
+ * Usage: epoch_stress [readers] [seconds]
+ * Build with -fsanitize=address to detect the accesses to released memory too.
+ */
+
+#include <pthread.h>
+#include <time.h>
+
+#include "lispd_epoch.h"
+#include "lispd_lpm.h"
+#include "patricia/patricia.h"
+#include "test_stubs.h"
+
+#define DEFAULT_READERS     4
+#define DEFAULT_SECONDS     10
+#define NUM_PREFIXES        4096
+#define OBJECT_MAGIC        0x4c495350
+#define OBJECT_POISON       0xdeaddead
+
+typedef struct {
+    uint32_t    magic;
+    int         length;
+} test_object;
+
+/* Equivalent of a balancing_locators_vecs: every position contains the length */
+typedef struct {
+    int         length;
+    int         *vec;
+} test_vector;
+
+static lpm_table            *table          = NULL;
+static test_vector          *vector         = NULL;
+static volatile int         running         = TRUE;
+static uint64_t             violations      = 0;
+
+static void release_object(test_object *object)
+{
+    object->magic = OBJECT_POISON;
+    free(object);
+}
+
+static void release_vector(test_vector *old)
+{
+    int     i   = 0;
+
+    for (i = 0; i < old->length; i++){
+        old->vec[i] = -1;
+    }
+    old->length = -1;
+    free(old->vec);
+    free(old);
+}
+
+static test_vector *new_vector(int length)
+{
+    test_vector *new    = malloc(sizeof(test_vector));
+    int         i       = 0;
+
+    new->length = length;
+    new->vec = malloc(length * sizeof(int));
+    for (i = 0; i < length; i++){
+        new->vec[i] = length;
+    }
+    return (new);
+}
+
+static void *reader_loop(void *arg)
+{
+    int             reader      = (int)(long)arg;
+    unsigned int    seed        = reader;
+    uint64_t        lookups     = 0;
+    test_object     *object     = NULL;
+    test_vector     *current    = NULL;
+    struct in_addr  address;
+    int             length      = 0;
+    int             i           = 0;
+
+    while (running == TRUE){
+        epoch_enter(reader);
+        /* A batch of packets */
+        for (i = 0; i < 64; i++){
+            address.s_addr = htonl(0x0a000000 | (rand_r(&seed) & 0xffffff));
+            object = (test_object *)lpm_lookup(table, &address);
+            if (object != NULL && (object->magic != OBJECT_MAGIC || object->length < 8)){
+                __sync_fetch_and_add(&violations, 1);
+            }
+            current = __atomic_load_n(&vector, __ATOMIC_ACQUIRE);
+            length = current->length;
+            if (length <= 0 || current->vec[rand_r(&seed) % length] != length){
+                __sync_fetch_and_add(&violations, 1);
+            }
+            lookups++;
+        }
+        epoch_exit(reader);
+    }
+    return ((void *)(long)lookups);
+}
+
+int main(int argc, char **argv)
+{
+    patricia_tree_t     *tree           = New_Patricia(32);
+    patricia_node_t     *node           = NULL;
+    patricia_node_t     *cover          = NULL;
+    patricia_node_t     **nodes         = NULL;
+    prefix_t            *prefix         = NULL;
+    prefix_t            removed;
+    test_object         *object         = NULL;
+    test_vector         *old            = NULL;
+    pthread_t           *threads        = NULL;
+    struct in_addr      address;
+    time_t              end             = 0;
+    uint64_t            changes         = 0;
+    uint64_t            lookups         = 0;
+    void                *result         = NULL;
+    int                 num_readers     = DEFAULT_READERS;
+    int                 seconds         = DEFAULT_SECONDS;
+    int                 length          = 0;
+    int                 pos             = 0;
+    int                 i               = 0;
+
+    if (argc > 1) {
+        num_readers = atoi(argv[1]);
+    }
+    if (argc > 2) {
+        seconds = atoi(argv[2]);
+    }
+    table = new_lpm_table(32, 16);
+    vector = new_vector(1);
+    nodes = calloc(NUM_PREFIXES, sizeof(patricia_node_t *));
+    threads = calloc(num_readers, sizeof(pthread_t));
+    if (init_epoch(num_readers) != GOOD){
+        exit(EXIT_FAILURE);
+    }
+    for (i = 0; i < num_readers; i++){
+        pthread_create(&threads[i], NULL, reader_loop, (void *)(long)i);
+    }
+
+    srand(time(NULL));
+    end = time(NULL) + seconds;
+    while (time(NULL) < end){
+        /* Insert or remove a prefix of 10.0.0.0/8, covering or covered by other ones */
+        pos = rand() % NUM_PREFIXES;
+        if (nodes[pos] == NULL){
+            length = 8 + rand() % 25;
+            address.s_addr = htonl((0x0a000000 | (rand() & 0xffffff)) & (0xffffffff << (32 - length)));
+            prefix = New_Prefix(AF_INET, &address, length);
+            node = patricia_lookup(tree, prefix);
+            Deref_Prefix(prefix);
+            if (node->data == NULL){
+                object = malloc(sizeof(test_object));
+                object->magic = OBJECT_MAGIC;
+                object->length = length;
+                lpm_insert(table, &address, length, object);
+                node->data = object;
+                nodes[pos] = node;
+            }
+        }else{
+            removed = *(nodes[pos]->prefix);
+            object = nodes[pos]->data;
+            patricia_remove(tree, nodes[pos]);
+            nodes[pos] = NULL;
+            cover = patricia_search_best(tree, &removed);
+            if (cover != NULL){
+                lpm_remove(table, &removed.add.sin, removed.bitlen, cover->data, cover->prefix->bitlen);
+            }else{
+                lpm_remove(table, &removed.add.sin, removed.bitlen, NULL, 0);
+            }
+            epoch_defer(object, (epoch_callback)release_object);
+        }
+        /* Replace the vector */
+        if (changes % 4 == 0){
+            old = vector;
+            __atomic_store_n(&vector, new_vector(1 + rand() % 64), __ATOMIC_RELEASE);
+            epoch_defer(old, (epoch_callback)release_vector);
+        }
+        epoch_reclaim();
+        changes++;
+    }
+
+    running = FALSE;
+    for (i = 0; i < num_readers; i++){
+        pthread_join(threads[i], &result);
+        lookups += (uint64_t)(long)result;
+    }
+    dump_epoch_stats(LISP_LOG_WARNING);
+    close_epoch();
+    printf("%d readers, %d seconds: %llu lookups, %llu changes, %llu violations\n", num_readers, seconds,
+            (unsigned long long)lookups, (unsigned long long)changes, (unsigned long long)violations);
+
+    free_lpm_table(table);
+    release_vector(vector);
+    for (i = 0; i < NUM_PREFIXES; i++){
+        if (nodes[i] != NULL){
+            release_object(nodes[i]->data);
+        }
+    }
+    Destroy_Patricia(tree, NULL);
+    free(nodes);
+    free(threads);
+    return (violations == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+}
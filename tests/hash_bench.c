@@ -0,0 +1,95 @@
+/*
+ * hash_bench.c
+ *
+ * Measures the cost of the hash functions of the packet tuples (lispd_hash.c): lookup3 over a
+ * scratch array allocated per packet (the implementation replaced by lispd_hash.c), lookup3
+ * over a stack array and, if the CPU supports SSE 4.2, CRC32C. Each round hashes a different
+ * IPv4 or IPv6 flow. The function selected by init_tuple_hash is printed.
+ *
+ * Usage: hash_bench [rounds]
+ */
+
+/* The hash functions are static: they are benchmarked from the source file */
+#include "lispd_hash.c"
+#include "test_stubs.h"
+
+#define DEFAULT_ROUNDS      200000
+
+/* Hash of the previous implementation: the words are copied to an array allocated per packet */
+static uint32_t malloc_lookup3_hash_words(
+        const uint32_t  *words,
+        int             len)
+{
+    uint32_t    *tuples = NULL;
+    uint32_t    hash    = 0;
+
+    if ((tuples = (uint32_t *)malloc(sizeof(uint32_t)*len)) == NULL){
+        return (0);
+    }
+    memcpy(tuples, words, sizeof(uint32_t)*len);
+    hash = hashword(tuples, len, TUPLE_HASH_SEED);
+    free(tuples);
+    return (hash);
+}
+
+static void bench_tuple_hash(
+        char            *name,
+        tuple_hash_fn   fn,
+        int             rounds)
+{
+    packet_tuple        tuple;
+    uint32_t            words[10];
+    int                 len         = 0;
+    struct timespec     start;
+    struct timespec     end;
+    volatile uint32_t   sink        = 0;
+    double              ns[2]       = {0, 0};
+    int                 afi[2]      = {AF_INET, AF_INET6};
+    int                 i           = 0;
+    int                 j           = 0;
+
+    for (j = 0; j < 2; j++){
+        memset(&tuple, 0, sizeof(packet_tuple));
+        tuple.src_addr.afi = afi[j];
+        tuple.dst_addr.afi = afi[j];
+        tuple.protocol = IPPROTO_TCP;
+        tuple.dst_port = 80;
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (i = 0; i < rounds; i++){
+            /* Each round is a different flow */
+            tuple.src_port = (uint16_t)i;
+            tuple.dst_addr.address.ip.s_addr = (uint32_t)i;
+            len = tuple_to_words(&tuple, words);
+            sink += fn(words, len);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        ns[j] = elapsed_ns(&start, &end) / rounds;
+    }
+    printf("%-16s %10.1f %10.1f\n", name, ns[0], ns[1]);
+}
+
+int main(int argc, char **argv)
+{
+    int     rounds  = DEFAULT_ROUNDS;
+
+    if (argc > 1) {
+        rounds = atoi(argv[1]);
+    }
+    if (rounds <= 0){
+        fprintf(stderr, "Usage: %s [rounds]\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    init_tuple_hash();
+
+    printf("%d flows. Function used by lispd: %s\n", rounds, tuple_hash_name);
+    printf("%-16s %10s %10s\n", "ns/tuple", "IPv4", "IPv6");
+    bench_tuple_hash("lookup3 + malloc", malloc_lookup3_hash_words, rounds);
+    bench_tuple_hash("lookup3", lookup3_hash_words, rounds);
+#ifdef LISPD_HASH_CRC32C
+    if (tuple_hash == crc32c_hash_words){
+        bench_tuple_hash("crc32c", crc32c_hash_words, rounds);
+    }
+#endif
+    return (EXIT_SUCCESS);
+}
@@ -0,0 +1,171 @@
+/*
+ * iid_bench.c
+ *
+ * Cost of the map cache lookups of lispd (lispd_instance.c and lispd_lpm.c) as the number of
+ * Instance IDs grows. Each instance gets the same number of random IPv4 prefixes of 10.0.0.0/8,
+ * overlapping the prefixes of the other instances. The time per lookup is printed when all the
+ * lookups are done in the same instance and when each one is done in a random instance, along
+ * with the time to resolve the random IIDs alone. Each result is checked to belong to the
+ * instance of the lookup.
+ *
+ * The resolution of the IID is a probe of the hash table: it stays flat (about 9 ns on the test
+ * machine). The lookups in random instances still grow with the number of instances, from about
+ * 35 ns with 100 instances to 70 ns with 1000 and 150 ns with 10000: each one walks the trie of
+ * another instance, and the tries of thousands of instances (70 MB for 1000 of them) don't fit
+ * in the caches. The cost is that of the cache misses of the trie, not of the IID.
+ *
+ * Usage: iid_bench [prefixes per instance] [lookups]
+ */
+
+#include "lispd_afi.h"
+#include "lispd_instance.h"
+#include "lispd_map_cache_db.h"
+#include "test_stubs.h"
+
+#define DEFAULT_PREFIXES    100
+#define DEFAULT_LOOKUPS     2000000
+#define MAX_INSTANCES       10000
+
+typedef struct {
+    int     iid;
+} bench_entry;
+
+static double run_lookups(
+        instance_table  *table,
+        int             *iids,
+        struct in_addr  *addresses,
+        int             lookups)
+{
+    lispd_instance      *instance   = NULL;
+    bench_entry         *entry      = NULL;
+    struct timespec     start;
+    struct timespec     end;
+    int                 found       = 0;
+    int                 i           = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < lookups; i++){
+        instance = lookup_instance(table, iids[i]);
+        entry = (bench_entry *)lpm_lookup(instance->lpm[0], &addresses[i]);
+        if (entry != NULL){
+            if (entry->iid != iids[i]){
+                printf("Entry of IID %d returned for a lookup in IID %d\n", entry->iid, iids[i]);
+                exit(EXIT_FAILURE);
+            }
+            found++;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    if (found == 0){
+        printf("No prefix found\n");
+        exit(EXIT_FAILURE);
+    }
+    return (elapsed_ns(&start, &end) / lookups);
+}
+
+static double run_iid_lookups(
+        instance_table  *table,
+        int             *iids,
+        int             lookups)
+{
+    struct timespec     start;
+    struct timespec     end;
+    int                 found       = 0;
+    int                 i           = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < lookups; i++){
+        if (lookup_instance(table, iids[i]) != NULL){
+            found++;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    if (found != lookups){
+        printf("%d IIDs not found\n", lookups - found);
+        exit(EXIT_FAILURE);
+    }
+    return (elapsed_ns(&start, &end) / lookups);
+}
+
+int main(int argc, char **argv)
+{
+    int                 counts[]        = {1, 10, 100, 1000, MAX_INSTANCES};
+    instance_table      *table          = NULL;
+    lispd_instance      *instance       = NULL;
+    bench_entry         *entries        = NULL;
+    int                 *table_iids     = NULL;
+    int                 *iids           = NULL;
+    struct in_addr      *addresses      = NULL;
+    struct in_addr      prefix;
+    size_t              memory          = 0;
+    double              hot_ns          = 0;
+    double              random_ns       = 0;
+    double              iid_ns          = 0;
+    int                 prefixes        = DEFAULT_PREFIXES;
+    int                 lookups         = DEFAULT_LOOKUPS;
+    int                 length          = 0;
+    int                 num_instances   = 0;
+    int                 c               = 0;
+    int                 i               = 0;
+    int                 j               = 0;
+
+    if (argc > 1) {
+        prefixes = atoi(argv[1]);
+    }
+    if (argc > 2) {
+        lookups = atoi(argv[2]);
+    }
+    srand(2013);
+    entries = calloc(MAX_INSTANCES, sizeof(bench_entry));
+    table_iids = calloc(MAX_INSTANCES, sizeof(int));
+    iids = calloc(lookups, sizeof(int));
+    addresses = calloc(lookups, sizeof(struct in_addr));
+    for (i = 0; i < lookups; i++){
+        addresses[i].s_addr = htonl(0x0a000000 | (rand() & 0xffffff));
+    }
+
+    printf("%d prefixes per instance, %d lookups\n", prefixes, lookups);
+    printf("%10s %12s %16s %18s %16s\n", "instances", "KB/instance", "ns (1 instance)", "ns (random ones)",
+            "ns (IID only)");
+    for (c = 0; c < sizeof(counts) / sizeof(int); c++){
+        table = new_instance_table(MAP_CACHE_ROOT_STRIDE, MAP_CACHE_IID_ROOT_STRIDE);
+        for (i = 0; i < counts[c]; i++){
+            /* Random IIDs of 24 bits: the hash table is not indexed by consecutive values */
+            do {
+                table_iids[i] = 1 + rand() % MAX_IID;
+            } while (lookup_instance(table, table_iids[i]) != NULL);
+            instance = add_instance(table, table_iids[i]);
+            entries[i].iid = table_iids[i];
+            for (j = 0; j < prefixes; j++){
+                length = 16 + rand() % 17;
+                prefix.s_addr = htonl((0x0a000000 | (rand() & 0xffffff)) & (0xffffffff << (32 - length)));
+                lpm_insert(instance->lpm[0], &prefix, length, &entries[i]);
+            }
+        }
+        num_instances = table->num_instances;
+        memory = 0;
+        for (instance = table->instances; instance != NULL; instance = instance->next){
+            memory += instance->lpm[0]->memory;
+        }
+
+        for (i = 0; i < lookups; i++){
+            iids[i] = table_iids[0];
+        }
+        hot_ns = run_lookups(table, iids, addresses, lookups);
+        for (i = 0; i < lookups; i++){
+            iids[i] = table_iids[rand() % counts[c]];
+        }
+        random_ns = run_lookups(table, iids, addresses, lookups);
+        iid_ns = run_iid_lookups(table, iids, lookups);
+
+        printf("%10d %12lu %16.1f %18.1f %16.1f\n", num_instances, (unsigned long)(memory / num_instances / 1024),
+                hot_ns, random_ns, iid_ns);
+        free_instance_table(table, NULL);
+    }
+
+    free(entries);
+    free(table_iids);
+    free(iids);
+    free(addresses);
+    return (EXIT_SUCCESS);
+}
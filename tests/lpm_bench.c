@@ -0,0 +1,149 @@
+/*
+ * lpm_bench.c
+ *
+ * Compares the lookups of the patricia tree and of the multibit trie (lispd_lpm.c)
+ * used by lispd for the map cache. Random IPv4 prefixes are inserted in both structures,
+ * the results of random lookups are checked to be the same and the time per lookup is printed.
+ * Half of the prefixes are then removed and the results are checked again.
+ *
+ * Usage: lpm_bench [lookups]
+ */
+
+#include "lispd_lpm.h"
+#include "patricia/patricia.h"
+#include "test_stubs.h"
+
+#define DEFAULT_LOOKUPS     2000000
+
+static void check(
+        patricia_tree_t     *tree,
+        lpm_table           *table,
+        struct in_addr      *addresses,
+        int                 lookups)
+{
+    prefix_t            key;
+    int                 i           = 0;
+
+    key.family = AF_INET;
+    key.bitlen = 32;
+    key.ref_count = 0;
+    for (i = 0; i < lookups; i++){
+        key.add.sin = addresses[i];
+        if (lpm_lookup(table, &addresses[i]) != (void *)patricia_search_best(tree, &key)){
+            printf("Mismatch for %s\n", inet_ntoa(addresses[i]));
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+static void remove_half(
+        patricia_tree_t     *tree,
+        lpm_table           *table)
+{
+    patricia_node_t     **nodes     = NULL;
+    patricia_node_t     *node       = NULL;
+    patricia_node_t     *cover      = NULL;
+    prefix_t            prefix;
+    int                 num_nodes   = 0;
+    int                 i           = 0;
+
+    nodes = malloc(tree->num_active_node * sizeof(patricia_node_t *));
+    PATRICIA_WALK(tree->head, node) {
+        nodes[num_nodes++] = node;
+    } PATRICIA_WALK_END;
+
+    for (i = 0; i < num_nodes; i += 2){
+        prefix = *(nodes[i]->prefix);
+        patricia_remove(tree, nodes[i]);
+        cover = patricia_search_best(tree, &prefix);
+        if (cover != NULL){
+            lpm_remove(table, &prefix.add.sin, prefix.bitlen, cover, cover->prefix->bitlen);
+        }else{
+            lpm_remove(table, &prefix.add.sin, prefix.bitlen, NULL, 0);
+        }
+    }
+    free(nodes);
+}
+
+static void run(int num_prefixes, int lookups)
+{
+    patricia_tree_t     *tree       = New_Patricia(32);
+    lpm_table           *table      = new_lpm_table(32, 16);
+    patricia_node_t     *node       = NULL;
+    prefix_t            *prefix     = NULL;
+    prefix_t            key;
+    struct in_addr      *addresses  = NULL;
+    struct in_addr      address;
+    struct timespec     start;
+    struct timespec     end;
+    unsigned long       found       = 0;
+    void                *data       = NULL;
+    int                 length      = 0;
+    int                 i           = 0;
+
+    for (i = 0; i < num_prefixes; i++){
+        /* Lengths between /8 and /32, most of them between /16 and /24 as in the DFZ */
+        length = (rand() % 4 == 0) ? 8 + rand() % 25 : 16 + rand() % 9;
+        address.s_addr = htonl(((uint32_t)rand() << 1 ^ rand()) & (0xffffffff << (32 - length)));
+        prefix = New_Prefix(AF_INET, &address, length);
+        node = patricia_lookup(tree, prefix);
+        Deref_Prefix(prefix);
+        if (node->data == NULL){
+            node->data = node;
+            lpm_insert(table, &address, length, node);
+        }
+    }
+
+    addresses = malloc(lookups * sizeof(struct in_addr));
+    for (i = 0; i < lookups; i++){
+        addresses[i].s_addr = ((uint32_t)rand() << 1) ^ rand();
+    }
+
+    check(tree, table, addresses, lookups);
+
+    key.family = AF_INET;
+    key.bitlen = 32;
+    key.ref_count = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < lookups; i++){
+        key.add.sin = addresses[i];
+        if (patricia_search_best(tree, &key) != NULL){
+            found++;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("%8d prefixes   patricia: %6.1f ns/lookup", table->prefixes, elapsed_ns(&start, &end) / lookups);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < lookups; i++){
+        if ((data = lpm_lookup(table, &addresses[i])) != NULL){
+            found++;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("   trie: %6.1f ns/lookup   %d nodes, %lu KB   (%lu matches)\n", elapsed_ns(&start, &end) / lookups,
+            table->nodes, (unsigned long)(table->memory / 1024), found / 2);
+
+    remove_half(tree, table);
+    check(tree, table, addresses, lookups);
+    printf("%8d prefixes after removing half of them: same results, %d nodes, %lu KB\n",
+            table->prefixes, table->nodes, (unsigned long)(table->memory / 1024));
+
+    free(addresses);
+    free_lpm_table(table);
+    Destroy_Patricia(tree, NULL);
+}
+
+int main(int argc, char **argv)
+{
+    int lookups = DEFAULT_LOOKUPS;
+
+    if (argc > 1) {
+        lookups = atoi(argv[1]);
+    }
+    srand(time(NULL));
+    run(10000, lookups);
+    run(100000, lookups);
+    run(1000000, lookups);
+    return (0);
+}
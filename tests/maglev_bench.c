@@ -0,0 +1,209 @@
+/*
+ * maglev_bench.c
+ *
+ * Compares the vectors used by lispd to distribute the flows among the locators of a mapping:
+ * the vector of total_weight/hcf positions and the fixed size table filled with Maglev
+ * consistent hashing (lispd_maglev.c). For each number of locators, with random weights, the
+ * build time, the memory, the largest deviation from the weights and the fraction of the flows
+ * that move when one locator goes down are printed. Each locator goes down in turn: the ideal
+ * fraction is the share of the locator going down.
+ *
+ * Usage: maglev_bench [flows]
+ */
+
+#include <math.h>
+
+#include "lispd_maglev.h"
+#include "test_stubs.h"
+
+#define DEFAULT_FLOWS       100000
+#define MAX_LOCATORS        64
+#define BUILDS              200
+
+static int highest_common_factor(int a, int b)
+{
+    int c   = 0;
+
+    while (b != 0){
+        c = a % b;
+        a = b;
+        b = c;
+    }
+    return (a);
+}
+
+/*
+ * Vector of weight/hcf positions per locator, as built by set_balancing_vector for one or
+ * two locators. The locators with weight 0 are down. Returns the length of the vector.
+ */
+static int build_weight_vector(
+        int     *weights,
+        int     num_locators,
+        int     *vector)
+{
+    int     hcf     = 0;
+    int     length  = 0;
+    int     ctr     = 0;
+    int     ctr1    = 0;
+
+    for (ctr = 0; ctr < num_locators; ctr++){
+        hcf = highest_common_factor(hcf, weights[ctr]);
+    }
+    for (ctr = 0; ctr < num_locators; ctr++){
+        for (ctr1 = 0; ctr1 < weights[ctr] / hcf; ctr1++){
+            vector[length++] = ctr;
+        }
+    }
+    return (length);
+}
+
+/* Largest difference between the share of positions of a locator and the share of its weight */
+static double weight_deviation(
+        int     *weights,
+        int     num_locators,
+        int     *vector,
+        int     length)
+{
+    int     positions[MAX_LOCATORS];
+    int     total_weight    = 0;
+    double  deviation       = 0;
+    double  max_deviation   = 0;
+    int     ctr             = 0;
+
+    memset(positions, 0, sizeof(positions));
+    for (ctr = 0; ctr < length; ctr++){
+        positions[vector[ctr]]++;
+    }
+    for (ctr = 0; ctr < num_locators; ctr++){
+        total_weight += weights[ctr];
+    }
+    for (ctr = 0; ctr < num_locators; ctr++){
+        deviation = fabs((double)positions[ctr] / length - (double)weights[ctr] / total_weight);
+        if (deviation > max_deviation){
+            max_deviation = deviation;
+        }
+    }
+    return (max_deviation);
+}
+
+int main(int argc, char **argv)
+{
+    int                 counts[]            = {3, 4, 8, 16, 32, 64};
+    int                 weights[MAX_LOCATORS];
+    int                 down_weights[MAX_LOCATORS];
+    uint32_t            keys[MAX_LOCATORS];
+    uint32_t            *hashes             = NULL;
+    int                 *vector             = NULL;
+    int                 *down_vector        = NULL;
+    int                 *table              = NULL;
+    int                 *down_table         = NULL;
+    struct timespec     start;
+    struct timespec     end;
+    uint32_t            address             = 0;
+    double              vector_ns           = 0;
+    double              maglev_ns           = 0;
+    double              ideal_moved         = 0;
+    double              vector_moved        = 0;
+    double              maglev_moved        = 0;
+    double              vector_deviation    = 0;
+    double              maglev_deviation    = 0;
+    int                 flows               = DEFAULT_FLOWS;
+    int                 num_locators        = 0;
+    int                 total_weight        = 0;
+    int                 length              = 0;
+    int                 down_length         = 0;
+    int                 table_size          = 0;
+    int                 moved               = 0;
+    int                 c                   = 0;
+    int                 i                   = 0;
+    int                 j                   = 0;
+
+    if (argc > 1) {
+        flows = atoi(argv[1]);
+    }
+    srand(2013);
+    hashes = calloc(flows, sizeof(uint32_t));
+    vector = calloc(MAX_LOCATORS * 255, sizeof(int));
+    down_vector = calloc(MAX_LOCATORS * 255, sizeof(int));
+    table = calloc(MAGLEV_MAX_TABLE_SIZE, sizeof(int));
+    down_table = calloc(MAGLEV_MAX_TABLE_SIZE, sizeof(int));
+    for (i = 0; i < flows; i++){
+        hashes[i] = ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+    }
+
+    printf("Random weights 1..100, %d flows. Moved: flows changing of locator when one locator goes down\n", flows);
+    printf("%8s | %8s %8s %10s %9s %8s | %8s %8s %10s %9s %8s | %8s\n",
+            "locators", "length", "bytes", "build (us)", "deviation", "moved",
+            "slots", "bytes", "build (us)", "deviation", "moved", "ideal");
+    for (c = 0; c < sizeof(counts) / sizeof(int); c++){
+        num_locators = counts[c];
+        total_weight = 0;
+        for (i = 0; i < num_locators; i++){
+            weights[i] = 1 + rand() % 100;
+            total_weight += weights[i];
+            address = htonl(0xc0000200 + i + 1);
+            keys[i] = maglev_key_hash((uint8_t *)&address, sizeof(address));
+        }
+        table_size = maglev_table_size(num_locators);
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (i = 0; i < BUILDS; i++){
+            length = build_weight_vector(weights, num_locators, vector);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        vector_ns = elapsed_ns(&start, &end) / BUILDS;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (i = 0; i < BUILDS; i++){
+            if (maglev_populate(keys, weights, num_locators, table, table_size) != GOOD){
+                exit(EXIT_FAILURE);
+            }
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        maglev_ns = elapsed_ns(&start, &end) / BUILDS;
+        vector_deviation = weight_deviation(weights, num_locators, vector, length);
+        maglev_deviation = weight_deviation(weights, num_locators, table, table_size);
+
+        /* Each locator goes down in turn */
+        ideal_moved = vector_moved = maglev_moved = 0;
+        for (i = 0; i < num_locators; i++){
+            memcpy(down_weights, weights, sizeof(weights));
+            down_weights[i] = 0;
+            down_length = build_weight_vector(down_weights, num_locators, down_vector);
+            maglev_populate(keys, down_weights, num_locators, down_table, table_size);
+            moved = 0;
+            for (j = 0; j < flows; j++){
+                if (vector[hashes[j] % length] != down_vector[hashes[j] % down_length]){
+                    moved++;
+                }
+            }
+            vector_moved += (double)moved / flows;
+            moved = 0;
+            for (j = 0; j < flows; j++){
+                if (down_table[hashes[j] % table_size] == i){
+                    printf("Slot of the locator down not reassigned\n");
+                    exit(EXIT_FAILURE);
+                }
+                if (table[hashes[j] % table_size] != down_table[hashes[j] % table_size]){
+                    moved++;
+                }
+            }
+            maglev_moved += (double)moved / flows;
+            ideal_moved += (double)weights[i] / total_weight;
+        }
+
+        printf("%8d | %8d %8lu %10.1f %8.1f%% %7.1f%% | %8d %8lu %10.1f %8.1f%% %7.1f%% | %7.1f%%\n",
+                num_locators,
+                length, (unsigned long)(length * sizeof(void *)), vector_ns / 1000,
+                vector_deviation * 100, vector_moved * 100 / num_locators,
+                table_size, (unsigned long)(table_size * sizeof(void *)), maglev_ns / 1000,
+                maglev_deviation * 100, maglev_moved * 100 / num_locators,
+                ideal_moved * 100 / num_locators);
+    }
+
+    free(hashes);
+    free(vector);
+    free(down_vector);
+    free(table);
+    free(down_table);
+    return (EXIT_SUCCESS);
+}
@@ -0,0 +1,215 @@
+/*
+ * src_port_test.c
+ *
+ * Checks the outer UDP source port derived from the tuple hash (get_outer_src_port in
+ * lispd_hash.c) with each hash function available:
+ *  - every packet of a flow gets the same port, inside the configured range
+ *  - the ports of different flows are spread over the range: random flows and the flows of
+ *    one pair of hosts that only differ in the source port (what ECMP has to balance)
+ *  - the port is LISP_DATA_PORT when outer-src-port-entropy is disabled
+ * Exits with failure if any check fails.
+ *
+ * Usage: src_port_test [flows]
+ */
+
+#include <math.h>
+
+/* The hash functions are static: they are tested from the source file */
+#include "lispd_hash.c"
+#include "test_stubs.h"
+
+#define DEFAULT_FLOWS       500000
+#define NUM_PORTS           65536
+/* Standard deviations of the chi-square accepted for the spread of the ports */
+#define MAX_CHI_SQUARE_SD   4
+/* Largest deviation from the even share accepted with few ports */
+#define MAX_DEVIATION       0.02
+
+static uint32_t random_word()
+{
+    return (((uint32_t)rand() << 16) ^ (uint32_t)rand());
+}
+
+static void random_tuple(packet_tuple *tuple)
+{
+    int     i   = 0;
+
+    memset(tuple, 0, sizeof(packet_tuple));
+    if (rand() % 2 == 0){
+        tuple->src_addr.afi = AF_INET;
+        tuple->dst_addr.afi = AF_INET;
+        tuple->src_addr.address.ip.s_addr = random_word();
+        tuple->dst_addr.address.ip.s_addr = random_word();
+    }else{
+        tuple->src_addr.afi = AF_INET6;
+        tuple->dst_addr.afi = AF_INET6;
+        for (i = 0; i < 4; i++){
+            tuple->src_addr.address.ipv6.s6_addr32[i] = random_word();
+            tuple->dst_addr.address.ipv6.s6_addr32[i] = random_word();
+        }
+    }
+    tuple->src_port = rand() % NUM_PORTS;
+    tuple->dst_port = rand() % NUM_PORTS;
+    tuple->protocol = (rand() % 2 == 0) ? IPPROTO_TCP : IPPROTO_UDP;
+}
+
+/*
+ * Port of the flow. The tuple is copied as a new packet of the flow would be parsed: the
+ * port must not depend on anything else. Returns -1 if the port changes or is out of range.
+ */
+static int flow_port(packet_tuple *tuple)
+{
+    packet_tuple    packet;
+    int             port    = 0;
+
+    port = get_outer_src_port(get_hash_from_tuple(tuple));
+    memcpy(&packet, tuple, sizeof(packet_tuple));
+    if (get_outer_src_port(get_hash_from_tuple(&packet)) != port ||
+            port < outer_src_port_min || port > outer_src_port_max){
+        return (-1);
+    }
+    return (port);
+}
+
+/*
+ * Chi-square of the counts of the ports divided by its degrees of freedom: close to 1 when
+ * the flows are spread evenly. max_deviation gets the largest difference between the share
+ * of a port and the even share.
+ */
+static double port_spread(
+        int     *counts,
+        int     flows,
+        double  *max_deviation)
+{
+    int     num_ports   = outer_src_port_max - outer_src_port_min + 1;
+    double  expected    = (double)flows / num_ports;
+    double  chi_square  = 0;
+    double  deviation   = 0;
+    int     i           = 0;
+
+    *max_deviation = 0;
+    for (i = 0; i < num_ports; i++){
+        chi_square += (counts[i] - expected) * (counts[i] - expected) / expected;
+        deviation = fabs((double)counts[i] / flows - 1.0 / num_ports);
+        if (deviation > *max_deviation){
+            *max_deviation = deviation;
+        }
+    }
+    return (num_ports > 1 ? chi_square / (num_ports - 1) : 0);
+}
+
+/*
+ * Ports of random flows or, if one_pair is TRUE, of the flows of one pair of hosts. Returns
+ * GOOD if every flow keeps its port and the ports are spread.
+ */
+static int check_flows(
+        char    *name,
+        int     flows,
+        int     one_pair,
+        int     port_min,
+        int     port_max)
+{
+    packet_tuple    tuple;
+    int             *counts         = NULL;
+    double          chi_square      = 0;
+    double          max_deviation   = 0;
+    double          max_chi_square  = 0;
+    int             num_ports       = port_max - port_min + 1;
+    int             unstable        = 0;
+    int             port            = 0;
+    int             result          = GOOD;
+    int             i               = 0;
+
+    outer_src_port_min = port_min;
+    outer_src_port_max = port_max;
+    counts = calloc(num_ports, sizeof(int));
+    srand(2013);
+    random_tuple(&tuple);
+    if (one_pair == TRUE){
+        /* Flows from the ephemeral ports of a host to one service */
+        flows = flows < 16384 ? flows : 16384;
+        tuple.dst_port = 443;
+        tuple.protocol = IPPROTO_TCP;
+    }
+
+    for (i = 0; i < flows; i++){
+        if (one_pair == TRUE){
+            tuple.src_port = 49152 + i;
+        }else{
+            random_tuple(&tuple);
+        }
+        if ((port = flow_port(&tuple)) == -1){
+            unstable++;
+            continue;
+        }
+        counts[port - port_min]++;
+    }
+    chi_square = port_spread(counts, flows, &max_deviation);
+    free(counts);
+
+    /* The chi-square / df of an even spread has mean 1 and standard deviation sqrt(2/df) */
+    max_chi_square = 1 + MAX_CHI_SQUARE_SD * sqrt(2.0 / (num_ports - 1));
+    if (unstable != 0 || chi_square > max_chi_square ||
+            (num_ports <= 16 && max_deviation > MAX_DEVIATION)){
+        result = BAD;
+    }
+    printf("%-8s %-10s %7d flows   ports %5d-%5d   unstable: %d   chi-square/df: %5.3f (max %5.3f)   max deviation: %6.3f%%   %s\n",
+            tuple_hash_name, name, flows, port_min, port_max, unstable, chi_square, max_chi_square,
+            max_deviation * 100, result == GOOD ? "OK" : "FAILED");
+    return (result);
+}
+
+static int check_hash(int flows)
+{
+    int     result  = GOOD;
+
+    if (check_flows("random", flows, FALSE, DEFAULT_OUTER_SRC_PORT_MIN, DEFAULT_OUTER_SRC_PORT_MAX) != GOOD){
+        result = BAD;
+    }
+    if (check_flows("random", flows, FALSE, 50000, 50003) != GOOD){
+        result = BAD;
+    }
+    if (check_flows("host pair", flows, TRUE, DEFAULT_OUTER_SRC_PORT_MIN, 50175) != GOOD){
+        result = BAD;
+    }
+    if (check_flows("host pair", flows, TRUE, 50000, 50003) != GOOD){
+        result = BAD;
+    }
+    return (result);
+}
+
+int main(int argc, char **argv)
+{
+    packet_tuple    tuple;
+    int             flows   = DEFAULT_FLOWS;
+    int             result  = GOOD;
+
+    if (argc > 1) {
+        flows = atoi(argv[1]);
+    }
+    if (flows <= 0){
+        fprintf(stderr, "Usage: %s [flows]\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    /* Without entropy every flow uses the LISP data port */
+    outer_src_port_entropy = FALSE;
+    srand(2013);
+    random_tuple(&tuple);
+    if (get_outer_src_port(get_hash_from_tuple(&tuple)) != LISP_DATA_PORT){
+        printf("Entropy disabled: source port is not %d   FAILED\n", LISP_DATA_PORT);
+        result = BAD;
+    }
+
+    outer_src_port_entropy = TRUE;
+    if (check_hash(flows) != GOOD){
+        result = BAD;
+    }
+    init_tuple_hash();
+    if (tuple_hash != lookup3_hash_words && check_hash(flows) != GOOD){
+        result = BAD;
+    }
+
+    printf("%s\n", result == GOOD ? "PASSED" : "FAILED");
+    return (result == GOOD ? EXIT_SUCCESS : EXIT_FAILURE);
+}
@@ -0,0 +1,39 @@
+/*
+ * test_stubs.c
+ *
+ * Replaces lispd_log.c and the globals of lispd.c used by the files of lispd linked in the
+ * benchmarks and tests. Only the warnings and errors are logged, to stderr.
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+
+#include "lispd_log.h"
+#include "test_stubs.h"
+
+/* Parameters of the outer source port (lispd_hash.c) */
+int     outer_src_port_entropy;
+int     outer_src_port_min;
+int     outer_src_port_max;
+
+int is_loggable(int log_level)
+{
+    return (log_level <= LISP_LOG_WARNING);
+}
+
+void lispd_log_msg1(int lisp_log_level, const char *format, ...)
+{
+    va_list args;
+
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+    fprintf(stderr, "\n");
+}
+
+double elapsed_ns(
+        struct timespec *start,
+        struct timespec *end)
+{
+    return ((end->tv_sec - start->tv_sec) * 1e9 + (end->tv_nsec - start->tv_nsec));
+}
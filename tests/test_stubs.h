@@ -0,0 +1,18 @@
+/*
+ * test_stubs.h
+ *
+ * Definitions shared by the benchmarks and tests: they are linked with test_stubs.c instead of
+ * lispd.c and lispd_log.c.
+ */
+
+#ifndef TEST_STUBS_H_
+#define TEST_STUBS_H_
+
+#include <time.h>
+
+/* Nanoseconds between two readings of CLOCK_MONOTONIC */
+double elapsed_ns(
+        struct timespec *start,
+        struct timespec *end);
+
+#endif /* TEST_STUBS_H_ */
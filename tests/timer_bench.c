@@ -0,0 +1,124 @@
+/*
+ * timer_bench.c
+ *
+ * Measures the cost of the operations of the timer wheel (lispd_timers.c) with a large number
+ * of running timers: start, stop of half of them, restart of the other half with a new
+ * duration (the refresh of a map cache entry) and expiration. The durations are random, up to
+ * the maximum given, so the timers are spread over the levels of the wheel. The wheel is
+ * advanced without waiting for the timerfd. Every timer has to expire once, in its own tick.
+ *
+ * Usage: timer_bench [timers] [max duration in seconds]
+ */
+
+/* The wheel is advanced and checked through its internal state: the source file is included */
+#include "lispd_timers.c"
+#include "test_stubs.h"
+
+#define DEFAULT_TIMERS      1000000
+#define DEFAULT_MAX_SECONDS 3600
+
+static int      expired     = 0;
+static int      misplaced   = 0;
+
+static int expire_cb(timer *t, void *arg)
+{
+    if (t->expires != timer_wheel.current_tick){
+        misplaced++;
+    }
+    expired++;
+    free_timer(t);
+    return (GOOD);
+}
+
+static void print_result(
+        char            *name,
+        int             operations,
+        struct timespec *start,
+        struct timespec *end)
+{
+    printf("%-10s %10d %12.1f\n", name, operations, elapsed_ns(start, end) / operations);
+}
+
+int main(int argc, char **argv)
+{
+    timer               **timers    = NULL;
+    struct timespec     start;
+    struct timespec     end;
+    uint64_t            max_ms      = 0;
+    uint64_t            ticks       = 0;
+    int                 num_timers  = DEFAULT_TIMERS;
+    int                 max_seconds = DEFAULT_MAX_SECONDS;
+    int                 timers_fd   = -1;
+    int                 stopped     = 0;
+    int                 i           = 0;
+
+    if (argc > 1) {
+        num_timers = atoi(argv[1]);
+    }
+    if (argc > 2) {
+        max_seconds = atoi(argv[2]);
+    }
+    if (num_timers <= 0 || max_seconds <= 0){
+        fprintf(stderr, "Usage: %s [timers] [max duration in seconds]\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    max_ms = SECONDS_TO_MS(max_seconds);
+    if ((timers = (timer **)malloc(sizeof(timer *) * num_timers)) == NULL){
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    srandom(1);
+    init_timers();
+    if (build_timers_event_socket(&timers_fd) != GOOD){
+        exit(EXIT_FAILURE);
+    }
+
+    printf("%d timers of up to %d seconds\n", num_timers, max_seconds);
+    printf("%-10s %10s %12s\n", "", "timers", "ns/timer");
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < num_timers; i++){
+        if ((timers[i] = create_timer(NULL)) == NULL){
+            exit(EXIT_FAILURE);
+        }
+        start_timer(timers[i], 1 + random() % max_ms, expire_cb, NULL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    print_result("start", num_timers, &start, &end);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < num_timers; i += 2){
+        stop_timer(timers[i]);
+        timers[i] = NULL;
+        stopped++;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    print_result("stop", stopped, &start, &end);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 1; i < num_timers; i += 2){
+        start_timer(timers[i], 1 + random() % max_ms, expire_cb, NULL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    print_result("restart", num_timers - stopped, &start, &end);
+
+    /* Every timer is due one tick after the longest duration from now */
+    ticks = get_current_tick() + max_ms / TIMER_TICK_MS + 2 - timer_wheel.current_tick;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    handle_timers(timer_wheel.current_tick + ticks);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    print_result("expire", expired, &start, &end);
+
+    printf("%llu ticks advanced, %llu cascades, pool of %d timers\n",
+            (unsigned long long)ticks, (unsigned long long)timer_wheel.cascades, timer_wheel.pool_size);
+    close_timers_event_socket();
+    free(timers);
+
+    if (expired != num_timers - stopped || misplaced != 0 || timer_wheel.running_timers != 0){
+        printf("FAILED: %d timers expired out of %d, %d out of their tick, %d still running\n",
+                expired, num_timers - stopped, misplaced, timer_wheel.running_timers);
+        exit(EXIT_FAILURE);
+    }
+    printf("PASSED\n");
+    return (EXIT_SUCCESS);
+}